@@ -17,6 +17,7 @@ limitations under the License.
 #pragma once
 
 #include <brpc/controller.h>
+#include <brpc/progressive_attachment.h>
 #include <butil/iobuf.h>
 #include <glog/logging.h>
 #include <json2pb/pb_to_json.h>
@@ -200,6 +201,17 @@ class StreamCallData : public CallData {
     return true;
   }
 
+  // Run `callback` once when the client connection goes away. The callback
+  // is also run when the call data is released normally, so it has to check
+  // by itself whether the request is still alive. Can only be called once.
+  void notify_on_cancel(::google::protobuf::Closure* callback) {
+    if (stream_) {
+      pa_->NotifyOnStopped(callback);
+    } else {
+      controller_->NotifyOnCancel(callback);
+    }
+  }
+
   Response& response() { return *response_; }
   ::google::protobuf::Closure* done() { return done_; }
   bool finished() { return finished_; }
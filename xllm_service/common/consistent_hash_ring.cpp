@@ -0,0 +1,78 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "consistent_hash_ring.h"
+
+#include <MurmurHash3.h>
+
+#include <algorithm>
+
+namespace {
+// fixed, so that the placement does not change with the prefix hash seed
+constexpr uint32_t kRingSeed = 0;
+}  // namespace
+
+namespace xllm_service {
+
+ConsistentHashRing::ConsistentHashRing(int32_t num_virtual_nodes)
+    : num_virtual_nodes_(std::max(num_virtual_nodes, 1)) {}
+
+uint64_t ConsistentHashRing::hash(std::string_view key) {
+  uint64_t value[2];
+  MurmurHash3_x64_128(key.data(), key.size(), kRingSeed, value);
+  return value[0];
+}
+
+void ConsistentHashRing::add(const std::string& name) {
+  remove(name);
+  const uint32_t id = names_.size();
+  names_.emplace_back(name);
+  for (int32_t i = 0; i < num_virtual_nodes_; ++i) {
+    ring_.emplace_back(hash(name + "#" + std::to_string(i)), id);
+  }
+  std::sort(ring_.begin(), ring_.end());
+}
+
+void ConsistentHashRing::remove(const std::string& name) {
+  auto it = std::find(names_.begin(), names_.end(), name);
+  if (it == names_.end()) {
+    return;
+  }
+  // keep the instance indexes dense, the later instances move down by one
+  const uint32_t id = it - names_.begin();
+  names_.erase(it);
+  ring_.erase(
+      std::remove_if(ring_.begin(),
+                     ring_.end(),
+                     [&](const auto& node) { return node.second == id; }),
+      ring_.end());
+  for (auto& node : ring_) {
+    if (node.second > id) {
+      --node.second;
+    }
+  }
+}
+
+size_t ConsistentHashRing::first_node(std::string_view key) const {
+  const uint64_t position = hash(key);
+  auto it = std::lower_bound(
+      ring_.begin(),
+      ring_.end(),
+      position,
+      [](const auto& node, uint64_t value) { return node.first < value; });
+  return it - ring_.begin();
+}
+
+}  // namespace xllm_service
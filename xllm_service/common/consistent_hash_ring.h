@@ -0,0 +1,102 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#include <bitset>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace xllm_service {
+
+// A consistent hash ring of instance names, every instance is placed at
+// `num_virtual_nodes` positions so that the keys spread evenly and only the
+// keys of an added or removed instance move. The positions are murmur3
+// hashes, so the placement is the same for every build. Not thread-safe, the
+// caller has to lock.
+class ConsistentHashRing {
+ public:
+  explicit ConsistentHashRing(int32_t num_virtual_nodes = 100);
+
+  bool empty() const { return ring_.empty(); }
+
+  // the number of instances
+  size_t size() const { return names_.size(); }
+
+  void add(const std::string& name);
+
+  void remove(const std::string& name);
+
+  // visit the distinct instances clockwise from the position of `key`, until
+  // `visit` returns true. Return the name of the instance `visit` accepted,
+  // empty if it accepted none.
+  template <typename Visitor>
+  std::string walk(std::string_view key, Visitor&& visit) const;
+
+ private:
+  // instances up to this number are marked visited in a bitmap on the stack
+  static constexpr size_t kMaxInlineInstances = 1024;
+
+  static uint64_t hash(std::string_view key);
+
+  // index of the first node at or after the position of `key`
+  size_t first_node(std::string_view key) const;
+
+  int32_t num_virtual_nodes_;
+  // the instances on the ring, the nodes refer to them by index
+  std::vector<std::string> names_;
+  // (position, index of the instance), sorted by position
+  std::vector<std::pair<uint64_t, uint32_t>> ring_;
+};
+
+template <typename Visitor>
+std::string ConsistentHashRing::walk(std::string_view key,
+                                     Visitor&& visit) const {
+  if (ring_.empty()) {
+    return "";
+  }
+
+  std::bitset<kMaxInlineInstances> inline_visited;
+  std::vector<bool> visited;
+  const bool use_inline = names_.size() <= kMaxInlineInstances;
+  if (!use_inline) {
+    visited.resize(names_.size());
+  }
+  size_t num_visited = 0;
+  size_t index = first_node(key);
+  for (size_t i = 0; i < ring_.size(); ++i, ++index) {
+    const uint32_t id = ring_[index % ring_.size()].second;
+    if (use_inline ? inline_visited[id] : visited[id]) {
+      continue;
+    }
+    if (use_inline) {
+      inline_visited[id] = true;
+    } else {
+      visited[id] = true;
+    }
+    if (visit(names_[id])) {
+      return names_[id];
+    }
+    if (++num_visited == names_.size()) {
+      break;
+    }
+  }
+  return "";
+}
+
+}  // namespace xllm_service
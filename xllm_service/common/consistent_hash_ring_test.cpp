@@ -0,0 +1,138 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "consistent_hash_ring.h"
+
+#include <gtest/gtest.h>
+
+#include <unordered_map>
+
+namespace xllm_service::test {
+
+namespace {
+// the first instance of the key on the ring
+std::string locate(const ConsistentHashRing& ring, const std::string& key) {
+  return ring.walk(key, [](const std::string&) { return true; });
+}
+
+ConsistentHashRing make_ring(int32_t num_instances) {
+  ConsistentHashRing ring;
+  for (int32_t i = 0; i < num_instances; ++i) {
+    ring.add("10.0.0." + std::to_string(i) + ":8000");
+  }
+  return ring;
+}
+}  // namespace
+
+TEST(ConsistentHashRingTest, EmptyRing) {
+  ConsistentHashRing ring;
+  EXPECT_TRUE(ring.empty());
+  EXPECT_EQ("", locate(ring, "session"));
+}
+
+TEST(ConsistentHashRingTest, WalkVisitsEveryInstanceOnce) {
+  auto ring = make_ring(8);
+  EXPECT_EQ(8, ring.size());
+  std::unordered_map<std::string, int32_t> visits;
+  EXPECT_EQ("", ring.walk("session", [&](const std::string& name) {
+    visits[name] += 1;
+    return false;
+  }));
+  EXPECT_EQ(8, visits.size());
+  for (const auto& [name, count] : visits) {
+    EXPECT_EQ(1, count) << name;
+  }
+
+  // the second instance on the way takes the key when the first refuses it
+  const std::string first = locate(ring, "session");
+  const std::string second =
+      ring.walk("session", [&](const std::string& name) {
+        return name != first;
+      });
+  EXPECT_NE("", second);
+  EXPECT_NE(first, second);
+}
+
+TEST(ConsistentHashRingTest, OnlyKeysOfChangedInstanceMove) {
+  constexpr int32_t kNumKeys = 10000;
+  auto ring = make_ring(8);
+  std::vector<std::string> owners;
+  std::unordered_map<std::string, int32_t> num_keys;
+  for (int32_t i = 0; i < kNumKeys; ++i) {
+    owners.emplace_back(locate(ring, "session_" + std::to_string(i)));
+    num_keys[owners.back()] += 1;
+  }
+  // every instance owns a fair share of the keys
+  for (const auto& [name, count] : num_keys) {
+    EXPECT_GT(count, kNumKeys / 8 / 2) << name;
+    EXPECT_LT(count, kNumKeys / 8 * 2) << name;
+  }
+
+  const std::string added = "10.0.0.8:8000";
+  ring.add(added);
+  int32_t num_moved = 0;
+  for (int32_t i = 0; i < kNumKeys; ++i) {
+    const std::string owner = locate(ring, "session_" + std::to_string(i));
+    if (owner != owners[i]) {
+      EXPECT_EQ(added, owner);
+      ++num_moved;
+    }
+  }
+  EXPECT_GT(num_moved, 0);
+  EXPECT_LT(num_moved, kNumKeys / 9 * 2);
+
+  // removing the instance again restores the previous owners
+  ring.remove(added);
+  EXPECT_EQ(8, ring.size());
+  for (int32_t i = 0; i < kNumKeys; ++i) {
+    EXPECT_EQ(owners[i], locate(ring, "session_" + std::to_string(i)));
+  }
+}
+
+TEST(ConsistentHashRingTest, RemoveInstanceInTheMiddle) {
+  auto ring = make_ring(8);
+  const std::string removed = "10.0.0.3:8000";
+  std::vector<std::string> owners;
+  for (int32_t i = 0; i < 1000; ++i) {
+    owners.emplace_back(locate(ring, "session_" + std::to_string(i)));
+  }
+  ring.remove(removed);
+  EXPECT_EQ(7, ring.size());
+  for (int32_t i = 0; i < 1000; ++i) {
+    const std::string owner = locate(ring, "session_" + std::to_string(i));
+    EXPECT_NE(removed, owner);
+    if (owners[i] != removed) {
+      EXPECT_EQ(owners[i], owner);
+    }
+  }
+}
+
+TEST(ConsistentHashRingTest, WalkBeyondInlineVisitedLimit) {
+  ConsistentHashRing ring(/*num_virtual_nodes=*/2);
+  for (int32_t i = 0; i < 2000; ++i) {
+    ring.add("instance_" + std::to_string(i));
+  }
+  std::unordered_map<std::string, int32_t> visits;
+  EXPECT_EQ("", ring.walk("session", [&](const std::string& name) {
+    visits[name] += 1;
+    return false;
+  }));
+  EXPECT_EQ(2000, visits.size());
+  for (const auto& [name, count] : visits) {
+    EXPECT_EQ(1, count) << name;
+  }
+}
+
+}  // namespace xllm_service::test
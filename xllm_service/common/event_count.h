@@ -0,0 +1,101 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <climits>
+#include <cstdint>
+
+namespace xllm_service {
+
+// an event count on top of a futex, lets threads sleep until a lock-free
+// condition may have changed without a lock on the fast path:
+//
+//   waiter:                        notifier:
+//     while (!condition()) {         make condition() true
+//       key = prepare_wait();        notify_one() or notify_all()
+//       if (condition()) {
+//         cancel_wait();
+//         break;
+//       }
+//       wait(key);
+//     }
+//
+// A notifier only makes a syscall if a thread is waiting.
+class EventCount final {
+ public:
+  EventCount() = default;
+
+  EventCount(const EventCount&) = delete;
+  EventCount& operator=(const EventCount&) = delete;
+
+  uint32_t prepare_wait() {
+    num_waiters_.fetch_add(1, std::memory_order_seq_cst);
+    const uint32_t key = epoch_.load(std::memory_order_seq_cst);
+    // orders the announcement before the check of the condition
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return key;
+  }
+
+  void cancel_wait() { num_waiters_.fetch_sub(1, std::memory_order_seq_cst); }
+
+  // sleep until a notification after `prepare_wait` returned `key`
+  void wait(uint32_t key) {
+    while (epoch_.load(std::memory_order_seq_cst) == key) {
+      syscall(SYS_futex,
+              reinterpret_cast<uint32_t*>(&epoch_),
+              FUTEX_WAIT_PRIVATE,
+              key,
+              nullptr,
+              nullptr,
+              0);
+    }
+    num_waiters_.fetch_sub(1, std::memory_order_seq_cst);
+  }
+
+  void notify_one() { notify(1); }
+
+  void notify_all() { notify(INT_MAX); }
+
+ private:
+  void notify(int32_t num_threads) {
+    // orders the change of the condition before the check for waiters
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (num_waiters_.load(std::memory_order_seq_cst) == 0) {
+      return;
+    }
+    epoch_.fetch_add(1, std::memory_order_seq_cst);
+    syscall(SYS_futex,
+            reinterpret_cast<uint32_t*>(&epoch_),
+            FUTEX_WAKE_PRIVATE,
+            num_threads,
+            nullptr,
+            nullptr,
+            0);
+  }
+
+  static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+                "the futex word must be a plain uint32_t");
+
+  std::atomic<uint32_t> epoch_{0};
+  std::atomic<int32_t> num_waiters_{0};
+};
+
+}  // namespace xllm_service
@@ -52,12 +52,36 @@ DEFINE_string(etcd_addr,
               "0.0.0.0:2379",
               "etcd adderss for save instance meta info");
 
+DEFINE_int32(etcd_max_inflight_txns,
+             8,
+             "Max number of etcd transactions of the metadata uploads in "
+             "flight at once");
+
+DEFINE_int32(watch_coalesce_window_us,
+             10000,
+             "Merge the metadata changes watched within this window by key "
+             "and apply them at once, in microseconds.");
+
+DEFINE_string(metadata_store,
+              "etcd",
+              "Where to keep the instance meta info: etcd, memory for a "
+              "single master without persistence, or file for a single "
+              "master which keeps it in --metadata_store_path");
+
+DEFINE_string(metadata_store_path,
+              "xllm_service_metadata.log",
+              "Log file of the file metadata store");
+
 DEFINE_uint32(murmur_hash3_seed, 1024, "default Murmur Hash seed");
 
 DEFINE_int32(port, 8888, "Port for xllm service to listen on");
 
 DEFINE_int32(num_threads, 32, "Number of threads to process requests");
 
+DEFINE_bool(pin_request_threads,
+            false,
+            "Pin the threads processing requests to consecutive cpus");
+
 DEFINE_int32(max_concurrency,
              128,
              "Limit number of requests processed in parallel");
@@ -85,11 +109,13 @@ DEFINE_int32(idle_timeout_s,
 
 DEFINE_string(load_balance_policy,
               "RR",
-              "Disaggregated prefill-decode policy.");
+              "Disaggregated prefill-decode policy, one of RR, CAR, "
+              "SLO_AWARE, P2C and CONSISTENT_HASH.");
 
 DEFINE_int32(detect_disconnected_instance_interval,
              15,
-             "The interval that server detect the disconnected instance.");
+             "Instances without heartbeats for this many seconds are "
+             "removed, disable the detection if not positive.");
 
 DEFINE_int32(block_size,
              128,
@@ -99,6 +125,12 @@ DEFINE_string(tokenizer_path, "", "tokenizer config path.");
 
 DEFINE_bool(enable_request_trace, false, "Whether to enable request trace");
 
+DEFINE_bool(enable_stage_timing_header,
+            false,
+            "Return the time of every service stage before the request is "
+            "forwarded in the x-xllm-stage-timing response header, in "
+            "microseconds.");
+
 DEFINE_int32(target_ttft,
              1000,
              "Target Time to First Token (TTFT), in milliseconds.");
@@ -109,4 +141,172 @@ DEFINE_int32(target_tpot,
              50,
              "Target Time Per Output Token (TPOT), in milliseconds.");
 
-BRPC_VALIDATE_GFLAG(target_tpot, brpc::NonNegativeInteger);
\ No newline at end of file
+BRPC_VALIDATE_GFLAG(target_tpot, brpc::NonNegativeInteger);
+
+DEFINE_string(instance_cancel_uri,
+              "",
+              "Opt-in: the http uri of instances used to cancel the requests "
+              "whose client has gone away, e.g. /v1/cancel if the instances "
+              "serve it. There is no default since the instances may not "
+              "serve such an uri. When empty, the service only stops "
+              "forwarding the outputs of a cancelled request and the "
+              "instances keep generating it until it finishes.");
+
+DEFINE_bool(enable_time_predictor_refit,
+            true,
+            "Refit the TTFT and TPOT predictors of the instances with the "
+            "latencies observed by the service.");
+
+DEFINE_double(time_predictor_forgetting_factor,
+              0.999,
+              "Forgetting factor of the online predictor refitting, smaller "
+              "values follow latency drift faster but are noisier.");
+
+DEFINE_bool(slo_use_measured_latency,
+            false,
+            "Whether the SLO aware policy also checks the p99 TBT of the "
+            "decode instances measured by the service against target_tpot.");
+
+DEFINE_int32(role_balance_interval_ms,
+             200,
+             "The interval to rebalance the roles of the MIX instances under "
+             "the SLO aware policy, in milliseconds. A value <= 0 disables "
+             "role switching.");
+
+DEFINE_int32(role_min_dwell_ms,
+             5000,
+             "The minimum time a MIX instance keeps its role before it can "
+             "be switched again, in milliseconds.");
+
+DEFINE_double(role_load_smoothing,
+              0.2,
+              "Weight of the latest sample when the smoothed prefill or decode "
+              "load used to rebalance the instance roles falls, 1 means no "
+              "smoothing.");
+
+DEFINE_string(topology_path,
+              "",
+              "Path of the json file with the network distances between the "
+              "instances, used to pair prefill and decode instances. Empty "
+              "means all instances are equally near.");
+
+DEFINE_int64(kv_cache_bytes_per_token,
+             131072,
+             "Size of the kv cache of one token in bytes, used to estimate "
+             "the kv cache transfer time between prefill and decode "
+             "instances.");
+
+DEFINE_int32(static_instance_list_size,
+             0,
+             "Max number of nearest instances returned in the static prefill "
+             "and decode lists, a value <= 0 returns all of them.");
+
+DEFINE_int32(admission_queue_size,
+             0,
+             "Max number of requests waiting for capacity while all instances "
+             "are saturated, 0 disables the admission queue and requests are "
+             "dispatched right away.");
+
+DEFINE_int32(admission_timeout_ms,
+             5000,
+             "Max time a request waits in the admission queue after its "
+             "arrival before it fails, in milliseconds.");
+
+DEFINE_double(admission_max_cache_usage,
+              0.95,
+              "Instances whose gpu cache usage reaches this ratio are "
+              "saturated and take no newly admitted requests.");
+
+DEFINE_int32(admission_max_requests_per_instance,
+             0,
+             "Instances running this many requests of their role are "
+             "saturated, 0 means no limit.");
+
+DEFINE_int32(routing_batch_window_us,
+             0,
+             "Collect the requests arriving within this window and route "
+             "them jointly, in microseconds. 0 routes every request on its "
+             "own.");
+
+DEFINE_int32(routing_max_batch_size,
+             64,
+             "Max number of requests routed jointly, a full batch is routed "
+             "before the window ends.");
+
+DEFINE_int32(p2c_num_choices,
+             2,
+             "Number of instances the P2C policy samples for every request, "
+             "the least loaded of them is chosen.");
+
+DEFINE_double(p2c_prefix_hit_weight,
+              1.0,
+              "Weight of the prefix cache hit tokens against the outstanding "
+              "tokens in the P2C policy.");
+
+DEFINE_double(consistent_hash_load_factor,
+              1.25,
+              "An instance takes at most this factor times the average number "
+              "of running requests in the CONSISTENT_HASH policy, the "
+              "requests of a loaded instance go to the next one on the ring.");
+
+DEFINE_int32(consistent_hash_virtual_nodes,
+             100,
+             "Number of positions of every instance on the consistent hash "
+             "ring.");
+
+DEFINE_string(session_key_header,
+              "x-session-id",
+              "The http header whose value routes the requests of a session "
+              "to the same instance in the CONSISTENT_HASH policy.");
+
+DEFINE_int32(routing_max_heartbeat_age_ms,
+             0,
+             "Instances without heartbeats for this long are not routed to "
+             "while there are others, in milliseconds. 0 routes to all "
+             "registered instances.");
+
+BRPC_VALIDATE_GFLAG(routing_max_heartbeat_age_ms, brpc::PassValidate);
+
+DEFINE_double(car_prefix_hit_weight,
+              1.0,
+              "Weight of the share of prompt blocks cached on an instance in "
+              "the CAR policy.");
+
+BRPC_VALIDATE_GFLAG(car_prefix_hit_weight, brpc::PassValidate);
+
+DEFINE_double(car_cache_usage_weight,
+              1.0,
+              "Weight of the gpu kv cache usage of an instance in the CAR "
+              "policy.");
+
+BRPC_VALIDATE_GFLAG(car_cache_usage_weight, brpc::PassValidate);
+
+DEFINE_double(car_queue_depth_weight,
+              1.0,
+              "Weight of the waiting requests of an instance relative to the "
+              "most waiting ones in the CAR policy.");
+
+BRPC_VALIDATE_GFLAG(car_queue_depth_weight, brpc::PassValidate);
+
+DEFINE_double(car_transfer_weight,
+              1.0,
+              "Weight of the kv cache transfer time between a prefill and a "
+              "decode instance relative to the target ttft in the CAR policy, "
+              "only used with a topology.");
+
+BRPC_VALIDATE_GFLAG(car_transfer_weight, brpc::PassValidate);
+
+DEFINE_double(slo_ttft_weight,
+              1.0,
+              "Weight of the predicted ttft of a prefill instance and of the "
+              "kv cache transfer time in the SLO_AWARE policy, per "
+              "millisecond.");
+
+BRPC_VALIDATE_GFLAG(slo_ttft_weight, brpc::PassValidate);
+
+DEFINE_double(slo_tpot_weight,
+              1.0,
+              "Weight of the predicted tpot of a decode instance missing the "
+              "target tpot in the SLO_AWARE policy, per millisecond.");
+
+BRPC_VALIDATE_GFLAG(slo_tpot_weight, brpc::PassValidate);
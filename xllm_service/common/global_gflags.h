@@ -49,10 +49,20 @@ DECLARE_int32(idle_timeout_s);
 
 DECLARE_int32(num_threads);
 
+DECLARE_bool(pin_request_threads);
+
 DECLARE_int32(max_concurrency);
 
 DECLARE_string(etcd_addr);
 
+DECLARE_int32(etcd_max_inflight_txns);
+
+DECLARE_int32(watch_coalesce_window_us);
+
+DECLARE_string(metadata_store);
+
+DECLARE_string(metadata_store_path);
+
 DECLARE_string(load_balance_policy);
 
 DECLARE_int32(detect_disconnected_instance_interval);
@@ -63,6 +73,64 @@ DECLARE_string(tokenizer_path);
 
 DECLARE_bool(enable_request_trace);
 
+DECLARE_bool(enable_stage_timing_header);
+
 DECLARE_int32(target_ttft);
 
-DECLARE_int32(target_tpot);
\ No newline at end of file
+DECLARE_int32(target_tpot);
+
+DECLARE_string(instance_cancel_uri);
+
+DECLARE_bool(enable_time_predictor_refit);
+
+DECLARE_double(time_predictor_forgetting_factor);
+
+DECLARE_bool(slo_use_measured_latency);
+
+DECLARE_int32(role_balance_interval_ms);
+
+DECLARE_int32(role_min_dwell_ms);
+
+DECLARE_double(role_load_smoothing);
+
+DECLARE_string(topology_path);
+
+DECLARE_int64(kv_cache_bytes_per_token);
+
+DECLARE_int32(static_instance_list_size);
+
+DECLARE_int32(admission_queue_size);
+
+DECLARE_int32(admission_timeout_ms);
+
+DECLARE_double(admission_max_cache_usage);
+
+DECLARE_int32(admission_max_requests_per_instance);
+
+DECLARE_int32(routing_batch_window_us);
+
+DECLARE_int32(routing_max_batch_size);
+
+DECLARE_int32(p2c_num_choices);
+
+DECLARE_double(p2c_prefix_hit_weight);
+
+DECLARE_double(consistent_hash_load_factor);
+
+DECLARE_int32(consistent_hash_virtual_nodes);
+
+DECLARE_string(session_key_header);
+
+DECLARE_int32(routing_max_heartbeat_age_ms);
+
+DECLARE_double(car_prefix_hit_weight);
+
+DECLARE_double(car_cache_usage_weight);
+
+DECLARE_double(car_queue_depth_weight);
+
+DECLARE_double(car_transfer_weight);
+
+DECLARE_double(slo_ttft_weight);
+
+DECLARE_double(slo_tpot_weight);
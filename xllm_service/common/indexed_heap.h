@@ -0,0 +1,128 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#include <cstddef>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace xllm_service {
+
+// a binary min heap whose elements can be found by key, so that the score of
+// any element can be updated or the element removed in O(log n). The smallest
+// element is returned in O(1). Not thread-safe, the caller has to lock.
+template <typename Key, typename Score>
+class IndexedMinHeap {
+ public:
+  bool empty() const { return heap_.empty(); }
+
+  size_t size() const { return heap_.size(); }
+
+  bool contains(const Key& key) const { return index_.count(key) != 0; }
+
+  // the element with the smallest score, the heap must not be empty
+  const std::pair<Score, Key>& top() const { return heap_.front(); }
+
+  // insert the element or update its score
+  void update(const Key& key, Score score) {
+    auto it = index_.find(key);
+    if (it == index_.end()) {
+      index_.emplace(key, heap_.size());
+      heap_.emplace_back(score, key);
+      sift_up(heap_.size() - 1);
+      return;
+    }
+
+    const size_t pos = it->second;
+    const bool decreased = score < heap_[pos].first;
+    heap_[pos].first = score;
+    if (decreased) {
+      sift_up(pos);
+    } else {
+      sift_down(pos);
+    }
+  }
+
+  void erase(const Key& key) {
+    auto it = index_.find(key);
+    if (it == index_.end()) {
+      return;
+    }
+
+    const size_t pos = it->second;
+    index_.erase(it);
+    if (pos + 1 == heap_.size()) {
+      heap_.pop_back();
+      return;
+    }
+
+    heap_[pos] = std::move(heap_.back());
+    heap_.pop_back();
+    index_[heap_[pos].second] = pos;
+    sift_up(pos);
+    sift_down(pos);
+  }
+
+  void clear() {
+    heap_.clear();
+    index_.clear();
+  }
+
+ private:
+  void swap_elements(size_t a, size_t b) {
+    std::swap(heap_[a], heap_[b]);
+    index_[heap_[a].second] = a;
+    index_[heap_[b].second] = b;
+  }
+
+  void sift_up(size_t pos) {
+    while (pos > 0) {
+      const size_t parent = (pos - 1) / 2;
+      if (!(heap_[pos].first < heap_[parent].first)) {
+        break;
+      }
+      swap_elements(pos, parent);
+      pos = parent;
+    }
+  }
+
+  void sift_down(size_t pos) {
+    while (true) {
+      const size_t left = 2 * pos + 1;
+      const size_t right = left + 1;
+      size_t smallest = pos;
+      if (left < heap_.size() && heap_[left].first < heap_[smallest].first) {
+        smallest = left;
+      }
+      if (right < heap_.size() && heap_[right].first < heap_[smallest].first) {
+        smallest = right;
+      }
+      if (smallest == pos) {
+        break;
+      }
+      swap_elements(pos, smallest);
+      pos = smallest;
+    }
+  }
+
+ private:
+  std::vector<std::pair<Score, Key>> heap_;
+  // key -> position in `heap_`
+  std::unordered_map<Key, size_t> index_;
+};
+
+}  // namespace xllm_service
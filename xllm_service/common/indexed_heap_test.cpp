@@ -0,0 +1,123 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "indexed_heap.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace xllm_service::test {
+
+namespace {
+// pop all elements by erasing the top, the scores come out in order
+std::vector<std::string> drain(IndexedMinHeap<std::string, float>* heap) {
+  std::vector<std::string> keys;
+  while (!heap->empty()) {
+    keys.emplace_back(heap->top().second);
+    heap->erase(keys.back());
+  }
+  return keys;
+}
+}  // namespace
+
+TEST(IndexedMinHeapTest, PushAndPopInScoreOrder) {
+  IndexedMinHeap<std::string, float> heap;
+  EXPECT_TRUE(heap.empty());
+  heap.update("c", 0.3);
+  heap.update("a", 0.1);
+  heap.update("d", 0.4);
+  heap.update("b", 0.2);
+  EXPECT_EQ(4u, heap.size());
+  EXPECT_TRUE(heap.contains("d"));
+  EXPECT_EQ("a", heap.top().second);
+  EXPECT_FLOAT_EQ(0.1, heap.top().first);
+
+  EXPECT_EQ(std::vector<std::string>({"a", "b", "c", "d"}), drain(&heap));
+  EXPECT_FALSE(heap.contains("a"));
+}
+
+TEST(IndexedMinHeapTest, UpdateKey) {
+  IndexedMinHeap<std::string, float> heap;
+  heap.update("a", 0.1);
+  heap.update("b", 0.2);
+  heap.update("c", 0.3);
+  // increase the top, it sinks
+  heap.update("a", 0.5);
+  EXPECT_EQ(3u, heap.size());
+  EXPECT_EQ("b", heap.top().second);
+  // decrease the last, it rises
+  heap.update("c", 0.05);
+  EXPECT_EQ("c", heap.top().second);
+
+  EXPECT_EQ(std::vector<std::string>({"c", "b", "a"}), drain(&heap));
+}
+
+TEST(IndexedMinHeapTest, EraseByKey) {
+  IndexedMinHeap<std::string, float> heap;
+  for (int32_t i = 0; i < 8; ++i) {
+    heap.update(std::to_string(i), i);
+  }
+  // the last element, one in the middle and the top
+  heap.erase("7");
+  heap.erase("3");
+  heap.erase("0");
+  // missing keys are ignored
+  heap.erase("3");
+  EXPECT_EQ(5u, heap.size());
+  EXPECT_FALSE(heap.contains("3"));
+  EXPECT_EQ(std::vector<std::string>({"1", "2", "4", "5", "6"}), drain(&heap));
+
+  heap.update("x", 1);
+  heap.clear();
+  EXPECT_TRUE(heap.empty());
+  EXPECT_FALSE(heap.contains("x"));
+}
+
+TEST(IndexedMinHeapTest, RandomOperations) {
+  std::mt19937 rng(42);
+  IndexedMinHeap<std::string, float> heap;
+  std::vector<std::pair<float, std::string>> expected;
+  for (int32_t i = 0; i < 1000; ++i) {
+    const std::string key = std::to_string(rng() % 64);
+    auto it = std::find_if(expected.begin(), expected.end(), [&](auto& e) {
+      return e.second == key;
+    });
+    if (rng() % 3 == 0) {
+      heap.erase(key);
+      if (it != expected.end()) {
+        expected.erase(it);
+      }
+    } else {
+      const float score = rng() % 1000;
+      heap.update(key, score);
+      if (it != expected.end()) {
+        it->first = score;
+      } else {
+        expected.emplace_back(score, key);
+      }
+    }
+    ASSERT_EQ(expected.size(), heap.size());
+    if (!expected.empty()) {
+      EXPECT_EQ(std::min_element(expected.begin(), expected.end())->first,
+                heap.top().first);
+    }
+  }
+}
+
+}  // namespace xllm_service::test
@@ -0,0 +1,145 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace xllm_service {
+
+// a move-only `void()` callable that keeps small functors in place instead of
+// allocating like std::function. Functors larger than `kInlineSize` or with
+// a throwing move constructor are kept on the heap. A null function pointer
+// or an empty std::function makes an empty task.
+class InlineTask final {
+ public:
+  static constexpr size_t kInlineSize = 48;
+
+  InlineTask() = default;
+
+  InlineTask(std::nullptr_t) {}
+
+  template <typename F,
+            typename D = std::decay_t<F>,
+            typename = std::enable_if_t<!std::is_same_v<D, InlineTask> &&
+                                        std::is_invocable_v<D&>>>
+  InlineTask(F&& f) {
+    if constexpr (std::is_constructible_v<bool, const D&>) {
+      if (!static_cast<bool>(f)) {
+        return;
+      }
+    }
+    if constexpr (fits_inline<D>()) {
+      ::new (static_cast<void*>(storage_)) D(std::forward<F>(f));
+      ops_ = &kInlineOps<D>;
+    } else {
+      ::new (static_cast<void*>(storage_)) D*(new D(std::forward<F>(f)));
+      ops_ = &kHeapOps<D>;
+    }
+  }
+
+  InlineTask(InlineTask&& other) noexcept { move_from(other); }
+
+  InlineTask& operator=(InlineTask&& other) noexcept {
+    if (this != &other) {
+      reset();
+      move_from(other);
+    }
+    return *this;
+  }
+
+  InlineTask(const InlineTask&) = delete;
+  InlineTask& operator=(const InlineTask&) = delete;
+
+  ~InlineTask() { reset(); }
+
+  explicit operator bool() const { return ops_ != nullptr; }
+
+  // the task must not be empty
+  void operator()() { ops_->invoke(storage_); }
+
+  // whether the functor is kept in place
+  bool is_inline() const { return ops_ != nullptr && ops_->is_inline; }
+
+ private:
+  struct Ops {
+    void (*invoke)(void* storage);
+    // move constructs the functor of `src` into `dst` and destroys `src`
+    void (*relocate)(void* dst, void* src);
+    void (*destroy)(void* storage);
+    bool is_inline;
+  };
+
+  template <typename D>
+  static constexpr bool fits_inline() {
+    return sizeof(D) <= kInlineSize &&
+           alignof(std::max_align_t) % alignof(D) == 0 &&
+           std::is_nothrow_move_constructible_v<D>;
+  }
+
+  template <typename D>
+  static D* inline_functor(void* storage) {
+    return std::launder(reinterpret_cast<D*>(storage));
+  }
+
+  template <typename D>
+  static D*& heap_functor(void* storage) {
+    return *std::launder(reinterpret_cast<D**>(storage));
+  }
+
+  template <typename D>
+  static constexpr Ops kInlineOps = {
+      [](void* storage) { (*inline_functor<D>(storage))(); },
+      [](void* dst, void* src) {
+        D* functor = inline_functor<D>(src);
+        ::new (dst) D(std::move(*functor));
+        functor->~D();
+      },
+      [](void* storage) { inline_functor<D>(storage)->~D(); },
+      /*is_inline=*/true};
+
+  template <typename D>
+  static constexpr Ops kHeapOps = {
+      [](void* storage) { (*heap_functor<D>(storage))(); },
+      [](void* dst, void* src) {
+        ::new (dst) D*(heap_functor<D>(src));
+      },
+      [](void* storage) { delete heap_functor<D>(storage); },
+      /*is_inline=*/false};
+
+  void move_from(InlineTask& other) {
+    if (other.ops_ != nullptr) {
+      other.ops_->relocate(storage_, other.storage_);
+      ops_ = other.ops_;
+      other.ops_ = nullptr;
+    }
+  }
+
+  void reset() {
+    if (ops_ != nullptr) {
+      ops_->destroy(storage_);
+      ops_ = nullptr;
+    }
+  }
+
+  alignas(std::max_align_t) unsigned char storage_[kInlineSize];
+  const Ops* ops_ = nullptr;
+};
+
+}  // namespace xllm_service
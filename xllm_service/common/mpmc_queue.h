@@ -0,0 +1,282 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "event_count.h"
+
+namespace xllm_service {
+
+// a bounded lock-free queue for multiple producers and multiple consumers,
+// with the interface of ConcurrentQueue. It is a ring of cells, each with a
+// sequence number telling whether the cell is free for the producer of a
+// position or filled for its consumer (D. Vyukov's bounded MPMC queue).
+// Producers and consumers claim positions with a CAS and never lock. The
+// blocking `push` and `pop` sleep on an EventCount when the queue stays full
+// or empty for a few retries. The capacity is rounded up to a power of 2.
+// Constructing the elements must not throw.
+template <typename T>
+class MPMCQueue {
+ public:
+  explicit MPMCQueue(size_t capacity)
+      : capacity_(round_up_capacity(capacity)),
+        mask_(capacity_ - 1),
+        cells_(new Cell[capacity_]) {
+    for (size_t i = 0; i < capacity_; ++i) {
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  MPMCQueue(const MPMCQueue&) = delete;
+  MPMCQueue& operator=(const MPMCQueue&) = delete;
+
+  ~MPMCQueue() {
+    // destroy the elements left
+    while (try_consume([](T&&) {})) {
+    }
+  }
+
+  // push an element to the queue, block if the queue is full
+  void push(T value) { emplace(std::move(value)); }
+
+  template <typename... Args>
+  void emplace(Args&&... args) {
+    for (int32_t i = 0; i < kNumSpins; ++i) {
+      if (try_emplace(std::forward<Args>(args)...)) {
+        return;
+      }
+      std::this_thread::yield();
+    }
+    while (!try_emplace(std::forward<Args>(args)...)) {
+      const uint32_t key = not_full_.prepare_wait();
+      if (try_emplace(std::forward<Args>(args)...)) {
+        not_full_.cancel_wait();
+        return;
+      }
+      not_full_.wait(key);
+    }
+  }
+
+  // return false if the queue is full
+  bool try_push(T value) { return try_emplace(std::move(value)); }
+
+  // return false if the queue is full. The arguments are not used then.
+  template <typename... Args>
+  bool try_emplace(Args&&... args) {
+    Cell* cell = nullptr;
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    while (true) {
+      cell = &cells_[pos & mask_];
+      const size_t sequence = cell->sequence.load(std::memory_order_acquire);
+      const intptr_t diff =
+          static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+      if (diff == 0) {
+        if (enqueue_pos_.compare_exchange_weak(
+                pos, pos + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        // the cell still holds the element of the previous round
+        return false;
+      } else {
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    ::new (static_cast<void*>(cell->storage)) T(std::forward<Args>(args)...);
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    not_empty_.notify_one();
+    return true;
+  }
+
+  // pop an element from the queue, block if the queue is empty
+  T pop() {
+    std::optional<T> value;
+    auto take = [&value](T&& element) { value.emplace(std::move(element)); };
+    for (int32_t i = 0; i < kNumSpins; ++i) {
+      if (try_consume(take)) {
+        return std::move(*value);
+      }
+      std::this_thread::yield();
+    }
+    while (!try_consume(take)) {
+      const uint32_t key = not_empty_.prepare_wait();
+      if (try_consume(take)) {
+        not_empty_.cancel_wait();
+        break;
+      }
+      not_empty_.wait(key);
+    }
+    return std::move(*value);
+  }
+
+  // return false if the queue is empty
+  bool try_pop(T* value) {
+    return try_consume(
+        [value](T&& element) { *value = std::move(element); });
+  }
+
+  // append up to `max_values` elements to `values`, block until there is
+  // at least one. Return the number of elements appended.
+  size_t pop_batch(std::vector<T>* values, size_t max_values) {
+    size_t num_values = try_pop_batch(values, max_values);
+    for (int32_t i = 0; i < kNumSpins && num_values == 0; ++i) {
+      std::this_thread::yield();
+      num_values = try_pop_batch(values, max_values);
+    }
+    while (num_values == 0 && max_values > 0) {
+      const uint32_t key = not_empty_.prepare_wait();
+      num_values = try_pop_batch(values, max_values);
+      if (num_values > 0) {
+        not_empty_.cancel_wait();
+        break;
+      }
+      not_empty_.wait(key);
+      num_values = try_pop_batch(values, max_values);
+    }
+    return num_values;
+  }
+
+  // append up to `max_values` elements to `values` without blocking. The
+  // consecutive filled cells are claimed with a single CAS.
+  size_t try_pop_batch(std::vector<T>* values, size_t max_values) {
+    size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    size_t num_values = 0;
+    while (true) {
+      num_values = 0;
+      while (num_values < max_values &&
+             cells_[(pos + num_values) & mask_].sequence.load(
+                 std::memory_order_acquire) == pos + num_values + 1) {
+        ++num_values;
+      }
+      if (num_values == 0) {
+        const size_t sequence =
+            cells_[pos & mask_].sequence.load(std::memory_order_acquire);
+        if (static_cast<intptr_t>(sequence) -
+                static_cast<intptr_t>(pos + 1) <
+            0) {
+          return 0;
+        }
+        // another consumer took the position
+        pos = dequeue_pos_.load(std::memory_order_relaxed);
+        continue;
+      }
+      if (dequeue_pos_.compare_exchange_weak(
+              pos, pos + num_values, std::memory_order_relaxed)) {
+        break;
+      }
+    }
+
+    values->reserve(values->size() + num_values);
+    for (size_t i = 0; i < num_values; ++i) {
+      Cell& cell = cells_[(pos + i) & mask_];
+      T* element = cell.element();
+      values->push_back(std::move(*element));
+      element->~T();
+      cell.sequence.store(pos + i + capacity_, std::memory_order_release);
+    }
+    if (num_values == 1) {
+      not_full_.notify_one();
+    } else {
+      not_full_.notify_all();
+    }
+    return num_values;
+  }
+
+  // return the size of the queue, which may be stale when returned
+  size_t size() const {
+    const size_t dequeue_pos = dequeue_pos_.load(std::memory_order_acquire);
+    const size_t enqueue_pos = enqueue_pos_.load(std::memory_order_acquire);
+    return enqueue_pos > dequeue_pos ? enqueue_pos - dequeue_pos : 0;
+  }
+
+  // return true if the queue is empty
+  bool empty() const { return size() == 0; }
+
+  size_t capacity() const { return capacity_; }
+
+ private:
+  struct Cell {
+    std::atomic<size_t> sequence;
+    alignas(T) unsigned char storage[sizeof(T)];
+
+    T* element() { return std::launder(reinterpret_cast<T*>(storage)); }
+  };
+
+  // times a blocking call retries, yielding in between, before it sleeps. A
+  // short wait is then cheaper than a wakeup.
+  static constexpr int32_t kNumSpins = 16;
+
+  static size_t round_up_capacity(size_t capacity) {
+    size_t rounded = 2;
+    while (rounded < capacity) {
+      rounded <<= 1;
+    }
+    return rounded;
+  }
+
+  // move the oldest element to `consume`, return false if the queue is empty
+  template <typename Consume>
+  bool try_consume(Consume&& consume) {
+    Cell* cell = nullptr;
+    size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    while (true) {
+      cell = &cells_[pos & mask_];
+      const size_t sequence = cell->sequence.load(std::memory_order_acquire);
+      const intptr_t diff =
+          static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+      if (diff == 0) {
+        if (dequeue_pos_.compare_exchange_weak(
+                pos, pos + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        // the producer of the position has not filled the cell
+        return false;
+      } else {
+        pos = dequeue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    T* element = cell->element();
+    consume(std::move(*element));
+    element->~T();
+    cell->sequence.store(pos + capacity_, std::memory_order_release);
+    not_full_.notify_one();
+    return true;
+  }
+
+  const size_t capacity_;
+  const size_t mask_;
+  std::unique_ptr<Cell[]> cells_;
+
+  // the positions are on their own cache lines, producers and consumers do
+  // not invalidate each other
+  alignas(64) std::atomic<size_t> enqueue_pos_{0};
+  alignas(64) std::atomic<size_t> dequeue_pos_{0};
+
+  alignas(64) EventCount not_empty_;
+  EventCount not_full_;
+};
+
+}  // namespace xllm_service
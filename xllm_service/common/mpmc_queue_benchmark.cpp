@@ -0,0 +1,128 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// Measures the throughput of MPMCQueue against ConcurrentQueue with the same
+// capacity under contention. --num_producers threads push --num_values
+// values in total and --num_consumers threads pop them, one at a time or
+// --batch_size at a time with pop_batch.
+
+#include <gflags/gflags.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "concurrent_queue.h"
+#include "mpmc_queue.h"
+
+DEFINE_int32(num_producers, 8, "Number of threads pushing values.");
+DEFINE_int32(num_consumers, 8, "Number of threads popping values.");
+DEFINE_int32(num_values, 4000000, "Number of values pushed.");
+DEFINE_int32(capacity, 1024, "Capacity of the queues.");
+DEFINE_int32(batch_size, 32, "Max number of values of a pop_batch.");
+
+namespace xllm_service {
+namespace {
+
+// a value the consumers stop at
+constexpr int64_t kStop = -1;
+
+template <typename Queue, typename Consume>
+void run(const std::string& name, Queue* queue, Consume consume) {
+  const auto start = std::chrono::steady_clock::now();
+
+  std::vector<std::thread> consumers;
+  for (int32_t i = 0; i < FLAGS_num_consumers; ++i) {
+    consumers.emplace_back([queue, consume]() { consume(queue); });
+  }
+  std::vector<std::thread> producers;
+  for (int32_t i = 0; i < FLAGS_num_producers; ++i) {
+    producers.emplace_back([queue, i]() {
+      for (int64_t j = i; j < FLAGS_num_values; j += FLAGS_num_producers) {
+        queue->push(j);
+      }
+    });
+  }
+  for (auto& producer : producers) {
+    producer.join();
+  }
+  // every consumer takes one stop value
+  for (int32_t i = 0; i < FLAGS_num_consumers; ++i) {
+    queue->push(kStop);
+  }
+  for (auto& consumer : consumers) {
+    consumer.join();
+  }
+
+  const double seconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+  std::printf("%-24s %10.3f s %12.0f values/s\n",
+              name.c_str(),
+              seconds,
+              FLAGS_num_values / seconds);
+}
+
+template <typename Queue>
+void pop_one_by_one(Queue* queue) {
+  while (queue->pop() != kStop) {
+  }
+}
+
+void pop_batches(MPMCQueue<int64_t>* queue) {
+  std::vector<int64_t> values;
+  while (true) {
+    values.clear();
+    queue->pop_batch(&values, FLAGS_batch_size);
+    const int64_t num_stops = std::count(values.begin(), values.end(), kStop);
+    if (num_stops > 0) {
+      // give the stop values of the other consumers back
+      for (int64_t i = 1; i < num_stops; ++i) {
+        queue->push(kStop);
+      }
+      return;
+    }
+  }
+}
+
+}  // namespace
+}  // namespace xllm_service
+
+int main(int argc, char* argv[]) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  using namespace xllm_service;
+
+  std::printf("producers: %d, consumers: %d, values: %d, capacity: %d\n",
+              FLAGS_num_producers,
+              FLAGS_num_consumers,
+              FLAGS_num_values,
+              FLAGS_capacity);
+  {
+    ConcurrentQueue<int64_t> queue(FLAGS_capacity);
+    run("ConcurrentQueue", &queue, pop_one_by_one<ConcurrentQueue<int64_t>>);
+  }
+  {
+    MPMCQueue<int64_t> queue(FLAGS_capacity);
+    run("MPMCQueue", &queue, pop_one_by_one<MPMCQueue<int64_t>>);
+  }
+  {
+    MPMCQueue<int64_t> queue(FLAGS_capacity);
+    run("MPMCQueue pop_batch", &queue, pop_batches);
+  }
+  return 0;
+}
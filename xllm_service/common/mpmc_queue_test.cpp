@@ -0,0 +1,130 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "mpmc_queue.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace xllm_service::test {
+
+TEST(MPMCQueueTest, PushAndPopInOrder) {
+  MPMCQueue<int32_t> queue(3);
+  EXPECT_EQ(4u, queue.capacity());
+  EXPECT_TRUE(queue.empty());
+  for (int32_t i = 0; i < 4; ++i) {
+    EXPECT_TRUE(queue.try_push(i));
+  }
+  EXPECT_FALSE(queue.try_push(4));
+  EXPECT_EQ(4u, queue.size());
+
+  EXPECT_EQ(0, queue.pop());
+  int32_t value = -1;
+  EXPECT_TRUE(queue.try_pop(&value));
+  EXPECT_EQ(1, value);
+  // the freed cells are used by the next round
+  EXPECT_TRUE(queue.try_push(4));
+  EXPECT_TRUE(queue.try_push(5));
+
+  std::vector<int32_t> values;
+  EXPECT_EQ(3u, queue.try_pop_batch(&values, 3));
+  EXPECT_EQ(std::vector<int32_t>({2, 3, 4}), values);
+  EXPECT_EQ(1u, queue.pop_batch(&values, 8));
+  EXPECT_EQ(5, values.back());
+  EXPECT_FALSE(queue.try_pop(&value));
+  EXPECT_EQ(0u, queue.try_pop_batch(&values, 8));
+}
+
+TEST(MPMCQueueTest, DestroyElementsLeft) {
+  auto element = std::make_shared<int32_t>(0);
+  {
+    MPMCQueue<std::shared_ptr<int32_t>> queue(4);
+    queue.push(element);
+    queue.push(element);
+    EXPECT_EQ(element, queue.pop());
+    EXPECT_EQ(2, element.use_count());
+  }
+  EXPECT_EQ(1, element.use_count());
+
+  // move-only elements
+  MPMCQueue<std::unique_ptr<int32_t>> queue(2);
+  queue.emplace(std::make_unique<int32_t>(7));
+  EXPECT_EQ(7, *queue.pop());
+}
+
+TEST(MPMCQueueTest, BlockWhenFullOrEmpty) {
+  constexpr int32_t kNumProducers = 4;
+  constexpr int32_t kNumConsumers = 4;
+  constexpr int32_t kNumValues = 20000;
+  // a small queue, producers and consumers wait for each other
+  MPMCQueue<int32_t> queue(8);
+  std::vector<std::vector<int32_t>> consumed(kNumConsumers);
+  std::atomic<int32_t> num_exited{0};
+  std::vector<std::thread> threads;
+  for (int32_t i = 0; i < kNumConsumers; ++i) {
+    threads.emplace_back([&queue, &consumed, &num_exited, i]() {
+      std::vector<int32_t> values;
+      while (true) {
+        values.clear();
+        queue.pop_batch(&values, i + 1);
+        for (int32_t value : values) {
+          if (value < 0) {
+            num_exited.fetch_add(1);
+            return;
+          }
+          consumed[i].push_back(value);
+        }
+      }
+    });
+  }
+  for (int32_t i = 0; i < kNumProducers; ++i) {
+    threads.emplace_back([&queue, i]() {
+      for (int32_t j = i; j < kNumValues; j += kNumProducers) {
+        queue.push(j);
+      }
+    });
+  }
+  for (int32_t i = kNumConsumers; i < kNumConsumers + kNumProducers; ++i) {
+    threads[i].join();
+  }
+  // a batch may take the stop marks of other consumers
+  while (num_exited.load() < kNumConsumers) {
+    queue.try_push(-1);
+    std::this_thread::yield();
+  }
+  for (int32_t i = 0; i < kNumConsumers; ++i) {
+    threads[i].join();
+  }
+
+  std::vector<int32_t> counts(kNumValues, 0);
+  for (const auto& values : consumed) {
+    // a consumer sees the values of a producer in order
+    std::vector<int32_t> last(kNumProducers, -1);
+    for (int32_t value : values) {
+      EXPECT_LT(last[value % kNumProducers], value);
+      last[value % kNumProducers] = value;
+      ++counts[value];
+    }
+  }
+  for (int32_t i = 0; i < kNumValues; ++i) {
+    EXPECT_EQ(1, counts[i]) << i;
+  }
+}
+
+}  // namespace xllm_service::test
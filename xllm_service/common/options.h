@@ -57,6 +57,12 @@ class Options {
   // instance manager options
   PROPERTY(std::string, etcd_addr);
 
+  // where the metadata is kept: etcd, memory or file
+  PROPERTY(std::string, metadata_store) = "etcd";
+
+  // log of the file metadata store
+  PROPERTY(std::string, metadata_store_path);
+
   PROPERTY(int32_t, detect_disconnected_instance_interval) = 15;
 
   // scheduler options
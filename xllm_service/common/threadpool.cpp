@@ -16,45 +16,176 @@ limitations under the License.
 
 #include "common/threadpool.h"
 
-#include <thread>
+#include <glog/logging.h>
+#include <pthread.h>
+#include <sched.h>
 
-#include "common/concurrent_queue.h"
+#include <algorithm>
+#include <thread>
 
 namespace xllm_service {
 
-ThreadPool::ThreadPool(size_t num_threads) {
+namespace {
+// the pool and the worker the current thread belongs to
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local size_t current_worker = 0;
+
+ThreadPoolOptions default_options(size_t num_threads) {
+  ThreadPoolOptions options;
+  options.num_threads = num_threads;
+  return options;
+}
+}  // namespace
+
+ThreadPool::ThreadPool(size_t num_threads)
+    : ThreadPool(default_options(num_threads)) {}
+
+ThreadPool::ThreadPool(const ThreadPoolOptions& options) : options_(options) {
+  if (!options_.name.empty()) {
+    const std::string prefix = "xllm_service_" + options_.name + "_pool_";
+    num_steals_.expose(prefix + "steals");
+    pending_tasks_status_ = std::make_unique<bvar::PassiveStatus<int64_t>>(
+        prefix + "pending_tasks",
+        [](void* pool) {
+          return static_cast<ThreadPool*>(pool)->num_pending_tasks();
+        },
+        this);
+  }
+
+  const size_t num_threads = std::max<size_t>(options_.num_threads, 1);
   for (size_t i = 0; i < num_threads; ++i) {
-    threads_.emplace_back([this]() { internal_loop(); });
+    workers_.emplace_back(std::make_unique<Worker>());
+  }
+  // start the threads after all deques exist, they steal from each other
+  for (size_t i = 0; i < num_threads; ++i) {
+    workers_[i]->thread = std::thread([this, i]() { internal_loop(i); });
   }
 }
 
 ThreadPool::~ThreadPool() {
-  // push nullptr to the queue to signal threads to exit
-  for (size_t i = 0; i < threads_.size(); ++i) {
-    queue_.push(nullptr);
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+    stopped_ = true;
   }
+  sleep_cv_.notify_all();
   // wait for all threads to finish
-  for (auto& thread : threads_) {
-    thread.join();
+  for (auto& worker : workers_) {
+    worker->thread.join();
   }
 }
 
 // schedule a task to be executed
 void ThreadPool::schedule(Task task) {
-  if (task == nullptr) {
+  if (!task) {
     return;
   }
-  queue_.push(std::move(task));
+  const size_t index =
+      current_pool == this
+          ? current_worker
+          : next_worker_.fetch_add(1, std::memory_order_relaxed) %
+                workers_.size();
+  num_pending_tasks_.fetch_add(1);
+  {
+    Worker& worker = *workers_[index];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    worker.tasks.push_back(std::move(task));
+    worker.num_tasks.store(worker.tasks.size(), std::memory_order_relaxed);
+  }
+  if (num_sleeping_.load() > 0) {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+    if (num_wakeups_ < num_sleeping_.load()) {
+      ++num_wakeups_;
+      sleep_cv_.notify_one();
+    }
+  }
 }
 
-void ThreadPool::internal_loop() {
+bool ThreadPool::pop(size_t index, Task* task) {
+  Worker& worker = *workers_[index];
+  if (worker.num_tasks.load(std::memory_order_relaxed) == 0) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(worker.mutex);
+  return take_front(&worker, task);
+}
+
+bool ThreadPool::steal(size_t index, Task* task) {
+  for (size_t i = 1; i < workers_.size(); ++i) {
+    Worker& victim = *workers_[(index + i) % workers_.size()];
+    if (victim.num_tasks.load(std::memory_order_relaxed) == 0) {
+      continue;
+    }
+    // skip a deque in use, the next round finds it again
+    std::unique_lock<std::mutex> lock(victim.mutex, std::try_to_lock);
+    if (lock.owns_lock() && take_front(&victim, task)) {
+      num_steals_ << 1;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ThreadPool::take_front(Worker* worker, Task* task) {
+  if (worker->tasks.empty()) {
+    return false;
+  }
+  *task = std::move(worker->tasks.front());
+  worker->tasks.pop_front();
+  worker->num_tasks.store(worker->tasks.size(), std::memory_order_relaxed);
+  return true;
+}
+
+void ThreadPool::pin_to_cpu(size_t index) {
+  const size_t num_cpus = std::max(std::thread::hardware_concurrency(), 1u);
+  const size_t cpu = (options_.first_cpu + index) % num_cpus;
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  CPU_SET(cpu, &cpu_set);
+  const int ret =
+      pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+  if (ret != 0) {
+    LOG(WARNING) << "Failed to pin worker " << index << " of pool "
+                 << options_.name << " to cpu " << cpu << ", error: " << ret;
+  }
+}
+
+void ThreadPool::internal_loop(size_t index) {
+  current_pool = this;
+  current_worker = index;
+  if (options_.pin_cpus) {
+    pin_to_cpu(index);
+  }
+
+  Task task;
   while (true) {
-    Task task = queue_.pop();
-    if (task == nullptr) {
-      // nullptr is a signal to exit
+    if (pop(index, &task) || steal(index, &task)) {
+      num_pending_tasks_.fetch_sub(1);
+      task();
+      task = nullptr;
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(sleep_mutex_);
+    num_sleeping_.fetch_add(1);
+    // a task scheduled before the worker counted itself did not wake anyone
+    const bool missed_task = num_pending_tasks_.load() > 0;
+    if (!missed_task && !stopped_) {
+      sleep_cv_.wait(lock, [this]() { return num_wakeups_ > 0 || stopped_; });
+      if (num_wakeups_ > 0) {
+        --num_wakeups_;
+      }
+    }
+    num_sleeping_.fetch_sub(1);
+    if (missed_task) {
+      // the task is not in a deque yet or its deque is in use
+      lock.unlock();
+      std::this_thread::yield();
+      continue;
+    }
+    if (stopped_ && num_pending_tasks_.load() == 0) {
+      // the pending tasks are run before exit
       break;
     }
-    task();
   }
 }
 
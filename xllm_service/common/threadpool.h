@@ -16,16 +16,44 @@ limitations under the License.
 
 #pragma once
 
-#include <functional>
+#include <bvar/bvar.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
 #include <thread>
+#include <vector>
 
-#include "concurrent_queue.h"
+#include "inline_task.h"
 
 namespace xllm_service {
 
+struct ThreadPoolOptions {
+  size_t num_threads = 1;
+
+  // exposes the bvars of the pool as `xllm_service_<name>_pool_*` if not
+  // empty
+  std::string name;
+
+  // pin worker i to cpu `(first_cpu + i) % num_cpus`
+  bool pin_cpus = false;
+  int32_t first_cpu = 0;
+};
+
+// a work-stealing thread pool. Every worker owns a deque: tasks scheduled by
+// a worker of the pool go to its own deque, other tasks are spread over the
+// workers in turn. A worker runs the tasks of its deque in order and steals
+// the oldest task of another deque when its own is empty, so a pool with a
+// single thread runs the tasks in the order they were scheduled. Idle
+// workers sleep until a task is scheduled. Tasks left at destruction are
+// run before the workers exit.
 class ThreadPool final {
  public:
-  using Task = std::function<void()>;
+  using Task = InlineTask;
 
   // constructors
   ThreadPool() : ThreadPool(1) {}
@@ -38,17 +66,65 @@ class ThreadPool final {
 
   explicit ThreadPool(size_t num_threads);
 
+  explicit ThreadPool(const ThreadPoolOptions& options);
+
   // destructor
   ~ThreadPool();
 
   // schedule a task to be executed
   void schedule(Task task);
 
+  size_t size() const { return workers_.size(); }
+
+  // tasks scheduled but not started yet
+  int64_t num_pending_tasks() const {
+    return num_pending_tasks_.load(std::memory_order_relaxed);
+  }
+
+  // tasks run by a worker other than the one they were scheduled to
+  int64_t num_steals() const { return num_steals_.get_value(); }
+
  private:
-  void internal_loop();
+  struct alignas(64) Worker {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+    // the size of `tasks`, read without the lock to skip empty deques
+    std::atomic<size_t> num_tasks{0};
+    std::thread thread;
+  };
+
+  void internal_loop(size_t index);
+
+  bool pop(size_t index, Task* task);
+
+  bool steal(size_t index, Task* task);
+
+  // the worker must be locked
+  static bool take_front(Worker* worker, Task* task);
+
+  void pin_to_cpu(size_t index);
+
+  const ThreadPoolOptions options_;
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+
+  // the worker the next task from outside the pool goes to
+  std::atomic<size_t> next_worker_{0};
+
+  std::atomic<int64_t> num_pending_tasks_{0};
+
+  // idle workers wait on `sleep_cv_` until `schedule` hands out a wakeup. A
+  // worker announces itself in `num_sleeping_` before it checks for pending
+  // tasks, and `schedule` counts the task before it checks for sleeping
+  // workers, so one of them always sees the other.
+  std::mutex sleep_mutex_;
+  std::condition_variable sleep_cv_;
+  std::atomic<int32_t> num_sleeping_{0};
+  int32_t num_wakeups_ = 0;
+  bool stopped_ = false;
 
-  std::vector<std::thread> threads_;
-  ConcurrentQueue<Task> queue_;
+  bvar::Adder<int64_t> num_steals_;
+  std::unique_ptr<bvar::PassiveStatus<int64_t>> pending_tasks_status_;
 };
 
 }  // namespace xllm_service
@@ -0,0 +1,155 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// Measures the task throughput of ThreadPool against a pool of threads
+// popping one shared ConcurrentQueue of std::function, which ThreadPool was
+// before it had a deque per worker. Producers outside the pool schedule
+// --num_tasks tasks, each spinning --task_work iterations; with
+// --nested_tasks every task also schedules a child from inside the pool.
+
+#include <gflags/gflags.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "concurrent_queue.h"
+#include "threadpool.h"
+
+DEFINE_int32(num_threads, 32, "Number of threads of the pools.");
+DEFINE_int32(num_producers, 8, "Number of threads scheduling tasks.");
+DEFINE_int32(num_tasks, 2000000, "Number of tasks scheduled by producers.");
+DEFINE_int32(task_work, 100, "Iterations a task spins for.");
+DEFINE_bool(nested_tasks, false, "Every task schedules a child task.");
+DEFINE_bool(pin_cpus, false, "Pin the workers of ThreadPool to cpus.");
+
+namespace xllm_service {
+namespace {
+
+// the pool ThreadPool replaced
+class SharedQueuePool final {
+ public:
+  explicit SharedQueuePool(size_t num_threads) {
+    for (size_t i = 0; i < num_threads; ++i) {
+      threads_.emplace_back([this]() {
+        while (true) {
+          std::function<void()> task = queue_.pop();
+          if (task == nullptr) {
+            break;
+          }
+          task();
+        }
+      });
+    }
+  }
+
+  ~SharedQueuePool() {
+    for (size_t i = 0; i < threads_.size(); ++i) {
+      queue_.push(nullptr);
+    }
+    for (auto& thread : threads_) {
+      thread.join();
+    }
+  }
+
+  void schedule(std::function<void()> task) { queue_.push(std::move(task)); }
+
+ private:
+  std::vector<std::thread> threads_;
+  ConcurrentQueue<std::function<void()>> queue_;
+};
+
+void spin(int32_t iterations) {
+  volatile int64_t sink = 0;
+  for (int32_t i = 0; i < iterations; ++i) {
+    sink = sink + i;
+  }
+}
+
+template <typename Pool>
+void run(const std::string& name, Pool* pool) {
+  const int64_t num_tasks =
+      static_cast<int64_t>(FLAGS_num_tasks) * (FLAGS_nested_tasks ? 2 : 1);
+  std::atomic<int64_t> num_done{0};
+  const auto start = std::chrono::steady_clock::now();
+
+  std::vector<std::thread> producers;
+  for (int32_t i = 0; i < FLAGS_num_producers; ++i) {
+    producers.emplace_back([i, pool, &num_done]() {
+      const int32_t begin =
+          static_cast<int64_t>(FLAGS_num_tasks) * i / FLAGS_num_producers;
+      const int32_t end =
+          static_cast<int64_t>(FLAGS_num_tasks) * (i + 1) / FLAGS_num_producers;
+      for (int32_t j = begin; j < end; ++j) {
+        pool->schedule([pool, &num_done]() {
+          spin(FLAGS_task_work);
+          if (FLAGS_nested_tasks) {
+            pool->schedule([&num_done]() {
+              spin(FLAGS_task_work);
+              num_done.fetch_add(1, std::memory_order_relaxed);
+            });
+          }
+          num_done.fetch_add(1, std::memory_order_relaxed);
+        });
+      }
+    });
+  }
+  for (auto& producer : producers) {
+    producer.join();
+  }
+  while (num_done.load(std::memory_order_relaxed) < num_tasks) {
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+
+  const double seconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+  std::printf("%-14s %10.3f s %12.0f tasks/s\n",
+              name.c_str(),
+              seconds,
+              num_tasks / seconds);
+}
+
+}  // namespace
+}  // namespace xllm_service
+
+int main(int argc, char* argv[]) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  using namespace xllm_service;
+
+  std::printf("threads: %d, producers: %d, tasks: %d, work: %d%s\n",
+              FLAGS_num_threads,
+              FLAGS_num_producers,
+              FLAGS_num_tasks,
+              FLAGS_task_work,
+              FLAGS_nested_tasks ? ", nested" : "");
+  {
+    SharedQueuePool pool(FLAGS_num_threads);
+    run("shared queue", &pool);
+  }
+  {
+    ThreadPoolOptions options;
+    options.num_threads = FLAGS_num_threads;
+    options.pin_cpus = FLAGS_pin_cpus;
+    ThreadPool pool(options);
+    run("work stealing", &pool);
+    std::printf("steals: %ld\n", static_cast<long>(pool.num_steals()));
+  }
+  return 0;
+}
@@ -0,0 +1,109 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "threadpool.h"
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <atomic>
+#include <functional>
+#include <future>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace xllm_service::test {
+
+TEST(InlineTaskTest, KeepSmallFunctorsInPlace) {
+  int32_t count = 0;
+  InlineTask small([&count]() { ++count; });
+  EXPECT_TRUE(small.is_inline());
+  std::array<int64_t, 16> values{};
+  InlineTask large([&count, values]() {
+    count += static_cast<int32_t>(values.size());
+  });
+  EXPECT_FALSE(large.is_inline());
+
+  InlineTask moved = std::move(small);
+  EXPECT_FALSE(small);
+  moved();
+  large();
+  EXPECT_EQ(17, count);
+
+  // the captures are released with the task
+  auto captured = std::make_shared<int32_t>(0);
+  {
+    InlineTask task([captured]() {});
+    EXPECT_EQ(2, captured.use_count());
+  }
+  EXPECT_EQ(1, captured.use_count());
+
+  EXPECT_FALSE(InlineTask(std::function<void()>()));
+  EXPECT_FALSE(InlineTask(nullptr));
+}
+
+TEST(ThreadPoolTest, RunTasksOfSingleThreadInOrder) {
+  std::vector<int32_t> order;
+  {
+    ThreadPool pool;
+    for (int32_t i = 0; i < 1000; ++i) {
+      pool.schedule([&order, i]() { order.push_back(i); });
+    }
+  }
+  // the tasks left are run before the pool goes away
+  ASSERT_EQ(1000u, order.size());
+  for (int32_t i = 0; i < 1000; ++i) {
+    EXPECT_EQ(i, order[i]);
+  }
+}
+
+TEST(ThreadPoolTest, RunAllTasks) {
+  std::atomic<int32_t> count{0};
+  {
+    ThreadPool pool(8);
+    std::vector<std::thread> producers;
+    for (int32_t i = 0; i < 4; ++i) {
+      producers.emplace_back([&pool, &count]() {
+        for (int32_t j = 0; j < 10000; ++j) {
+          pool.schedule([&count]() { count.fetch_add(1); });
+        }
+      });
+    }
+    for (auto& producer : producers) {
+      producer.join();
+    }
+  }
+  EXPECT_EQ(40000, count.load());
+}
+
+TEST(ThreadPoolTest, StealFromBusyWorker) {
+  ThreadPool pool(2);
+  std::promise<void> stolen;
+  auto stolen_future = stolen.get_future();
+  std::promise<void> done;
+  pool.schedule([&pool, &stolen, &stolen_future, &done]() {
+    // the task goes to the deque of this worker, which is busy until the
+    // other worker runs it
+    pool.schedule([&stolen]() { stolen.set_value(); });
+    stolen_future.wait();
+    done.set_value();
+  });
+  done.get_future().wait();
+  EXPECT_EQ(1, pool.num_steals());
+  EXPECT_EQ(0, pool.num_pending_tasks());
+}
+
+}  // namespace xllm_service::test
@@ -15,81 +15,154 @@ limitations under the License.
 
 #include "time_predictor.h"
 
+#include "common/global_gflags.h"
+
 namespace {
+// degree of the ttft polynomial
 constexpr int32_t kDegree = 2;
+
+// Lengths are scaled down before they are used as features, otherwise the
+// squared lengths make the least squares problems badly conditioned.
+constexpr double kLengthScale = 1000.0;
+
+// initial covariance without profiling data, large means no confidence in
+// the initial coefficients.
+constexpr double kInitialCovariance = 1e4;
+constexpr double kRegularization = 1e-6;
+
+// stop forgetting once the covariance gets this large, e.g. when the same
+// lengths are observed for a long time.
+constexpr double kMaxCovarianceTrace = 1e6;
 }  // namespace
 
 namespace xllm_service {
 
+TimePredictor::Features TimePredictor::ttft_features(int32_t length) {
+  static_assert(kDegree + 1 == kNumFeatures);
+  Features features;
+  const double scaled_length = length / kLengthScale;
+  double power = 1.0;
+  for (int32_t i = 0; i <= kDegree; ++i) {
+    features(i) = power;
+    power *= scaled_length;
+  }
+  return features;
+}
+
+TimePredictor::Features TimePredictor::tpot_features(double total_length,
+                                                     int32_t batch_size) {
+  Features features;
+  features(0) = 1.0;  // the index 0 is always for constant
+  features(1) = batch_size;
+  features(2) = total_length / kLengthScale;
+  return features;
+}
+
 TimePredictor::TimePredictor(
     const std::vector<std::pair<int32_t, double>>& ttft_profiling_data,
     const std::vector<std::tuple<int32_t, int32_t, double>>&
         tpot_profiling_data) {
-  if (!ttft_profiling_data.empty()) {
-    // construct Vandermonde matrix
-    int32_t m = ttft_profiling_data.size();
-    int32_t n = kDegree + 1;
-    Eigen::MatrixXd matrix(m, n);
-    for (int32_t i = 0; i < m; ++i) {
-      for (int32_t j = 0; j < n; ++j) {
-        matrix(i, j) = std::pow(ttft_profiling_data[i].first, j);
-      }
-    }
-
-    // construct target vector
-    Eigen::VectorXd target(m);
-    for (int32_t i = 0; i < m; ++i) {
-      target(i) = ttft_profiling_data[i].second;
-    }
-
-    // get coefficients
-    ttft_coefficients_ = matrix.colPivHouseholderQr().solve(target);
-  } else {
-    ttft_coefficients_ = Eigen::VectorXd::Zero(1);
+  // construct Vandermonde matrix and target vector
+  int32_t m = ttft_profiling_data.size();
+  FeatureMatrix ttft_matrix(m, kNumFeatures);
+  Eigen::VectorXd ttft_target(m);
+  for (int32_t i = 0; i < m; ++i) {
+    ttft_matrix.row(i) = ttft_features(ttft_profiling_data[i].first);
+    ttft_target(i) = ttft_profiling_data[i].second;
   }
+  ttft_state_ = fit(ttft_matrix, ttft_target);
+
+  m = tpot_profiling_data.size();
+  FeatureMatrix tpot_matrix(m, kNumFeatures);
+  Eigen::VectorXd tpot_target(m);
+  for (int32_t i = 0; i < m; ++i) {
+    int32_t avg_length = std::get<0>(tpot_profiling_data[i]);
+    int32_t batch_size = std::get<1>(tpot_profiling_data[i]);
+    tpot_matrix.row(i) =
+        tpot_features(double(batch_size) * (avg_length - 1), batch_size);
+    tpot_target(i) = std::get<2>(tpot_profiling_data[i]);
+  }
+  tpot_state_ = fit(tpot_matrix, tpot_target);
 
-  if (!tpot_profiling_data.empty()) {
-    int32_t m = tpot_profiling_data.size();
-    int32_t n = kDegree + 1;
-    Eigen::MatrixXd matrix(m, n);
-    for (int32_t i = 0; i < m; ++i) {
-      int32_t avg_length = std::get<0>(tpot_profiling_data[i]);
-      int32_t batch_size = std::get<1>(tpot_profiling_data[i]);
-
-      matrix(i, 0) = 1.0;  // the index 0 is always for constant
-      matrix(i, 1) = batch_size;
-      matrix(i, 2) = batch_size * (avg_length - 1);
-    }
-
-    // construct target vector
-    Eigen::VectorXd target(m);
-    for (int32_t i = 0; i < m; ++i) {
-      target(i) = std::get<2>(tpot_profiling_data[i]);
-    }
-
-    // get coefficients
-    tpot_coefficients_ = matrix.colPivHouseholderQr().solve(target);
-  } else {
-    ttft_coefficients_ = Eigen::VectorXd::Zero(3);
+  static_ttft_coefficients_ = ttft_state_.coefficients;
+  static_tpot_coefficients_ = tpot_state_.coefficients;
+}
+
+TimePredictor::RlsState TimePredictor::fit(const FeatureMatrix& features,
+                                           const Eigen::VectorXd& target) {
+  RlsState state;
+  if (features.rows() == 0) {
+    state.coefficients.setZero();
+    state.covariance.setIdentity();
+    state.covariance *= kInitialCovariance;
+    return state;
   }
+
+  // get coefficients
+  state.coefficients = features.colPivHouseholderQr().solve(target);
+  // the profiling data counts as observations already made
+  state.covariance =
+      (features.transpose() * features +
+       decltype(state.covariance)::Identity() * kRegularization)
+          .inverse();
+  return state;
 }
 
-double TimePredictor::predict_ttft(int32_t length) {
-  double result = 0.0;
-  double power = 1.0;
-  for (int32_t i = 0; i < ttft_coefficients_.size(); ++i) {
-    result += ttft_coefficients_(i) * power;
-    power *= length;
+void TimePredictor::update(const Features& features,
+                           double target,
+                           RlsState* state) {
+  double forgetting_factor = FLAGS_time_predictor_forgetting_factor;
+  if (state->covariance.trace() > kMaxCovarianceTrace) {
+    forgetting_factor = 1.0;
   }
 
-  return result;
+  const Features pf = state->covariance * features;
+  const Features gain = pf / (forgetting_factor + features.dot(pf));
+  const double error = target - features.dot(state->coefficients);
+  state->coefficients += gain * error;
+  state->covariance =
+      (state->covariance - gain * pf.transpose()) / forgetting_factor;
+  // keep the covariance symmetric against rounding errors
+  state->covariance =
+      0.5 * (state->covariance + state->covariance.transpose()).eval();
+}
+
+double TimePredictor::predict_ttft(int32_t length) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return ttft_features(length).dot(ttft_state_.coefficients);
 }
 
 double TimePredictor::predict_tpot(int32_t total_length, int32_t batch_size) {
-  double result = 0.0;
-  result = tpot_coefficients_(0) + tpot_coefficients_(1) * batch_size +
-           tpot_coefficients_(2) * total_length;
-  return result;
+  std::lock_guard<std::mutex> lock(mutex_);
+  return tpot_features(total_length, batch_size).dot(tpot_state_.coefficients);
+}
+
+double TimePredictor::predict_static_ttft(int32_t length) {
+  return ttft_features(length).dot(static_ttft_coefficients_);
+}
+
+double TimePredictor::predict_static_tpot(int32_t total_length,
+                                          int32_t batch_size) {
+  return tpot_features(total_length, batch_size)
+      .dot(static_tpot_coefficients_);
+}
+
+void TimePredictor::update_ttft(int32_t length, double latency) {
+  if (latency <= 0) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  update(ttft_features(length), latency, &ttft_state_);
+}
+
+void TimePredictor::update_tpot(int32_t total_length,
+                                int32_t batch_size,
+                                double latency) {
+  if (latency <= 0 || batch_size <= 0) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  update(tpot_features(total_length, batch_size), latency, &tpot_state_);
 }
 
-}  // namespace xllm_service
\ No newline at end of file
+}  // namespace xllm_service
@@ -16,10 +16,16 @@ limitations under the License.
 #pragma once
 
 #include <Eigen/Dense>
+#include <mutex>
+#include <tuple>
+#include <utility>
+#include <vector>
 
 namespace xllm_service {
 
-// Predictor for predicting TTFT and TPOT
+// Predictor for predicting TTFT and TPOT. The coefficients are fitted on the
+// profiling data first, then refitted online with the latencies observed by
+// the service through recursive least squares.
 class TimePredictor final {
  public:
   TimePredictor(
@@ -32,9 +38,45 @@ class TimePredictor final {
 
   double predict_tpot(int32_t total_length, int32_t batch_size);
 
+  // predictions of the fit on the profiling data only
+  double predict_static_ttft(int32_t length);
+
+  double predict_static_tpot(int32_t total_length, int32_t batch_size);
+
+  // refit with an observed latency, the unit is milliseconds
+  void update_ttft(int32_t length, double latency);
+
+  void update_tpot(int32_t total_length, int32_t batch_size, double latency);
+
  private:
-  Eigen::VectorXd ttft_coefficients_;
-  Eigen::VectorXd tpot_coefficients_;
+  // both predictors use three features, fixed-size types keep the online
+  // updates free of heap allocations.
+  static constexpr int32_t kNumFeatures = 3;
+  using Features = Eigen::Matrix<double, kNumFeatures, 1>;
+  using FeatureMatrix = Eigen::Matrix<double, Eigen::Dynamic, kNumFeatures>;
+
+  // state of the recursive least squares estimator
+  struct RlsState {
+    Features coefficients;
+    // inverse of the weighted correlation matrix of the features
+    Eigen::Matrix<double, kNumFeatures, kNumFeatures> covariance;
+  };
+
+  static Features ttft_features(int32_t length);
+
+  static Features tpot_features(double total_length, int32_t batch_size);
+
+  static RlsState fit(const FeatureMatrix& features,
+                      const Eigen::VectorXd& target);
+
+  static void update(const Features& features, double target, RlsState* state);
+
+  std::mutex mutex_;
+  RlsState ttft_state_;
+  RlsState tpot_state_;
+  // the fit on the profiling data
+  Features static_ttft_coefficients_;
+  Features static_tpot_coefficients_;
 };
 
-}  // namespace xllm_service
\ No newline at end of file
+}  // namespace xllm_service
@@ -0,0 +1,125 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "topology.h"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <fstream>
+
+#include "common/global_gflags.h"
+
+namespace xllm_service {
+
+bool Topology::load(const std::string& path) {
+  std::ifstream file(path);
+  if (!file.is_open()) {
+    LOG(ERROR) << "Failed to open topology file: " << path;
+    return false;
+  }
+  try {
+    return parse(nlohmann::json::parse(file));
+  } catch (const std::exception& e) {
+    LOG(ERROR) << "Failed to parse topology file: " << path << ", "
+               << e.what();
+    return false;
+  }
+}
+
+bool Topology::parse(const nlohmann::json& json) {
+  try {
+    same_host_distance_ =
+        json.value("same_host_distance", same_host_distance_);
+    same_domain_distance_ =
+        json.value("same_domain_distance", same_domain_distance_);
+    default_distance_ = json.value("default_distance", default_distance_);
+
+    if (json.contains("domains")) {
+      for (const auto& [domain, prefixes] : json.at("domains").items()) {
+        const int32_t index = domain_index_.size();
+        domain_index_.emplace(domain, index);
+        for (const auto& prefix : prefixes) {
+          prefixes_.emplace_back(prefix.get<std::string>(), index);
+        }
+      }
+    }
+    // longest prefix first
+    std::sort(prefixes_.begin(), prefixes_.end(), [](auto& a, auto& b) {
+      return a.first.size() > b.first.size();
+    });
+
+    if (json.contains("distances")) {
+      const int64_t num_domains = domain_index_.size();
+      for (const auto& item : json.at("distances")) {
+        auto from = domain_index_.find(item.at("from").get<std::string>());
+        auto to = domain_index_.find(item.at("to").get<std::string>());
+        if (from == domain_index_.end() || to == domain_index_.end()) {
+          LOG(ERROR) << "Unknown domain in topology distance: " << item;
+          return false;
+        }
+        const double distance = item.at("distance").get<double>();
+        distances_[from->second * num_domains + to->second] = distance;
+        distances_[to->second * num_domains + from->second] = distance;
+      }
+    }
+  } catch (const std::exception& e) {
+    LOG(ERROR) << "Invalid topology: " << e.what();
+    return false;
+  }
+  enabled_ = true;
+  return true;
+}
+
+TopologyLocation Topology::locate(const std::string& instance_name) const {
+  TopologyLocation location;
+  location.host = instance_name.substr(0, instance_name.rfind(':'));
+  for (const auto& [prefix, domain] : prefixes_) {
+    if (location.host.compare(0, prefix.size(), prefix) == 0) {
+      location.domain = domain;
+      break;
+    }
+  }
+  return location;
+}
+
+double Topology::distance(const TopologyLocation& a,
+                          const TopologyLocation& b) const {
+  if (!enabled_) {
+    return 0;
+  }
+  if (a.host == b.host) {
+    return same_host_distance_;
+  }
+  if (a.domain < 0 || b.domain < 0) {
+    return default_distance_;
+  }
+  if (a.domain == b.domain) {
+    return same_domain_distance_;
+  }
+  auto it = distances_.find(int64_t(a.domain) * domain_index_.size() +
+                            b.domain);
+  return it == distances_.end() ? default_distance_ : it->second;
+}
+
+double Topology::transfer_time(const TopologyLocation& a,
+                               const TopologyLocation& b,
+                               int64_t num_tokens) const {
+  constexpr double kBytesPerMiB = 1024.0 * 1024.0;
+  return distance(a, b) * num_tokens * FLAGS_kv_cache_bytes_per_token /
+         kBytesPerMiB;
+}
+
+}  // namespace xllm_service
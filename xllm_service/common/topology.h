@@ -0,0 +1,85 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#include <nlohmann/json.hpp>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace xllm_service {
+
+// Where an instance is placed, see `Topology::locate`.
+struct TopologyLocation {
+  std::string host;
+  // index of the domain, -1 if the host is in no configured domain
+  int32_t domain = -1;
+};
+
+// Distances between instances used to pair prefill and decode instances
+// which are cheap to transfer kv cache between. The topology is read from a
+// json file:
+// {
+//   "domains": {
+//     "rack_a": ["10.0.1.", "10.0.2."],
+//     "rack_b": ["10.0.3."]
+//   },
+//   "distances": [
+//     {"from": "rack_a", "to": "rack_b", "distance": 2.0}
+//   ],
+//   "same_host_distance": 0,
+//   "same_domain_distance": 0.1,
+//   "default_distance": 1
+// }
+// A host belongs to the domain with the longest matching address prefix.
+// Distances are symmetric and given in milliseconds per MiB of kv cache
+// transferred. Without a topology every pair is equally near.
+// Immutable after loading, so it can be read from any thread.
+class Topology {
+ public:
+  Topology() = default;
+
+  // load the topology from a json file, return false on errors
+  bool load(const std::string& path);
+  bool parse(const nlohmann::json& json);
+
+  bool enabled() const { return enabled_; }
+
+  // `instance_name` is the "host:port" address of the instance
+  TopologyLocation locate(const std::string& instance_name) const;
+
+  // in milliseconds per MiB
+  double distance(const TopologyLocation& a, const TopologyLocation& b) const;
+
+  // the time in milliseconds to transfer the kv cache of `num_tokens`
+  // between the two instances
+  double transfer_time(const TopologyLocation& a,
+                       const TopologyLocation& b,
+                       int64_t num_tokens) const;
+
+ private:
+  bool enabled_ = false;
+  double same_host_distance_ = 0;
+  double same_domain_distance_ = 0.1;
+  double default_distance_ = 1;
+  // address prefix -> domain index
+  std::vector<std::pair<std::string, int32_t>> prefixes_;
+  std::unordered_map<std::string, int32_t> domain_index_;
+  // (domain_a * num_domains + domain_b) -> distance
+  std::unordered_map<int64_t, double> distances_;
+};
+
+}  // namespace xllm_service
@@ -0,0 +1,93 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "topology.h"
+
+#include <gtest/gtest.h>
+
+#include "common/global_gflags.h"
+
+namespace xllm_service::test {
+
+namespace {
+nlohmann::json make_topology() {
+  return nlohmann::json::parse(R"({
+    "domains": {
+      "rack_a": ["10.0.1.", "10.0.2."],
+      "rack_b": ["10.0.3."],
+      "rack_c": ["10.0.3.128"]
+    },
+    "distances": [
+      {"from": "rack_a", "to": "rack_b", "distance": 2.0}
+    ],
+    "same_host_distance": 0,
+    "same_domain_distance": 0.5,
+    "default_distance": 4
+  })");
+}
+}  // namespace
+
+TEST(TopologyTest, AllInstancesEquallyNearWithoutTopology) {
+  Topology topology;
+  EXPECT_FALSE(topology.enabled());
+  EXPECT_EQ(0, topology.distance(topology.locate("10.0.1.1:8000"),
+                                 topology.locate("10.0.3.1:8000")));
+  EXPECT_EQ(0,
+            topology.transfer_time(topology.locate("10.0.1.1:8000"),
+                                   topology.locate("10.0.3.1:8000"),
+                                   1024));
+}
+
+TEST(TopologyTest, Distance) {
+  Topology topology;
+  ASSERT_TRUE(topology.parse(make_topology()));
+  auto a1 = topology.locate("10.0.1.1:8000");
+  auto a1_other_port = topology.locate("10.0.1.1:9000");
+  auto a2 = topology.locate("10.0.2.1:8000");
+  auto b = topology.locate("10.0.3.1:8000");
+  auto c = topology.locate("10.0.3.128:8000");
+  auto unknown = topology.locate("192.168.0.1:8000");
+
+  EXPECT_EQ("10.0.1.1", a1.host);
+  EXPECT_EQ(0, topology.distance(a1, a1_other_port));
+  EXPECT_EQ(0.5, topology.distance(a1, a2));
+  EXPECT_EQ(2.0, topology.distance(a1, b));
+  EXPECT_EQ(2.0, topology.distance(b, a2));
+  // the longest prefix wins, no distance configured between rack a and c
+  EXPECT_NE(b.domain, c.domain);
+  EXPECT_EQ(4, topology.distance(a1, c));
+  EXPECT_EQ(4, topology.distance(a1, unknown));
+}
+
+TEST(TopologyTest, TransferTime) {
+  Topology topology;
+  ASSERT_TRUE(topology.parse(make_topology()));
+  const int64_t num_tokens = 4 * 1024 * 1024 / FLAGS_kv_cache_bytes_per_token;
+  EXPECT_DOUBLE_EQ(8.0,
+                   topology.transfer_time(topology.locate("10.0.1.1:8000"),
+                                          topology.locate("10.0.3.1:8000"),
+                                          num_tokens));
+}
+
+TEST(TopologyTest, RejectUnknownDomain) {
+  auto json = make_topology();
+  json["distances"].push_back(
+      {{"from", "rack_a"}, {"to", "rack_x"}, {"distance", 1.0}});
+  Topology topology;
+  EXPECT_FALSE(topology.parse(json));
+  EXPECT_FALSE(topology.enabled());
+}
+
+}  // namespace xllm_service::test
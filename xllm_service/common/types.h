@@ -39,11 +39,16 @@ using Murmur3KeyCacheMap = std::unordered_map<Murmur3Key,
 struct Routing {
   std::string prefill_name;
   std::string decode_name;
+  // data parallel rank within the instance, -1 lets the instance choose
+  int32_t prefill_dp_rank = -1;
+  int32_t decode_dp_rank = -1;
 
   nlohmann::json serialize_to_json() const {
     nlohmann::json json_val;
     json_val["prefill_name"] = prefill_name;
     json_val["decode_name"] = decode_name;
+    json_val["prefill_dp_rank"] = prefill_dp_rank;
+    json_val["decode_dp_rank"] = decode_dp_rank;
     return json_val;
   }
 
@@ -152,6 +157,62 @@ struct RequestMetrics {
   // Estimated execution time for all prefill requests on the instance.
   // The unit is milliseconds.
   int64_t estimated_prefill_time;
+
+  // number of running requests routed to each data parallel rank
+  std::vector<int64_t> dp_rank_request_num;
+};
+
+// The limits an instance taking newly admitted requests has to stay below.
+struct CapacityLimits {
+  float max_cache_usage = 1;
+  // the running requests of the role of the instance, not limited if not
+  // positive
+  int64_t max_requests = 0;
+  // the queued prefill work, in milliseconds
+  int64_t max_prefill_time = 0;
+
+  // whether an instance taking requests of `role` has room for one more,
+  // `load_metrics` is null if the instance has not reported its load
+  bool has_room(InstanceType role,
+                const LoadMetrics* load_metrics,
+                const RequestMetrics& request_metrics) const {
+    if (load_metrics != nullptr &&
+        load_metrics->gpu_cache_usage_perc >= max_cache_usage) {
+      return false;
+    }
+    const bool prefill = role != InstanceType::DECODE;
+    const int64_t request_num = prefill ? request_metrics.prefill_request_num
+                                        : request_metrics.decode_request_num;
+    if (max_requests > 0 && request_num >= max_requests) {
+      return false;
+    }
+    // the queued prefill work already misses the target ttft
+    return !prefill ||
+           request_metrics.estimated_prefill_time < max_prefill_time;
+  }
+};
+
+// An instance considered by the routing policies, with a snapshot of its
+// load taken when the request is routed.
+struct InstanceCandidate {
+  std::string name;
+  // PREFILL for the instances taking prefill requests, DECODE otherwise
+  InstanceType role = InstanceType::PREFILL;
+
+  // the time since the latest heartbeat, in milliseconds
+  int64_t heartbeat_age_ms = 0;
+
+  bool has_load_metrics = false;
+  LoadMetrics load_metrics;
+  RequestMetrics request_metrics;
+
+  // the predicted latencies of the routed request on the instance, only set
+  // when they are asked for. In milliseconds.
+  int64_t predicted_ttft = 0;
+  int64_t predicted_tpot = 0;
+
+  // set by the scoring pipeline, higher is better
+  float score = 0;
 };
 
 struct InstanceMetaInfo {
@@ -175,7 +236,7 @@ struct InstanceMetaInfo {
   std::vector<std::string> addrs;
   std::vector<uint64_t> k_cache_ids;
   std::vector<uint64_t> v_cache_ids;
-  int32_t dp_size;
+  int32_t dp_size = 1;
   // ttft profiling data
   std::vector<std::pair<int32_t, double>> ttft_profiling_data;
   // tpot profiling data
@@ -269,16 +330,25 @@ struct InstanceMetaInfo {
   }
 };
 
+// data parallel ranks are tracked as bits of a mask
+constexpr int32_t kMaxDpRanks = 64;
+
 struct CacheLocations {
   std::unordered_set<std::string> hbm_instance_set;
   std::unordered_set<std::string> dram_instance_set;
   std::unordered_set<std::string> ssd_instance_set;
+  // instance name -> mask of the data parallel ranks holding the block in
+  // hbm. Instances missing here did not report their ranks.
+  std::unordered_map<std::string, uint64_t> hbm_dp_ranks;
 
   nlohmann::json serialize_to_json() const {
     nlohmann::json json_val;
     json_val["hbm_instance_set"] = hbm_instance_set;
     json_val["dram_instance_set"] = dram_instance_set;
     json_val["ssd_instance_set"] = ssd_instance_set;
+    if (!hbm_dp_ranks.empty()) {
+      json_val["hbm_dp_ranks"] = hbm_dp_ranks;
+    }
     return json_val;
   }
 
@@ -302,6 +372,11 @@ struct CacheLocations {
         ssd_instance_set.insert(item);
       }
 
+      if (json_value.contains("hbm_dp_ranks")) {
+        hbm_dp_ranks = json_value.at("hbm_dp_ranks")
+                           .get<std::unordered_map<std::string, uint64_t>>();
+      }
+
     } catch (const std::exception& e) {
       LOG(ERROR) << "json str:" << json_str
                  << ", parse to cachelocation error: " << e.what();
@@ -337,6 +412,9 @@ struct OverlapScores {
   // SSD storage type instance match length mapping (instance name -> match
   // length)
   std::unordered_map<std::string, uint32_t> ssd_instance_score;
+  // HBM match length of every data parallel rank (instance name -> match
+  // length indexed by rank), only for instances reporting their ranks
+  std::unordered_map<std::string, std::vector<uint32_t>> hbm_dp_rank_score;
   uint32_t max_block_num = 0;
   uint32_t max_matched_block_num = 0;
   std::string max_matched_instance_name = "";
@@ -347,6 +425,7 @@ struct OverlapScores {
     json_val["hbm_instance_score"] = hbm_instance_score;
     json_val["dram_instance_score"] = dram_instance_score;
     json_val["ssd_instance_score"] = ssd_instance_score;
+    json_val["hbm_dp_rank_score"] = hbm_dp_rank_score;
     json_val["max_block_num"] = max_block_num;
     json_val["max_matched_block_num"] = max_matched_block_num;
     json_val["max_matched_instance_name"] = max_matched_instance_name;
@@ -354,40 +433,6 @@ struct OverlapScores {
   }
 };
 
-struct LoadBalanceInfos {
-  OverlapScores overlap_scores;
-  std::unordered_map<std::string, LoadMetrics> prefill_load_metrics;
-  std::unordered_map<std::string, LoadMetrics> decode_load_metrics;
-  uint64_t prefill_max_waiting_requests_num = 0;
-  uint64_t decode_max_waiting_requests_num = 0;
-
-  std::string debug_string() {
-    nlohmann::json json_val;
-
-    json_val["overlap_scores"] =
-        nlohmann::json::parse(overlap_scores.debug_string());
-
-    nlohmann::json prefill_json;
-    for (auto& [key, metrics] : prefill_load_metrics) {
-      prefill_json[key] = nlohmann::json::parse(metrics.debug_string());
-    }
-    json_val["prefill_load_metrics"] = prefill_json;
-
-    nlohmann::json decode_json;
-    for (auto& [key, metrics] : decode_load_metrics) {
-      decode_json[key] = nlohmann::json::parse(metrics.debug_string());
-    }
-    json_val["decode_load_metrics"] = decode_json;
-
-    json_val["prefill_max_waiting_requests_num"] =
-        prefill_max_waiting_requests_num;
-    json_val["decode_max_waiting_requests_num"] =
-        decode_max_waiting_requests_num;
-
-    return json_val.dump(2);
-  }
-};
-
 // Function call related types
 struct JsonFunction {
   std::string name;
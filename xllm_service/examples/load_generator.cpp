@@ -0,0 +1,513 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// Open-loop load generator of the http service. Requests are sent at the
+// arrival times recorded by the request tracer (--enable_request_trace), or
+// at Poisson arrivals of a synthetic workload with shared prompt prefixes.
+// A request is sent at its arrival time whether or not the earlier ones have
+// finished, so a saturated service shows up as growing latencies and errors
+// instead of a lower sending rate.
+
+#include <brpc/channel.h>
+#include <brpc/progressive_reader.h>
+#include <butil/time.h>
+#include <gflags/gflags.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+DEFINE_string(server, "127.0.0.1:9999", "Address of the http service.");
+DEFINE_string(trace_path,
+              "",
+              "Replay the requests of this request trace, a synthetic "
+              "workload is sent if empty.");
+DEFINE_double(time_scale,
+              1.0,
+              "Replay the recorded arrivals this many times faster.");
+DEFINE_double(qps, 10.0, "Poisson arrival rate of the synthetic workload.");
+DEFINE_int32(num_requests, 1000, "Number of synthetic requests.");
+DEFINE_string(model, "", "Model of the synthetic requests.");
+DEFINE_int32(num_prefixes,
+             16,
+             "Number of prompt prefixes shared by the synthetic requests.");
+DEFINE_int32(prefix_words, 256, "Number of words of a shared prefix.");
+DEFINE_int32(min_suffix_words, 16, "Min words of a prompt after the prefix.");
+DEFINE_int32(max_suffix_words, 256, "Max words of a prompt after the prefix.");
+DEFINE_int32(max_tokens, 128, "max_tokens of the synthetic requests.");
+DEFINE_double(stream_ratio,
+              1.0,
+              "Fraction of the synthetic requests which are streamed.");
+DEFINE_uint64(random_seed, 1, "Seed of the synthetic workload.");
+DEFINE_int32(max_inflight,
+             8192,
+             "Requests arriving while this many are in flight are dropped "
+             "and counted as errors.");
+DEFINE_int32(timeout_ms, 600000, "Timeout of a request in milliseconds.");
+DEFINE_int32(report_interval_s, 5, "Seconds between two progress reports.");
+
+namespace {
+
+constexpr char kCompletionsPath[] = "/v1/completions";
+constexpr char kChatCompletionsPath[] = "/v1/chat/completions";
+constexpr char kStreamEventPrefix[] = "data: ";
+constexpr char kStreamEventSeparator[] = "\n\n";
+
+struct LoadRequest {
+  // relative to the first request
+  int64_t arrival_time_us = 0;
+  std::string path;
+  std::string body;
+  bool stream = false;
+};
+
+// the fields added by the service when it forwards a request
+const char* const kServiceFields[] = {"service_request_id",
+                                      "token_ids",
+                                      "routing"};
+
+// the trace holds the requests forwarded to the instances, the original
+// request is what is left after removing the fields added by the service.
+bool load_trace(const std::string& path, std::vector<LoadRequest>* requests) {
+  std::ifstream stream(path);
+  if (!stream.is_open()) {
+    std::cerr << "Failed to open trace " << path << std::endl;
+    return false;
+  }
+
+  std::unordered_map<std::string, LoadRequest> traced_requests;
+  std::string line;
+  while (std::getline(stream, line)) {
+    auto entry = nlohmann::json::parse(line, nullptr, false);
+    if (entry.is_discarded() || !entry.contains("data") ||
+        !entry.contains("time_ms") || !entry.contains("service_request_id")) {
+      continue;
+    }
+    auto body = nlohmann::json::parse(
+        entry["data"].get<std::string>(), nullptr, false);
+    if (body.is_discarded() || !body.is_object() ||
+        !body.contains("token_ids")) {
+      continue;
+    }
+    for (const char* field : kServiceFields) {
+      body.erase(field);
+    }
+
+    LoadRequest request;
+    request.arrival_time_us = entry["time_ms"].get<int64_t>() * 1000;
+    request.path =
+        body.contains("messages") ? kChatCompletionsPath : kCompletionsPath;
+    request.stream = body.value("stream", false);
+    request.body = body.dump();
+    const auto id = entry["service_request_id"].get<std::string>();
+    traced_requests[id] = std::move(request);
+  }
+
+  requests->clear();
+  for (auto& [id, request] : traced_requests) {
+    requests->emplace_back(std::move(request));
+  }
+  std::sort(requests->begin(),
+            requests->end(),
+            [](const LoadRequest& a, const LoadRequest& b) {
+              return a.arrival_time_us < b.arrival_time_us;
+            });
+  if (!requests->empty()) {
+    const int64_t start_time_us = requests->front().arrival_time_us;
+    for (auto& request : *requests) {
+      request.arrival_time_us = static_cast<int64_t>(
+          (request.arrival_time_us - start_time_us) / FLAGS_time_scale);
+    }
+  }
+  return true;
+}
+
+std::string random_words(int32_t num_words, std::mt19937_64* rng) {
+  std::uniform_int_distribution<int32_t> word(0, 9999);
+  std::string text;
+  for (int32_t i = 0; i < num_words; ++i) {
+    text += "w" + std::to_string(word(*rng)) + " ";
+  }
+  return text;
+}
+
+std::vector<LoadRequest> generate_requests() {
+  std::mt19937_64 rng(FLAGS_random_seed);
+  std::vector<std::string> prefixes;
+  for (int32_t i = 0; i < FLAGS_num_prefixes; ++i) {
+    prefixes.emplace_back(random_words(FLAGS_prefix_words, &rng));
+  }
+  std::uniform_int_distribution<int32_t> prefix(0, FLAGS_num_prefixes - 1);
+  std::uniform_int_distribution<int32_t> suffix_words(FLAGS_min_suffix_words,
+                                                      FLAGS_max_suffix_words);
+  std::exponential_distribution<double> interval(FLAGS_qps);
+  std::bernoulli_distribution stream(FLAGS_stream_ratio);
+
+  std::vector<LoadRequest> requests(FLAGS_num_requests);
+  double arrival_time_s = 0;
+  for (auto& request : requests) {
+    nlohmann::json body;
+    body["model"] = FLAGS_model;
+    body["prompt"] = (prefixes.empty() ? "" : prefixes[prefix(rng)]) +
+                     random_words(suffix_words(rng), &rng);
+    body["max_tokens"] = FLAGS_max_tokens;
+    body["stream"] = stream(rng);
+
+    request.arrival_time_us = static_cast<int64_t>(arrival_time_s * 1e6);
+    request.path = kCompletionsPath;
+    request.stream = body["stream"].get<bool>();
+    request.body = body.dump();
+    arrival_time_s += interval(rng);
+  }
+  return requests;
+}
+
+int64_t percentile(const std::vector<int64_t>& sorted_values, double p) {
+  if (sorted_values.empty()) {
+    return 0;
+  }
+  const size_t index =
+      std::min(sorted_values.size() - 1,
+               static_cast<size_t>(p / 100.0 * sorted_values.size()));
+  return sorted_values[index];
+}
+
+class LoadStats {
+ public:
+  void record_sent() { num_sent_.fetch_add(1, std::memory_order_relaxed); }
+
+  void record_ttft(int64_t ttft_us) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    ttft_us_.emplace_back(ttft_us);
+  }
+
+  void record_tbt(int64_t tbt_us) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    tbt_us_.emplace_back(tbt_us);
+  }
+
+  void record_finish(int64_t latency_us, int64_t num_tokens) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    latency_us_.emplace_back(latency_us);
+    num_tokens_ += num_tokens;
+    num_finished_ += 1;
+  }
+
+  void record_error(const std::string& type) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    num_errors_[type] += 1;
+  }
+
+  void print_progress(int64_t elapsed_us, int64_t num_inflight) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    int64_t num_errors = 0;
+    for (const auto& [type, num] : num_errors_) {
+      num_errors += num;
+    }
+    std::printf("[%7.1fs] sent %ld, in flight %ld, finished %ld, errors %ld, "
+                "output tokens %ld\n",
+                elapsed_us / 1e6,
+                num_sent_.load(std::memory_order_relaxed),
+                num_inflight,
+                num_finished_,
+                num_errors,
+                num_tokens_);
+    std::fflush(stdout);
+  }
+
+  void print_summary(int64_t send_duration_us, int64_t duration_us) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    const int64_t num_sent = num_sent_.load(std::memory_order_relaxed);
+    int64_t num_errors = 0;
+    for (const auto& [type, num] : num_errors_) {
+      num_errors += num;
+    }
+    const double send_duration_s = std::max<int64_t>(send_duration_us, 1) / 1e6;
+    const double duration_s = std::max<int64_t>(duration_us, 1) / 1e6;
+
+    std::printf("requests:   %ld sent, %ld finished, %ld errors (%.2f%%)\n",
+                num_sent,
+                num_finished_,
+                num_errors,
+                num_sent > 0 ? 100.0 * num_errors / num_sent : 0.0);
+    for (const auto& [type, num] : num_errors_) {
+      std::printf("  %-22s %ld\n", type.c_str(), num);
+    }
+    std::printf("offered:    %.2f req/s\n", num_sent / send_duration_s);
+    std::printf("throughput: %.2f req/s, %.2f output tok/s\n",
+                num_finished_ / duration_s,
+                num_tokens_ / duration_s);
+    print_latency("ttft", &ttft_us_);
+    print_latency("tbt", &tbt_us_);
+    print_latency("latency", &latency_us_);
+  }
+
+ private:
+  static void print_latency(const char* name, std::vector<int64_t>* values) {
+    std::sort(values->begin(), values->end());
+    std::printf("%-8s(ms) p50 %9.2f  p90 %9.2f  p99 %9.2f  max %9.2f\n",
+                name,
+                percentile(*values, 50) / 1e3,
+                percentile(*values, 90) / 1e3,
+                percentile(*values, 99) / 1e3,
+                values->empty() ? 0.0 : values->back() / 1e3);
+  }
+
+  std::atomic<int64_t> num_sent_ = 0;
+
+  std::mutex mutex_;
+  std::vector<int64_t> ttft_us_;
+  std::vector<int64_t> tbt_us_;
+  std::vector<int64_t> latency_us_;
+  int64_t num_finished_ = 0;
+  int64_t num_tokens_ = 0;
+  std::map<std::string, int64_t> num_errors_;
+};
+
+LoadStats g_stats;
+std::atomic<int64_t> g_num_inflight = 0;
+
+std::string error_type(const brpc::Controller& cntl) {
+  if (cntl.ErrorCode() == brpc::ERPCTIMEDOUT) {
+    return "timeout";
+  }
+  const int status_code = cntl.http_response().status_code();
+  if (status_code >= 400) {
+    return "http_" + std::to_string(status_code);
+  }
+  return "rpc_" + std::to_string(cntl.ErrorCode());
+}
+
+// Reads the server-sent events of a streamed response. Every event with
+// generated tokens is one step of the request, the time to the first one is
+// the ttft and the times between the following ones are the tbt.
+class StreamReader : public brpc::ProgressiveReader {
+ public:
+  StreamReader(std::unique_ptr<brpc::Controller> cntl, int64_t send_time_us)
+      : cntl_(std::move(cntl)),
+        send_time_us_(send_time_us),
+        last_event_time_us_(send_time_us) {}
+
+  butil::Status OnReadOnePart(const void* data, size_t length) override {
+    buffer_.append(static_cast<const char*>(data), length);
+    const int64_t now_us = butil::monotonic_time_us();
+    size_t end = buffer_.find(kStreamEventSeparator);
+    while (end != std::string::npos) {
+      on_event(buffer_.substr(0, end), now_us);
+      buffer_.erase(0, end + sizeof(kStreamEventSeparator) - 1);
+      end = buffer_.find(kStreamEventSeparator);
+    }
+    return butil::Status::OK();
+  }
+
+  void OnEndOfMessage(const butil::Status& status) override {
+    if (!buffer_.empty()) {
+      // the service writes errors without framing them as events
+      on_event(buffer_, butil::monotonic_time_us());
+    }
+    if (!error_.empty()) {
+      g_stats.record_error(error_);
+    } else if (!status.ok() || !done_) {
+      g_stats.record_error("stream_broken");
+    } else {
+      g_stats.record_finish(butil::monotonic_time_us() - send_time_us_,
+                            num_usage_tokens_ > 0 ? num_usage_tokens_
+                                                  : num_token_events_);
+    }
+    g_num_inflight.fetch_sub(1, std::memory_order_relaxed);
+    delete this;
+  }
+
+ private:
+  void on_event(const std::string& event, int64_t now_us) {
+    const size_t prefix_len = sizeof(kStreamEventPrefix) - 1;
+    if (event.compare(0, prefix_len, kStreamEventPrefix) != 0) {
+      error_ = "stream_error";
+      return;
+    }
+    if (event.compare(prefix_len, std::string::npos, "[DONE]") == 0) {
+      done_ = true;
+      return;
+    }
+    // only the last event carries the usage, parse it just then
+    if (event.find("\"usage\"") != std::string::npos) {
+      auto response = nlohmann::json::parse(
+          event.begin() + prefix_len, event.end(), nullptr, false);
+      if (!response.is_discarded() && response.contains("usage") &&
+          response["usage"].is_object()) {
+        num_usage_tokens_ =
+            response["usage"].value("completion_tokens", int64_t(0));
+        return;
+      }
+    }
+
+    if (num_token_events_ == 0) {
+      g_stats.record_ttft(now_us - send_time_us_);
+    } else {
+      g_stats.record_tbt(now_us - last_event_time_us_);
+    }
+    num_token_events_ += 1;
+    last_event_time_us_ = now_us;
+  }
+
+  std::unique_ptr<brpc::Controller> cntl_;
+  int64_t send_time_us_;
+  int64_t last_event_time_us_;
+  std::string buffer_;
+  int64_t num_token_events_ = 0;
+  int64_t num_usage_tokens_ = 0;
+  bool done_ = false;
+  std::string error_;
+};
+
+void handle_response(brpc::Controller* cntl,
+                     bool stream,
+                     int64_t send_time_us) {
+  std::unique_ptr<brpc::Controller> cntl_guard(cntl);
+  if (cntl->Failed()) {
+    g_stats.record_error(error_type(*cntl));
+    g_num_inflight.fetch_sub(1, std::memory_order_relaxed);
+    return;
+  }
+  if (stream) {
+    // the reader takes over the controller and finishes the request
+    cntl->ReadProgressiveAttachmentBy(
+        new StreamReader(std::move(cntl_guard), send_time_us));
+    return;
+  }
+
+  const int64_t latency_us = butil::monotonic_time_us() - send_time_us;
+  auto response = nlohmann::json::parse(
+      cntl->response_attachment().to_string(), nullptr, false);
+  int64_t num_tokens = 0;
+  if (!response.is_discarded() && response.contains("usage") &&
+      response["usage"].is_object()) {
+    num_tokens = response["usage"].value("completion_tokens", int64_t(0));
+  }
+  // without streaming the first token arrives with the whole response
+  g_stats.record_ttft(latency_us);
+  g_stats.record_finish(latency_us, num_tokens);
+  g_num_inflight.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void send_request(brpc::Channel* channel, const LoadRequest& request) {
+  auto* cntl = new brpc::Controller();
+  cntl->http_request().uri() = FLAGS_server + request.path;
+  cntl->http_request().set_method(brpc::HTTP_METHOD_POST);
+  cntl->http_request().set_content_type("application/json");
+  cntl->request_attachment().append(request.body);
+  if (request.stream) {
+    cntl->response_will_be_read_progressively();
+  }
+
+  const int64_t send_time_us = butil::monotonic_time_us();
+  g_num_inflight.fetch_add(1, std::memory_order_relaxed);
+  g_stats.record_sent();
+  channel->CallMethod(
+      nullptr,
+      cntl,
+      nullptr,
+      nullptr,
+      brpc::NewCallback(&handle_response, cntl, request.stream, send_time_us));
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  std::vector<LoadRequest> requests;
+  if (!FLAGS_trace_path.empty()) {
+    if (!load_trace(FLAGS_trace_path, &requests)) {
+      return -1;
+    }
+  } else {
+    requests = generate_requests();
+  }
+  if (requests.empty()) {
+    std::cerr << "No request to send." << std::endl;
+    return -1;
+  }
+
+  // http/1.1 has one request in flight per connection, every concurrent
+  // stream needs a connection of its own.
+  brpc::Channel channel;
+  brpc::ChannelOptions options;
+  options.protocol = "http";
+  options.connection_type = "pooled";
+  options.timeout_ms = FLAGS_timeout_ms;
+  options.max_retry = 0;
+  if (channel.Init(FLAGS_server.c_str(), "", &options) != 0) {
+    std::cerr << "Fail to initialize channel." << std::endl;
+    return -1;
+  }
+
+  std::cout << "Sending " << requests.size() << " requests over "
+            << requests.back().arrival_time_us / 1e6 << "s to "
+            << FLAGS_server << std::endl;
+
+  const int64_t start_time_us = butil::monotonic_time_us();
+  std::atomic_bool exited = false;
+  std::thread reporter([&]() {
+    const auto interval = std::chrono::seconds(FLAGS_report_interval_s);
+    auto next_report = std::chrono::steady_clock::now() + interval;
+    while (!exited.load(std::memory_order_relaxed)) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      if (std::chrono::steady_clock::now() < next_report) {
+        continue;
+      }
+      next_report += interval;
+      g_stats.print_progress(butil::monotonic_time_us() - start_time_us,
+                             g_num_inflight.load(std::memory_order_relaxed));
+    }
+  });
+
+  for (const auto& request : requests) {
+    const int64_t delay_us =
+        start_time_us + request.arrival_time_us - butil::monotonic_time_us();
+    if (delay_us > 0) {
+      std::this_thread::sleep_for(std::chrono::microseconds(delay_us));
+    }
+    if (g_num_inflight.load(std::memory_order_relaxed) >= FLAGS_max_inflight) {
+      g_stats.record_sent();
+      g_stats.record_error("dropped");
+      continue;
+    }
+    send_request(&channel, request);
+  }
+  const int64_t send_duration_us = butil::monotonic_time_us() - start_time_us;
+
+  while (g_num_inflight.load(std::memory_order_relaxed) > 0) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  const int64_t duration_us = butil::monotonic_time_us() - start_time_us;
+  exited = true;
+  reporter.join();
+
+  g_stats.print_summary(send_duration_us, duration_us);
+  return 0;
+}
@@ -54,6 +54,10 @@ void RequestTracer::log(const std::string& service_request_id,
 
   nlohmann::json j;
   j["timestamp"] = timestamp;
+  // the arrival times of replayed requests need milliseconds
+  j["time_ms"] = std::chrono::duration_cast<std::chrono::milliseconds>(
+                     std::chrono::system_clock::now().time_since_epoch())
+                     .count();
   j["service_request_id"] = service_request_id;
   j["data"] = input_or_output;
 
@@ -15,10 +15,14 @@ limitations under the License.
 
 #include "http_service/service.h"
 
+#include <absl/strings/numbers.h>
 #include <absl/time/clock.h>
 #include <absl/time/time.h>
+#include <brpc/builtin/prometheus_metrics_service.h>
 #include <brpc/controller.h>
+#include <brpc/errno.pb.h>
 #include <brpc/progressive_reader.h>
+#include <butil/time.h>
 #include <glog/logging.h>
 #include <json2pb/json_to_pb.h>
 #include <json2pb/pb_to_json.h>
@@ -29,6 +33,7 @@ limitations under the License.
 #include "chat.pb.h"
 #include "common/call_data.h"
 #include "common/closure_guard.h"
+#include "common/global_gflags.h"
 #include "common/utils.h"
 #include "common/xllm/uuid.h"
 #include "completion.pb.h"
@@ -46,13 +51,87 @@ std::string generate_service_request_id(const std::string& method) {
   ss << short_uuid.random();
   return ss.str();
 }
+
+// Serialize the request forwarded to the instances. The routing message of
+// the request proto has no data parallel ranks, if ranks are selected the
+// routing object is written after the rest of the request instead.
+template <typename RequestProto>
+bool request_to_json(const Routing& routing,
+                     RequestProto* req_pb,
+                     std::string* req_json) {
+  if (routing.prefill_dp_rank < 0 && routing.decode_dp_rank < 0) {
+    req_pb->mutable_routing()->set_prefill_name(routing.prefill_name);
+    req_pb->mutable_routing()->set_decode_name(routing.decode_name);
+    return json2pb::ProtoMessageToJson(*req_pb, req_json);
+  }
+  req_pb->clear_routing();
+  if (!json2pb::ProtoMessageToJson(*req_pb, req_json) || req_json->empty() ||
+      req_json->back() != '}') {
+    return false;
+  }
+  req_json->pop_back();
+  if (req_json->size() > 1) {
+    req_json->push_back(',');
+  }
+  req_json->append("\"routing\":");
+  req_json->append(routing.serialize_to_json().dump());
+  req_json->push_back('}');
+  return true;
+}
+
+// overloaded services answer 503 and timed out requests 504, so that clients
+// can back off
+void set_schedule_failed(brpc::Controller* cntl, const llm::Status& status) {
+  switch (status.code()) {
+    case llm::StatusCode::RESOURCE_EXHAUSTED:
+      cntl->SetFailed(brpc::ELIMIT, "%s", status.message().c_str());
+      break;
+    case llm::StatusCode::DEADLINE_EXCEEDED:
+      cntl->SetFailed(brpc::ERPCTIMEDOUT, "%s", status.message().c_str());
+      break;
+    default:
+      cntl->SetFailed("Schedule request failed!");
+      break;
+  }
+  LOG(ERROR) << "Schedule request failed: " << status;
+}
+
+// the stages the service took before the request is forwarded, for clients
+// to see where the time went
+void set_stage_timing_header(brpc::Controller* cntl, const Request& request) {
+  if (FLAGS_enable_stage_timing_header) {
+    cntl->http_response().SetHeader("x-xllm-stage-timing",
+                                    request.stages.to_string());
+  }
+}
+
+// requests of higher priority leave the admission queue first
+int32_t get_request_priority(brpc::Controller* cntl) {
+  const std::string* priority =
+      cntl->http_request().GetHeader("x-request-priority");
+  int32_t value = 0;
+  if (priority != nullptr && !absl::SimpleAtoi(*priority, &value)) {
+    LOG(WARNING) << "Invalid request priority: " << *priority;
+  }
+  return value;
+}
+
+std::string get_session_key(brpc::Controller* cntl) {
+  const std::string* session_key =
+      cntl->http_request().GetHeader(FLAGS_session_key_header);
+  return session_key != nullptr ? *session_key : "";
+}
 }  // namespace
 
 XllmHttpServiceImpl::XllmHttpServiceImpl(const Options& options,
                                          Scheduler* scheduler)
     : options_(options), scheduler_(scheduler) {
   initialized_ = true;
-  thread_pool_ = std::make_unique<ThreadPool>(options_.num_threads());
+  ThreadPoolOptions pool_options;
+  pool_options.num_threads = options_.num_threads();
+  pool_options.name = "http_service";
+  pool_options.pin_cpus = FLAGS_pin_request_threads;
+  thread_pool_ = std::make_unique<ThreadPool>(pool_options);
   request_tracer_ =
       std::make_unique<RequestTracer>(options_.enable_request_trace());
 }
@@ -92,8 +171,9 @@ template <typename T>
 void handle_first_response(brpc::Controller* cntl,
                            std::shared_ptr<T> call_data,
                            Scheduler* scheduler,
-                           std::string service_request_id,
-                           bool stream) {
+                           std::shared_ptr<Request> request) {
+  request->stages.end(RequestStage::FIRST_RESPONSE);
+  const std::string& service_request_id = request->service_request_id;
   // update request metrics for prefill finished request
   scheduler->update_request_metrics_for_prefill(service_request_id);
 
@@ -104,13 +184,19 @@ void handle_first_response(brpc::Controller* cntl,
     scheduler->finish_request(service_request_id, /*error=*/true);
     return;
   }
-  if (stream) {
+  if (request->stream) {
     // write first token from prefill
     call_data->write(cntl->response_attachment().to_string());
   }
   // non-stream, all generated tokens will be sent from decode via rpc service.
 }
 
+void handle_client_cancel(Scheduler* scheduler,
+                          std::string service_request_id) {
+  // no-op if the request has already finished normally.
+  scheduler->cancel_request(service_request_id);
+}
+
 template <typename T>
 class CustomProgressiveReader : public brpc::ProgressiveReader {
  public:
@@ -149,6 +235,12 @@ void XllmHttpServiceImpl::handle(std::shared_ptr<T> call_data,
                                  const std::string& req_attachment,
                                  std::shared_ptr<Request> request,
                                  const std::string& method) {
+  // the forwarded request carries the token ids, the traced requests can be
+  // replayed with them
+  if (request->trace_callback) {
+    request->trace_callback(req_attachment);
+  }
+
   // record request
   bool success = scheduler_->record_new_request(call_data, request);
   if (!success) {
@@ -158,6 +250,10 @@ void XllmHttpServiceImpl::handle(std::shared_ptr<T> call_data,
     return;
   }
 
+  // release the request and stop the instances once the client goes away.
+  call_data->notify_on_cancel(brpc::NewCallback(
+      &handle_client_cancel, scheduler_, request->service_request_id));
+
   // async redistribute the request and wait the response
   // TODO: optimize the thread pool to async mode.
   auto& target_uri = request->routing.prefill_name;
@@ -170,6 +266,12 @@ void XllmHttpServiceImpl::handle(std::shared_ptr<T> call_data,
                           call_data,
                           channel_ptr,
                           target_uri = target_uri + method]() {
+    if (request->cancelled) {
+      // the client has gone away before the request was forwarded.
+      return;
+    }
+    request->forward_time_us = butil::monotonic_time_us();
+    request->stages.end(RequestStage::DISPATCH);
     brpc::Controller* redirect_cntl = new brpc::Controller();
     redirect_cntl->http_request().uri() = target_uri.c_str();
     redirect_cntl->http_request().set_method(brpc::HTTP_METHOD_POST);
@@ -183,8 +285,7 @@ void XllmHttpServiceImpl::handle(std::shared_ptr<T> call_data,
                           redirect_cntl,
                           call_data,
                           scheduler_,
-                          request->service_request_id,
-                          request->stream);
+                          request);
     channel_ptr->CallMethod(NULL, redirect_cntl, NULL, NULL, done);
     return;
   });
@@ -193,8 +294,11 @@ void XllmHttpServiceImpl::handle(std::shared_ptr<T> call_data,
 template <typename T>
 std::shared_ptr<Request> XllmHttpServiceImpl::generate_request(
     T* req_pb,
-    const std::string& method) {
+    const std::string& method,
+    int64_t start_ns) {
   auto request = std::make_shared<Request>();
+  request->arrival_time_us = butil::monotonic_time_us();
+  request->stages.start(start_ns);
   request->model = req_pb->model();
 
   // TODO: add `created_time` fileds etc.
@@ -209,6 +313,10 @@ std::shared_ptr<Request> XllmHttpServiceImpl::generate_request(
     request->include_usage = req_pb->stream_options().include_usage();
   }
 
+  if (req_pb->has_max_tokens()) {
+    request->max_tokens = req_pb->max_tokens();
+  }
+
   if (options_.enable_request_trace()) {
     request->trace_callback =
         [this, service_request_id = request->service_request_id](
@@ -217,6 +325,7 @@ std::shared_ptr<Request> XllmHttpServiceImpl::generate_request(
         };
   }
 
+  request->stages.end(RequestStage::PARSE);
   return request;
 }
 
@@ -257,9 +366,9 @@ void XllmHttpServiceImpl::get_serving(
       cntl, false, done_guard.release(), nullptr);
 
   auto service_request = std::make_shared<Request>();
-  if (!scheduler_->schedule(service_request)) {
-    cntl->SetFailed("Schedule request failed!");
-    LOG(ERROR) << "Schedule request failed!";
+  auto status = scheduler_->schedule(service_request);
+  if (!status.ok()) {
+    set_schedule_failed(cntl, status);
     return;
   }
 
@@ -297,6 +406,7 @@ void XllmHttpServiceImpl::Completions(
     cntl->SetFailed("brpc request | respose | controller is null");
     return;
   }
+  const int64_t start_ns = butil::cpuwide_time_ns();
 
   auto arena = response->GetArena();
   auto req_pb =
@@ -315,14 +425,16 @@ void XllmHttpServiceImpl::Completions(
     return;
   }
 
-  auto service_request = generate_request(req_pb, "/v1/completions");
+  auto service_request = generate_request(req_pb, "/v1/completions", start_ns);
+  service_request->priority = get_request_priority(cntl);
+  service_request->session_key = get_session_key(cntl);
 
   if (!req_pb->prompt().empty()) {
     service_request->prompt = req_pb->prompt();
     // select instance for request
-    if (!scheduler_->schedule(service_request)) {
-      cntl->SetFailed("Schedule request failed!");
-      LOG(ERROR) << "Schedule request failed!";
+    auto status = scheduler_->schedule(service_request);
+    if (!status.ok()) {
+      set_schedule_failed(cntl, status);
       return;
     }
   } else {
@@ -335,20 +447,22 @@ void XllmHttpServiceImpl::Completions(
   req_pb->set_service_request_id(service_request->service_request_id);
   req_pb->mutable_token_ids()->Add(service_request->token_ids.begin(),
                                    service_request->token_ids.end());
-  req_pb->mutable_routing()->set_prefill_name(
-      service_request->routing.prefill_name);
-  req_pb->mutable_routing()->set_decode_name(
-      service_request->routing.decode_name);
 
   std::string req_attachment;
-  if (!json2pb::ProtoMessageToJson(*req_pb, &req_attachment)) {
+  if (!request_to_json(service_request->routing, req_pb, &req_attachment)) {
     cntl->SetFailed("proto to json failed");
     LOG(ERROR) << "proto to json failed";
     return;
   }
-
-  auto call_data = std::make_shared<CompletionCallData>(
-      cntl, service_request->stream, done_guard.release(), resp_pb);
+  service_request->stages.end(RequestStage::SERIALIZE);
+  set_stage_timing_header(cntl, *service_request);
+
+  auto call_data =
+      std::make_shared<CompletionCallData>(cntl,
+                                           service_request->stream,
+                                           done_guard.release(),
+                                           resp_pb,
+                                           service_request->trace_callback);
   handle(call_data, req_attachment, service_request, "/v1/completions");
 }
 
@@ -366,6 +480,7 @@ void XllmHttpServiceImpl::ChatCompletions(
     cntl->SetFailed("brpc request | respose | controller is null");
     return;
   }
+  const int64_t start_ns = butil::cpuwide_time_ns();
 
   auto arena = response->GetArena();
   auto req_pb =
@@ -383,7 +498,10 @@ void XllmHttpServiceImpl::ChatCompletions(
     return;
   }
 
-  auto service_request = generate_request(req_pb, "/v1/chat/completions");
+  auto service_request =
+      generate_request(req_pb, "/v1/chat/completions", start_ns);
+  service_request->priority = get_request_priority(cntl);
+  service_request->session_key = get_session_key(cntl);
 
   if (req_pb->messages_size() > 0) {
     service_request->messages.reserve(req_pb->messages_size());
@@ -391,9 +509,9 @@ void XllmHttpServiceImpl::ChatCompletions(
       service_request->messages.emplace_back(message.role(), message.content());
     }
 
-    if (!scheduler_->schedule(service_request)) {
-      cntl->SetFailed("Schedule request failed!");
-      LOG(ERROR) << "Schedule request failed!";
+    auto status = scheduler_->schedule(service_request);
+    if (!status.ok()) {
+      set_schedule_failed(cntl, status);
       return;
     }
   } else {
@@ -406,20 +524,22 @@ void XllmHttpServiceImpl::ChatCompletions(
   req_pb->set_service_request_id(service_request->service_request_id);
   req_pb->mutable_token_ids()->Add(service_request->token_ids.begin(),
                                    service_request->token_ids.end());
-  req_pb->mutable_routing()->set_prefill_name(
-      service_request->routing.prefill_name);
-  req_pb->mutable_routing()->set_decode_name(
-      service_request->routing.decode_name);
 
   std::string req_attachment;
-  if (!json2pb::ProtoMessageToJson(*req_pb, &req_attachment)) {
+  if (!request_to_json(service_request->routing, req_pb, &req_attachment)) {
     cntl->SetFailed("proto to json failed");
     LOG(ERROR) << "proto to json failed";
     return;
   }
-
-  auto call_data = std::make_shared<ChatCallData>(
-      cntl, service_request->stream, done_guard.release(), resp_pb);
+  service_request->stages.end(RequestStage::SERIALIZE);
+  set_stage_timing_header(cntl, *service_request);
+
+  auto call_data =
+      std::make_shared<ChatCallData>(cntl,
+                                     service_request->stream,
+                                     done_guard.release(),
+                                     resp_pb,
+                                     service_request->trace_callback);
   handle(call_data, req_attachment, service_request, "/v1/chat/completions");
 }
 
@@ -453,7 +573,20 @@ void XllmHttpServiceImpl::Metrics(::google::protobuf::RpcController* controller,
                                   const proto::HttpRequest* request,
                                   proto::HttpResponse* response,
                                   ::google::protobuf::Closure* done) {
-  get_serving("/metrics", controller, request, response, done);
+  ClosureGuard done_guard(done);
+  auto cntl = reinterpret_cast<brpc::Controller*>(controller);
+
+  // the metrics of the service itself, including the latencies it measures
+  // for every instance. The metrics of an instance are served by the
+  // instance.
+  butil::IOBuf buf;
+  if (brpc::DumpPrometheusMetricsToIOBuf(&buf) != 0) {
+    cntl->SetFailed("Fail to dump metrics");
+    LOG(ERROR) << "Fail to dump metrics";
+    return;
+  }
+  cntl->http_response().set_content_type("text/plain");
+  cntl->response_attachment().swap(buf);
 }
 
 }  // namespace xllm_service
@@ -74,7 +74,8 @@ class XllmHttpServiceImpl : public proto::XllmHttpService {
  private:
   template <typename T>
   std::shared_ptr<Request> generate_request(T* req_pb,
-                                            const std::string& method);
+                                            const std::string& method,
+                                            int64_t start_ns);
 
   template <typename T>
   void handle(std::shared_ptr<T> call_data,
@@ -0,0 +1,106 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <thread>
+
+#include "common/global_gflags.h"
+#include "common/options.h"
+#include "common/utils.h"
+#include "master.h"
+
+static std::atomic<uint32_t> g_signal_received{0};
+void shutdown_handler(int signal) {
+  LOG(WARNING) << "Received signal " << signal << ", stopping master...";
+  exit(1);
+}
+
+int main(int argc, char* argv[]) {
+  // Initialize gflags
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  // Initialize glog
+  google::InitGoogleLogging(argv[0]);
+  FLAGS_logtostderr = true;
+
+  LOG(INFO) << "Starting xllm master service.";
+
+  // check port available or not
+  if (!xllm_service::utils::is_port_available(FLAGS_http_server_port)) {
+    LOG(ERROR)
+        << "Http server port " << FLAGS_http_server_port
+        << " is already in use. "
+        << "Please specify a different port using --http_server_port flag.";
+    return -1;
+  }
+  if (!xllm_service::utils::is_port_available(FLAGS_rpc_server_port)) {
+    LOG(ERROR)
+        << "Rpc server port " << FLAGS_rpc_server_port << " is already in use. "
+        << "Please specify a different port using --rpc_server_port flag.";
+    return -1;
+  }
+
+  xllm_service::Options options;
+  options.server_host(FLAGS_server_host)
+      .http_port(FLAGS_http_server_port)
+      .http_idle_timeout_s(FLAGS_http_server_idle_timeout_s)
+      .http_num_threads(FLAGS_http_server_num_threads)
+      .http_max_concurrency(FLAGS_http_server_max_concurrency)
+      .rpc_port(FLAGS_rpc_server_port)
+      .rpc_idle_timeout_s(FLAGS_rpc_server_idle_timeout_s)
+      .rpc_num_threads(FLAGS_rpc_server_num_threads)
+      .rpc_max_concurrency(FLAGS_rpc_server_max_concurrency)
+      .num_threads(FLAGS_num_threads)
+      .max_concurrency(FLAGS_max_concurrency)
+      .timeout_ms(FLAGS_timeout_ms)
+      .connect_timeout_ms(FLAGS_connect_timeout_ms)
+      .etcd_addr(FLAGS_etcd_addr)
+      .metadata_store(FLAGS_metadata_store)
+      .metadata_store_path(FLAGS_metadata_store_path)
+      .load_balance_policy(FLAGS_load_balance_policy)
+      .murmur_hash3_seed(FLAGS_murmur_hash3_seed)
+      .service_name(xllm_service::utils::get_local_ip() + ":" +
+                    std::to_string(FLAGS_rpc_server_port))
+      .detect_disconnected_instance_interval(
+          FLAGS_detect_disconnected_instance_interval)
+      .enable_request_trace(FLAGS_enable_request_trace)
+      .block_size(FLAGS_block_size)
+      .tokenizer_path(FLAGS_tokenizer_path);
+
+  xllm_service::Master master(options);
+
+  if (!master.start()) {
+    LOG(ERROR) << "Failed to start master service.";
+    return -1;
+  }
+
+  // install graceful shutdown handler
+  (void)signal(SIGINT, shutdown_handler);
+  (void)signal(SIGTERM, shutdown_handler);
+
+  while (g_signal_received.load(std::memory_order_relaxed) == 0) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+  }
+
+  // wait here
+  master.stop();
+
+  return 0;
+}
@@ -15,12 +15,6 @@ limitations under the License.
 
 #include "master.h"
 
-#include <csignal>
-
-#include "common/global_gflags.h"
-#include "common/types.h"
-#include "common/utils.h"
-
 namespace xllm_service {
 
 Master::Master(const Options& options) : options_(options) {
@@ -36,24 +30,31 @@ Master::Master(const Options& options) : options_(options) {
 Master::~Master() { stop(); }
 
 bool Master::start() {
+  // the servers run in their own bthreads, both are serving once started.
   // 1. start http server
-  http_server_thread_ =
-      std::make_unique<std::thread>([this]() { start_http_server(); });
+  if (!start_http_server()) {
+    return false;
+  }
 
   // 2. start rpc server
-  rpc_server_thread_ =
-      std::make_unique<std::thread>([this]() { start_rpc_server(); });
+  if (!start_rpc_server()) {
+    http_server_.Stop(0);
+    http_server_.Join();
+    return false;
+  }
 
   return true;
 }
 
 void Master::stop() {
-  if (http_server_thread_ && http_server_thread_->joinable()) {
-    http_server_thread_->join();
+  if (http_server_.IsRunning()) {
+    http_server_.Stop(0);
+    http_server_.Join();
   }
 
-  if (rpc_server_thread_ && rpc_server_thread_->joinable()) {
-    rpc_server_thread_->join();
+  if (rpc_server_.IsRunning()) {
+    rpc_server_.Stop(0);
+    rpc_server_.Join();
   }
 }
 
@@ -95,9 +96,6 @@ bool Master::start_http_server() {
   }
 
   LOG(INFO) << "Xllm http server started on: " << endpoint;
-
-  // Wait until Ctrl-C is pressed, then Stop() and Join() the server.
-  http_server_.RunUntilAskedToQuit();
   return true;
 }
 
@@ -132,87 +130,7 @@ bool Master::start_rpc_server() {
   }
 
   LOG(INFO) << "Xllm rpc server started on: " << endpoint;
-
-  // Wait until Ctrl-C is pressed, then Stop() and Join() the server.
-  rpc_server_.RunUntilAskedToQuit();
   return true;
 }
 
 }  // namespace xllm_service
-
-static std::atomic<uint32_t> g_signal_received{0};
-void shutdown_handler(int signal) {
-  LOG(WARNING) << "Received signal " << signal << ", stopping master...";
-  exit(1);
-}
-
-int main(int argc, char* argv[]) {
-  // Initialize gflags
-  gflags::ParseCommandLineFlags(&argc, &argv, true);
-
-  // Initialize glog
-  google::InitGoogleLogging(argv[0]);
-  FLAGS_logtostderr = true;
-
-  LOG(INFO) << "Starting xllm master service.";
-
-  // check port available or not
-  if (!xllm_service::utils::is_port_available(FLAGS_http_server_port)) {
-    LOG(ERROR)
-        << "Http server port " << FLAGS_http_server_port
-        << " is already in use. "
-        << "Please specify a different port using --http_server_port flag.";
-    return -1;
-  }
-  if (!xllm_service::utils::is_port_available(FLAGS_rpc_server_port)) {
-    LOG(ERROR)
-        << "Rpc server port " << FLAGS_rpc_server_port << " is already in use. "
-        << "Please specify a different port using --rpc_server_port flag.";
-    return -1;
-  }
-
-  xllm_service::Options options;
-  options.server_host(FLAGS_server_host)
-      .http_port(FLAGS_http_server_port)
-      .http_idle_timeout_s(FLAGS_http_server_idle_timeout_s)
-      .http_num_threads(FLAGS_http_server_num_threads)
-      .http_max_concurrency(FLAGS_http_server_max_concurrency)
-      .rpc_port(FLAGS_rpc_server_port)
-      .rpc_idle_timeout_s(FLAGS_rpc_server_idle_timeout_s)
-      .rpc_num_threads(FLAGS_rpc_server_num_threads)
-      .rpc_max_concurrency(FLAGS_rpc_server_max_concurrency)
-      .num_threads(FLAGS_num_threads)
-      .max_concurrency(FLAGS_max_concurrency)
-      .timeout_ms(FLAGS_timeout_ms)
-      .connect_timeout_ms(FLAGS_connect_timeout_ms)
-      .etcd_addr(FLAGS_etcd_addr)
-      .load_balance_policy(FLAGS_load_balance_policy)
-      .murmur_hash3_seed(FLAGS_murmur_hash3_seed)
-      .service_name(xllm_service::utils::get_local_ip() + ":" +
-                    std::to_string(FLAGS_rpc_server_port))
-      .detect_disconnected_instance_interval(
-          FLAGS_detect_disconnected_instance_interval)
-      .enable_request_trace(FLAGS_enable_request_trace)
-      .block_size(FLAGS_block_size)
-      .tokenizer_path(FLAGS_tokenizer_path);
-
-  xllm_service::Master master(options);
-
-  if (!master.start()) {
-    LOG(ERROR) << "Failed to start master service.";
-    return -1;
-  }
-
-  // install graceful shutdown handler
-  (void)signal(SIGINT, shutdown_handler);
-  (void)signal(SIGTERM, shutdown_handler);
-
-  while (g_signal_received.load(std::memory_order_relaxed) == 0) {
-    std::this_thread::sleep_for(std::chrono::milliseconds(500));
-  }
-
-  // wait here
-  master.stop();
-
-  return 0;
-}
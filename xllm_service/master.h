@@ -17,8 +17,6 @@ limitations under the License.
 
 #include <brpc/server.h>
 
-#include <thread>
-
 #include "common/options.h"
 #include "http_service/service.h"
 #include "rpc_service/service.h"
@@ -31,6 +29,7 @@ class Master {
   explicit Master(const Options& options);
   ~Master();
 
+  // start the http and rpc servers, returns once both are serving
   bool start();
   void stop();
 
@@ -48,13 +47,11 @@ class Master {
   std::string http_server_address_;
   std::unique_ptr<xllm_service::XllmHttpServiceImpl> http_service_;
   brpc::Server http_server_;
-  std::unique_ptr<std::thread> http_server_thread_;
 
   // 2.For rpc service
   std::string rpc_server_address_;
   std::unique_ptr<xllm_service::XllmRpcService> rpc_service_;
   brpc::Server rpc_server_;
-  std::unique_ptr<std::thread> rpc_server_thread_;
 };
 
 }  // namespace xllm_service
@@ -0,0 +1,98 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "common/global_gflags.h"
+#include "mock_instance.h"
+
+DEFINE_string(master_rpc_address,
+              "127.0.0.1:8889",
+              "Address of the master rpc service to register at.");
+DEFINE_string(mock_host, "127.0.0.1", "Host of the mock instances.");
+DEFINE_int32(mock_base_port,
+             18000,
+             "Port of the first mock instance, the others take the next "
+             "ports.");
+DEFINE_int32(num_mock_instances, 1, "Number of mock instances to run.");
+DEFINE_string(mock_type,
+              "DEFAULT",
+              "Type of the mock instances, DEFAULT, PREFILL, DECODE or MIX.");
+DEFINE_int32(prefill_time_ms, 20, "Time to the first token of a request.");
+DEFINE_int32(decode_step_ms, 20, "Time between two tokens of a request.");
+DEFINE_int32(default_output_tokens,
+             128,
+             "Output length of requests without max_tokens.");
+DEFINE_int32(mock_cache_blocks,
+             8192,
+             "Number of kv cache blocks reported by a mock instance.");
+
+namespace {
+bool parse_instance_type(const std::string& name,
+                         xllm_service::InstanceType* type) {
+  if (name == "DEFAULT") {
+    *type = xllm_service::InstanceType::DEFAULT;
+  } else if (name == "PREFILL") {
+    *type = xllm_service::InstanceType::PREFILL;
+  } else if (name == "DECODE") {
+    *type = xllm_service::InstanceType::DECODE;
+  } else if (name == "MIX") {
+    *type = xllm_service::InstanceType::MIX;
+  } else {
+    return false;
+  }
+  return true;
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+
+  xllm_service::MockInstanceOptions options;
+  if (!parse_instance_type(FLAGS_mock_type, &options.type)) {
+    LOG(ERROR) << "Unknown instance type " << FLAGS_mock_type;
+    return -1;
+  }
+  options.master_rpc_address = FLAGS_master_rpc_address;
+  options.prefill_time_ms = FLAGS_prefill_time_ms;
+  options.decode_step_ms = FLAGS_decode_step_ms;
+  options.default_output_tokens = FLAGS_default_output_tokens;
+  options.block_size = FLAGS_block_size;
+  options.num_cache_blocks = FLAGS_mock_cache_blocks;
+
+  std::vector<std::unique_ptr<xllm_service::MockInstance>> instances;
+  for (int32_t i = 0; i < FLAGS_num_mock_instances; ++i) {
+    options.name =
+        FLAGS_mock_host + ":" + std::to_string(FLAGS_mock_base_port + i);
+    auto instance = std::make_unique<xllm_service::MockInstance>(options);
+    if (!instance->start()) {
+      return -1;
+    }
+    LOG(INFO) << "Mock instance " << options.name << " started.";
+    instances.emplace_back(std::move(instance));
+  }
+
+  while (true) {
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+  }
+  return 0;
+}
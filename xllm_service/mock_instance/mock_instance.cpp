@@ -0,0 +1,367 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "mock_instance.h"
+
+#include <brpc/controller.h>
+#include <butil/time.h>
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <nlohmann/json.hpp>
+
+#include "common/hash_util.h"
+#include "common/slice.h"
+
+namespace xllm_service {
+
+namespace {
+constexpr char kFinishReason[] = "length";
+
+std::string first_token_chunk(const std::string& service_request_id,
+                              bool chat,
+                              const std::string& text) {
+  nlohmann::json chunk;
+  chunk["id"] = service_request_id;
+  chunk["created"] = 0;
+  chunk["model"] = "mock";
+  nlohmann::json choice;
+  choice["index"] = 0;
+  if (chat) {
+    chunk["object"] = "chat.completion.chunk";
+    choice["delta"]["role"] = "assistant";
+    choice["delta"]["content"] = text;
+  } else {
+    chunk["object"] = "text_completion";
+    choice["text"] = text;
+  }
+  chunk["choices"] = nlohmann::json::array({choice});
+  return "data: " + chunk.dump() + "\n\n";
+}
+}  // namespace
+
+void MockInstance::HttpService::Completions(
+    google::protobuf::RpcController* cntl_base,
+    const proto::HttpRequest* req,
+    proto::HttpResponse* resp,
+    google::protobuf::Closure* done) {
+  instance_->add_request(
+      static_cast<brpc::Controller*>(cntl_base), done, /*chat=*/false);
+}
+
+void MockInstance::HttpService::ChatCompletions(
+    google::protobuf::RpcController* cntl_base,
+    const proto::HttpRequest* req,
+    proto::HttpResponse* resp,
+    google::protobuf::Closure* done) {
+  instance_->add_request(
+      static_cast<brpc::Controller*>(cntl_base), done, /*chat=*/true);
+}
+
+MockInstance::MockInstance(const MockInstanceOptions& options)
+    : options_(options), http_service_(this) {}
+
+MockInstance::~MockInstance() { stop(); }
+
+bool MockInstance::start() {
+  if (server_.AddService(&http_service_,
+                         brpc::SERVER_DOESNT_OWN_SERVICE,
+                         "/v1/completions => Completions,"
+                         "/v1/chat/completions => ChatCompletions,") != 0) {
+    LOG(ERROR) << "Failed to add http service of mock instance "
+               << options_.name;
+    return false;
+  }
+  butil::EndPoint endpoint;
+  if (butil::str2endpoint(options_.name.c_str(), &endpoint) != 0) {
+    LOG(ERROR) << "Mock instance name is not an address: " << options_.name;
+    return false;
+  }
+  if (server_.Start(endpoint, nullptr) != 0) {
+    LOG(ERROR) << "Failed to start mock instance on " << options_.name;
+    return false;
+  }
+
+  brpc::ChannelOptions chan_options;
+  chan_options.protocol = "baidu_std";
+  chan_options.timeout_ms = 1000;
+  if (master_channel_.Init(options_.master_rpc_address.c_str(),
+                           &chan_options) != 0) {
+    LOG(ERROR) << "Failed to initialize channel to master "
+               << options_.master_rpc_address;
+    server_.Stop(0);
+    server_.Join();
+    return false;
+  }
+  master_stub_ = std::make_unique<proto::XllmRpcService_Stub>(&master_channel_);
+
+  ChannelOptions client_options;
+  client_options.timeout_ms = 1000;
+  client_options.heartbeat_interval_ms = options_.heartbeat_interval_ms;
+  client_ = std::make_unique<XllmRpcClient>(
+      options_.name, options_.master_rpc_address, client_options);
+  InstanceMetaInfo metainfo(options_.name, options_.name, options_.type);
+  if (client_->register_instance(metainfo) != ErrorCode::OK) {
+    LOG(ERROR) << "Failed to register mock instance " << options_.name;
+    client_.reset();
+    server_.Stop(0);
+    server_.Join();
+    return false;
+  }
+
+  thread_ = std::make_unique<std::thread>(&MockInstance::run, this);
+  return true;
+}
+
+void MockInstance::stop() {
+  if (thread_ == nullptr) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    exited_ = true;
+  }
+  cv_.notify_one();
+  thread_->join();
+  thread_.reset();
+
+  server_.Stop(0);
+  server_.Join();
+  client_.reset();
+}
+
+void MockInstance::add_request(brpc::Controller* cntl,
+                               google::protobuf::Closure* done,
+                               bool chat) {
+  auto body = nlohmann::json::parse(
+      cntl->request_attachment().to_string(), nullptr, false);
+  if (body.is_discarded() || !body.is_object() ||
+      !body.contains("service_request_id")) {
+    cntl->SetFailed("Invalid forwarded request.");
+    done->Run();
+    return;
+  }
+
+  auto request = std::make_unique<MockRequest>();
+  request->service_request_id = body["service_request_id"].get<std::string>();
+  request->chat = chat;
+  request->stream = body.value("stream", false);
+  request->num_output_tokens =
+      body.value("max_tokens", options_.default_output_tokens);
+  request->receive_time_us = butil::monotonic_time_us();
+  request->prefill_done_time_us =
+      request->receive_time_us + options_.prefill_time_ms * 1000;
+  request->cntl = cntl;
+  request->done = done;
+  if (body.contains("token_ids") && body["token_ids"].is_array()) {
+    auto token_ids = body["token_ids"].get<std::vector<int32_t>>();
+    request->num_prompt_tokens = token_ids.size();
+    record_prompt_caches(token_ids);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (exited_) {
+      cntl->SetFailed("Mock instance is stopped.");
+      done->Run();
+      return;
+    }
+    prefill_requests_.emplace_back(std::move(request));
+  }
+  cv_.notify_one();
+}
+
+void MockInstance::run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!exited_) {
+    const int64_t now_us = butil::monotonic_time_us();
+    int64_t wake_time_us = std::numeric_limits<int64_t>::max();
+    if (!prefill_requests_.empty()) {
+      wake_time_us = prefill_requests_.front()->prefill_done_time_us;
+    }
+    if (!decode_requests_.empty()) {
+      wake_time_us = std::min(wake_time_us, next_step_time_us_);
+    }
+    if (wake_time_us == std::numeric_limits<int64_t>::max()) {
+      cv_.wait(lock);
+      continue;
+    }
+    if (wake_time_us > now_us) {
+      cv_.wait_for(lock, std::chrono::microseconds(wake_time_us - now_us));
+      continue;
+    }
+
+    lock.unlock();
+    finish_prefills(now_us);
+    if (!decode_requests_.empty() && next_step_time_us_ <= now_us) {
+      decode_step();
+      next_step_time_us_ =
+          std::max(next_step_time_us_ + options_.decode_step_ms * 1000,
+                   butil::monotonic_time_us());
+    }
+    lock.lock();
+
+    float cache_usage = 0;
+    if (options_.num_cache_blocks > 0) {
+      std::lock_guard<std::mutex> cache_lock(cache_mutex_);
+      cache_usage = static_cast<float>(cached_blocks_.size()) /
+                    options_.num_cache_blocks;
+    }
+    client_->record_load_metrics(prefill_requests_.size(), cache_usage);
+  }
+
+  // fail the requests which have not got their first token yet, the others
+  // are dropped and time out in the service
+  for (auto& request : prefill_requests_) {
+    request->cntl->SetFailed("Mock instance is stopped.");
+    request->done->Run();
+  }
+  prefill_requests_.clear();
+  decode_requests_.clear();
+}
+
+void MockInstance::finish_prefills(int64_t now_us) {
+  std::vector<std::unique_ptr<MockRequest>> requests;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    while (!prefill_requests_.empty() &&
+           prefill_requests_.front()->prefill_done_time_us <= now_us) {
+      requests.emplace_back(std::move(prefill_requests_.front()));
+      prefill_requests_.pop_front();
+    }
+  }
+
+  for (auto& request : requests) {
+    const int64_t send_time_us = butil::monotonic_time_us();
+    const std::string text = std::to_string(request->receive_time_us) + "-" +
+                             std::to_string(send_time_us) + " ";
+    if (request->stream) {
+      request->cntl->response_attachment().append(first_token_chunk(
+          request->service_request_id, request->chat, text));
+    } else {
+      // the service waits for the whole output from the generations
+      request->cntl->response_attachment().append("{}");
+      request->text = text;
+    }
+    request->done->Run();
+    request->cntl = nullptr;
+    request->done = nullptr;
+    request->num_generated_tokens = 1;
+
+    if (decode_requests_.empty()) {
+      next_step_time_us_ = send_time_us + options_.decode_step_ms * 1000;
+    }
+    decode_requests_.emplace_back(std::move(request));
+  }
+}
+
+void MockInstance::decode_step() {
+  const std::string text = std::to_string(butil::monotonic_time_us()) + " ";
+  proto::DisaggStreamGenerations gens;
+  size_t num_decoding = 0;
+  for (auto& request : decode_requests_) {
+    const bool has_token =
+        request->num_generated_tokens < request->num_output_tokens;
+    if (has_token) {
+      request->num_generated_tokens += 1;
+    }
+    const bool finished =
+        request->num_generated_tokens >= request->num_output_tokens;
+    if (!request->stream && !finished) {
+      request->text += text;
+      decode_requests_[num_decoding++] = std::move(request);
+      continue;
+    }
+
+    auto* gen = gens.add_gens();
+    gen->set_req_id(request->service_request_id);
+    gen->set_service_req_id(request->service_request_id);
+    auto* output = gen->add_outputs();
+    output->set_index(0);
+    if (has_token) {
+      output->set_text(request->stream ? text : request->text + text);
+      output->add_token_ids(0);
+    }
+    if (finished) {
+      output->set_finish_reason(kFinishReason);
+      gen->set_finished(true);
+      auto* usage = gen->mutable_usage();
+      usage->set_num_prompt_tokens(request->num_prompt_tokens);
+      usage->set_num_generated_tokens(request->num_generated_tokens);
+      usage->set_num_total_tokens(request->num_prompt_tokens +
+                                  request->num_generated_tokens);
+    } else {
+      decode_requests_[num_decoding++] = std::move(request);
+    }
+  }
+  decode_requests_.resize(num_decoding);
+
+  if (gens.gens_size() == 0) {
+    return;
+  }
+  brpc::Controller cntl;
+  proto::StatusSet resp;
+  master_stub_->Generations(&cntl, &gens, &resp, nullptr);
+  if (cntl.Failed()) {
+    LOG_EVERY_N(WARNING, 100) << options_.name
+                              << " failed to send generations: "
+                              << cntl.ErrorText();
+  }
+}
+
+void MockInstance::record_prompt_caches(const std::vector<int32_t>& token_ids) {
+  if (options_.num_cache_blocks <= 0 || options_.block_size <= 0) {
+    return;
+  }
+  std::vector<std::string> block_keys;
+  Murmur3Key key;
+  const uint8_t* pre_key = nullptr;
+  const Slice<int32_t> tokens(token_ids);
+  for (size_t start = 0; start + options_.block_size <= tokens.size();
+       start += options_.block_size) {
+    murmur_hash3(
+        pre_key, tokens.slice(start, start + options_.block_size), key.data);
+    pre_key = key.data;
+    block_keys.emplace_back(key.to_string());
+  }
+
+  std::vector<std::string> stored;
+  std::vector<std::string> removed;
+  {
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    for (auto& block_key : block_keys) {
+      if (cached_blocks_.insert(block_key).second) {
+        cache_order_.emplace_back(block_key);
+        stored.emplace_back(std::move(block_key));
+      }
+    }
+    while (cache_order_.size() >
+           static_cast<size_t>(options_.num_cache_blocks)) {
+      cached_blocks_.erase(cache_order_.front());
+      removed.emplace_back(std::move(cache_order_.front()));
+      cache_order_.pop_front();
+    }
+  }
+  if (!stored.empty()) {
+    client_->record_stored_cache(stored);
+  }
+  if (!removed.empty()) {
+    client_->record_removed_cache(removed);
+  }
+}
+
+}  // namespace xllm_service
@@ -0,0 +1,153 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#include <brpc/server.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "common/types.h"
+#include "rpc_service/client.h"
+#include "xllm_http_service.pb.h"
+#include "xllm_rpc_service.pb.h"
+
+namespace xllm_service {
+
+struct MockInstanceOptions {
+  // ip:port of the http server, also the name of the instance
+  std::string name;
+  // ip:port of the master rpc server
+  std::string master_rpc_address;
+  InstanceType type = InstanceType::DEFAULT;
+  // time from receiving a request to returning its first token
+  int64_t prefill_time_ms = 20;
+  // time of one decode step, every decoding request gets one token per step
+  int64_t decode_step_ms = 20;
+  // output length of requests without max_tokens
+  int32_t default_output_tokens = 128;
+  // the prompt blocks are reported as stored kv caches, the oldest ones are
+  // reported as removed beyond `num_cache_blocks`. 0 disables the reports.
+  int32_t block_size = 128;
+  int32_t num_cache_blocks = 8192;
+  int32_t heartbeat_interval_ms = 1000;
+};
+
+// An xLLM instance without a model, for measuring the service itself. The
+// forwarded requests get their first token after a fixed prefill time, the
+// following tokens are streamed to the master by Generations rpcs, one rpc
+// per decode step with the tokens of all decoding requests. The instance
+// registers at the master rpc service and reports its kv caches and load
+// through heartbeats, like a real one.
+//
+// The text of every token is the monotonic time in microseconds when it was
+// sent, the first token is "<receive time>-<send time>". A client in the
+// same process can tell from them how long the service took to forward the
+// request and to deliver every token.
+class MockInstance {
+ public:
+  explicit MockInstance(const MockInstanceOptions& options);
+  ~MockInstance();
+
+  // start the http server and register at the master
+  bool start();
+  void stop();
+
+  const std::string& name() const { return options_.name; }
+
+ private:
+  struct MockRequest {
+    std::string service_request_id;
+    bool chat = false;
+    bool stream = false;
+    int32_t num_prompt_tokens = 0;
+    int32_t num_output_tokens = 0;
+    int32_t num_generated_tokens = 0;
+    int64_t receive_time_us = 0;
+    int64_t prefill_done_time_us = 0;
+    // answered with the first token
+    brpc::Controller* cntl = nullptr;
+    google::protobuf::Closure* done = nullptr;
+    // the output of non-stream requests, sent when they finish
+    std::string text;
+  };
+
+  class HttpService : public proto::XllmHttpService {
+   public:
+    explicit HttpService(MockInstance* instance) : instance_(instance) {}
+
+    void Completions(google::protobuf::RpcController* cntl_base,
+                     const proto::HttpRequest* req,
+                     proto::HttpResponse* resp,
+                     google::protobuf::Closure* done) override;
+
+    void ChatCompletions(google::protobuf::RpcController* cntl_base,
+                         const proto::HttpRequest* req,
+                         proto::HttpResponse* resp,
+                         google::protobuf::Closure* done) override;
+
+   private:
+    MockInstance* instance_;
+  };
+
+  void add_request(brpc::Controller* cntl,
+                   google::protobuf::Closure* done,
+                   bool chat);
+
+  void run();
+
+  // answer the requests whose prefill is done with their first token
+  void finish_prefills(int64_t now_us);
+
+  // generate one token for every decoding request
+  void decode_step();
+
+  void record_prompt_caches(const std::vector<int32_t>& token_ids);
+
+ private:
+  MockInstanceOptions options_;
+  HttpService http_service_;
+  brpc::Server server_;
+  brpc::Channel master_channel_;
+  std::unique_ptr<proto::XllmRpcService_Stub> master_stub_;
+  std::unique_ptr<XllmRpcClient> client_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool exited_ = false;
+  // in order of arrival, every prefill takes the same time
+  std::deque<std::unique_ptr<MockRequest>> prefill_requests_;
+  std::unique_ptr<std::thread> thread_;
+
+  // only accessed by `thread_`
+  std::vector<std::unique_ptr<MockRequest>> decode_requests_;
+  int64_t next_step_time_us_ = 0;
+
+  std::mutex cache_mutex_;
+  std::unordered_set<std::string> cached_blocks_;
+  // oldest first
+  std::deque<std::string> cache_order_;
+};
+
+}  // namespace xllm_service
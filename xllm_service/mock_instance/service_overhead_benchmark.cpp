@@ -0,0 +1,454 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// Runs the whole master in process against mock instances and measures the
+// time the service adds to every request and every token. The mocks stamp
+// the text of every token with the time it was sent, the clients compare
+// them with the times they send the requests and receive the tokens:
+//
+//   forward:     client sends the request -> the instance receives it
+//   first token: the instance sends the first token -> the client gets it
+//   token:       the instance sends a later token -> the client gets it
+//
+// The master keeps its metadata in memory unless --metadata_store says
+// otherwise, and needs the tokenizer at --tokenizer_path like in production.
+
+#include <brpc/channel.h>
+#include <brpc/progressive_reader.h>
+#include <butil/time.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common/global_gflags.h"
+#include "common/options.h"
+#include "master.h"
+#include "mock_instance.h"
+
+DEFINE_int32(num_mock_instances, 4, "Number of mock instances.");
+DEFINE_int32(mock_base_port,
+             28000,
+             "Port of the first mock instance, the others take the next "
+             "ports.");
+DEFINE_int32(prefill_time_ms, 10, "Time to the first token of a request.");
+DEFINE_int32(decode_step_ms, 10, "Time between two tokens of a request.");
+DEFINE_int32(mock_cache_blocks,
+             8192,
+             "Number of kv cache blocks reported by a mock instance.");
+DEFINE_int32(mock_heartbeat_interval_ms,
+             500,
+             "Heartbeat interval of the mock instances.");
+DEFINE_int32(concurrency, 32, "Number of clients sending requests in turn.");
+DEFINE_int32(num_requests, 2000, "Number of measured requests.");
+DEFINE_int32(warmup_requests, 200, "Number of requests before measuring.");
+DEFINE_int32(prompt_words, 512, "Number of words of a prompt.");
+DEFINE_int32(num_prefixes,
+             8,
+             "Number of prefixes shared by the prompts, a prefix is half of "
+             "a prompt.");
+DEFINE_int32(output_tokens, 32, "max_tokens of the requests.");
+DEFINE_bool(stream, true, "Stream the responses.");
+DEFINE_bool(chat, false, "Send chat completions instead of completions.");
+
+namespace xllm_service {
+namespace {
+
+// times of one request, the first token time is only known for streams
+struct RequestTimes {
+  int64_t forward_us = -1;
+  int64_t first_token_us = -1;
+  std::vector<int64_t> token_us;
+  int64_t num_tokens = 0;
+  bool failed = false;
+};
+
+// the text of a chunk, or empty if it has none
+std::string chunk_text(const nlohmann::json& chunk) {
+  if (!chunk.contains("choices") || !chunk["choices"].is_array() ||
+      chunk["choices"].empty()) {
+    return "";
+  }
+  const auto& choice = chunk["choices"][0];
+  if (choice.contains("text") && choice["text"].is_string()) {
+    return choice["text"].get<std::string>();
+  }
+  for (const char* field : {"delta", "message"}) {
+    if (choice.contains(field) && choice[field].contains("content") &&
+        choice[field]["content"].is_string()) {
+      return choice[field]["content"].get<std::string>();
+    }
+  }
+  return "";
+}
+
+// the text is a list of send times, the first one prefixed by the receive
+// time of the request
+void record_token_times(const std::string& text,
+                        int64_t send_time_us,
+                        int64_t now_us,
+                        RequestTimes* times) {
+  size_t begin = 0;
+  while (begin < text.size()) {
+    size_t end = text.find(' ', begin);
+    if (end == std::string::npos) {
+      end = text.size();
+    }
+    const std::string token = text.substr(begin, end - begin);
+    begin = end + 1;
+    if (token.empty()) {
+      continue;
+    }
+    const size_t dash = token.find('-');
+    if (dash != std::string::npos) {
+      const int64_t receive_us = std::stoll(token.substr(0, dash));
+      const int64_t first_send_us = std::stoll(token.substr(dash + 1));
+      times->forward_us = receive_us - send_time_us;
+      times->first_token_us = now_us - first_send_us;
+    } else {
+      times->token_us.emplace_back(now_us - std::stoll(token));
+    }
+    times->num_tokens += 1;
+  }
+}
+
+class StreamReader : public brpc::ProgressiveReader {
+ public:
+  StreamReader(int64_t send_time_us, RequestTimes* times)
+      : send_time_us_(send_time_us), times_(times) {}
+
+  butil::Status OnReadOnePart(const void* data, size_t length) override {
+    const int64_t now_us = butil::monotonic_time_us();
+    buffer_.append(static_cast<const char*>(data), length);
+    size_t end = buffer_.find("\n\n");
+    while (end != std::string::npos) {
+      on_event(buffer_.substr(0, end), now_us);
+      buffer_.erase(0, end + 2);
+      end = buffer_.find("\n\n");
+    }
+    return butil::Status::OK();
+  }
+
+  void OnEndOfMessage(const butil::Status& status) override {
+    if (!status.ok() || !done_) {
+      times_->failed = true;
+    }
+    finished_.set_value();
+  }
+
+  void wait() { finished_.get_future().wait(); }
+
+ private:
+  void on_event(const std::string& event, int64_t now_us) {
+    const std::string prefix = "data: ";
+    if (event.compare(0, prefix.size(), prefix) != 0) {
+      times_->failed = true;
+      return;
+    }
+    if (event.compare(prefix.size(), std::string::npos, "[DONE]") == 0) {
+      done_ = true;
+      return;
+    }
+    auto chunk = nlohmann::json::parse(
+        event.begin() + prefix.size(), event.end(), nullptr, false);
+    if (chunk.is_discarded()) {
+      times_->failed = true;
+      return;
+    }
+    record_token_times(chunk_text(chunk), send_time_us_, now_us, times_);
+  }
+
+  int64_t send_time_us_;
+  RequestTimes* times_;
+  std::string buffer_;
+  bool done_ = false;
+  std::promise<void> finished_;
+};
+
+std::string random_words(int32_t num_words, std::mt19937_64* rng) {
+  std::uniform_int_distribution<int32_t> word(0, 9999);
+  std::string text;
+  for (int32_t i = 0; i < num_words; ++i) {
+    text += "w" + std::to_string(word(*rng)) + " ";
+  }
+  return text;
+}
+
+class Client {
+ public:
+  explicit Client(brpc::Channel* channel) : channel_(channel) {
+    std::mt19937_64 rng(0);
+    for (int32_t i = 0; i < FLAGS_num_prefixes; ++i) {
+      prefixes_.emplace_back(random_words(FLAGS_prompt_words / 2, &rng));
+    }
+  }
+
+  // send `num_requests` requests from `FLAGS_concurrency` clients, every
+  // client sends its next request once the last one is finished
+  std::vector<RequestTimes> run(int32_t num_requests) {
+    std::vector<RequestTimes> times(num_requests);
+    std::atomic<int32_t> next_request = 0;
+    std::vector<std::thread> threads;
+    for (int32_t i = 0; i < FLAGS_concurrency; ++i) {
+      threads.emplace_back([&]() {
+        std::mt19937_64 rng(next_seed_.fetch_add(1));
+        int32_t index = next_request.fetch_add(1);
+        while (index < num_requests) {
+          send(build_prompt(&rng), &times[index]);
+          index = next_request.fetch_add(1);
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    return times;
+  }
+
+ private:
+  std::string build_prompt(std::mt19937_64* rng) {
+    std::string prompt;
+    if (!prefixes_.empty()) {
+      std::uniform_int_distribution<size_t> prefix(0, prefixes_.size() - 1);
+      prompt = prefixes_[prefix(*rng)];
+    }
+    return prompt + random_words(FLAGS_prompt_words / 2, rng);
+  }
+
+  void send(const std::string& prompt, RequestTimes* times) {
+    nlohmann::json body;
+    body["model"] = "mock";
+    body["max_tokens"] = FLAGS_output_tokens;
+    body["stream"] = FLAGS_stream;
+    if (FLAGS_chat) {
+      body["messages"] = nlohmann::json::array(
+          {{{"role", "user"}, {"content", prompt}}});
+    } else {
+      body["prompt"] = prompt;
+    }
+
+    brpc::Controller cntl;
+    cntl.http_request().uri() =
+        FLAGS_chat ? "/v1/chat/completions" : "/v1/completions";
+    cntl.http_request().set_method(brpc::HTTP_METHOD_POST);
+    cntl.request_attachment().append(body.dump());
+    if (FLAGS_stream) {
+      cntl.response_will_be_read_progressively();
+    }
+    const int64_t send_time_us = butil::monotonic_time_us();
+    channel_->CallMethod(nullptr, &cntl, nullptr, nullptr, nullptr);
+    if (cntl.Failed()) {
+      times->failed = true;
+      LOG_EVERY_N(WARNING, 100) << "Request failed: " << cntl.ErrorText();
+      return;
+    }
+    if (FLAGS_stream) {
+      auto reader = std::make_unique<StreamReader>(send_time_us, times);
+      cntl.ReadProgressiveAttachmentBy(reader.get());
+      reader->wait();
+      return;
+    }
+
+    auto response = nlohmann::json::parse(
+        cntl.response_attachment().to_string(), nullptr, false);
+    if (response.is_discarded()) {
+      times->failed = true;
+      return;
+    }
+    // all tokens arrive together, only the last one tells the delivery time
+    record_token_times(chunk_text(response),
+                       send_time_us,
+                       butil::monotonic_time_us(),
+                       times);
+    times->first_token_us = -1;
+    if (!times->token_us.empty()) {
+      times->token_us = {times->token_us.back()};
+    }
+  }
+
+  brpc::Channel* channel_;
+  std::vector<std::string> prefixes_;
+  std::atomic<uint64_t> next_seed_ = 1;
+};
+
+int64_t cpu_time_us() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000L +
+         usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+void print_latency(const char* name, std::vector<int64_t> values) {
+  if (values.empty()) {
+    std::printf("%-12s no samples\n", name);
+    return;
+  }
+  std::sort(values.begin(), values.end());
+  double sum = 0;
+  for (int64_t value : values) {
+    sum += value;
+  }
+  auto percentile = [&](double p) {
+    return values[std::min(values.size() - 1,
+                           static_cast<size_t>(p * values.size()))];
+  };
+  std::printf("%-12s(us) mean %8.1f  p50 %7ld  p90 %7ld  p99 %7ld\n",
+              name,
+              sum / values.size(),
+              percentile(0.5),
+              percentile(0.9),
+              percentile(0.99));
+}
+
+Options master_options() {
+  Options options;
+  options.server_host("127.0.0.1")
+      .http_port(FLAGS_http_server_port)
+      .http_idle_timeout_s(FLAGS_http_server_idle_timeout_s)
+      .http_num_threads(FLAGS_http_server_num_threads)
+      .http_max_concurrency(FLAGS_http_server_max_concurrency)
+      .rpc_port(FLAGS_rpc_server_port)
+      .rpc_idle_timeout_s(FLAGS_rpc_server_idle_timeout_s)
+      .rpc_num_threads(FLAGS_rpc_server_num_threads)
+      .rpc_max_concurrency(FLAGS_rpc_server_max_concurrency)
+      .num_threads(FLAGS_num_threads)
+      .max_concurrency(FLAGS_max_concurrency)
+      .timeout_ms(FLAGS_timeout_ms)
+      .connect_timeout_ms(FLAGS_connect_timeout_ms)
+      .etcd_addr(FLAGS_etcd_addr)
+      .metadata_store(FLAGS_metadata_store)
+      .metadata_store_path(FLAGS_metadata_store_path)
+      .load_balance_policy(FLAGS_load_balance_policy)
+      .murmur_hash3_seed(FLAGS_murmur_hash3_seed)
+      .service_name("127.0.0.1:" + std::to_string(FLAGS_rpc_server_port))
+      .detect_disconnected_instance_interval(
+          FLAGS_detect_disconnected_instance_interval)
+      .enable_request_trace(false)
+      .block_size(FLAGS_block_size)
+      .tokenizer_path(FLAGS_tokenizer_path);
+  return options;
+}
+
+}  // namespace
+}  // namespace xllm_service
+
+int main(int argc, char* argv[]) {
+  // measure the service without an etcd round trip per heartbeat
+  gflags::SetCommandLineOptionWithMode(
+      "metadata_store", "memory", gflags::SET_FLAGS_DEFAULT);
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  using namespace xllm_service;
+
+  Master master(master_options());
+  if (!master.start()) {
+    LOG(ERROR) << "Failed to start master.";
+    return -1;
+  }
+
+  MockInstanceOptions mock_options;
+  mock_options.master_rpc_address =
+      "127.0.0.1:" + std::to_string(FLAGS_rpc_server_port);
+  mock_options.prefill_time_ms = FLAGS_prefill_time_ms;
+  mock_options.decode_step_ms = FLAGS_decode_step_ms;
+  mock_options.block_size = FLAGS_block_size;
+  mock_options.num_cache_blocks = FLAGS_mock_cache_blocks;
+  mock_options.heartbeat_interval_ms = FLAGS_mock_heartbeat_interval_ms;
+  std::vector<std::unique_ptr<MockInstance>> instances;
+  for (int32_t i = 0; i < FLAGS_num_mock_instances; ++i) {
+    mock_options.name = "127.0.0.1:" + std::to_string(FLAGS_mock_base_port + i);
+    instances.emplace_back(std::make_unique<MockInstance>(mock_options));
+    if (!instances.back()->start()) {
+      return -1;
+    }
+  }
+  // let the master get the load of every instance before routing
+  std::this_thread::sleep_for(
+      std::chrono::milliseconds(2 * FLAGS_mock_heartbeat_interval_ms));
+
+  brpc::Channel channel;
+  brpc::ChannelOptions channel_options;
+  channel_options.protocol = "http";
+  channel_options.connection_type = "pooled";
+  channel_options.timeout_ms = FLAGS_timeout_ms;
+  channel_options.max_retry = 0;
+  const std::string http_address =
+      "127.0.0.1:" + std::to_string(FLAGS_http_server_port);
+  if (channel.Init(http_address.c_str(), "", &channel_options) != 0) {
+    LOG(ERROR) << "Failed to initialize channel to " << http_address;
+    return -1;
+  }
+
+  Client client(&channel);
+  client.run(FLAGS_warmup_requests);
+
+  const int64_t start_cpu_us = cpu_time_us();
+  const int64_t start_us = butil::monotonic_time_us();
+  const auto times = client.run(FLAGS_num_requests);
+  const int64_t duration_us = butil::monotonic_time_us() - start_us;
+  const int64_t cpu_us = cpu_time_us() - start_cpu_us;
+
+  std::vector<int64_t> forward_us;
+  std::vector<int64_t> first_token_us;
+  std::vector<int64_t> token_us;
+  int64_t num_failed = 0;
+  int64_t num_tokens = 0;
+  for (const auto& request_times : times) {
+    if (request_times.failed || request_times.forward_us < 0) {
+      num_failed += 1;
+      continue;
+    }
+    forward_us.emplace_back(request_times.forward_us);
+    if (request_times.first_token_us >= 0) {
+      first_token_us.emplace_back(request_times.first_token_us);
+    }
+    token_us.insert(token_us.end(),
+                    request_times.token_us.begin(),
+                    request_times.token_us.end());
+    num_tokens += request_times.num_tokens;
+  }
+
+  std::printf("instances: %d, concurrency: %d, requests: %d, failed: %ld\n",
+              FLAGS_num_mock_instances,
+              FLAGS_concurrency,
+              FLAGS_num_requests,
+              num_failed);
+  std::printf("throughput: %.1f req/s, %.1f tok/s\n",
+              FLAGS_num_requests * 1e6 / std::max<int64_t>(duration_us, 1),
+              num_tokens * 1e6 / std::max<int64_t>(duration_us, 1));
+  print_latency("forward", forward_us);
+  print_latency("first token", first_token_us);
+  print_latency("token", token_us);
+  // the cpu time of the process includes the mocks and the clients
+  std::printf("process cpu: %.1f us/request, %.1f us/token\n",
+              static_cast<double>(cpu_us) / std::max(FLAGS_num_requests, 1),
+              static_cast<double>(cpu_us) / std::max<int64_t>(num_tokens, 1));
+
+  instances.clear();
+  master.stop();
+  return 0;
+}
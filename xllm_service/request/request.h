@@ -15,9 +15,12 @@ limitations under the License.
 
 #pragma once
 
+#include <atomic>
+
 #include "chat_template/jinja_chat_template.h"
 #include "common/types.h"
 #include "common/xllm/output.h"
+#include "request/request_stages.h"
 
 namespace xllm_service {
 
@@ -49,12 +52,50 @@ struct Request {
   // instance routing
   Routing routing;
 
+  // prefix match of the routing policy, reused to select the data parallel
+  // ranks. Only valid if `prefix_matched` is set.
+  OverlapScores overlap_scores;
+  bool prefix_matched = false;
+
   // the number of generated tokens
   int64_t num_generated_tokens = 0;
 
   // the estimated TTFT obtained from the TTFT predictor
   int64_t estimated_ttft = 0;
 
+  // the max number of tokens to generate, 0 means not set by the client
+  int64_t max_tokens = 0;
+
+  // requests of higher priority leave the admission queue first
+  int32_t priority = 0;
+
+  // identifies the session of the request, the requests of a session are
+  // routed to the same instance by the CONSISTENT_HASH policy. Empty if the
+  // client does not set it.
+  std::string session_key;
+
+  // whether the prefill instance has returned the first response
+  bool prefill_finished = false;
+
+  // when the request arrives at the service, is dispatched to the instances,
+  // is forwarded to the prefill instance and when the latest token is
+  // received, used to measure the latencies. In microseconds.
+  int64_t arrival_time_us = 0;
+  int64_t schedule_time_us = 0;
+  int64_t forward_time_us = 0;
+  int64_t last_token_time_us = 0;
+
+  // inter-token latencies not used to refit the tpot predictor yet, in
+  // microseconds. Guarded by the request lock of the scheduler.
+  int64_t pending_tbt_us = 0;
+  int32_t num_pending_tbt = 0;
+
+  // the time spent in every stage of the service
+  RequestStageTimer stages;
+
+  // set when the client goes away before the request is finished
+  std::atomic_bool cancelled = false;
+
   // output callback
   OutputCallback output_callback;
 
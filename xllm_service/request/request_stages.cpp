@@ -0,0 +1,88 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "request/request_stages.h"
+
+#include <butil/time.h>
+#include <bvar/bvar.h>
+
+#include <string>
+
+namespace xllm_service {
+
+namespace {
+constexpr const char* kStageNames[] = {"parse",
+                                       "chat_template",
+                                       "tokenize",
+                                       "admission",
+                                       "prefix_match",
+                                       "routing",
+                                       "serialize",
+                                       "dispatch",
+                                       "first_response"};
+static_assert(sizeof(kStageNames) / sizeof(kStageNames[0]) ==
+                  RequestStageTimer::kNumStages,
+              "every stage needs a name");
+
+bvar::LatencyRecorder& stage_latency(RequestStage stage) {
+  // never destroyed, requests may end stages while the process exits
+  static bvar::LatencyRecorder* recorders = []() {
+    auto* recorders = new bvar::LatencyRecorder[RequestStageTimer::kNumStages];
+    for (size_t i = 0; i < RequestStageTimer::kNumStages; ++i) {
+      recorders[i].expose(std::string("xllm_service_stage_") + kStageNames[i]);
+    }
+    return recorders;
+  }();
+  return recorders[static_cast<size_t>(stage)];
+}
+}  // namespace
+
+const char* request_stage_name(RequestStage stage) {
+  return kStageNames[static_cast<size_t>(stage)];
+}
+
+void RequestStageTimer::end(RequestStage stage) {
+  if (last_ns_ == 0) {
+    return;
+  }
+  const int64_t now_ns = butil::cpuwide_time_ns();
+  const int64_t elapsed_ns = now_ns - last_ns_;
+  last_ns_ = now_ns;
+  stage_ns_[static_cast<size_t>(stage)] = elapsed_ns;
+  stage_latency(stage) << elapsed_ns / 1000;
+}
+
+int64_t RequestStageTimer::stage_us(RequestStage stage) const {
+  const int64_t elapsed_ns = stage_ns_[static_cast<size_t>(stage)];
+  return elapsed_ns < 0 ? -1 : elapsed_ns / 1000;
+}
+
+std::string RequestStageTimer::to_string() const {
+  std::string result;
+  for (size_t i = 0; i < kNumStages; ++i) {
+    if (stage_ns_[i] < 0) {
+      continue;
+    }
+    if (!result.empty()) {
+      result += ';';
+    }
+    result += kStageNames[i];
+    result += '=';
+    result += std::to_string(stage_ns_[i] / 1000);
+  }
+  return result;
+}
+
+}  // namespace xllm_service
@@ -0,0 +1,80 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+namespace xllm_service {
+
+// The stages of a request in the service, in the order they run. The time of
+// a stage is the time since the previous stage ended, skipped stages are
+// counted in the next one.
+enum class RequestStage : int32_t {
+  // parse the http body, from the arrival of the request
+  PARSE = 0,
+  CHAT_TEMPLATE,
+  TOKENIZE,
+  // wait in the admission queue
+  ADMISSION,
+  // match the prompt against the global kv cache index, when the scheduler
+  // does it before the load balance policy. Otherwise the policy matches it
+  // as part of the routing.
+  PREFIX_MATCH,
+  // the load balance policy and the data parallel ranks
+  ROUTING,
+  // rebuild the request json for the instance
+  SERIALIZE,
+  // record the request and wait for a thread to forward it
+  DISPATCH,
+  // from forwarding the request to the first response of the prefill
+  // instance
+  FIRST_RESPONSE,
+  NUM_STAGES,
+};
+
+const char* request_stage_name(RequestStage stage);
+
+// Times the stages of a request with the TSC based butil::cpuwide_time_ns(),
+// which costs a few nanoseconds. Every ended stage is also recorded in the
+// `xllm_service_stage_<name>` latency recorder in microseconds. The stages
+// may end on different threads, one after the other.
+class RequestStageTimer final {
+ public:
+  static constexpr size_t kNumStages =
+      static_cast<size_t>(RequestStage::NUM_STAGES);
+
+  RequestStageTimer() { stage_ns_.fill(-1); }
+
+  // the stages are not timed before
+  void start(int64_t now_ns) { last_ns_ = now_ns; }
+
+  void end(RequestStage stage);
+
+  // in microseconds, -1 if the stage has not ended
+  int64_t stage_us(RequestStage stage) const;
+
+  // the ended stages in microseconds, like "parse=12;tokenize=340"
+  std::string to_string() const;
+
+ private:
+  // when the latest stage ended, 0 before `start`
+  int64_t last_ns_ = 0;
+  std::array<int64_t, kNumStages> stage_ns_;
+};
+
+}  // namespace xllm_service
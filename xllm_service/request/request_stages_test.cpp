@@ -0,0 +1,51 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "request_stages.h"
+
+#include <butil/time.h>
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <thread>
+
+namespace xllm_service::test {
+
+TEST(RequestStageTimerTest, TimeStagesSincePreviousStage) {
+  RequestStageTimer timer;
+  // nothing is timed before the timer starts
+  timer.end(RequestStage::PARSE);
+  EXPECT_EQ(-1, timer.stage_us(RequestStage::PARSE));
+  EXPECT_EQ("", timer.to_string());
+
+  timer.start(butil::cpuwide_time_ns());
+  timer.end(RequestStage::PARSE);
+  std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  // the chat template is skipped, tokenization takes its time
+  timer.end(RequestStage::TOKENIZE);
+
+  EXPECT_GE(timer.stage_us(RequestStage::PARSE), 0);
+  EXPECT_LT(timer.stage_us(RequestStage::PARSE), 5000);
+  EXPECT_EQ(-1, timer.stage_us(RequestStage::CHAT_TEMPLATE));
+  EXPECT_GE(timer.stage_us(RequestStage::TOKENIZE), 5000);
+  EXPECT_EQ("parse=" + std::to_string(timer.stage_us(RequestStage::PARSE)) +
+                ";tokenize=" +
+                std::to_string(timer.stage_us(RequestStage::TOKENIZE)),
+            timer.to_string());
+  EXPECT_STREQ("first_response",
+               request_stage_name(RequestStage::FIRST_RESPONSE));
+}
+
+}  // namespace xllm_service::test
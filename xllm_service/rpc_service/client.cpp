@@ -15,11 +15,68 @@ limitations under the License.
 
 #include "rpc_service/client.h"
 
+#include <butil/object_pool.h>
+#include <bvar/bvar.h>
 #include <glog/logging.h>
 
+#include <algorithm>
+#include <map>
+#include <string_view>
+#include <unordered_map>
+
+#include "common/hash_util.h"
+#include "common/macros.h"
+
 namespace {
-// magic number, TODO: move to config file or env var
-constexpr int32_t kHeartbeatInterval = 3;  // in seconds
+// Send the full load metrics every `kFullSyncHeartbeats` heartbeats even if
+// they do not change, so that a new master gets them in time.
+constexpr uint64_t kFullSyncHeartbeats = 10;
+
+// Multiple offloads of a block in one batch are kept, hbm -> dram -> ssd.
+constexpr int8_t kMaxOffloadTimes = 2;
+
+// Pooled events keep the buffer of their keys up to this size.
+constexpr size_t kMaxPooledHashKeysBytes =
+    256 * xllm_service::MURMUR_HASH3_VALUE_LEN;
+
+bvar::Adder<int64_t> g_dropped_cache_events(
+    "xllm_service_client_dropped_cache_events");
+
+struct NetCacheEvent {
+  bool removed = false;
+  bool stored = false;
+  int8_t offload_times = 0;
+  // the event which decided the net change, blocks of the same event with the
+  // same net change are sent as one range.
+  const void* source = nullptr;
+};
+
+// A key shorter than a murmur3 hash would shift all keys packed after it,
+// it is dropped. Longer keys are cut to the hash length.
+void append_hash_key(const std::string& hash_key, std::string* packed) {
+  if (hash_key.size() < xllm_service::MURMUR_HASH3_VALUE_LEN) {
+    LOG_EVERY_N(ERROR, 1000) << "Drop the cache event of a hash key of "
+                             << hash_key.size() << " bytes";
+    return;
+  }
+  packed->append(hash_key, 0, xllm_service::MURMUR_HASH3_VALUE_LEN);
+}
+
+void pack_hash_keys(const std::vector<std::string>& hash_keys,
+                    std::string* packed) {
+  packed->reserve(hash_keys.size() * xllm_service::MURMUR_HASH3_VALUE_LEN);
+  for (const auto& hash_key : hash_keys) {
+    append_hash_key(hash_key, packed);
+  }
+}
+
+void update_max(std::atomic<int64_t>* max_value, int64_t value) {
+  int64_t current = max_value->load(std::memory_order_relaxed);
+  while (value > current &&
+         !max_value->compare_exchange_weak(
+             current, value, std::memory_order_relaxed)) {
+  }
+}
 }  // namespace
 
 namespace xllm_service {
@@ -27,7 +84,9 @@ namespace xllm_service {
 XllmRpcClient::XllmRpcClient(const std::string& instace_name,
                              const std::string& master_addr,
                              const ChannelOptions& options)
-    : instance_name_(instace_name), master_addr_(master_addr) {
+    : instance_name_(instace_name),
+      master_addr_(master_addr),
+      options_(options) {
   brpc::ChannelOptions chan_options;
   chan_options.protocol = options.protocol;
   chan_options.connection_type = options.connection_type;
@@ -48,31 +107,373 @@ XllmRpcClient::XllmRpcClient(const std::string& instace_name,
 
 XllmRpcClient::~XllmRpcClient() {
   exited_ = true;
+  flush();
   if (heartbeat_thread_) {
     heartbeat_thread_->join();
   }
+
+  CacheEventNode* node = cache_events_.exchange(nullptr);
+  while (node != nullptr) {
+    CacheEventNode* next = node->next;
+    release_cache_event(node);
+    node = next;
+  }
+}
+
+XllmRpcClient::CacheEventNode* XllmRpcClient::new_cache_event() {
+  CacheEventNode* node = butil::get_object<CacheEventNode>();
+  node->hash_keys.clear();
+  node->next = nullptr;
+  return node;
+}
+
+void XllmRpcClient::release_cache_event(CacheEventNode* node) {
+  if (node->hash_keys.capacity() > kMaxPooledHashKeysBytes) {
+    std::string().swap(node->hash_keys);
+  }
+  butil::return_object(node);
+}
+
+void XllmRpcClient::record_stored_cache(const std::string& hash_key,
+                                        int32_t dp_rank) {
+  CacheEventNode* node = new_cache_event();
+  append_hash_key(hash_key, &node->hash_keys);
+  record_cache_event(KvCacheEventType::STORED, dp_rank, node);
+}
+
+void XllmRpcClient::record_offload_cache(const std::string& hash_key,
+                                         int32_t dp_rank) {
+  CacheEventNode* node = new_cache_event();
+  append_hash_key(hash_key, &node->hash_keys);
+  record_cache_event(KvCacheEventType::OFFLOAD, dp_rank, node);
+}
+
+void XllmRpcClient::record_removed_cache(const std::string& hash_key,
+                                         int32_t dp_rank) {
+  CacheEventNode* node = new_cache_event();
+  append_hash_key(hash_key, &node->hash_keys);
+  record_cache_event(KvCacheEventType::REMOVED, dp_rank, node);
+}
+
+void XllmRpcClient::record_stored_cache(
+    const std::vector<std::string>& hash_keys,
+    int32_t dp_rank) {
+  CacheEventNode* node = new_cache_event();
+  pack_hash_keys(hash_keys, &node->hash_keys);
+  record_cache_event(KvCacheEventType::STORED, dp_rank, node);
+}
+
+void XllmRpcClient::record_offload_cache(
+    const std::vector<std::string>& hash_keys,
+    int32_t dp_rank) {
+  CacheEventNode* node = new_cache_event();
+  pack_hash_keys(hash_keys, &node->hash_keys);
+  record_cache_event(KvCacheEventType::OFFLOAD, dp_rank, node);
+}
+
+void XllmRpcClient::record_removed_cache(
+    const std::vector<std::string>& hash_keys,
+    int32_t dp_rank) {
+  CacheEventNode* node = new_cache_event();
+  pack_hash_keys(hash_keys, &node->hash_keys);
+  record_cache_event(KvCacheEventType::REMOVED, dp_rank, node);
+}
+
+void XllmRpcClient::record_cache_event(KvCacheEventType type,
+                                       int32_t dp_rank,
+                                       CacheEventNode* node) {
+  const int64_t num_blocks = node->hash_keys.size() / MURMUR_HASH3_VALUE_LEN;
+  if (num_blocks == 0) {
+    release_cache_event(node);
+    return;
+  }
+  node->type = type;
+  node->dp_rank = std::max(dp_rank, -1);
+  node->next = cache_events_.load(std::memory_order_relaxed);
+  while (!cache_events_.compare_exchange_weak(node->next,
+                                              node,
+                                              std::memory_order_release,
+                                              std::memory_order_relaxed)) {
+  }
+
+  int64_t num_pending =
+      num_pending_events_.fetch_add(num_blocks, std::memory_order_relaxed);
+  if (num_pending < options_.max_batch_events &&
+      num_pending + num_blocks >= options_.max_batch_events) {
+    flush();
+  }
+}
+
+void XllmRpcClient::record_load_metrics(uint64_t waiting_requests_num,
+                                        float gpu_cache_usage_perc) {
+  waiting_requests_num_.store(waiting_requests_num, std::memory_order_relaxed);
+  gpu_cache_usage_perc_.store(gpu_cache_usage_perc, std::memory_order_relaxed);
+}
+
+void XllmRpcClient::record_latency(int64_t ttft, int64_t tbt) {
+  update_max(&recent_max_ttft_, ttft);
+  update_max(&recent_max_tbt_, tbt);
+}
+
+void XllmRpcClient::flush() {
+  {
+    std::lock_guard<std::mutex> lock(flush_mutex_);
+    flush_requested_ = true;
+  }
+  flush_cv_.notify_one();
+}
+
+int64_t XllmRpcClient::collect_cache_events(proto::HeartbeatRequest* req,
+                                            int64_t max_events) {
+  CacheEventNode* head =
+      cache_events_.exchange(nullptr, std::memory_order_acquire);
+
+  // the list is newest first, reverse it into one list per rank to apply
+  // events in record order.
+  struct RankEvents {
+    CacheEventNode* nodes = nullptr;
+    int64_t num_events = 0;
+  };
+  std::map<int32_t, RankEvents> rank_events;
+  int64_t num_events = 0;
+  int64_t num_dropped = 0;
+  while (head != nullptr) {
+    CacheEventNode* next = head->next;
+    const int64_t num_blocks = head->hash_keys.size() / MURMUR_HASH3_VALUE_LEN;
+    if (num_events + num_blocks > max_events) {
+      num_dropped += num_blocks;
+      release_cache_event(head);
+      head = next;
+      continue;
+    }
+    auto& events = rank_events[head->dp_rank];
+    head->next = events.nodes;
+    events.nodes = head;
+    events.num_events += num_blocks;
+    num_events += num_blocks;
+    head = next;
+  }
+  num_pending_events_.fetch_sub(num_events + num_dropped,
+                                std::memory_order_relaxed);
+  if (num_dropped > 0) {
+    g_dropped_cache_events << num_dropped;
+    LOG(WARNING) << instance_name_ << " dropped " << num_dropped
+                 << " cache events the master has not taken";
+  }
+
+  for (auto& [dp_rank, events] : rank_events) {
+    proto::KvCacheEvent* event = nullptr;
+    if (dp_rank < 0) {
+      event = req->mutable_cache_event();
+    } else {
+      event = req->add_dp_cache_events();
+      event->set_dp_rank(dp_rank);
+    }
+    fold_cache_events(events.nodes, events.num_events, event);
+
+    while (events.nodes != nullptr) {
+      CacheEventNode* next = events.nodes->next;
+      release_cache_event(events.nodes);
+      events.nodes = next;
+    }
+  }
+  return num_events;
+}
+
+void XllmRpcClient::fold_cache_events(const CacheEventNode* nodes,
+                                      int64_t num_events,
+                                      proto::KvCacheEvent* event) {
+  // keys point into the nodes, which are released after folding.
+  std::unordered_map<std::string_view, NetCacheEvent> net_events;
+  net_events.reserve(num_events);
+  for (auto* node = nodes; node != nullptr; node = node->next) {
+    std::string_view hash_keys(node->hash_keys);
+    for (size_t pos = 0; pos + MURMUR_HASH3_VALUE_LEN <= hash_keys.size();
+         pos += MURMUR_HASH3_VALUE_LEN) {
+      auto& net_event =
+          net_events[hash_keys.substr(pos, MURMUR_HASH3_VALUE_LEN)];
+      switch (node->type) {
+        case KvCacheEventType::STORED:
+          net_event = NetCacheEvent{false, true, 0, node};
+          break;
+        case KvCacheEventType::OFFLOAD:
+          if (!net_event.removed &&
+              net_event.offload_times < kMaxOffloadTimes) {
+            ++net_event.offload_times;
+          }
+          break;
+        case KvCacheEventType::REMOVED:
+          net_event = NetCacheEvent{true, false, 0, node};
+          break;
+      }
+    }
+  }
+
+  // The master applies stored, offload and removed events in this order, so
+  // only the net change of every block is sent. Stored and removed blocks are
+  // grouped back into the ranges they were recorded with, a range is split
+  // where a block was changed again by a later event.
+  for (auto* node = nodes; node != nullptr; node = node->next) {
+    if (node->type == KvCacheEventType::OFFLOAD) {
+      continue;
+    }
+    const bool removed = node->type == KvCacheEventType::REMOVED;
+    std::string_view hash_keys(node->hash_keys);
+    size_t range_begin = 0;
+    size_t range_end = 0;
+    auto add_range = [&]() {
+      auto range = hash_keys.substr(range_begin, range_end - range_begin);
+      if (range.empty()) {
+        return;
+      }
+      const bool single = range.size() == MURMUR_HASH3_VALUE_LEN;
+      if (removed) {
+        single ? event->add_removed_cache(range.data(), range.size())
+               : event->add_removed_ranges(range.data(), range.size());
+      } else {
+        single ? event->add_stored_cache(range.data(), range.size())
+               : event->add_stored_ranges(range.data(), range.size());
+      }
+    };
+    for (size_t pos = 0; pos + MURMUR_HASH3_VALUE_LEN <= hash_keys.size();
+         pos += MURMUR_HASH3_VALUE_LEN) {
+      auto& net_event =
+          net_events.at(hash_keys.substr(pos, MURMUR_HASH3_VALUE_LEN));
+      if (net_event.source == node) {
+        // a block appears once in a chain, clear the source anyway so that it
+        // is never sent twice.
+        net_event.source = nullptr;
+        range_end = pos + MURMUR_HASH3_VALUE_LEN;
+        continue;
+      }
+      add_range();
+      range_begin = range_end = pos + MURMUR_HASH3_VALUE_LEN;
+    }
+    add_range();
+  }
+
+  for (auto& [hash_key, net_event] : net_events) {
+    for (int8_t i = 0; i < net_event.offload_times; ++i) {
+      event->add_offload_cache(hash_key.data(), hash_key.size());
+    }
+  }
+}
+
+bool XllmRpcClient::send_heartbeat() {
+  // The master applies the stored, offload and removed events of a heartbeat
+  // in this order, so the events of a failed heartbeat can not be merged with
+  // newer events of the same blocks. Resend them alone first.
+  if (has_unsent_request_) {
+    if (!send_heartbeat_request(unsent_request_)) {
+      return false;
+    }
+    unsent_request_.Clear();
+    has_unsent_request_ = false;
+    num_unsent_events_ = 0;
+  }
+
+  proto::HeartbeatRequest req;
+  req.set_name(instance_name_);
+  const int64_t num_events = collect_cache_events(&req);
+
+  LoadMetrics load_metrics(
+      waiting_requests_num_.load(std::memory_order_relaxed),
+      gpu_cache_usage_perc_.load(std::memory_order_relaxed));
+  if (num_heartbeats_ % kFullSyncHeartbeats == 0 ||
+      load_metrics.waiting_requests_num !=
+          last_load_metrics_.waiting_requests_num ||
+      load_metrics.gpu_cache_usage_perc !=
+          last_load_metrics_.gpu_cache_usage_perc) {
+    req.mutable_load_metrics()->set_waiting_requests_num(
+        load_metrics.waiting_requests_num);
+    req.mutable_load_metrics()->set_gpu_cache_usage_perc(
+        load_metrics.gpu_cache_usage_perc);
+  }
+
+  int64_t recent_max_ttft = recent_max_ttft_.exchange(0);
+  int64_t recent_max_tbt = recent_max_tbt_.exchange(0);
+  if (recent_max_ttft > 0 || recent_max_tbt > 0) {
+    req.mutable_latency_metrics()->set_recent_max_ttft(recent_max_ttft);
+    req.mutable_latency_metrics()->set_recent_max_tbt(recent_max_tbt);
+  }
+
+  if (!send_heartbeat_request(req)) {
+    // keep the events and resend them with the next heartbeat
+    unsent_request_.Swap(&req);
+    has_unsent_request_ = true;
+    num_unsent_events_ = num_events;
+    return false;
+  }
+  if (req.has_load_metrics()) {
+    last_load_metrics_ = load_metrics;
+  }
+  ++num_heartbeats_;
+  return true;
+}
+
+void XllmRpcClient::limit_unsent_events() {
+  const int64_t max_events = std::max<int64_t>(options_.max_pending_events, 1);
+  if (num_unsent_events_ +
+          num_pending_events_.load(std::memory_order_relaxed) <=
+      max_events) {
+    return;
+  }
+  // the failed heartbeat holds the oldest events
+  if (has_unsent_request_) {
+    g_dropped_cache_events << num_unsent_events_;
+    LOG(WARNING) << instance_name_ << " dropped " << num_unsent_events_
+                 << " cache events the master has not taken";
+    unsent_request_.Clear();
+    has_unsent_request_ = false;
+    num_unsent_events_ = 0;
+  }
+  // keep the newest pending events in a heartbeat sent ahead of the next ones
+  if (num_pending_events_.load(std::memory_order_relaxed) > max_events) {
+    unsent_request_.set_name(instance_name_);
+    num_unsent_events_ = collect_cache_events(&unsent_request_, max_events);
+    has_unsent_request_ = true;
+  }
+}
+
+bool XllmRpcClient::send_heartbeat_request(
+    const proto::HeartbeatRequest& req) {
+  brpc::Controller cntl;
+  proto::Status res;
+  master_stub_->Heartbeat(&cntl, &req, &res, nullptr);
+  if (cntl.Failed()) {
+    LOG(ERROR) << instance_name_
+               << " failed to send heartbeat to master: " << cntl.ErrorText();
+    return false;
+  }
+  if (!res.ok()) {
+    // the master has removed the instance, e.g. after missed heartbeats
+    register_again();
+    return false;
+  }
+  return true;
 }
 
-// TODO: send metainfo/metrics to master ?
 void XllmRpcClient::heartbeat() {
   while (!exited_) {
-    std::this_thread::sleep_for(std::chrono::seconds(kHeartbeatInterval));
-    if (!register_inst_done_) continue;
-
-    brpc::Controller cntl;
-    proto::HeartbeatRequest req;
-    req.set_name(instance_name_);
-    // TODO: set req.cache_event and req.load_metrics
-    proto::Status res;
-    master_stub_->Heartbeat(&cntl, &req, &res, nullptr);
-    if (cntl.Failed()) {
-      LOG(ERROR) << instance_name_
-                 << " failed to send heartbeat to master: " << cntl.ErrorText();
-      ;
-    } else if (!res.ok()) {
-      LOG(ERROR) << instance_name_
-                 << " failed to send heartbeat to master, status: " << res.ok();
+    {
+      std::unique_lock<std::mutex> lock(flush_mutex_);
+      flush_cv_.wait_for(lock,
+                         std::chrono::milliseconds(
+                             options_.heartbeat_interval_ms),
+                         [this] { return flush_requested_; });
+      flush_requested_ = false;
+    }
+    if (exited_) {
+      break;
     }
+    if (!register_inst_done_ || !send_heartbeat()) {
+      limit_unsent_events();
+    }
+  }
+
+  // flush the pending events once more on shutdown
+  if (register_inst_done_) {
+    send_heartbeat();
   }
 }
 
@@ -83,9 +484,9 @@ ErrorCode XllmRpcClient::register_instance() {
 }
 
 ErrorCode XllmRpcClient::register_instance(const InstanceMetaInfo& metainfo) {
-  brpc::Controller cntl;
   proto::InstanceMetaInfo req;
   req.set_name(metainfo.name);
+  req.set_rpc_address(metainfo.rpc_address);
   if (metainfo.type == InstanceType::PREFILL) {
     req.set_type(proto::InstanceType::PREFILL);
   } else if (metainfo.type == InstanceType::DECODE) {
@@ -95,22 +496,66 @@ ErrorCode XllmRpcClient::register_instance(const InstanceMetaInfo& metainfo) {
   } else {
     req.set_type(proto::InstanceType::DEFAULT);
   }
+  ADD_VECTOR_TO_PROTO(req.mutable_cluster_ids(), metainfo.cluster_ids);
+  ADD_VECTOR_TO_PROTO(req.mutable_addrs(), metainfo.addrs);
+  ADD_VECTOR_TO_PROTO(req.mutable_k_cache_ids(), metainfo.k_cache_ids);
+  ADD_VECTOR_TO_PROTO(req.mutable_v_cache_ids(), metainfo.v_cache_ids);
+  req.set_dp_size(metainfo.dp_size);
+  for (const auto& [token_length, latency] : metainfo.ttft_profiling_data) {
+    auto* data = req.add_ttft_profiling_data();
+    data->set_token_length(token_length);
+    data->set_latency(latency);
+  }
+  for (const auto& [avg_length, batch_size, latency] :
+       metainfo.tpot_profiling_data) {
+    auto* data = req.add_tpot_profiling_data();
+    data->set_avg_length(avg_length);
+    data->set_batch_size(batch_size);
+    data->set_latency(latency);
+  }
+
+  ErrorCode code = send_register_request(req);
+  if (code == ErrorCode::OK) {
+    std::lock_guard<std::mutex> lock(register_mutex_);
+    register_request_ = std::move(req);
+    // register instance success
+    register_inst_done_ = true;
+    flush();
+  }
+  return code;
+}
+
+ErrorCode XllmRpcClient::send_register_request(
+    const proto::InstanceMetaInfo& req) {
+  brpc::Controller cntl;
   proto::StatusCode res;
   master_stub_->RegisterInstance(&cntl, &req, &res, nullptr);
   if (cntl.Failed()) {
     LOG(ERROR) << instance_name_
                << " failed to send register_instance to master: "
                << cntl.ErrorText();
-    ;
+    return ErrorCode::INTERNAL_ERROR;
   } else if (res.status_code() != ConvertErrorCode::to_int(ErrorCode::OK)) {
     LOG(ERROR) << instance_name_
                << " failed to send register_instance to master: "
                << "res = " << res.status_code();
-  } else {
-    // register instance success
-    register_inst_done_ = true;
   }
   return ConvertErrorCode::from_int(res.status_code());
 }
 
+void XllmRpcClient::register_again() {
+  proto::InstanceMetaInfo req;
+  {
+    std::lock_guard<std::mutex> lock(register_mutex_);
+    req = register_request_;
+  }
+  LOG(WARNING) << instance_name_
+               << " is unknown to the master, register it again.";
+  // the instance may still be known by another path, e.g. etcd
+  ErrorCode code = send_register_request(req);
+  if (code != ErrorCode::OK && code != ErrorCode::INSTANCE_EXISTED) {
+    LOG(ERROR) << instance_name_ << " failed to register again.";
+  }
+}
+
 }  // namespace xllm_service
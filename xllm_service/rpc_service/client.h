@@ -18,8 +18,13 @@ limitations under the License.
 #include <brpc/channel.h>
 #include <butil/time.h>
 
+#include <atomic>
+#include <condition_variable>
+#include <limits>
+#include <mutex>
 #include <string>
 #include <thread>
+#include <vector>
 
 #include "common/types.h"
 #include "xllm_rpc_service.pb.h"
@@ -33,8 +38,25 @@ struct ChannelOptions {
   int timeout_ms = 100;
   int max_retry = 3;
   int interval_ms = 1000;
+  // max interval between two heartbeats
+  int heartbeat_interval_ms = 3000;
+  // send a heartbeat right away once this many cache events are pending
+  int max_batch_events = 4096;
+  // max number of block events kept while the master does not take the
+  // heartbeats, the oldest events are dropped beyond it
+  int64_t max_pending_events = 1 << 20;
 };
 
+enum class KvCacheEventType : int8_t {
+  STORED = 0,
+  OFFLOAD = 1,
+  REMOVED = 2,
+};
+
+// Instance side reporting client. Engine threads record kv cache events and
+// metrics without taking locks, a background thread batches them into
+// heartbeats which are flushed on time or when enough events are pending.
+// The pending events are flushed once more when the client is destroyed.
 class XllmRpcClient {
  public:
   XllmRpcClient(const std::string& instace_name,
@@ -45,18 +67,119 @@ class XllmRpcClient {
   ErrorCode register_instance();
   ErrorCode register_instance(const InstanceMetaInfo& metainfo);
 
+  // record kv cache block events, `hash_key` is the murmur3 hash of the block.
+  // `dp_rank` is the data parallel rank holding the block, -1 if the ranks
+  // are not reported.
+  void record_stored_cache(const std::string& hash_key, int32_t dp_rank = -1);
+  void record_offload_cache(const std::string& hash_key,
+                            int32_t dp_rank = -1);
+  void record_removed_cache(const std::string& hash_key,
+                            int32_t dp_rank = -1);
+
+  // record events of consecutive blocks of one sequence in chain order, they
+  // are sent to the master as ranges.
+  void record_stored_cache(const std::vector<std::string>& hash_keys,
+                           int32_t dp_rank = -1);
+  void record_offload_cache(const std::vector<std::string>& hash_keys,
+                            int32_t dp_rank = -1);
+  void record_removed_cache(const std::vector<std::string>& hash_keys,
+                            int32_t dp_rank = -1);
+
+  void record_load_metrics(uint64_t waiting_requests_num,
+                           float gpu_cache_usage_perc);
+
+  // record the latency of a finished request, the max value between two
+  // heartbeats is reported. The unit is milliseconds.
+  void record_latency(int64_t ttft, int64_t tbt);
+
+  // wake up the heartbeat thread to send pending events immediately
+  void flush();
+
  private:
+  // the nodes come from a butil object pool and keep the capacity of
+  // `hash_keys` across events.
+  struct CacheEventNode {
+    KvCacheEventType type = KvCacheEventType::STORED;
+    int32_t dp_rank = -1;
+    // packed hash keys of consecutive blocks
+    std::string hash_keys;
+    CacheEventNode* next = nullptr;
+  };
+
+  static CacheEventNode* new_cache_event();
+  static void release_cache_event(CacheEventNode* node);
+
+  // push `node` with the packed keys of its blocks to the pending events
+  void record_cache_event(KvCacheEventType type,
+                          int32_t dp_rank,
+                          CacheEventNode* node);
+
+  // take the pending cache events and fold them into the cache events of
+  // `req`, one per data parallel rank. Only the newest `max_events` block
+  // events are kept, return the number of them.
+  int64_t collect_cache_events(
+      proto::HeartbeatRequest* req,
+      int64_t max_events = std::numeric_limits<int64_t>::max());
+
+  // fold the events of one rank in record order into `event`, only the net
+  // change of every block is kept. Blocks recorded together whose net change
+  // is the same are sent as one range.
+  void fold_cache_events(const CacheEventNode* nodes,
+                         int64_t num_events,
+                         proto::KvCacheEvent* event);
+
   void heartbeat();
 
+  bool send_heartbeat();
+
+  // drop the oldest events while the master has not taken more than
+  // `max_pending_events` of them
+  void limit_unsent_events();
+
+  // return false if the master did not take the heartbeat
+  bool send_heartbeat_request(const proto::HeartbeatRequest& req);
+
+  ErrorCode send_register_request(const proto::InstanceMetaInfo& req);
+
+  // register with the last registered meta info after the master has
+  // removed the instance.
+  void register_again();
+
  private:
-  bool exited_ = false;
-  bool register_inst_done_ = false;
+  std::atomic_bool exited_ = false;
+  std::atomic_bool register_inst_done_ = false;
   // instance rdma address or other info: ip port
   std::string instance_name_;
   std::string master_addr_;
+  ChannelOptions options_;
   brpc::Channel master_channel_;
   std::unique_ptr<proto::XllmRpcService_Stub> master_stub_;
   std::unique_ptr<std::thread> heartbeat_thread_;
+
+  std::mutex register_mutex_;
+  proto::InstanceMetaInfo register_request_;
+
+  // lock-free list of pending cache events, newest first
+  std::atomic<CacheEventNode*> cache_events_ = nullptr;
+  std::atomic<int64_t> num_pending_events_ = 0;
+
+  // latest metrics, only sent when they change
+  std::atomic<uint64_t> waiting_requests_num_ = 0;
+  std::atomic<float> gpu_cache_usage_perc_ = 0;
+  std::atomic<int64_t> recent_max_ttft_ = 0;
+  std::atomic<int64_t> recent_max_tbt_ = 0;
+
+  // only accessed by the heartbeat thread
+  LoadMetrics last_load_metrics_;
+  uint64_t num_heartbeats_ = 0;
+  // a failed heartbeat, resent alone before the next one
+  proto::HeartbeatRequest unsent_request_;
+  bool has_unsent_request_ = false;
+  int64_t num_unsent_events_ = 0;
+
+  std::mutex flush_mutex_;
+  std::condition_variable flush_cv_;
+  bool flush_requested_ = false;
 };
 
 }  // namespace xllm_service
@@ -0,0 +1,218 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "rpc_service/client.h"
+
+#include <brpc/server.h>
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+
+#include "common/hash_util.h"
+
+namespace xllm_service::test {
+
+namespace {
+
+// Master which keeps the cached blocks of one instance, it applies the events
+// of a heartbeat in the same order as the real master.
+class FakeMaster : public proto::XllmRpcService {
+ public:
+  void RegisterInstance(google::protobuf::RpcController* cntl_base,
+                        const proto::InstanceMetaInfo* req,
+                        proto::StatusCode* resp,
+                        google::protobuf::Closure* done) override {
+    brpc::ClosureGuard done_guard(done);
+    resp->set_status_code(ConvertErrorCode::to_int(ErrorCode::OK));
+  }
+
+  void Heartbeat(google::protobuf::RpcController* cntl_base,
+                 const proto::HeartbeatRequest* req,
+                 proto::Status* resp,
+                 google::protobuf::Closure* done) override {
+    brpc::ClosureGuard done_guard(done);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (num_failures_ > 0) {
+      --num_failures_;
+      static_cast<brpc::Controller*>(cntl_base)->SetFailed("injected");
+      cv_.notify_all();
+      return;
+    }
+    const auto& event = req->cache_event();
+    for (const auto& hash_key : event.stored_cache()) {
+      blocks_.insert(hash_key);
+    }
+    for (const auto& range : event.stored_ranges()) {
+      for_each_block(range, [this](std::string&& b) { blocks_.insert(b); });
+    }
+    for (const auto& hash_key : event.removed_cache()) {
+      blocks_.erase(hash_key);
+    }
+    for (const auto& range : event.removed_ranges()) {
+      for_each_block(range, [this](std::string&& b) { blocks_.erase(b); });
+    }
+    ++num_heartbeats_;
+    resp->set_ok(true);
+    cv_.notify_all();
+  }
+
+  void fail_next_heartbeats(int32_t num_failures) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    num_failures_ = num_failures;
+  }
+
+  // wait until the master has taken `num_heartbeats` heartbeats and failed
+  // all injected ones
+  bool wait_for_heartbeats(int64_t num_heartbeats) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return cv_.wait_for(lock, std::chrono::seconds(10), [&] {
+      return num_heartbeats_ >= num_heartbeats && num_failures_ == 0;
+    });
+  }
+
+  bool has_block(const std::string& hash_key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return blocks_.count(hash_key) != 0;
+  }
+
+  size_t num_blocks() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return blocks_.size();
+  }
+
+ private:
+  template <typename Fn>
+  static void for_each_block(const std::string& range, Fn&& fn) {
+    for (size_t pos = 0; pos + MURMUR_HASH3_VALUE_LEN <= range.size();
+         pos += MURMUR_HASH3_VALUE_LEN) {
+      fn(range.substr(pos, MURMUR_HASH3_VALUE_LEN));
+    }
+  }
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::unordered_set<std::string> blocks_;
+  int64_t num_heartbeats_ = 0;
+  int32_t num_failures_ = 0;
+};
+
+class XllmRpcClientTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_EQ(0,
+              server_.AddService(&master_, brpc::SERVER_DOESNT_OWN_SERVICE));
+    ASSERT_EQ(0, server_.Start(brpc::PortRange(20000, 30000), nullptr));
+    master_addr_ =
+        "127.0.0.1:" + std::to_string(server_.listen_address().port);
+  }
+
+  void TearDown() override {
+    server_.Stop(0);
+    server_.Join();
+  }
+
+  ChannelOptions channel_options() const {
+    ChannelOptions options;
+    options.max_retry = 0;
+    options.timeout_ms = 1000;
+    // only flushes send heartbeats
+    options.heartbeat_interval_ms = 3600 * 1000;
+    return options;
+  }
+
+  FakeMaster master_;
+  brpc::Server server_;
+  std::string master_addr_;
+};
+
+}  // namespace
+
+TEST_F(XllmRpcClientTest, ResendFailedHeartbeatBeforeNewEvents) {
+  const std::string hash_key(MURMUR_HASH3_VALUE_LEN, 'x');
+  XllmRpcClient client("instance", master_addr_, channel_options());
+  client.record_stored_cache(hash_key);
+  ASSERT_EQ(ErrorCode::OK, client.register_instance());
+  ASSERT_TRUE(master_.wait_for_heartbeats(1));
+  EXPECT_TRUE(master_.has_block(hash_key));
+
+  // the removal is lost with a failed heartbeat
+  master_.fail_next_heartbeats(1);
+  client.record_removed_cache(hash_key);
+  client.flush();
+  ASSERT_TRUE(master_.wait_for_heartbeats(1));
+
+  // the block is stored again before the removal is resent, the master must
+  // end up with the block.
+  client.record_stored_cache(hash_key);
+  client.flush();
+  ASSERT_TRUE(master_.wait_for_heartbeats(3));
+  EXPECT_TRUE(master_.has_block(hash_key));
+}
+
+TEST_F(XllmRpcClientTest, DropShortHashKeys) {
+  const std::string short_key = "short";
+  const std::string first_key(MURMUR_HASH3_VALUE_LEN, 'a');
+  const std::string second_key(MURMUR_HASH3_VALUE_LEN, 'b');
+  XllmRpcClient client("instance", master_addr_, channel_options());
+  client.record_stored_cache(short_key);
+  // the keys after the short one keep their place in the packed range
+  client.record_stored_cache({first_key, short_key, second_key});
+  ASSERT_EQ(ErrorCode::OK, client.register_instance());
+  ASSERT_TRUE(master_.wait_for_heartbeats(1));
+  EXPECT_TRUE(master_.has_block(first_key));
+  EXPECT_TRUE(master_.has_block(second_key));
+  EXPECT_EQ(2, master_.num_blocks());
+}
+
+TEST_F(XllmRpcClientTest, DropOldestEventsBeyondBacklog) {
+  const std::string first_key(MURMUR_HASH3_VALUE_LEN, 'a');
+  const std::string second_key(MURMUR_HASH3_VALUE_LEN, 'b');
+  const std::string third_key(MURMUR_HASH3_VALUE_LEN, 'c');
+  const std::string last_key(MURMUR_HASH3_VALUE_LEN, 'd');
+  ChannelOptions options = channel_options();
+  options.max_pending_events = 2;
+  XllmRpcClient client("instance", master_addr_, options);
+  ASSERT_EQ(ErrorCode::OK, client.register_instance());
+  ASSERT_TRUE(master_.wait_for_heartbeats(1));
+
+  // the failed heartbeat holds more events than the backlog takes
+  master_.fail_next_heartbeats(1);
+  client.record_stored_cache({first_key, second_key, third_key});
+  client.flush();
+  ASSERT_TRUE(master_.wait_for_heartbeats(1));
+
+  client.record_stored_cache(last_key);
+  client.flush();
+  ASSERT_TRUE(master_.wait_for_heartbeats(2));
+  EXPECT_TRUE(master_.has_block(last_key));
+  EXPECT_EQ(1, master_.num_blocks());
+}
+
+TEST_F(XllmRpcClientTest, FlushPendingEventsOnShutdown) {
+  const std::string hash_key(MURMUR_HASH3_VALUE_LEN, 'x');
+  {
+    XllmRpcClient client("instance", master_addr_, channel_options());
+    ASSERT_EQ(ErrorCode::OK, client.register_instance());
+    ASSERT_TRUE(master_.wait_for_heartbeats(1));
+    client.record_stored_cache(hash_key);
+  }
+  EXPECT_TRUE(master_.has_block(hash_key));
+}
+
+}  // namespace xllm_service::test
@@ -32,8 +32,13 @@ XllmRpcServiceImpl::XllmRpcServiceImpl(const Options& options,
 
 XllmRpcServiceImpl::~XllmRpcServiceImpl() { scheduler_->exited(); }
 
-void XllmRpcServiceImpl::heartbeat(const proto::HeartbeatRequest* req) {
-  scheduler_->handle_instance_heartbeat(req);
+ErrorCode XllmRpcServiceImpl::register_instance(
+    const InstanceMetaInfo& metainfo) {
+  return scheduler_->register_instance(metainfo);
+}
+
+bool XllmRpcServiceImpl::heartbeat(const proto::HeartbeatRequest* req) {
+  return scheduler_->handle_instance_heartbeat(req);
 }
 
 InstanceMetaInfo XllmRpcServiceImpl::get_instance_info(
@@ -104,13 +109,54 @@ void XllmRpcService::GetInstanceInfo(google::protobuf::RpcController* cntl_base,
   resp->set_dp_size(metainfo.dp_size);
 }
 
+void XllmRpcService::RegisterInstance(
+    google::protobuf::RpcController* cntl_base,
+    const proto::InstanceMetaInfo* req,
+    proto::StatusCode* resp,
+    google::protobuf::Closure* done) {
+  brpc::ClosureGuard done_guard(done);
+  InstanceMetaInfo metainfo(req->name(), req->rpc_address());
+  switch (req->type()) {
+    case proto::InstanceType::PREFILL:
+      metainfo.type = InstanceType::PREFILL;
+      break;
+    case proto::InstanceType::DECODE:
+      metainfo.type = InstanceType::DECODE;
+      break;
+    case proto::InstanceType::MIX:
+      metainfo.type = InstanceType::MIX;
+      break;
+    default:
+      metainfo.type = InstanceType::DEFAULT;
+      break;
+  }
+  metainfo.cluster_ids.assign(req->cluster_ids().begin(),
+                              req->cluster_ids().end());
+  metainfo.addrs.assign(req->addrs().begin(), req->addrs().end());
+  metainfo.k_cache_ids.assign(req->k_cache_ids().begin(),
+                              req->k_cache_ids().end());
+  metainfo.v_cache_ids.assign(req->v_cache_ids().begin(),
+                              req->v_cache_ids().end());
+  metainfo.dp_size = req->dp_size();
+  for (const auto& data : req->ttft_profiling_data()) {
+    metainfo.ttft_profiling_data.emplace_back(data.token_length(),
+                                              data.latency());
+  }
+  for (const auto& data : req->tpot_profiling_data()) {
+    metainfo.tpot_profiling_data.emplace_back(
+        data.avg_length(), data.batch_size(), data.latency());
+  }
+
+  resp->set_status_code(ConvertErrorCode::to_int(
+      xllm_rpc_service_impl_->register_instance(metainfo)));
+}
+
 void XllmRpcService::Heartbeat(google::protobuf::RpcController* cntl_base,
                                const proto::HeartbeatRequest* req,
                                proto::Status* resp,
                                google::protobuf::Closure* done) {
   brpc::ClosureGuard done_guard(done);
-  xllm_rpc_service_impl_->heartbeat(req);
-  resp->set_ok(true);
+  resp->set_ok(xllm_rpc_service_impl_->heartbeat(req));
 }
 
 void XllmRpcService::GetStaticDecodeList(
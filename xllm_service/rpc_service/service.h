@@ -36,7 +36,9 @@ class XllmRpcServiceImpl final {
   XllmRpcServiceImpl(const Options& options, Scheduler* scheduler);
   ~XllmRpcServiceImpl();
 
-  void heartbeat(const proto::HeartbeatRequest* req);
+  ErrorCode register_instance(const InstanceMetaInfo& metainfo);
+
+  bool heartbeat(const proto::HeartbeatRequest* req);
 
   InstanceMetaInfo get_instance_info(const std::string& instance_name);
 
@@ -82,6 +84,12 @@ class XllmRpcService : public proto::XllmRpcService {
                      proto::Status* resp,
                      google::protobuf::Closure* done) override;
 
+  // register instance directly without etcd
+  virtual void RegisterInstance(google::protobuf::RpcController* cntl_base,
+                                const proto::InstanceMetaInfo* req,
+                                proto::StatusCode* resp,
+                                google::protobuf::Closure* done) override;
+
   virtual void Heartbeat(google::protobuf::RpcController* cntl_base,
                          const proto::HeartbeatRequest* req,
                          proto::Status* resp,
@@ -0,0 +1,119 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "admission_queue.h"
+
+#include <butil/time.h>
+#include <bvar/bvar.h>
+
+#include <algorithm>
+
+namespace xllm_service {
+
+namespace {
+bvar::Adder<int64_t> g_admission_rejected("xllm_service_admission_rejected");
+bvar::Adder<int64_t> g_admission_timeout("xllm_service_admission_timeout");
+bvar::LatencyRecorder g_admission_wait_latency("xllm_service_admission_wait");
+}  // namespace
+
+AdmissionQueue::AdmissionQueue(const AdmissionQueueOptions& options,
+                               std::function<bool()> has_capacity)
+    : options_(options), has_capacity_(std::move(has_capacity)) {}
+
+llm::Status AdmissionQueue::admit(int32_t priority,
+                                  int64_t deadline_us,
+                                  bool* queued) {
+  const int64_t start_us = butil::monotonic_time_us();
+  *queued = false;
+  std::unique_lock<bthread::Mutex> lock(mutex_);
+  if (waiters_.empty() && !dispatching_ && probe_capacity(&lock) &&
+      waiters_.empty() && !dispatching_) {
+    g_admission_wait_latency << 0;
+    return llm::Status();
+  }
+
+  if (waiters_.size() >= static_cast<size_t>(options_.max_depth)) {
+    // shed the lowest priority request if the new one is more important
+    auto lowest = std::prev(waiters_.end());
+    if (-lowest->first >= priority) {
+      g_admission_rejected << 1;
+      return llm::Status(llm::StatusCode::RESOURCE_EXHAUSTED,
+                         "Admission queue is full.");
+    }
+    waiters_.erase(lowest);
+    cv_.notify_all();
+  }
+
+  const WaiterKey key(-priority, next_sequence_++);
+  waiters_.insert(key);
+  while (true) {
+    if (waiters_.count(key) == 0) {
+      g_admission_rejected << 1;
+      return llm::Status(llm::StatusCode::RESOURCE_EXHAUSTED,
+                         "Shed by requests of higher priority.");
+    }
+    if (*waiters_.begin() == key && !dispatching_) {
+      const bool has_capacity = probe_capacity(&lock);
+      if (waiters_.count(key) == 0 || *waiters_.begin() != key ||
+          dispatching_) {
+        // the queue has changed while the lock was released
+        continue;
+      }
+      if (has_capacity) {
+        waiters_.erase(key);
+        dispatching_ = true;
+        *queued = true;
+        g_admission_wait_latency << butil::monotonic_time_us() - start_us;
+        return llm::Status();
+      }
+    }
+
+    const int64_t now_us = butil::monotonic_time_us();
+    if (now_us >= deadline_us) {
+      waiters_.erase(key);
+      // the next request may become the head
+      cv_.notify_all();
+      g_admission_timeout << 1;
+      return llm::Status(llm::StatusCode::DEADLINE_EXCEEDED,
+                         "No capacity before the deadline.");
+    }
+    cv_.wait_for(lock,
+                 std::min(deadline_us - now_us, options_.poll_interval_us));
+  }
+}
+
+bool AdmissionQueue::probe_capacity(std::unique_lock<bthread::Mutex>* lock) {
+  lock->unlock();
+  const bool has_capacity = has_capacity_();
+  lock->lock();
+  return has_capacity;
+}
+
+void AdmissionQueue::dispatched() {
+  {
+    std::lock_guard<bthread::Mutex> lock(mutex_);
+    dispatching_ = false;
+  }
+  cv_.notify_all();
+}
+
+void AdmissionQueue::notify() { cv_.notify_all(); }
+
+int32_t AdmissionQueue::size() {
+  std::lock_guard<bthread::Mutex> lock(mutex_);
+  return waiters_.size();
+}
+
+}  // namespace xllm_service
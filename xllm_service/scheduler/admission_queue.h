@@ -0,0 +1,91 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#include <bthread/condition_variable.h>
+#include <bthread/mutex.h>
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <utility>
+
+#include "common/macros.h"
+#include "common/xllm/status.h"
+
+namespace xllm_service {
+
+struct AdmissionQueueOptions {
+  // max number of waiting requests, 0 disables the queue
+  int32_t max_depth = 0;
+  // how often waiting requests check the load signals which change without
+  // notification, e.g. with heartbeats.
+  int64_t poll_interval_us = 10000;
+};
+
+// Holds requests back while every instance is saturated instead of failing
+// them or piling them onto overloaded instances. Requests are released one at
+// a time in priority order, the next one only after the previous one has been
+// dispatched, so that every release sees the load it added.
+// The waits use bthread primitives and do not block the brpc workers.
+class AdmissionQueue final {
+ public:
+  AdmissionQueue(const AdmissionQueueOptions& options,
+                 std::function<bool()> has_capacity);
+
+  bool enabled() const { return options_.max_depth > 0; }
+
+  // Wait until the request may be dispatched. Fails with RESOURCE_EXHAUSTED
+  // if the queue is full of requests with at least the same priority or the
+  // request is shed for a higher priority one, with DEADLINE_EXCEEDED if
+  // there is no capacity before `deadline_us` (monotonic time). Requests
+  // admitted without waiting are routed concurrently, `queued` is set if the
+  // request has waited and `dispatched` must be called once it is routed.
+  llm::Status admit(int32_t priority, int64_t deadline_us, bool* queued);
+
+  void dispatched();
+
+  // wake up the waiting requests after capacity has been freed
+  void notify();
+
+  int32_t size();
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(AdmissionQueue);
+
+  // higher priority first, then in arrival order
+  using WaiterKey = std::pair<int32_t, uint64_t>;
+
+  // `has_capacity_` takes the locks of the instance manager, it is called
+  // with `lock` released so that the waiters do not hold the queue on them.
+  bool probe_capacity(std::unique_lock<bthread::Mutex>* lock);
+
+ private:
+  const AdmissionQueueOptions options_;
+  const std::function<bool()> has_capacity_;
+
+  bthread::Mutex mutex_;
+  bthread::ConditionVariable cv_;
+  // (-priority, sequence) of the waiting requests, a request whose key is
+  // removed by somebody else has been shed.
+  std::set<WaiterKey> waiters_;
+  uint64_t next_sequence_ = 0;
+  // a released request has not been dispatched yet
+  bool dispatching_ = false;
+};
+
+}  // namespace xllm_service
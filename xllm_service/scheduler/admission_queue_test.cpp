@@ -0,0 +1,181 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "admission_queue.h"
+
+#include <butil/time.h>
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace xllm_service::test {
+
+namespace {
+constexpr int64_t kLongDeadlineUs = 10 * 1000 * 1000;
+
+AdmissionQueueOptions make_options(int32_t max_depth) {
+  AdmissionQueueOptions options;
+  options.max_depth = max_depth;
+  options.poll_interval_us = 1000;
+  return options;
+}
+
+llm::Status admit(AdmissionQueue* queue,
+                  int32_t priority,
+                  int64_t timeout_us = kLongDeadlineUs,
+                  bool* queued = nullptr) {
+  bool waited = false;
+  auto status = queue->admit(
+      priority, butil::monotonic_time_us() + timeout_us, &waited);
+  if (queued != nullptr) {
+    *queued = waited;
+  }
+  return status;
+}
+
+void wait_for_size(AdmissionQueue* queue, int32_t size) {
+  while (queue->size() != size) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+}  // namespace
+
+TEST(AdmissionQueueTest, AdmitRightAwayWithCapacity) {
+  AdmissionQueue queue(make_options(4), []() { return true; });
+  bool queued = true;
+  ASSERT_TRUE(admit(&queue, 0, kLongDeadlineUs, &queued).ok());
+  EXPECT_FALSE(queued);
+  // requests admitted right away are routed concurrently
+  ASSERT_TRUE(admit(&queue, 0, kLongDeadlineUs, &queued).ok());
+  EXPECT_FALSE(queued);
+  EXPECT_EQ(0, queue.size());
+}
+
+TEST(AdmissionQueueTest, FailAfterDeadline) {
+  AdmissionQueue queue(make_options(4), []() { return false; });
+  const int64_t start_us = butil::monotonic_time_us();
+  auto status = admit(&queue, 0, /*timeout_us=*/20000);
+  EXPECT_EQ(llm::StatusCode::DEADLINE_EXCEEDED, status.code());
+  EXPECT_GE(butil::monotonic_time_us() - start_us, 20000);
+  EXPECT_EQ(0, queue.size());
+}
+
+TEST(AdmissionQueueTest, ReleaseInPriorityOrder) {
+  std::atomic_bool has_capacity = false;
+  AdmissionQueue queue(make_options(8),
+                       [&]() { return has_capacity.load(); });
+
+  std::mutex mutex;
+  std::vector<int32_t> released;
+  std::vector<std::thread> threads;
+  const std::vector<int32_t> priorities = {0, 2, 1, 2};
+  for (size_t i = 0; i < priorities.size(); ++i) {
+    threads.emplace_back([&, priority = priorities[i]]() {
+      bool queued = false;
+      ASSERT_TRUE(admit(&queue, priority, kLongDeadlineUs, &queued).ok());
+      EXPECT_TRUE(queued);
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        released.push_back(priority);
+      }
+      queue.dispatched();
+    });
+    // fix the arrival order
+    wait_for_size(&queue, i + 1);
+  }
+
+  has_capacity = true;
+  queue.notify();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(std::vector<int32_t>({2, 2, 1, 0}), released);
+}
+
+TEST(AdmissionQueueTest, ShedLowerPriorityWhenFull) {
+  std::atomic_bool has_capacity = false;
+  AdmissionQueue queue(make_options(1),
+                       [&]() { return has_capacity.load(); });
+
+  llm::Status low_status;
+  std::thread low([&]() { low_status = admit(&queue, 0); });
+  wait_for_size(&queue, 1);
+
+  // the same priority does not push out a waiting request
+  EXPECT_EQ(llm::StatusCode::RESOURCE_EXHAUSTED, admit(&queue, 0).code());
+
+  llm::Status high_status;
+  std::thread high([&]() { high_status = admit(&queue, 1); });
+  low.join();
+  EXPECT_EQ(llm::StatusCode::RESOURCE_EXHAUSTED, low_status.code());
+
+  has_capacity = true;
+  queue.notify();
+  high.join();
+  EXPECT_TRUE(high_status.ok());
+  queue.dispatched();
+}
+
+TEST(AdmissionQueueTest, ReleaseQueuedRequestsOneAtATime) {
+  std::atomic_bool has_capacity = false;
+  AdmissionQueue queue(make_options(4),
+                       [&]() { return has_capacity.load(); });
+
+  std::atomic_int32_t num_admitted = 0;
+  auto wait = [&]() {
+    ASSERT_TRUE(admit(&queue, 0).ok());
+    ++num_admitted;
+  };
+  std::thread first(wait);
+  wait_for_size(&queue, 1);
+  std::thread second(wait);
+  wait_for_size(&queue, 2);
+
+  has_capacity = true;
+  queue.notify();
+  first.join();
+  // the second request waits until the first one is dispatched
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  EXPECT_EQ(1, num_admitted);
+  // and so do new requests
+  EXPECT_EQ(llm::StatusCode::DEADLINE_EXCEEDED,
+            admit(&queue, 0, /*timeout_us=*/5000).code());
+
+  queue.dispatched();
+  second.join();
+  EXPECT_EQ(2, num_admitted);
+  queue.dispatched();
+}
+
+TEST(AdmissionQueueTest, ProbeCapacityWithoutQueueLock) {
+  // the capacity check may take the queue lock, e.g. through `size()`
+  AdmissionQueue queue(make_options(4), [&]() { return queue.size() == 0; });
+  bool queued = true;
+  ASSERT_TRUE(admit(&queue, 0, kLongDeadlineUs, &queued).ok());
+  EXPECT_FALSE(queued);
+
+  // a queued request probes the capacity as the head of the queue
+  AdmissionQueue waiting_queue(
+      make_options(4), [&]() { return waiting_queue.size() == 1; });
+  ASSERT_TRUE(admit(&waiting_queue, 0, kLongDeadlineUs, &queued).ok());
+  EXPECT_TRUE(queued);
+  waiting_queue.dispatched();
+}
+
+}  // namespace xllm_service::test
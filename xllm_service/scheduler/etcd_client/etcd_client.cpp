@@ -17,12 +17,24 @@ limitations under the License.
 
 #include <glog/logging.h>
 
+#include <algorithm>
+#include <atomic>
 #include <nlohmann/json.hpp>
 
+namespace {
+// etcd rejects transactions with more operations than --max-txn-ops, which
+// is 128 by default.
+constexpr size_t kMaxTxnOps = 128;
+}  // namespace
+
 namespace xllm_service {
 
-EtcdClient::EtcdClient(const std::string& etcd_addr)
-    : client_(etcd_addr), etcd_addr_(etcd_addr) {
+EtcdClient::EtcdClient(const std::string& etcd_addr,
+                       int32_t max_inflight_txns)
+    : client_(etcd_addr),
+      etcd_addr_(etcd_addr),
+      max_inflight_txns_(std::max(max_inflight_txns, 1)),
+      txn_pool_(max_inflight_txns_) {
   LOG(INFO) << "EtcdClient init put start!";
   auto response = client_.put("XLLM_PING", "PING");
   LOG(INFO) << "EtcdClient init put end!";
@@ -34,7 +46,7 @@ EtcdClient::EtcdClient(const std::string& etcd_addr)
 
 EtcdClient::~EtcdClient() { stop_watch(); }
 
-bool EtcdClient::set(const std::string& key, const std::string& value) {
+bool EtcdClient::put(const std::string& key, const std::string& value) {
   auto response = client_.put(key, value);
   if (!response.is_ok()) {
     LOG(ERROR) << "etcd set " << key << " failed: " << response.error_message();
@@ -44,9 +56,9 @@ bool EtcdClient::set(const std::string& key, const std::string& value) {
   return true;
 }
 
-bool EtcdClient::set(const std::string& key,
-                     const std::string& value,
-                     const int ttl) {
+bool EtcdClient::create_with_lease(const std::string& key,
+                                   const std::string& value,
+                                   int ttl) {
   auto keep_alive = std::make_shared<etcd::KeepAlive>(client_, ttl);
   etcdv3::Transaction transaction;
   transaction.add_compare_create(key, 0);
@@ -61,20 +73,78 @@ bool EtcdClient::set(const std::string& key,
   }
 }
 
-bool EtcdClient::set(const std::string& key_prefix,
-                     const Murmur3KeyCacheMap& values) {
-  bool rt = true;
-  for (const auto& iter : values) {
-    if (iter.second.empty()) {
-      rt = rt && client_.rm(key_prefix + iter.first.to_string()).is_ok();
-    } else {
-      rt = rt && client_
-                     .put(key_prefix + iter.first.to_string(),
-                          iter.second.serialize_to_json().dump())
-                     .is_ok();
+bool EtcdClient::batch_update(
+    const std::vector<std::pair<std::string, std::string>>& puts,
+    const std::vector<std::string>& deletes) {
+  return batch_update_async(BatchUpdate{puts, deletes}).get();
+}
+
+void EtcdClient::batch_update_async(BatchUpdate update, UpdateCallback done) {
+  struct UpdateState {
+    std::atomic<size_t> num_pending_txns;
+    std::atomic_bool ok = true;
+    UpdateCallback done;
+  };
+
+  const size_t num_ops = update.puts.size() + update.deletes.size();
+  if (num_ops == 0) {
+    done(true);
+    return;
+  }
+  auto state = std::make_shared<UpdateState>();
+  state->num_pending_txns = (num_ops + kMaxTxnOps - 1) / kMaxTxnOps;
+  state->done = std::move(done);
+
+  size_t num_txn_ops = 0;
+  auto transaction = std::make_shared<etcdv3::Transaction>();
+  auto commit = [&]() {
+    acquire_txn_slot();
+    txn_pool_.schedule([this, state, transaction, num_txn_ops]() {
+      auto response = client_.txn(*transaction);
+      if (!response.is_ok()) {
+        LOG(ERROR) << "etcd txn of " << num_txn_ops
+                   << " operations failed: " << response.error_message();
+        state->ok = false;
+      }
+      release_txn_slot();
+      if (state->num_pending_txns.fetch_sub(1) == 1) {
+        state->done(state->ok);
+      }
+    });
+    transaction = std::make_shared<etcdv3::Transaction>();
+    num_txn_ops = 0;
+  };
+
+  for (const auto& [key, value] : update.puts) {
+    transaction->add_success_put(key, value);
+    if (++num_txn_ops == kMaxTxnOps) {
+      commit();
     }
   }
-  return true;
+  for (const auto& key : update.deletes) {
+    transaction->add_success_delete(key);
+    if (++num_txn_ops == kMaxTxnOps) {
+      commit();
+    }
+  }
+  if (num_txn_ops > 0) {
+    commit();
+  }
+}
+
+void EtcdClient::acquire_txn_slot() {
+  std::unique_lock<std::mutex> lock(txn_mutex_);
+  txn_cv_.wait(lock,
+               [this]() { return num_inflight_txns_ < max_inflight_txns_; });
+  ++num_inflight_txns_;
+}
+
+void EtcdClient::release_txn_slot() {
+  {
+    std::lock_guard<std::mutex> lock(txn_mutex_);
+    --num_inflight_txns_;
+  }
+  txn_cv_.notify_one();
 }
 
 bool EtcdClient::rm(const std::string& key) {
@@ -87,17 +157,6 @@ bool EtcdClient::rm(const std::string& key) {
   return true;
 }
 
-bool EtcdClient::rm(const std::string& key_prefix,
-                    const std::unordered_set<std::string>& keys) {
-  etcdv3::Transaction transaction;
-  transaction.add_compare_version(
-      "XLLM:SERVICE:MASTER", etcdv3::CompareResult::GREATER, -1);
-  for (const auto& iter : keys) {
-    transaction.add_success_delete(key_prefix + iter);
-  }
-  return client_.txn(transaction).is_ok();
-}
-
 bool EtcdClient::get(const std::string& key, std::string* value) {
   auto response = client_.get(key);
   if (!response.is_ok()) {
@@ -110,30 +169,6 @@ bool EtcdClient::get(const std::string& key, std::string* value) {
   return true;
 }
 
-bool EtcdClient::get_prefix(const std::string& key_prefix,
-                            Murmur3KeyCacheMap* values) {
-  auto response = client_.ls(key_prefix);
-  if (!response.is_ok()) {
-    LOG(ERROR) << "etcd get " << key_prefix
-               << " failed: " << response.error_message();
-    return false;
-  }
-
-  for (int i = 0; i < response.keys().size(); i++) {
-    Murmur3Key key(response.key(i).substr(key_prefix.size()).c_str());
-    auto json_str = response.value(i).as_string();
-
-    CacheLocations value;
-    if (!value.parse_from_json(json_str)) {
-      LOG(ERROR) << "Parse json fail: " << json_str;
-      continue;
-    }
-
-    values->insert_or_assign(std::move(key), std::move(value));
-  }
-  return true;
-}
-
 bool EtcdClient::get_prefix(
     const std::string& key_prefix,
     std::unordered_map<std::string, std::string>* values) {
@@ -165,7 +200,26 @@ void EtcdClient::add_watch(const std::string& key_prefix,
       client_,
       key_prefix,
       [callback, key_prefix](etcd::Response response) {
-        callback(response, uint64_t(key_prefix.size()));
+        if (!response.is_ok()) {
+          LOG(ERROR) << "etcd watch " << key_prefix
+                     << " failed: " << response.error_message();
+          return;
+        }
+        WatchEvents events;
+        events.reserve(response.events().size());
+        for (const auto& event : response.events()) {
+          if (event.event_type() == etcd::Event::EventType::PUT) {
+            events.push_back({WatchEvent::Type::PUT,
+                              event.kv().key(),
+                              event.kv().as_string()});
+          } else if (event.event_type() == etcd::Event::EventType::DELETE_) {
+            events.push_back(
+                {WatchEvent::Type::DELETE, event.kv().key(), ""});
+          }
+        }
+        if (!events.empty()) {
+          callback(events, uint64_t(key_prefix.size()));
+        }
       },
       recursive);
 
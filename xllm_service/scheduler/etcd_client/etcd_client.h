@@ -19,116 +19,63 @@ limitations under the License.
 #include <etcd/SyncClient.hpp>
 #include <etcd/Watcher.hpp>
 #include <etcd/v3/Transaction.hpp>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
-#include <unordered_set>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
-#include "common/hash_util.h"
-#include "common/types.h"
+#include "common/threadpool.h"
+#include "scheduler/metadata_store/metadata_store.h"
 
 namespace xllm_service {
 
-using Callback = std::function<void(const etcd::Response&, const uint64_t&)>;
-
-class EtcdClient {
+// Updates are split into transactions of at most --max-txn-ops operations,
+// which are sent by a pool of `max_inflight_txns` threads. Up to that many
+// transactions are in flight, further ones wait for a free slot.
+class EtcdClient : public MetadataStore {
  public:
-  EtcdClient(const std::string& etcd_addr);
-  ~EtcdClient();
-
-  template <typename T>
-  bool set(const std::string& key, const T& value) {
-    auto response = client_.put(key, value.serialize_to_json().dump());
-    if (!response.is_ok()) {
-      LOG(ERROR) << "etcd set " << key
-                 << " failed: " << response.error_message();
-      return false;
-    }
-
-    return true;
-  }
-
-  template <typename T>
-  bool set(const std::string& key_prefix,
-           const unordered_map<std::string, T>& values) {
-    bool rt = true;
-    for (const auto& iter : values) {
-      if (iter.second.empty()) {
-        rt = rt && client_.rm(key_prefix + iter.first).is_ok();
-      } else {
-        rt = rt && client_
-                       .put(key_prefix + iter.first,
-                            iter.second.serialize_to_json().dump())
-                       .is_ok();
-      }
-    }
-    return true;
-  }
-
-  bool set(const std::string& key_prefix, const Murmur3KeyCacheMap& values);
-
-  bool set(const std::string& key, const std::string& value);
+  EtcdClient(const std::string& etcd_addr, int32_t max_inflight_txns = 8);
+  ~EtcdClient() override;
+
+  using MetadataStore::batch_update_async;
+  using MetadataStore::get;
+  using MetadataStore::get_prefix;
+  using MetadataStore::rm;
+
+  bool put(const std::string& key, const std::string& value) override;
+
+  bool get(const std::string& key, std::string* value) override;
+
+  bool get_prefix(
+      const std::string& key_prefix,
+      std::unordered_map<std::string, std::string>* values) override;
+
+  bool rm(const std::string& key) override;
+
+  // apply the puts and deletes in as few transactions as etcd accepts,
+  // which are sent concurrently.
+  bool batch_update(
+      const std::vector<std::pair<std::string, std::string>>& puts,
+      const std::vector<std::string>& deletes) override;
+
+  void batch_update_async(BatchUpdate update, UpdateCallback done) override;
 
   // create key-value with lease and transaction
-  bool set(const std::string& key, const std::string& value, const int ttl);
-
-  bool rm(const std::string& key);
-
-  bool rm(const std::string& key_prefix,
-          const std::unordered_set<std::string>& keys);
-
-  template <typename T>
-  bool get(const std::string& key, T* value) {
-    auto response = client_.get(key);
-    if (!response.is_ok()) {
-      LOG(ERROR) << "etcd get " << key
-                 << " failed: " << response.error_message();
-      return false;
-    }
-    if (value) {
-      return value->parse_from_json(response.value().as_string());
-    } else {
-      return true;
-    }
-  }
-
-  bool get(const std::string& key_prefix, std::string* value);
-
-  template <typename T>
-  bool get_prefix(const std::string& key_prefix,
-                  std::unordered_map<std::string, T>* values) {
-    auto response = client_.ls(key_prefix);
-    if (!response.is_ok()) {
-      LOG(ERROR) << "etcd get " << key_prefix
-                 << " failed: " << response.error_message();
-      return false;
-    }
-
-    for (int i = 0; i < response.keys().size(); i++) {
-      auto key_str = response.key(i).substr(key_prefix.size());
-      auto json_str = response.value(i).as_string();
-
-      T value;
-      if (!value.parse_from_json(json_str)) {
-        LOG(ERROR) << "Parse json fail: " << json_str;
-        continue;
-      }
-
-      values->insert_or_assign(std::move(key_str), std::move(value));
-    }
-    return true;
-  }
-
-  bool get_prefix(const std::string& key_prefix, Murmur3KeyCacheMap* values);
-
-  bool get_prefix(const std::string& key_prefix,
-                  std::unordered_map<std::string, std::string>* values);
+  bool create_with_lease(const std::string& key,
+                         const std::string& value,
+                         int ttl) override;
 
   void add_watch(const std::string& key_prefix,
                  Callback callback,
-                 bool recursive = true);
+                 bool recursive = true) override;
 
-  void remove_watch(const std::string& key_prefix);
+  void remove_watch(const std::string& key_prefix) override;
 
-  void stop_watch();
+  void stop_watch() override;
 
  private:
   struct WatcherInfo {
@@ -136,11 +83,23 @@ class EtcdClient {
     Callback callback;
   };
 
+  // wait for a free slot of the in-flight window
+  void acquire_txn_slot();
+  void release_txn_slot();
+
   etcd::SyncClient client_;
   std::string etcd_addr_;
+
+  int32_t max_inflight_txns_;
+  std::mutex txn_mutex_;
+  std::condition_variable txn_cv_;
+  int32_t num_inflight_txns_ = 0;
   std::mutex watchers_mutex_;
   std::map<std::string, WatcherInfo> watchers_;
   std::vector<std::shared_ptr<etcd::KeepAlive>> keep_alives_;
+
+  // declared last to finish the transactions in flight first
+  ThreadPool txn_pool_;
 };
 
 }  // namespace xllm_service
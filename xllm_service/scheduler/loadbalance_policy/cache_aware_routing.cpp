@@ -15,72 +15,193 @@ limitations under the License.
 
 #include "cache_aware_routing.h"
 
+#include <algorithm>
+#include <numeric>
+#include <unordered_map>
+
+#include "common/global_gflags.h"
+
 namespace xllm_service {
 
-constexpr float MIN_SCORE = -2.0;
+CacheAwareRouting::CacheAwareRouting(
+    std::shared_ptr<InstanceMgr> instance_mgr,
+    std::shared_ptr<GlobalKVCacheMgr> global_kvcache_mgr)
+    : LoadBalancePolicy(instance_mgr),
+      pipeline_(weighted(PrefixHitScorer(), &FLAGS_car_prefix_hit_weight),
+                weighted(CacheUsageScorer(), &FLAGS_car_cache_usage_weight),
+                weighted(QueueDepthScorer(), &FLAGS_car_queue_depth_weight)),
+      global_kvcache_mgr_(global_kvcache_mgr) {}
+
+void CacheAwareRouting::get_candidates(
+    const CandidateQuery& query,
+    std::vector<InstanceCandidate>* prefill_candidates,
+    std::vector<InstanceCandidate>* decode_candidates) {
+  auto collect = [&](const CandidateQuery& query) {
+    std::vector<InstanceCandidate> candidates;
+    instance_mgr_->get_candidates(query, &candidates);
+    prefer_candidates(&candidates,
+                      HealthFilter{FLAGS_routing_max_heartbeat_age_ms});
+    // instances without load metrics would be scored as idle
+    filter_candidates(&candidates, LoadReportedFilter());
+    *decode_candidates = candidates;
+    filter_candidates(decode_candidates, RoleFilter{InstanceType::DECODE});
+    *prefill_candidates = std::move(candidates);
+    filter_candidates(prefill_candidates, RoleFilter{InstanceType::PREFILL});
+  };
+  collect(query);
+  if (FLAGS_admission_queue_size <= 0) {
+    return;
+  }
+
+  // admitted requests go to instances with room, if the instances holding
+  // the prefix have none, look at all instances
+  const RoomFilter room_filter{InstanceMgr::capacity_limits()};
+  auto has_room = [&](const std::vector<InstanceCandidate>& candidates) {
+    return candidates.empty() ||
+           std::any_of(candidates.begin(), candidates.end(), room_filter);
+  };
+  if (query.names != nullptr &&
+      (!has_room(*prefill_candidates) || !has_room(*decode_candidates))) {
+    collect(CandidateQuery());
+  }
+  prefer_candidates(prefill_candidates, room_filter);
+  prefer_candidates(decode_candidates, room_filter);
+}
 
 bool CacheAwareRouting::select_instances_pair(
     std::shared_ptr<Request> request) {
-  LoadBalanceInfos lb_infos;
+  OverlapScores& overlap_scores = request->overlap_scores;
   if (!request->token_ids.empty()) {
     Slice<int32_t> token_ids(request->token_ids.data(),
                              request->token_ids.size());
-    global_kvcache_mgr_->match(token_ids, &lb_infos.overlap_scores);
-    DLOG(INFO) << lb_infos.debug_string();
+    global_kvcache_mgr_->match(token_ids, &overlap_scores);
+    request->prefix_matched = true;
+    DLOG(INFO) << overlap_scores.debug_string();
   }
 
-  instance_mgr_->get_load_metrics(&lb_infos);
-  DLOG(INFO) << lb_infos.debug_string();
-
-  if (lb_infos.prefill_load_metrics.size() == 0) {
+  CandidateQuery query;
+  query.names = &overlap_scores.instances;
+  std::vector<InstanceCandidate> prefill_candidates;
+  std::vector<InstanceCandidate> decode_candidates;
+  get_candidates(query, &prefill_candidates, &decode_candidates);
+  if (prefill_candidates.empty()) {
     LOG(INFO) << "No node available!";
     return false;
   }
 
-  // find preifll
-  cost_function(lb_infos.overlap_scores.hbm_instance_score,
-                lb_infos.overlap_scores.max_block_num,
-                lb_infos.prefill_load_metrics,
-                lb_infos.prefill_max_waiting_requests_num,
-                &request->routing.prefill_name);
-
-  // find decode
-  if (lb_infos.decode_load_metrics.size()) {
-    cost_function(lb_infos.overlap_scores.hbm_instance_score,
-                  lb_infos.overlap_scores.max_block_num,
-                  lb_infos.decode_load_metrics,
-                  lb_infos.decode_max_waiting_requests_num,
-                  &request->routing.decode_name);
+  ScoringContext context;
+  context.overlap_scores = &overlap_scores;
+  normalize(prefill_candidates, &context);
+  pipeline_.score(&prefill_candidates, context);
+  if (decode_candidates.empty()) {
+    request->routing.prefill_name = select_best(prefill_candidates)->name;
+    return true;
   }
 
+  normalize(decode_candidates, &context);
+  pipeline_.score(&decode_candidates, context);
+  // the kv cache transfer time is weighted against the scores relative to
+  // the target ttft
+  auto [prefill, decode] = select_best_pair(
+      prefill_candidates,
+      decode_candidates,
+      instance_mgr_->topology(),
+      request->token_ids.size(),
+      FLAGS_car_transfer_weight / std::max(FLAGS_target_ttft, 1));
+  request->routing.prefill_name = prefill->name;
+  request->routing.decode_name = decode->name;
   return true;
 }
 
-void CacheAwareRouting::cost_function(
-    const std::unordered_map<std::string, uint32_t>& overlap_scores,
-    const uint32_t& max_block_num,
-    const std::unordered_map<std::string, LoadMetrics>& load_metrics,
-    const int64_t& max_waiting_requests_num,
-    std::string* best_choice) {
-  float best_score = MIN_SCORE;
-  for (const auto& it : load_metrics) {
-    const auto matched_blocks_it = overlap_scores.find(it.first);
-    uint32_t matched_blocks = 0;
-    if (matched_blocks_it != overlap_scores.end()) {
-      matched_blocks = matched_blocks_it->second;
+void CacheAwareRouting::select_instances_pairs(
+    const std::vector<BatchedRequest*>& batch) {
+  // requests with long prefix hits first, they gain the most from getting
+  // the instance holding their prefix
+  std::vector<size_t> order(batch.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return batch[a]->overlap_scores.max_matched_block_num >
+           batch[b]->overlap_scores.max_matched_block_num;
+  });
+
+  const Topology& topology = instance_mgr_->topology();
+  const double transfer_weight =
+      topology.enabled()
+          ? FLAGS_car_transfer_weight / std::max(FLAGS_target_ttft, 1)
+          : 0;
+  // the requests assigned to an instance in this batch, counted as waiting on
+  // it on top of its reported load
+  std::unordered_map<std::string, uint64_t> num_assigned;
+  auto add_assigned = [&](std::vector<InstanceCandidate>* candidates) {
+    for (auto& candidate : *candidates) {
+      auto it = num_assigned.find(candidate.name);
+      if (it != num_assigned.end()) {
+        candidate.load_metrics.waiting_requests_num += it->second;
+      }
+    }
+  };
+  // the candidates of the requests without a prefix hit, collected once
+  std::vector<InstanceCandidate> all_prefill_candidates;
+  std::vector<InstanceCandidate> all_decode_candidates;
+  bool has_all_candidates = false;
+
+  for (size_t i : order) {
+    const OverlapScores& overlap_scores = batch[i]->overlap_scores;
+    std::vector<InstanceCandidate> prefill_candidates;
+    std::vector<InstanceCandidate> decode_candidates;
+    if (!overlap_scores.instances.empty()) {
+      // the instances holding the prefix as in `select_instances_pair`
+      CandidateQuery query;
+      query.names = &overlap_scores.instances;
+      get_candidates(query, &prefill_candidates, &decode_candidates);
+    } else {
+      if (!has_all_candidates) {
+        get_candidates(
+            CandidateQuery(), &all_prefill_candidates, &all_decode_candidates);
+        has_all_candidates = true;
+      }
+      prefill_candidates = all_prefill_candidates;
+      decode_candidates = all_decode_candidates;
+    }
+    if (prefill_candidates.empty()) {
+      LOG(INFO) << "No node available!";
+      continue;
     }
 
-    auto score =
-        (max_block_num == 0 ? 0 : matched_blocks / max_block_num) -
-        it.second.gpu_cache_usage_perc -
-        (max_waiting_requests_num == 0
-             ? 0
-             : it.second.waiting_requests_num / max_waiting_requests_num);
+    auto& routing = batch[i]->request->routing;
+    ScoringContext context;
+    context.overlap_scores = &overlap_scores;
+    add_assigned(&prefill_candidates);
+    normalize(prefill_candidates, &context);
+    pipeline_.score(&prefill_candidates, context);
+    const InstanceCandidate* prefill = select_best(&prefill_candidates);
+    routing.prefill_name = prefill->name;
+    num_assigned[prefill->name] += 1;
+    if (decode_candidates.empty()) {
+      continue;
+    }
 
-    if (score > best_score) {
-      best_score = score;
-      *best_choice = it.first;
+    add_assigned(&decode_candidates);
+    normalize(decode_candidates, &context);
+    pipeline_.score(&decode_candidates, context);
+    if (transfer_weight > 0) {
+      // weight the kv cache transfer time from the assigned prefill instance
+      // as in `select_instances_pair`
+      const TopologyLocation prefill_location = topology.locate(prefill->name);
+      const int64_t num_tokens = batch[i]->request->token_ids.size();
+      for (auto& decode : decode_candidates) {
+        decode.score -=
+            transfer_weight *
+            topology.transfer_time(
+                prefill_location, topology.locate(decode.name), num_tokens);
+      }
     }
+    routing.decode_name = select_best(&decode_candidates)->name;
+    num_assigned[routing.decode_name] += 1;
+  }
+
+  for (auto* item : batch) {
+    item->selected = !item->request->routing.prefill_name.empty();
   }
 }
 
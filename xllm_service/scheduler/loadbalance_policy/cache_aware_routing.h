@@ -18,30 +18,45 @@ limitations under the License.
 #include "common/macros.h"
 #include "loadbalance_policy.h"
 #include "scheduler/managers/global_kvcache_mgr.h"
+#include "scoring_pipeline.h"
 
 namespace xllm_service {
 
+// Routes to the instances holding the longest prefix of the request with the
+// least loads. Instances are scored by their prefix hit, gpu cache usage and
+// waiting requests, weighted by the `FLAGS_car_*_weight` flags. Only the
+// instances with a prefix hit are considered, or the least loaded one of a
+// role if none of them has a hit.
 class CacheAwareRouting final : public LoadBalancePolicy {
  public:
   CacheAwareRouting(std::shared_ptr<InstanceMgr> instance_mgr,
-                    std::shared_ptr<GlobalKVCacheMgr> global_kvcache_mgr)
-      : global_kvcache_mgr_(global_kvcache_mgr),
-        LoadBalancePolicy(instance_mgr) {};
+                    std::shared_ptr<GlobalKVCacheMgr> global_kvcache_mgr);
 
   virtual ~CacheAwareRouting() = default;
 
   bool select_instances_pair(std::shared_ptr<Request> request) override;
 
+  // assign the requests greedily, every request sees the waiting requests
+  // added by the requests assigned before it. A request is routed among the
+  // instances holding its prefix like a single one, a request without a
+  // prefix hit among all instances, so that the batch spreads them.
+  void select_instances_pairs(
+      const std::vector<BatchedRequest*>& batch) override;
+
+  bool use_overlap_scores() const override { return true; }
+
  private:
   DISALLOW_COPY_AND_ASSIGN(CacheAwareRouting);
 
-  void cost_function(
-      const std::unordered_map<std::string, uint32_t>& overlap_scores,
-      const uint32_t& max_block_num,
-      const std::unordered_map<std::string, LoadMetrics>& load_metrics,
-      const int64_t& max_waiting_requests_num,
-      std::string* best_choice);
+  using Pipeline =
+      ScoringPipeline<PrefixHitScorer, CacheUsageScorer, QueueDepthScorer>;
+
+  // collect the healthy candidates of both roles which reported their load
+  void get_candidates(const CandidateQuery& query,
+                      std::vector<InstanceCandidate>* prefill_candidates,
+                      std::vector<InstanceCandidate>* decode_candidates);
 
+  Pipeline pipeline_;
   std::shared_ptr<GlobalKVCacheMgr> global_kvcache_mgr_;
 };
 
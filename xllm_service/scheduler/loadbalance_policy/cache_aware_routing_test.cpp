@@ -0,0 +1,131 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "cache_aware_routing.h"
+
+#include <gtest/gtest.h>
+
+#include <unordered_map>
+
+#include "common/hash_util.h"
+#include "scheduler/metadata_store/memory_store.h"
+
+namespace xllm_service::test {
+
+namespace {
+InstanceMetaInfo make_instance(const std::string& name, InstanceType type) {
+  InstanceMetaInfo metainfo;
+  metainfo.name = name;
+  metainfo.rpc_address = name;
+  metainfo.type = type;
+  metainfo.dp_size = 1;
+  return metainfo;
+}
+}  // namespace
+
+// a cache aware routing policy of the master service on a memory store
+class CacheAwareRoutingTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    options_.block_size(4);
+    metadata_store_ = std::make_shared<MemoryStore>();
+    instance_mgr_ = std::make_shared<InstanceMgr>(
+        options_, metadata_store_, /*is_master_service=*/true);
+    kvcache_mgr_ = std::make_shared<GlobalKVCacheMgr>(
+        options_, metadata_store_, /*is_master_service=*/true);
+    policy_ = std::make_unique<CacheAwareRouting>(instance_mgr_, kvcache_mgr_);
+  }
+
+  // register an idle instance which has reported its load
+  void register_instance(const std::string& name, InstanceType type) {
+    ASSERT_EQ(ErrorCode::OK,
+              instance_mgr_->register_instance(make_instance(name, type)));
+    proto::LoadMetrics load_metrics;
+    load_metrics.set_waiting_requests_num(0);
+    load_metrics.set_gpu_cache_usage_perc(0.1);
+    instance_mgr_->record_load_metrics_update(name, load_metrics);
+    ASSERT_TRUE(instance_mgr_->upload_load_metrics());
+  }
+
+  // cache the first block of `token_ids` on the instance
+  void cache_block(const std::string& name,
+                   const std::vector<int32_t>& token_ids) {
+    Murmur3Key key;
+    murmur_hash3(nullptr, Slice<int32_t>(token_ids).slice(0, 4), key.data);
+    proto::KvCacheEvent event;
+    event.add_stored_cache(key.to_string());
+    kvcache_mgr_->record_updated_kvcaches(name, event);
+    ASSERT_TRUE(kvcache_mgr_->upload_kvcache());
+  }
+
+  BatchedRequest make_batched_request(std::vector<int32_t> token_ids) {
+    BatchedRequest item;
+    item.request = std::make_shared<Request>();
+    item.request->token_ids = std::move(token_ids);
+    kvcache_mgr_->match(Slice<int32_t>(item.request->token_ids),
+                        &item.overlap_scores);
+    return item;
+  }
+
+  Options options_;
+  std::shared_ptr<MetadataStore> metadata_store_;
+  std::shared_ptr<InstanceMgr> instance_mgr_;
+  std::shared_ptr<GlobalKVCacheMgr> kvcache_mgr_;
+  std::unique_ptr<CacheAwareRouting> policy_;
+};
+
+TEST_F(CacheAwareRoutingTest, SpreadBatchOverInstancesHoldingPrefix) {
+  const std::string first_name = "127.0.0.1:19300";
+  const std::string second_name = "127.0.0.1:19301";
+  const std::string other_name = "127.0.0.1:19302";
+  const std::string decode_name = "127.0.0.1:19303";
+  register_instance(first_name, InstanceType::PREFILL);
+  register_instance(second_name, InstanceType::PREFILL);
+  register_instance(other_name, InstanceType::PREFILL);
+  register_instance(decode_name, InstanceType::DECODE);
+  const std::vector<int32_t> token_ids = {1, 2, 3, 4, 5, 6};
+  cache_block(first_name, token_ids);
+  cache_block(second_name, token_ids);
+
+  std::vector<BatchedRequest> items;
+  for (int32_t i = 0; i < 4; ++i) {
+    items.emplace_back(make_batched_request(token_ids));
+  }
+  // without a prefix hit
+  items.emplace_back(make_batched_request({7, 8, 9, 10}));
+  std::vector<BatchedRequest*> batch;
+  for (auto& item : items) {
+    batch.emplace_back(&item);
+  }
+  policy_->select_instances_pairs(batch);
+
+  // the requests with the prefix stay on the instances holding it, and the
+  // batch does not pile them onto one of them
+  std::unordered_map<std::string, int32_t> num_routed;
+  for (int32_t i = 0; i < 4; ++i) {
+    ASSERT_TRUE(items[i].selected);
+    num_routed[items[i].request->routing.prefill_name] += 1;
+    EXPECT_EQ(decode_name, items[i].request->routing.decode_name);
+  }
+  EXPECT_EQ(0, num_routed.count(other_name));
+  EXPECT_EQ(2, num_routed[first_name]);
+  EXPECT_EQ(2, num_routed[second_name]);
+
+  // the request without a hit goes to the instance the batch left idle
+  ASSERT_TRUE(items[4].selected);
+  EXPECT_EQ(other_name, items[4].request->routing.prefill_name);
+}
+
+}  // namespace xllm_service::test
@@ -0,0 +1,63 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "consistent_hashing.h"
+
+#include <algorithm>
+
+#include "common/global_gflags.h"
+#include "common/hash_util.h"
+
+namespace xllm_service {
+
+ConsistentHashing::ConsistentHashing(const Options& options,
+                                     std::shared_ptr<InstanceMgr> instance_mgr)
+    : LoadBalancePolicy(instance_mgr), options_(options) {}
+
+bool ConsistentHashing::select_instances_pair(
+    std::shared_ptr<Request> request) {
+  const std::string key = session_key(*request);
+  if (!instance_mgr_->select_instance_by_hash(
+          InstanceType::PREFILL,
+          key,
+          FLAGS_consistent_hash_load_factor,
+          &request->routing.prefill_name)) {
+    LOG(ERROR) << "No prefill or default instance found!";
+    return false;
+  }
+  instance_mgr_->select_instance_by_hash(InstanceType::DECODE,
+                                         key,
+                                         FLAGS_consistent_hash_load_factor,
+                                         &request->routing.decode_name);
+  return true;
+}
+
+std::string ConsistentHashing::session_key(const Request& request) const {
+  if (!request.session_key.empty()) {
+    return request.session_key;
+  }
+  if (request.token_ids.empty()) {
+    // no affinity, spread the requests by their ids
+    return request.service_request_id;
+  }
+  const size_t num_tokens = std::min<size_t>(
+      request.token_ids.size(), std::max(options_.block_size(), 1));
+  Murmur3Key key;
+  murmur_hash3(
+      nullptr, Slice<int32_t>(request.token_ids.data(), num_tokens), key.data);
+  return key.to_string();
+}
+
+}  // namespace xllm_service
@@ -0,0 +1,50 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#include "common/macros.h"
+#include "common/options.h"
+#include "loadbalance_policy.h"
+
+namespace xllm_service {
+
+// Consistent hashing with bounded loads: the requests of a session go to the
+// instance of the session key on the consistent hash ring, so every turn of
+// a chat finds the kv cache of the previous turns even when the cache
+// heartbeats lag. An instance above `FLAGS_consistent_hash_load_factor`
+// times the average load passes the request on to the next instance on the
+// ring. The session key comes from the `FLAGS_session_key_header` header, or
+// else the hash of the first prompt block, which is shared by the turns of a
+// chat. Clients whose prompts start with a long common system prompt should
+// set the header.
+class ConsistentHashing final : public LoadBalancePolicy {
+ public:
+  ConsistentHashing(const Options& options,
+                    std::shared_ptr<InstanceMgr> instance_mgr);
+
+  virtual ~ConsistentHashing() = default;
+
+  bool select_instances_pair(std::shared_ptr<Request> request) override;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(ConsistentHashing);
+
+  std::string session_key(const Request& request) const;
+
+  Options options_;
+};
+
+}  // namespace xllm_service
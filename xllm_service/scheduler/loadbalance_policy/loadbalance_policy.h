@@ -21,6 +21,14 @@ limitations under the License.
 
 namespace xllm_service {
 
+// a request routed together with the requests arriving at the same time
+struct BatchedRequest {
+  std::shared_ptr<Request> request;
+  // prefix match of the request, only filled for policies which use it
+  OverlapScores overlap_scores;
+  bool selected = false;
+};
+
 class LoadBalancePolicy {
  public:
   LoadBalancePolicy(std::shared_ptr<InstanceMgr> instance_mgr)
@@ -30,6 +38,21 @@ class LoadBalancePolicy {
 
   virtual bool select_instances_pair(std::shared_ptr<Request> request) = 0;
 
+  // route a batch of requests jointly, the default routes them one by one
+  virtual void select_instances_pairs(
+      const std::vector<BatchedRequest*>& batch) {
+    for (auto* item : batch) {
+      item->selected = select_instances_pair(item->request);
+    }
+  }
+
+  // whether `select_instances_pairs` needs the prefix match of the requests
+  virtual bool use_overlap_scores() const { return false; }
+
+  // whether the roles of MIX instances are rebalanced periodically for the
+  // policy
+  virtual bool balances_roles() const { return false; }
+
  protected:
   std::shared_ptr<InstanceMgr> instance_mgr_;
 };
@@ -0,0 +1,105 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "p2c.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "common/global_gflags.h"
+
+namespace xllm_service {
+
+namespace {
+// the instance with the most matched blocks, empty if there is no hit
+std::string longest_hit(const OverlapScores& overlap_scores) {
+  std::string name;
+  uint32_t max_block_num = 0;
+  for (const auto& [instance_name, block_num] :
+       overlap_scores.hbm_instance_score) {
+    if (block_num > max_block_num ||
+        (block_num == max_block_num && instance_name < name)) {
+      max_block_num = block_num;
+      name = instance_name;
+    }
+  }
+  return name;
+}
+}  // namespace
+
+P2C::P2C(const Options& options,
+         std::shared_ptr<InstanceMgr> instance_mgr,
+         std::shared_ptr<GlobalKVCacheMgr> global_kvcache_mgr)
+    : LoadBalancePolicy(instance_mgr),
+      options_(options),
+      global_kvcache_mgr_(global_kvcache_mgr) {}
+
+bool P2C::select_instances_pair(std::shared_ptr<Request> request) {
+  OverlapScores& overlap_scores = request->overlap_scores;
+  if (!request->token_ids.empty()) {
+    Slice<int32_t> token_ids(request->token_ids.data(),
+                             request->token_ids.size());
+    global_kvcache_mgr_->match(token_ids, &overlap_scores);
+    request->prefix_matched = true;
+  }
+
+  const size_t num_choices = std::max(FLAGS_p2c_num_choices, 1);
+  std::vector<InstanceSample> samples;
+  if (!instance_mgr_->sample_instances(InstanceType::PREFILL,
+                                       num_choices,
+                                       longest_hit(overlap_scores),
+                                       &samples)) {
+    LOG(ERROR) << "No prefill or default instance found!";
+    return false;
+  }
+  request->routing.prefill_name = select_best(samples, overlap_scores);
+
+  // the prefix cache only saves prefill work, decode instances are chosen by
+  // load alone
+  if (instance_mgr_->sample_instances(
+          InstanceType::DECODE, num_choices, "", &samples)) {
+    request->routing.decode_name = select_best(samples, OverlapScores());
+  }
+  return true;
+}
+
+std::string P2C::select_best(const std::vector<InstanceSample>& samples,
+                             const OverlapScores& overlap_scores) const {
+  // admitted requests skip the saturated samples, unless all of them are
+  const bool check_room =
+      FLAGS_admission_queue_size > 0 &&
+      std::any_of(samples.begin(), samples.end(), [](const auto& sample) {
+        return sample.has_room;
+      });
+  const InstanceSample* best = nullptr;
+  double min_cost = std::numeric_limits<double>::max();
+  for (const auto& sample : samples) {
+    if (check_room && !sample.has_room) {
+      continue;
+    }
+    double cost = sample.outstanding_tokens;
+    auto it = overlap_scores.hbm_instance_score.find(sample.name);
+    if (it != overlap_scores.hbm_instance_score.end()) {
+      cost -= FLAGS_p2c_prefix_hit_weight * it->second * options_.block_size();
+    }
+    if (cost < min_cost) {
+      min_cost = cost;
+      best = &sample;
+    }
+  }
+  return best->name;
+}
+
+}  // namespace xllm_service
@@ -0,0 +1,50 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#include "common/macros.h"
+#include "common/options.h"
+#include "loadbalance_policy.h"
+#include "scheduler/managers/global_kvcache_mgr.h"
+
+namespace xllm_service {
+
+// Power of two choices: sample a few instances at random and route to the
+// one with the least outstanding tokens, less the tokens of its prefix cache
+// hit. The instance with the longest prefix hit is always sampled as well.
+// The cost of a decision does not grow with the number of instances.
+class P2C final : public LoadBalancePolicy {
+ public:
+  P2C(const Options& options,
+      std::shared_ptr<InstanceMgr> instance_mgr,
+      std::shared_ptr<GlobalKVCacheMgr> global_kvcache_mgr);
+
+  virtual ~P2C() = default;
+
+  bool select_instances_pair(std::shared_ptr<Request> request) override;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(P2C);
+
+  // the name of the sample with the least cost
+  std::string select_best(const std::vector<InstanceSample>& samples,
+                          const OverlapScores& overlap_scores) const;
+
+  Options options_;
+  std::shared_ptr<GlobalKVCacheMgr> global_kvcache_mgr_;
+};
+
+}  // namespace xllm_service
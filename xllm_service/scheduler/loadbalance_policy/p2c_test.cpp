@@ -0,0 +1,140 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "p2c.h"
+
+#include <gflags/gflags.h>
+#include <gtest/gtest.h>
+
+#include "common/global_gflags.h"
+#include "common/hash_util.h"
+#include "scheduler/metadata_store/memory_store.h"
+
+namespace xllm_service::test {
+
+namespace {
+InstanceMetaInfo make_instance(const std::string& name, InstanceType type) {
+  InstanceMetaInfo metainfo;
+  metainfo.name = name;
+  metainfo.rpc_address = name;
+  metainfo.type = type;
+  metainfo.dp_size = 1;
+  return metainfo;
+}
+
+std::shared_ptr<Request> make_request(std::vector<int32_t> token_ids) {
+  auto request = std::make_shared<Request>();
+  request->token_ids = std::move(token_ids);
+  return request;
+}
+}  // namespace
+
+// a P2C policy of the master service on a memory store
+class P2CTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    options_.block_size(4);
+    metadata_store_ = std::make_shared<MemoryStore>();
+    instance_mgr_ = std::make_shared<InstanceMgr>(
+        options_, metadata_store_, /*is_master_service=*/true);
+    kvcache_mgr_ = std::make_shared<GlobalKVCacheMgr>(
+        options_, metadata_store_, /*is_master_service=*/true);
+    policy_ = std::make_unique<P2C>(options_, instance_mgr_, kvcache_mgr_);
+  }
+
+  void register_instance(const std::string& name, InstanceType type) {
+    ASSERT_EQ(ErrorCode::OK,
+              instance_mgr_->register_instance(make_instance(name, type)));
+  }
+
+  // cache the first block of `token_ids` on the instance
+  void cache_block(const std::string& name,
+                   const std::vector<int32_t>& token_ids) {
+    Murmur3Key key;
+    murmur_hash3(nullptr, Slice<int32_t>(token_ids).slice(0, 4), key.data);
+    proto::KvCacheEvent event;
+    event.add_stored_cache(key.to_string());
+    kvcache_mgr_->record_updated_kvcaches(name, event);
+    ASSERT_TRUE(kvcache_mgr_->upload_kvcache());
+  }
+
+  gflags::FlagSaver flag_saver_;
+  Options options_;
+  std::shared_ptr<MetadataStore> metadata_store_;
+  std::shared_ptr<InstanceMgr> instance_mgr_;
+  std::shared_ptr<GlobalKVCacheMgr> kvcache_mgr_;
+  std::unique_ptr<P2C> policy_;
+};
+
+TEST_F(P2CTest, RouteToLongestPrefixHit) {
+  FLAGS_p2c_num_choices = 1;
+  for (int32_t i = 0; i < 8; ++i) {
+    register_instance("127.0.0.1:1920" + std::to_string(i),
+                      InstanceType::PREFILL);
+  }
+  const std::string decode_name = "127.0.0.1:19210";
+  register_instance(decode_name, InstanceType::DECODE);
+  const std::string cached_name = "127.0.0.1:19203";
+  const std::vector<int32_t> token_ids = {1, 2, 3, 4, 5, 6};
+  cache_block(cached_name, token_ids);
+
+  // the instance with the hit is sampled on top of the random choice and
+  // wins on the saved prefill tokens
+  for (int32_t i = 0; i < 20; ++i) {
+    auto request = make_request(token_ids);
+    ASSERT_TRUE(policy_->select_instances_pair(request));
+    EXPECT_EQ(cached_name, request->routing.prefill_name);
+    EXPECT_EQ(decode_name, request->routing.decode_name);
+    EXPECT_TRUE(request->prefix_matched);
+  }
+}
+
+TEST_F(P2CTest, RouteToLeastOutstandingTokens) {
+  FLAGS_p2c_num_choices = 2;
+  const std::string loaded_name = "127.0.0.1:19220";
+  const std::string idle_name = "127.0.0.1:19221";
+  const std::string decode_name = "127.0.0.1:19222";
+  register_instance(loaded_name, InstanceType::PREFILL);
+  register_instance(idle_name, InstanceType::PREFILL);
+  register_instance(decode_name, InstanceType::DECODE);
+
+  auto running = make_request(std::vector<int32_t>(64, 1));
+  running->routing.prefill_name = loaded_name;
+  running->routing.decode_name = decode_name;
+  instance_mgr_->update_request_metrics(running, RequestAction::SCHEDULE);
+
+  // both instances are sampled
+  for (int32_t i = 0; i < 20; ++i) {
+    auto request = make_request({7, 8, 9, 10});
+    ASSERT_TRUE(policy_->select_instances_pair(request));
+    EXPECT_EQ(idle_name, request->routing.prefill_name);
+  }
+}
+
+TEST_F(P2CTest, RouteWithFewerInstancesThanChoices) {
+  FLAGS_p2c_num_choices = 2;
+  EXPECT_FALSE(policy_->select_instances_pair(make_request({1, 2, 3, 4})));
+
+  // a single default instance takes the prefill, no instance has the decode
+  // role
+  const std::string name = "127.0.0.1:19230";
+  register_instance(name, InstanceType::DEFAULT);
+  auto request = make_request({1, 2, 3, 4});
+  ASSERT_TRUE(policy_->select_instances_pair(request));
+  EXPECT_EQ(name, request->routing.prefill_name);
+  EXPECT_EQ("", request->routing.decode_name);
+}
+
+}  // namespace xllm_service::test
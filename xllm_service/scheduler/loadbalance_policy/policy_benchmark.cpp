@@ -0,0 +1,98 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// Routes a synthetic request stream over a large simulated fleet with the
+// shipped load balance policies, and compares the TTFT, the prefix cache hit
+// ratio and the routing cost per decision. The policies run on the real
+// managers in the `ClusterSimulator`, so the routing cost includes the prefix
+// match and the instance lookups of the policy.
+//
+// The request rate grows with the fleet, some instances run at half speed.
+// Every request starts with the shared prefix of its prefix group. P2C
+// samples --p2c_num_choices instances, run it with 2 and 4 to compare.
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "common/global_gflags.h"
+#include "scheduler/simulator/cluster_simulator.h"
+
+DEFINE_string(policies, "RR,CAR,P2C", "Comma separated policies to compare.");
+DEFINE_int32(num_prefill_instances, 256, "The number of prefill instances.");
+DEFINE_int32(num_decode_instances, 64, "The number of decode instances.");
+DEFINE_int32(num_requests, 20000, "The number of routed requests.");
+DEFINE_double(qps_per_instance, 0.5, "Request rate per prefill instance.");
+DEFINE_double(slow_fraction, 0.25, "Fraction of instances at half speed.");
+DEFINE_int32(num_prefixes, 4096, "The number of prefix groups.");
+DEFINE_double(prefix_skew, 1.0, "Zipf exponent of the prefix popularity.");
+DEFINE_int32(prefix_len, 1024, "Length of the shared prefixes.");
+DEFINE_int32(seed, 1, "Seed of the request stream.");
+
+int main(int argc, char* argv[]) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  using namespace xllm_service;
+
+  if (FLAGS_num_prefill_instances < 1 || FLAGS_num_requests < 1) {
+    std::fprintf(stderr, "need at least one instance and one request\n");
+    return 1;
+  }
+  SyntheticTraceOptions trace_options;
+  trace_options.num_requests = FLAGS_num_requests;
+  trace_options.qps = FLAGS_qps_per_instance * FLAGS_num_prefill_instances;
+  trace_options.num_prefixes = FLAGS_num_prefixes;
+  trace_options.prefix_skew = FLAGS_prefix_skew;
+  trace_options.prefix_len = FLAGS_prefix_len;
+  trace_options.seed = FLAGS_seed;
+  const auto trace = generate_trace(trace_options);
+
+  ClusterSimulatorOptions options;
+  options.options.block_size(FLAGS_block_size)
+      .murmur_hash3_seed(FLAGS_murmur_hash3_seed);
+  options.num_prefill_instances = FLAGS_num_prefill_instances;
+  options.num_decode_instances = FLAGS_num_decode_instances;
+  options.slow_fraction = FLAGS_slow_fraction;
+  set_default_profile(&options);
+
+  std::printf("requests: %zu, prefill instances: %d, qps: %.1f\n",
+              trace.size(),
+              options.num_prefill_instances,
+              trace_options.qps);
+  ClusterSimulator simulator(options);
+  std::stringstream policies(FLAGS_policies);
+  std::string policy;
+  while (std::getline(policies, policy, ',')) {
+    SimulationReport report;
+    if (!simulator.run(policy, trace, &report)) {
+      std::fprintf(stderr, "skip policy %s\n", policy.c_str());
+      continue;
+    }
+    std::printf(
+        "%-16s failed: %5ld  ttft mean/p99: %8.1f/%8.1f ms  hit: %5.1f%%"
+        "  routing: %7.0f ns\n",
+        report.policy.c_str(),
+        report.num_failed,
+        report.ttft.mean,
+        report.ttft.p99,
+        100 * report.cache_hit_rate,
+        report.routing_time_ns);
+  }
+  return 0;
+}
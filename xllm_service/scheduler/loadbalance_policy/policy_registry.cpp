@@ -0,0 +1,85 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "policy_registry.h"
+
+#include <algorithm>
+
+#include "cache_aware_routing.h"
+#include "consistent_hashing.h"
+#include "p2c.h"
+#include "round_robin.h"
+#include "slo_aware_policy.h"
+
+namespace xllm_service {
+
+PolicyRegistry& PolicyRegistry::instance() {
+  static PolicyRegistry registry;
+  return registry;
+}
+
+PolicyRegistry::PolicyRegistry() {
+  // registered here instead of by static initializers in the policy files,
+  // which the linker drops from a static library when nothing refers to them
+  register_policy("RR", [](const PolicyContext& context) {
+    return std::make_unique<RoundRobin>(context.instance_mgr);
+  });
+  register_policy("CAR", [](const PolicyContext& context) {
+    return std::make_unique<CacheAwareRouting>(context.instance_mgr,
+                                               context.global_kvcache_mgr);
+  });
+  register_policy("SLO_AWARE", [](const PolicyContext& context) {
+    return std::make_unique<SloAwarePolicy>(context.options,
+                                            context.instance_mgr);
+  });
+  register_policy("P2C", [](const PolicyContext& context) {
+    return std::make_unique<P2C>(
+        context.options, context.instance_mgr, context.global_kvcache_mgr);
+  });
+  register_policy("CONSISTENT_HASH", [](const PolicyContext& context) {
+    return std::make_unique<ConsistentHashing>(context.options,
+                                               context.instance_mgr);
+  });
+}
+
+bool PolicyRegistry::register_policy(const std::string& name,
+                                     Factory factory) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return factories_.emplace(name, std::move(factory)).second;
+}
+
+std::unique_ptr<LoadBalancePolicy> PolicyRegistry::create(
+    const std::string& name,
+    const PolicyContext& context) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = factories_.find(name);
+  if (it == factories_.end()) {
+    return nullptr;
+  }
+  return it->second(context);
+}
+
+std::vector<std::string> PolicyRegistry::names() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<std::string> names;
+  names.reserve(factories_.size());
+  for (const auto& [name, factory] : factories_) {
+    names.emplace_back(name);
+  }
+  std::sort(names.begin(), names.end());
+  return names;
+}
+
+}  // namespace xllm_service
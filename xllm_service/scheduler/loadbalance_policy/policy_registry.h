@@ -0,0 +1,68 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "common/macros.h"
+#include "common/options.h"
+#include "loadbalance_policy.h"
+#include "scheduler/managers/global_kvcache_mgr.h"
+
+namespace xllm_service {
+
+// what a load balance policy is created with
+struct PolicyContext {
+  Options options;
+  std::shared_ptr<InstanceMgr> instance_mgr;
+  std::shared_ptr<GlobalKVCacheMgr> global_kvcache_mgr;
+};
+
+// Creates the load balance policies by the name given with
+// `--load_balance_policy`. The built-in policies are registered on first use,
+// others can be added with `register_policy` before the scheduler starts.
+class PolicyRegistry final {
+ public:
+  using Factory =
+      std::function<std::unique_ptr<LoadBalancePolicy>(const PolicyContext&)>;
+
+  static PolicyRegistry& instance();
+
+  // return false if a policy of the name is already registered
+  bool register_policy(const std::string& name, Factory factory);
+
+  // null if no policy of the name is registered
+  std::unique_ptr<LoadBalancePolicy> create(
+      const std::string& name,
+      const PolicyContext& context) const;
+
+  // the names of the registered policies, sorted
+  std::vector<std::string> names() const;
+
+ private:
+  PolicyRegistry();
+  DISALLOW_COPY_AND_ASSIGN(PolicyRegistry);
+
+  mutable std::mutex mutex_;
+  std::unordered_map<std::string, Factory> factories_;
+};
+
+}  // namespace xllm_service
@@ -0,0 +1,80 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "scoring_pipeline.h"
+
+#include <limits>
+
+namespace xllm_service {
+
+void normalize(const std::vector<InstanceCandidate>& candidates,
+               ScoringContext* context) {
+  context->max_waiting_requests_num = 0;
+  for (const auto& candidate : candidates) {
+    context->max_waiting_requests_num =
+        std::max(context->max_waiting_requests_num,
+                 candidate.load_metrics.waiting_requests_num);
+  }
+}
+
+const InstanceCandidate* select_best(
+    const std::vector<InstanceCandidate>& candidates) {
+  const InstanceCandidate* best = nullptr;
+  for (const auto& candidate : candidates) {
+    if (best == nullptr || candidate.score > best->score) {
+      best = &candidate;
+    }
+  }
+  return best;
+}
+
+std::pair<const InstanceCandidate*, const InstanceCandidate*> select_best_pair(
+    const std::vector<InstanceCandidate>& prefill_candidates,
+    const std::vector<InstanceCandidate>& decode_candidates,
+    const Topology& topology,
+    int64_t num_tokens,
+    double transfer_weight) {
+  std::pair<const InstanceCandidate*, const InstanceCandidate*> best = {
+      nullptr, nullptr};
+  if (!topology.enabled() || transfer_weight == 0) {
+    if (!prefill_candidates.empty() && !decode_candidates.empty()) {
+      best = {select_best(prefill_candidates), select_best(decode_candidates)};
+    }
+    return best;
+  }
+
+  std::vector<TopologyLocation> decode_locations;
+  decode_locations.reserve(decode_candidates.size());
+  for (const auto& candidate : decode_candidates) {
+    decode_locations.emplace_back(topology.locate(candidate.name));
+  }
+  double best_score = std::numeric_limits<double>::lowest();
+  for (const auto& prefill : prefill_candidates) {
+    const TopologyLocation prefill_location = topology.locate(prefill.name);
+    for (size_t i = 0; i < decode_candidates.size(); ++i) {
+      const double transfer_time = topology.transfer_time(
+          prefill_location, decode_locations[i], num_tokens);
+      const double score = prefill.score + decode_candidates[i].score -
+                           transfer_weight * transfer_time;
+      if (score > best_score) {
+        best_score = score;
+        best = {&prefill, &decode_candidates[i]};
+      }
+    }
+  }
+  return best;
+}
+
+}  // namespace xllm_service
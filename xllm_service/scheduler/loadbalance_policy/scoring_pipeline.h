@@ -0,0 +1,249 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "common/topology.h"
+#include "common/types.h"
+
+namespace xllm_service {
+
+// The building blocks of the routing policies. A policy collects candidate
+// instances once, drops the unfit ones with filters, scores the others with a
+// weighted sum of scorers and selects the best instance or the best pair of
+// prefill and decode instances.
+//
+// Scorers and filters are plain types composed at compile time, so that the
+// scoring loop has no virtual calls. The weights are read at every decision
+// and can be tuned at runtime.
+
+// what the scorers know about the routed request, shared by all candidates
+struct ScoringContext {
+  // null if the prefix of the request was not matched
+  const OverlapScores* overlap_scores = nullptr;
+  // normalizers, the max values among the candidates
+  uint64_t max_waiting_requests_num = 0;
+  // in milliseconds
+  int64_t target_tpot = 0;
+};
+
+// fill the normalizers of `context` from `candidates`
+void normalize(const std::vector<InstanceCandidate>& candidates,
+               ScoringContext* context);
+
+// ------------------------------- filters --------------------------------
+
+// keep the candidates which serve `role`
+struct RoleFilter {
+  InstanceType role;
+
+  bool operator()(const InstanceCandidate& candidate) const {
+    return candidate.role == role;
+  }
+};
+
+// keep the candidates which sent a heartbeat recently, not applied if
+// `max_heartbeat_age_ms` is not positive
+struct HealthFilter {
+  int64_t max_heartbeat_age_ms;
+
+  bool operator()(const InstanceCandidate& candidate) const {
+    return max_heartbeat_age_ms <= 0 ||
+           candidate.heartbeat_age_ms <= max_heartbeat_age_ms;
+  }
+};
+
+// keep the candidates which report their load
+struct LoadReportedFilter {
+  bool operator()(const InstanceCandidate& candidate) const {
+    return candidate.has_load_metrics;
+  }
+};
+
+// keep the candidates with room for another request within `limits`
+struct RoomFilter {
+  CapacityLimits limits;
+
+  bool operator()(const InstanceCandidate& candidate) const {
+    return limits.has_room(
+        candidate.role,
+        candidate.has_load_metrics ? &candidate.load_metrics : nullptr,
+        candidate.request_metrics);
+  }
+};
+
+// remove the candidates failing any of `filters`
+template <typename... Filters>
+void filter_candidates(std::vector<InstanceCandidate>* candidates,
+                       const Filters&... filters) {
+  candidates->erase(
+      std::remove_if(candidates->begin(),
+                     candidates->end(),
+                     [&](const InstanceCandidate& candidate) {
+                       return !(filters(candidate) && ...);
+                     }),
+      candidates->end());
+}
+
+// like `filter_candidates`, but a filter removing all candidates is skipped.
+// For the filters routing to an unfit instance is better than failing the
+// request for.
+template <typename... Filters>
+void prefer_candidates(std::vector<InstanceCandidate>* candidates,
+                       const Filters&... filters) {
+  auto apply = [candidates](const auto& filter) {
+    auto end =
+        std::stable_partition(candidates->begin(), candidates->end(), filter);
+    if (end != candidates->begin()) {
+      candidates->erase(end, candidates->end());
+    }
+  };
+  (apply(filters), ...);
+}
+
+// ------------------------------- scorers --------------------------------
+
+// the share of the prompt blocks cached on the instance, in [0, 1]
+struct PrefixHitScorer {
+  float operator()(const InstanceCandidate& candidate,
+                   const ScoringContext& context) const {
+    const OverlapScores* overlap_scores = context.overlap_scores;
+    if (overlap_scores == nullptr || overlap_scores->max_block_num == 0) {
+      return 0;
+    }
+    auto it = overlap_scores->hbm_instance_score.find(candidate.name);
+    if (it == overlap_scores->hbm_instance_score.end()) {
+      return 0;
+    }
+    return static_cast<float>(it->second) / overlap_scores->max_block_num;
+  }
+};
+
+// the waiting requests relative to the most waiting ones, in [-1, 0]
+struct QueueDepthScorer {
+  float operator()(const InstanceCandidate& candidate,
+                   const ScoringContext& context) const {
+    if (context.max_waiting_requests_num == 0) {
+      return 0;
+    }
+    return -static_cast<float>(
+               candidate.load_metrics.waiting_requests_num) /
+           context.max_waiting_requests_num;
+  }
+};
+
+// the used share of the gpu kv cache, in [-1, 0]
+struct CacheUsageScorer {
+  float operator()(const InstanceCandidate& candidate,
+                   const ScoringContext& context) const {
+    return -candidate.load_metrics.gpu_cache_usage_perc;
+  }
+};
+
+// the predicted time until the first token: the queued prefill work plus the
+// prefill of the request, in negative milliseconds
+struct PredictedTtftScorer {
+  float operator()(const InstanceCandidate& candidate,
+                   const ScoringContext& context) const {
+    return -static_cast<float>(
+        candidate.request_metrics.estimated_prefill_time +
+        candidate.predicted_ttft);
+  }
+};
+
+// 0 if the predicted tpot meets the target tpot, the negative predicted tpot
+// in milliseconds otherwise. All instances meeting the target are equally
+// good.
+struct PredictedTpotScorer {
+  float operator()(const InstanceCandidate& candidate,
+                   const ScoringContext& context) const {
+    if (candidate.predicted_tpot <= context.target_tpot) {
+      return 0;
+    }
+    return -static_cast<float>(candidate.predicted_tpot);
+  }
+};
+
+// a scorer with its weight, `weight` is read at every decision so that it can
+// be changed at runtime, e.g. by a reloadable flag.
+template <typename Scorer>
+struct Weighted {
+  Scorer scorer;
+  const double* weight;
+};
+
+template <typename Scorer>
+Weighted<Scorer> weighted(Scorer scorer, const double* weight) {
+  return Weighted<Scorer>{std::move(scorer), weight};
+}
+
+template <typename... Scorers>
+class ScoringPipeline {
+ public:
+  explicit ScoringPipeline(Weighted<Scorers>... scorers)
+      : scorers_(std::move(scorers)...) {}
+
+  float score(const InstanceCandidate& candidate,
+              const ScoringContext& context) const {
+    return std::apply(
+        [&](const auto&... scorers) {
+          return (0.0f + ... +
+                  static_cast<float>(*scorers.weight *
+                                     scorers.scorer(candidate, context)));
+        },
+        scorers_);
+  }
+
+  // set the score of every candidate
+  void score(std::vector<InstanceCandidate>* candidates,
+             const ScoringContext& context) const {
+    for (auto& candidate : *candidates) {
+      candidate.score = score(candidate, context);
+    }
+  }
+
+ private:
+  std::tuple<Weighted<Scorers>...> scorers_;
+};
+
+// ------------------------------- selectors ------------------------------
+
+// the candidate of the highest score, the first one on ties. Null if there
+// are no candidates.
+const InstanceCandidate* select_best(
+    const std::vector<InstanceCandidate>& candidates);
+
+inline InstanceCandidate* select_best(
+    std::vector<InstanceCandidate>* candidates) {
+  return const_cast<InstanceCandidate*>(select_best(*candidates));
+}
+
+// the pair of the highest sum of scores less `transfer_weight` times the time
+// to transfer the kv cache of `num_tokens` between them, in milliseconds.
+// Both are null if either side has no candidates.
+std::pair<const InstanceCandidate*, const InstanceCandidate*> select_best_pair(
+    const std::vector<InstanceCandidate>& prefill_candidates,
+    const std::vector<InstanceCandidate>& decode_candidates,
+    const Topology& topology,
+    int64_t num_tokens,
+    double transfer_weight);
+
+}  // namespace xllm_service
@@ -0,0 +1,162 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "scoring_pipeline.h"
+
+#include <gtest/gtest.h>
+
+namespace xllm_service::test {
+
+namespace {
+InstanceCandidate make_candidate(const std::string& name,
+                                 InstanceType role,
+                                 float gpu_cache_usage_perc,
+                                 uint64_t waiting_requests_num) {
+  InstanceCandidate candidate;
+  candidate.name = name;
+  candidate.role = role;
+  candidate.has_load_metrics = true;
+  candidate.load_metrics =
+      LoadMetrics(waiting_requests_num, gpu_cache_usage_perc);
+  return candidate;
+}
+
+std::vector<std::string> names_of(
+    const std::vector<InstanceCandidate>& candidates) {
+  std::vector<std::string> names;
+  for (const auto& candidate : candidates) {
+    names.emplace_back(candidate.name);
+  }
+  return names;
+}
+}  // namespace
+
+TEST(ScoringPipelineTest, WeightedScores) {
+  double prefix_hit_weight = 1;
+  double queue_depth_weight = 1;
+  ScoringPipeline<PrefixHitScorer, QueueDepthScorer> pipeline(
+      weighted(PrefixHitScorer(), &prefix_hit_weight),
+      weighted(QueueDepthScorer(), &queue_depth_weight));
+
+  std::vector<InstanceCandidate> candidates = {
+      make_candidate("cached", InstanceType::PREFILL, 0.5, 4),
+      make_candidate("idle", InstanceType::PREFILL, 0.5, 0)};
+  OverlapScores overlap_scores;
+  overlap_scores.max_block_num = 4;
+  overlap_scores.hbm_instance_score["cached"] = 3;
+  ScoringContext context;
+  context.overlap_scores = &overlap_scores;
+  normalize(candidates, &context);
+  EXPECT_EQ(4, context.max_waiting_requests_num);
+
+  pipeline.score(&candidates, context);
+  EXPECT_FLOAT_EQ(0.75 - 1, candidates[0].score);
+  EXPECT_FLOAT_EQ(0, candidates[1].score);
+  EXPECT_EQ("idle", select_best(candidates)->name);
+
+  // the weights are read at every decision
+  prefix_hit_weight = 2;
+  pipeline.score(&candidates, context);
+  EXPECT_FLOAT_EQ(1.5 - 1, candidates[0].score);
+  EXPECT_EQ("cached", select_best(candidates)->name);
+}
+
+TEST(ScoringPipelineTest, PredictedTpotMeetingTargetIsEquallyGood) {
+  double weight = 1;
+  ScoringPipeline<PredictedTpotScorer> pipeline(
+      weighted(PredictedTpotScorer(), &weight));
+  std::vector<InstanceCandidate> candidates(3);
+  candidates[0].name = "slow";
+  candidates[0].predicted_tpot = 80;
+  candidates[1].name = "fast";
+  candidates[1].predicted_tpot = 40;
+  candidates[2].name = "fastest";
+  candidates[2].predicted_tpot = 10;
+  ScoringContext context;
+  context.target_tpot = 50;
+  pipeline.score(&candidates, context);
+  // the first candidate meeting the target wins
+  EXPECT_EQ("fast", select_best(candidates)->name);
+
+  context.target_tpot = 5;
+  pipeline.score(&candidates, context);
+  EXPECT_EQ("fastest", select_best(candidates)->name);
+}
+
+TEST(ScoringPipelineTest, Filters) {
+  std::vector<InstanceCandidate> candidates = {
+      make_candidate("prefill", InstanceType::PREFILL, 0, 0),
+      make_candidate("stale", InstanceType::PREFILL, 0, 0),
+      make_candidate("decode", InstanceType::DECODE, 0, 0)};
+  candidates[1].heartbeat_age_ms = 10000;
+
+  auto prefill_candidates = candidates;
+  filter_candidates(&prefill_candidates,
+                    RoleFilter{InstanceType::PREFILL},
+                    HealthFilter{1000});
+  EXPECT_EQ(std::vector<std::string>({"prefill"}),
+            names_of(prefill_candidates));
+
+  // a hard filter may remove all candidates, a preference never does
+  auto stale_candidates = std::vector<InstanceCandidate>({candidates[1]});
+  prefer_candidates(&stale_candidates, HealthFilter{1000});
+  EXPECT_EQ(std::vector<std::string>({"stale"}), names_of(stale_candidates));
+  filter_candidates(&stale_candidates, HealthFilter{1000});
+  EXPECT_TRUE(stale_candidates.empty());
+
+  // not applied without a max age
+  auto all_candidates = candidates;
+  filter_candidates(&all_candidates, HealthFilter{0});
+  EXPECT_EQ(3, all_candidates.size());
+}
+
+TEST(ScoringPipelineTest, PairByTransferTime) {
+  Topology topology;
+  ASSERT_TRUE(topology.parse(nlohmann::json::parse(R"({
+    "domains": {"rack_a": ["10.0.1."], "rack_b": ["10.0.2."]},
+    "same_host_distance": 0,
+    "same_domain_distance": 0.1,
+    "default_distance": 10
+  })")));
+  std::vector<InstanceCandidate> prefill_candidates = {
+      make_candidate("10.0.1.1:8000", InstanceType::PREFILL, 0, 0),
+      make_candidate("10.0.2.1:8000", InstanceType::PREFILL, 0, 0)};
+  std::vector<InstanceCandidate> decode_candidates = {
+      make_candidate("10.0.1.2:8000", InstanceType::DECODE, 0, 0),
+      make_candidate("10.0.2.2:8000", InstanceType::DECODE, 0, 0)};
+  prefill_candidates[0].score = 1;
+  prefill_candidates[1].score = 0.9;
+  decode_candidates[0].score = 0.5;
+  decode_candidates[1].score = 1;
+
+  // without weighting the transfer time the best of each side is paired
+  auto [prefill, decode] = select_best_pair(
+      prefill_candidates, decode_candidates, topology, 1024, 0);
+  EXPECT_EQ("10.0.1.1:8000", prefill->name);
+  EXPECT_EQ("10.0.2.2:8000", decode->name);
+
+  // the pair within rack b loses the least to the transfer
+  std::tie(prefill, decode) = select_best_pair(
+      prefill_candidates, decode_candidates, topology, 1024, 1);
+  EXPECT_EQ("10.0.2.1:8000", prefill->name);
+  EXPECT_EQ("10.0.2.2:8000", decode->name);
+
+  std::tie(prefill, decode) =
+      select_best_pair(prefill_candidates, {}, topology, 1024, 1);
+  EXPECT_EQ(nullptr, prefill);
+  EXPECT_EQ(nullptr, decode);
+}
+
+}  // namespace xllm_service::test
@@ -15,26 +15,91 @@ limitations under the License.
 
 #include "slo_aware_policy.h"
 
+#include <algorithm>
+#include <limits>
+
 #include "common/global_gflags.h"
 
 namespace xllm_service {
 
 SloAwarePolicy::SloAwarePolicy(const Options& options,
                                std::shared_ptr<InstanceMgr> instance_mgr)
-    : options_(options), LoadBalancePolicy(instance_mgr) {}
+    : LoadBalancePolicy(instance_mgr),
+      options_(options),
+      prefill_pipeline_(
+          weighted(PredictedTtftScorer(), &FLAGS_slo_ttft_weight)),
+      decode_pipeline_(
+          weighted(PredictedTpotScorer(), &FLAGS_slo_tpot_weight)) {}
 
 bool SloAwarePolicy::select_instances_pair(std::shared_ptr<Request> request) {
   if (request->token_ids.empty()) {
     return instance_mgr_->get_next_instance_pair(&request->routing);
   }
 
-  // select instances pair based on slo
-  if (!instance_mgr_->select_instance_pair_on_slo(request)) {
-    LOG(ERROR) << "Select instances based on the SLO failed!";
+  CandidateQuery query;
+  query.num_prompt_tokens = request->token_ids.size();
+  std::vector<InstanceCandidate> prefill_candidates;
+  instance_mgr_->get_candidates(query, &prefill_candidates);
+  prefer_candidates(&prefill_candidates,
+                    HealthFilter{FLAGS_routing_max_heartbeat_age_ms});
+  std::vector<InstanceCandidate> decode_candidates = prefill_candidates;
+  filter_candidates(&prefill_candidates, RoleFilter{InstanceType::PREFILL});
+  filter_candidates(&decode_candidates, RoleFilter{InstanceType::DECODE});
+  if (FLAGS_admission_queue_size > 0) {
+    // admitted requests go to instances with room
+    const RoomFilter room_filter{InstanceMgr::capacity_limits()};
+    prefer_candidates(&prefill_candidates, room_filter);
+    prefer_candidates(&decode_candidates, room_filter);
+  }
+  if (prefill_candidates.empty()) {
+    LOG(ERROR) << "No prefill or default instance found!";
+    return false;
+  }
+  if (decode_candidates.empty()) {
+    LOG(ERROR) << "No decode instance found!";
     return false;
   }
 
+  ScoringContext context;
+  context.target_tpot = FLAGS_target_tpot;
+  prefill_pipeline_.score(&prefill_candidates, context);
+  decode_pipeline_.score(&decode_candidates, context);
+  // the kv cache transfer time adds to the ttft
+  auto [prefill, decode] = select_best_pair(prefill_candidates,
+                                            decode_candidates,
+                                            instance_mgr_->topology(),
+                                            request->token_ids.size(),
+                                            FLAGS_slo_ttft_weight);
+
+  // When the prefill instances are already overloaded and there are other
+  // instances with lower loads in the decode group, we will dispatch the
+  // prefill requests to those instances to alleviate the pressure on the
+  // prefill instances.
+  int64_t min_prefill_time = std::numeric_limits<int64_t>::max();
+  for (const auto& candidate : prefill_candidates) {
+    min_prefill_time = std::min(
+        min_prefill_time, candidate.request_metrics.estimated_prefill_time);
+  }
+  const InstanceCandidate* min_decode = &*std::min_element(
+      decode_candidates.begin(),
+      decode_candidates.end(),
+      [](const auto& a, const auto& b) {
+        return a.predicted_tpot < b.predicted_tpot;
+      });
+  const float tpot_threshold =
+      (decode_candidates.size() - 1.0f) / decode_candidates.size();
+  if (min_prefill_time > FLAGS_target_ttft && min_decode != decode &&
+      min_decode->predicted_tpot < FLAGS_target_tpot * tpot_threshold &&
+      min_decode->request_metrics.estimated_prefill_time < min_prefill_time) {
+    prefill = min_decode;
+  }
+
+  request->routing.prefill_name = prefill->name;
+  request->routing.decode_name = decode->name;
+  request->estimated_ttft = prefill->predicted_ttft;
+  instance_mgr_->add_estimated_prefill_time(prefill->name,
+                                            request->estimated_ttft);
   return true;
 }
 
-}  // namespace xllm_service
\ No newline at end of file
+}  // namespace xllm_service
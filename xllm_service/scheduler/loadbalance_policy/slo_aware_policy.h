@@ -18,9 +18,15 @@ limitations under the License.
 #include "common/options.h"
 #include "common/types.h"
 #include "loadbalance_policy.h"
+#include "scoring_pipeline.h"
 
 namespace xllm_service {
 
+// Routes to the decode instances predicted to meet the target tpot and the
+// prefill instances of the least predicted ttft, weighted by the
+// `FLAGS_slo_*_weight` flags. When the prefill instances miss the target ttft
+// and a decode instance has spare capacity, the prefill goes to that decode
+// instance.
 class SloAwarePolicy final : public LoadBalancePolicy {
  public:
   SloAwarePolicy(const Options& options,
@@ -30,10 +36,14 @@ class SloAwarePolicy final : public LoadBalancePolicy {
 
   bool select_instances_pair(std::shared_ptr<Request> request) override;
 
+  bool balances_roles() const override { return true; }
+
  private:
   DISALLOW_COPY_AND_ASSIGN(SloAwarePolicy);
 
   Options options_;
+  ScoringPipeline<PredictedTtftScorer> prefill_pipeline_;
+  ScoringPipeline<PredictedTpotScorer> decode_pipeline_;
 };
 
-}  // namespace xllm_service
\ No newline at end of file
+}  // namespace xllm_service
@@ -16,7 +16,9 @@ limitations under the License.
 #include "global_kvcache_mgr.h"
 
 #include <nlohmann/json.hpp>
+#include <optional>
 
+#include "common/global_gflags.h"
 #include "common/hash_util.h"
 
 namespace {
@@ -31,29 +33,32 @@ namespace xllm_service {
 
 GlobalKVCacheMgr::GlobalKVCacheMgr(
     const Options& options,
-    const std::shared_ptr<EtcdClient>& etcd_client,
+    const std::shared_ptr<MetadataStore>& metadata_store,
     const bool is_master_service)
     : options_(options),
       is_master_service_(is_master_service),
-      etcd_client_(etcd_client) {
+      metadata_store_(metadata_store) {
+  kvcache_watch_ = std::make_unique<WatchEventCoalescer>(
+      "kvcache",
+      FLAGS_watch_coalesce_window_us,
+      [this](const WatchEvents& events) { update_kvcache(events); });
   if (!is_master_service_) {
-    auto handle_kvcache = std::bind(&GlobalKVCacheMgr::update_kvcache,
-                                    this,
-                                    std::placeholders::_1,
-                                    std::placeholders::_2);
-    etcd_client_->add_watch(ETCD_CACHE_PREFIX, handle_kvcache);
+    metadata_store_->add_watch(ETCD_CACHE_PREFIX, kvcache_watch_->callback());
   }
 
   {
     std::unique_lock<std::shared_mutex> lock(kvcache_mutex_);
-    etcd_client_->get_prefix(ETCD_CACHE_PREFIX, &kvcache_infos_);
+    metadata_store_->get_prefix(ETCD_CACHE_PREFIX, &kvcache_infos_);
     DLOG(INFO) << "Load etcd cache infos:" << kvcache_infos_.size();
   }
 }
 
 GlobalKVCacheMgr::~GlobalKVCacheMgr() {
   exited_ = true;
-  etcd_client_->remove_watch(ETCD_CACHE_PREFIX);
+  metadata_store_->remove_watch(ETCD_CACHE_PREFIX);
+  // the upload in flight calls back into the manager
+  std::unique_lock<std::mutex> update_lock(update_mutex_);
+  upload_cv_.wait(update_lock, [this]() { return !uploading_; });
 }
 
 void set_score(const std::unordered_set<std::string>& instance_names,
@@ -70,6 +75,51 @@ void set_score(const std::unordered_set<std::string>& instance_names,
   }
 }
 
+// remove the hbm copy of the block on `rank` of the instance, or on all ranks
+// if `rank` is -1. Return whether there was such a copy.
+bool erase_hbm_location(const std::string& instance_name,
+                        int32_t rank,
+                        CacheLocations* locations) {
+  auto it = locations->hbm_dp_ranks.find(instance_name);
+  if (rank < 0 || it == locations->hbm_dp_ranks.end()) {
+    if (it != locations->hbm_dp_ranks.end()) {
+      locations->hbm_dp_ranks.erase(it);
+    }
+    return locations->hbm_instance_set.erase(instance_name) != 0;
+  }
+
+  const uint64_t rank_bit = uint64_t(1) << rank;
+  if ((it->second & rank_bit) == 0) {
+    return false;
+  }
+  it->second &= ~rank_bit;
+  if (it->second == 0) {
+    locations->hbm_dp_ranks.erase(it);
+    locations->hbm_instance_set.erase(instance_name);
+  }
+  return true;
+}
+
+void set_dp_rank_score(
+    const std::unordered_map<std::string, uint64_t>& hbm_dp_ranks,
+    const uint32_t& match_length,
+    std::unordered_map<std::string, std::vector<uint32_t>>* scores) {
+  for (const auto& [name, ranks] : hbm_dp_ranks) {
+    auto& rank_scores = (*scores)[name];
+    for (int32_t rank = 0; rank < kMaxDpRanks; ++rank) {
+      if ((ranks >> rank) == 0) {
+        break;
+      }
+      if ((ranks >> rank) & 1) {
+        if (rank_scores.size() <= static_cast<size_t>(rank)) {
+          rank_scores.resize(rank + 1, 0);
+        }
+        rank_scores[rank] = match_length;
+      }
+    }
+  }
+}
+
 void GlobalKVCacheMgr::match(const Slice<int32_t>& token_ids,
                              OverlapScores* overlap_scores) {
   // allign tokens to block boundary
@@ -100,6 +150,9 @@ void GlobalKVCacheMgr::match(const Slice<int32_t>& token_ids,
                   i / options_.block_size() + 1,
                   &(overlap_scores->hbm_instance_score),
                   &(overlap_scores->instances));
+        set_dp_rank_score(iter->second.hbm_dp_ranks,
+                          i / options_.block_size() + 1,
+                          &(overlap_scores->hbm_dp_rank_score));
         overlap_scores->max_matched_instance_name =
             *iter->second.hbm_instance_set.begin();
         overlap_scores->max_matched_block_num = i / options_.block_size() + 1;
@@ -130,125 +183,214 @@ void GlobalKVCacheMgr::match(const Slice<int32_t>& token_ids,
   }
 }
 
-void GlobalKVCacheMgr::update_kvcache(const etcd::Response& response,
-                                      const uint64_t prefix_len) {
-  if (response.events().empty() || exited_) {
+void GlobalKVCacheMgr::update_kvcache(const WatchEvents& events) {
+  if (exited_) {
     return;
   }
-  threadpool_.schedule([this,
-                        response = std::move(response),
-                        prefix_len = std::move(prefix_len)] {
-    if (exited_) return;
-    Murmur3KeyCacheMap put_map;
-    std::vector<Murmur3Key> delete_list;
-
-    for (const auto& event : response.events()) {
-      auto key = event.kv().key().substr(prefix_len);
-
-      if (event.event_type() == etcd::Event::EventType::PUT) {
-        CacheLocations cachelocations;
-        auto json_str = event.kv().as_string();
-        if (!cachelocations.parse_from_json(json_str)) {
-          LOG(ERROR) << "pase json:" << json_str << " error!";
-          continue;
-        }
-
-        put_map.insert_or_assign(Murmur3Key{key.c_str()},
-                                 std::move(cachelocations));
-
-      } else if (event.event_type() == etcd::Event::EventType::DELETE_) {
-        delete_list.emplace_back(Murmur3Key{key.c_str()});
-      }
+  // parse outside of the writer lock, nullopt for deletes
+  std::vector<std::pair<Murmur3Key, std::optional<CacheLocations>>> updates;
+  updates.reserve(events.size());
+  for (const auto& event : events) {
+    Murmur3Key key{event.key.c_str()};
+    if (event.type == WatchEvent::Type::DELETE) {
+      updates.emplace_back(std::move(key), std::nullopt);
+      continue;
     }
+    CacheLocations cachelocations;
+    if (!cachelocations.parse_from_json(event.value)) {
+      LOG(ERROR) << "pase json:" << event.value << " error!";
+      continue;
+    }
+    updates.emplace_back(std::move(key), std::move(cachelocations));
+  }
 
-    {
-      std::unique_lock<std::shared_mutex> lock(kvcache_mutex_);
-      for (auto& iter : put_map) {
-        kvcache_infos_.insert_or_assign(iter.first, std::move(iter.second));
-      }
-
-      for (auto& iter : delete_list) {
-        kvcache_infos_.erase(iter);
-      }
+  std::unique_lock<std::shared_mutex> lock(kvcache_mutex_);
+  for (auto& [key, cachelocations] : updates) {
+    if (cachelocations.has_value()) {
+      kvcache_infos_.insert_or_assign(key, std::move(*cachelocations));
+    } else {
+      kvcache_infos_.erase(key);
     }
-  });
+  }
+}
+
+CacheLocations* GlobalKVCacheMgr::find_updated_kvcache(const Murmur3Key& key,
+                                                      bool create) {
+  auto iter = updated_kvcaches_.find(key);
+  if (iter != updated_kvcaches_.end()) {
+    return &iter->second;
+  }
+  auto info_iter = kvcache_infos_.find(key);
+  if (info_iter != kvcache_infos_.end()) {
+    return &updated_kvcaches_.emplace(key, info_iter->second).first->second;
+  }
+  if (!create) {
+    return nullptr;
+  }
+  return &updated_kvcaches_.emplace(key, CacheLocations()).first->second;
 }
 
 void GlobalKVCacheMgr::record_updated_kvcaches(
     const std::string& instance_name,
     const proto::KvCacheEvent& kvcache_event) {
-  std::lock_guard<std::mutex> update_lock(update_mutex_);
-  std::shared_lock<std::shared_mutex> metric_lock(kvcache_mutex_);
-  for (int i = 0; i < kvcache_event.stored_cache_size(); i++) {
-    Murmur3Key key(kvcache_event.stored_cache(i).c_str());
-    if (updated_kvcaches_.count(key) == 0) {
-      if (kvcache_infos_.count(key) == 0) {
-        updated_kvcaches_.insert_or_assign(key, CacheLocations());
-      } else {
-        updated_kvcaches_.insert_or_assign(key, kvcache_infos_[key]);
+  // visit every block hash of the single events and the packed ranges
+  auto for_each_key = [](const auto& keys, const auto& ranges, auto&& fn) {
+    for (const auto& key : keys) {
+      fn(Murmur3Key(key.c_str()));
+    }
+    for (const auto& range : ranges) {
+      for (size_t pos = 0; pos + MURMUR_HASH3_VALUE_LEN <= range.size();
+           pos += MURMUR_HASH3_VALUE_LEN) {
+        fn(Murmur3Key(range.data() + pos));
       }
     }
-    updated_kvcaches_.at(key).hbm_instance_set.insert(instance_name);
+  };
+
+  int32_t rank = -1;
+  if (kvcache_event.has_dp_rank()) {
+    rank = kvcache_event.dp_rank();
+    if (rank < 0 || rank >= kMaxDpRanks) {
+      LOG(ERROR) << "Invalid dp rank " << rank << " of instance "
+                 << instance_name;
+      return;
+    }
+  }
+
+  size_t num_stored = kvcache_event.stored_cache_size();
+  for (const auto& range : kvcache_event.stored_ranges()) {
+    num_stored += range.size() / MURMUR_HASH3_VALUE_LEN;
   }
 
-  for (int i = 0; i < kvcache_event.offload_cache_size(); i++) {
-    Murmur3Key key(kvcache_event.offload_cache(i).c_str());
-    if (updated_kvcaches_.count(key) == 0) {
-      if (kvcache_infos_.count(key) == 0) {
-        continue;
-      } else {
-        updated_kvcaches_.insert_or_assign(key, kvcache_infos_[key]);
+  std::lock_guard<std::mutex> update_lock(update_mutex_);
+  std::shared_lock<std::shared_mutex> metric_lock(kvcache_mutex_);
+  // rehash at most once for the whole heartbeat
+  updated_kvcaches_.reserve(updated_kvcaches_.size() + num_stored);
+
+  for_each_key(kvcache_event.stored_cache(),
+               kvcache_event.stored_ranges(),
+               [&](const Murmur3Key& key) {
+                 auto* locations = find_updated_kvcache(key, true);
+                 locations->hbm_instance_set.insert(instance_name);
+                 if (rank >= 0) {
+                   locations->hbm_dp_ranks[instance_name] |= uint64_t(1)
+                                                             << rank;
+                 }
+               });
+
+  for_each_key(kvcache_event.offload_cache(),
+               kvcache_event.offload_ranges(),
+               [&](const Murmur3Key& key) {
+                 auto* locations = find_updated_kvcache(key, false);
+                 if (locations == nullptr) {
+                   return;
+                 }
+                 if (erase_hbm_location(instance_name, rank, locations)) {
+                   locations->dram_instance_set.insert(instance_name);
+                 } else {
+                   locations->dram_instance_set.erase(instance_name);
+                   locations->ssd_instance_set.insert(instance_name);
+                 }
+               });
+
+  for_each_key(kvcache_event.removed_cache(),
+               kvcache_event.removed_ranges(),
+               [&](const Murmur3Key& key) {
+                 auto* locations = find_updated_kvcache(key, false);
+                 if (locations == nullptr) {
+                   return;
+                 }
+                 erase_hbm_location(instance_name, rank, locations);
+                 locations->dram_instance_set.erase(instance_name);
+                 locations->ssd_instance_set.erase(instance_name);
+               });
+}
+
+void GlobalKVCacheMgr::remove_instance_caches(
+    const std::vector<std::string>& instance_names) {
+  auto contains_instance = [&](const CacheLocations& locations) {
+    for (const auto& name : instance_names) {
+      if (locations.hbm_instance_set.count(name) != 0 ||
+          locations.dram_instance_set.count(name) != 0 ||
+          locations.ssd_instance_set.count(name) != 0) {
+        return true;
       }
     }
-    if (updated_kvcaches_.at(key).hbm_instance_set.count(instance_name) != 0) {
-      updated_kvcaches_.at(key).hbm_instance_set.erase(instance_name);
-      updated_kvcaches_.at(key).dram_instance_set.insert(instance_name);
-    } else {
-      updated_kvcaches_.at(key).dram_instance_set.erase(instance_name);
-      updated_kvcaches_.at(key).ssd_instance_set.insert(instance_name);
+    return false;
+  };
+  auto remove_instances = [&](CacheLocations* locations) {
+    for (const auto& name : instance_names) {
+      locations->hbm_instance_set.erase(name);
+      locations->dram_instance_set.erase(name);
+      locations->ssd_instance_set.erase(name);
+      locations->hbm_dp_ranks.erase(name);
     }
-  }
+  };
 
-  for (int i = 0; i < kvcache_event.removed_cache_size(); i++) {
-    Murmur3Key key(kvcache_event.removed_cache(i).c_str());
-    if (updated_kvcaches_.count(key) == 0) {
-      if (kvcache_infos_.count(key) == 0) {
-        continue;
-      } else {
-        updated_kvcaches_.insert_or_assign(key, kvcache_infos_[key]);
-      }
+  std::lock_guard<std::mutex> update_lock(update_mutex_);
+  std::shared_lock<std::shared_mutex> metric_lock(kvcache_mutex_);
+  for (auto& [key, locations] : updated_kvcaches_) {
+    remove_instances(&locations);
+  }
+  for (const auto& [key, locations] : kvcache_infos_) {
+    if (updated_kvcaches_.count(key) == 0 && contains_instance(locations)) {
+      remove_instances(
+          &updated_kvcaches_.emplace(key, locations).first->second);
     }
-    updated_kvcaches_.at(key).hbm_instance_set.erase(instance_name);
-    updated_kvcaches_.at(key).dram_instance_set.erase(instance_name);
-    updated_kvcaches_.at(key).ssd_instance_set.erase(instance_name);
   }
 }
 
 bool GlobalKVCacheMgr::upload_kvcache() {
-  std::lock_guard<std::mutex> update_lock(update_mutex_);
-  if (updated_kvcaches_.empty()) {
-    return true;
-  }
-  bool rt = etcd_client_->set(ETCD_CACHE_PREFIX, updated_kvcaches_);
+  return upload_kvcache_async().get();
+}
+
+std::future<bool> GlobalKVCacheMgr::upload_kvcache_async() {
+  auto promise = std::make_shared<std::promise<bool>>();
+  auto future = promise->get_future();
+  auto uploading = std::make_shared<Murmur3KeyCacheMap>();
   {
-    std::unique_lock<std::shared_mutex> metric_lock(kvcache_mutex_);
-    for (auto& iter : updated_kvcaches_) {
-      if (iter.second.empty()) {
-        kvcache_infos_.erase(iter.first);
-      } else {
-        kvcache_infos_.insert_or_assign(iter.first, std::move(iter.second));
+    std::unique_lock<std::mutex> update_lock(update_mutex_);
+    // a later upload of a block must not overtake an earlier one
+    upload_cv_.wait(update_lock, [this]() { return !uploading_; });
+    if (updated_kvcaches_.empty()) {
+      promise->set_value(true);
+      return future;
+    }
+    {
+      std::unique_lock<std::shared_mutex> metric_lock(kvcache_mutex_);
+      for (const auto& iter : updated_kvcaches_) {
+        if (iter.second.empty()) {
+          kvcache_infos_.erase(iter.first);
+        } else {
+          kvcache_infos_.insert_or_assign(iter.first, iter.second);
+        }
       }
     }
+    uploading->swap(updated_kvcaches_);
+    uploading_ = true;
   }
-  if (rt) {
-    updated_kvcaches_.clear();
-  }
-  return rt;
+
+  auto update = MetadataStore::make_batch_update(ETCD_CACHE_PREFIX, *uploading);
+  metadata_store_->batch_update_async(
+      std::move(update), [this, uploading, promise](bool ok) {
+        {
+          std::lock_guard<std::mutex> update_lock(update_mutex_);
+          if (!ok) {
+            // retry with the next upload, unless the block has changed again
+            for (auto& [key, locations] : *uploading) {
+              updated_kvcaches_.try_emplace(key, std::move(locations));
+            }
+          }
+          uploading_ = false;
+        }
+        upload_cv_.notify_all();
+        promise->set_value(ok);
+      });
+  return future;
 }
 
 void GlobalKVCacheMgr::set_as_master() {
   is_master_service_ = true;
-  etcd_client_->remove_watch(ETCD_CACHE_PREFIX);
+  metadata_store_->remove_watch(ETCD_CACHE_PREFIX);
 }
 
 }  // namespace xllm_service
@@ -15,25 +15,29 @@ limitations under the License.
 
 #pragma once
 
+#include <condition_variable>
+#include <future>
+#include <mutex>
 #include <shared_mutex>
 #include <thread>
 
-#include "../etcd_client/etcd_client.h"
 #include "common/hash_util.h"
 #include "common/macros.h"
 #include "common/options.h"
 #include "common/slice.h"
-#include "common/threadpool.h"
 #include "common/types.h"
+#include "scheduler/metadata_store/metadata_store.h"
+#include "scheduler/metadata_store/watch_event_coalescer.h"
 #include "xllm_rpc_service.pb.h"
 
 namespace xllm_service {
 
 class GlobalKVCacheMgr final {
  public:
-  explicit GlobalKVCacheMgr(const Options& options,
-                            const std::shared_ptr<EtcdClient>& etcd_client,
-                            const bool is_master_service);
+  explicit GlobalKVCacheMgr(
+      const Options& options,
+      const std::shared_ptr<MetadataStore>& metadata_store,
+      const bool is_master_service);
   ~GlobalKVCacheMgr();
 
   void match(const Slice<int32_t>& token_ids, OverlapScores* overlap_scores);
@@ -42,13 +46,27 @@ class GlobalKVCacheMgr final {
                                const proto::KvCacheEvent& kvcache_event);
   bool upload_kvcache();
 
+  // upload the pending updates without waiting for the store, the local
+  // index is updated at once. The updates of a failed upload are retried
+  // with the next one, an upload waits until the previous one is done.
+  std::future<bool> upload_kvcache_async();
+
+  // drop the cache locations of removed instances, the change is uploaded
+  // with the next `upload_kvcache`.
+  void remove_instance_caches(const std::vector<std::string>& instance_names);
+
   void set_as_master();
 
  private:
   DISALLOW_COPY_AND_ASSIGN(GlobalKVCacheMgr);
 
-  void update_kvcache(const etcd::Response& response,
-                      const uint64_t prefix_len);
+  // apply the coalesced changes of the cache locations in order
+  void update_kvcache(const WatchEvents& events);
+
+  // get the pending update of `key`, starting from the current locations.
+  // Return nullptr if the block is unknown and `create` is false. Requires
+  // update_mutex_ and kvcache_mutex_ to be held.
+  CacheLocations* find_updated_kvcache(const Murmur3Key& key, bool create);
 
  private:
   Options options_;
@@ -56,12 +74,16 @@ class GlobalKVCacheMgr final {
   bool exited_ = false;
   std::shared_mutex kvcache_mutex_;
   Murmur3KeyCacheMap kvcache_infos_;
-  std::shared_ptr<EtcdClient> etcd_client_;  // not own
+  std::shared_ptr<MetadataStore> metadata_store_;  // not own
 
   std::mutex update_mutex_;
   Murmur3KeyCacheMap updated_kvcaches_;
+  // an upload is in flight, guarded by update_mutex_
+  bool uploading_ = false;
+  std::condition_variable upload_cv_;
 
-  ThreadPool threadpool_;
+  // declared last to stop applying changes first
+  std::unique_ptr<WatchEventCoalescer> kvcache_watch_;
 };
 
 }  // namespace xllm_service
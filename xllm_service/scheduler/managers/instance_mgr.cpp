@@ -15,12 +15,19 @@ limitations under the License.
 
 #include "instance_mgr.h"
 
+#include <absl/random/random.h>
 #include <absl/strings/str_join.h>
+#include <bvar/bvar.h>
 #include <glog/logging.h>
 
+#include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <cstdlib>
 #include <iostream>
 #include <nlohmann/json.hpp>
+#include <numeric>
+#include <optional>
 
 #include "common/global_gflags.h"
 #include "common/types.h"
@@ -37,30 +44,71 @@ std::unordered_map<InstanceType, std::string> ETCD_KEYS_PREFIX_MAP = {
 
 std::string ETCD_ALL_KEYS_PREFIX = "XLLM:";
 std::string ETCD_LOADMETRICS_PREFIX = "XLLM:LOADMETRICS:";
+
+// Mean absolute error of the predictions made before every observed latency,
+// of the profiling fit and of the online refitted predictors. In
+// milliseconds.
+bvar::IntRecorder g_static_ttft_error("xllm_service_static_ttft_error_ms");
+bvar::IntRecorder g_online_ttft_error("xllm_service_online_ttft_error_ms");
+bvar::IntRecorder g_static_tpot_error("xllm_service_static_tpot_error_ms");
+bvar::IntRecorder g_online_tpot_error("xllm_service_online_tpot_error_ms");
+
+xllm_service::RoleBalancerOptions role_balancer_options() {
+  xllm_service::RoleBalancerOptions options;
+  options.target_ttft = FLAGS_target_ttft;
+  options.target_tpot = FLAGS_target_tpot;
+  options.smoothing = FLAGS_role_load_smoothing;
+  options.min_dwell_ms = FLAGS_role_min_dwell_ms;
+  return options;
+}
+
+// the role whose requests the instance takes, PREFILL or DECODE
+InstanceType serving_role(const xllm_service::InstanceMetaInfo& metainfo) {
+  const InstanceType type = metainfo.type == InstanceType::MIX
+                                ? metainfo.current_type
+                                : metainfo.type;
+  return type == InstanceType::DECODE ? InstanceType::DECODE
+                                      : InstanceType::PREFILL;
+}
+
+uint64_t now_ms() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
 }  // namespace
 
 namespace xllm_service {
 
 InstanceMgr::InstanceMgr(const Options& options,
-                         const std::shared_ptr<EtcdClient>& etcd_client,
-                         const bool is_master_service)
+                         const std::shared_ptr<MetadataStore>& metadata_store,
+                         const bool is_master_service,
+                         std::shared_ptr<GlobalKVCacheMgr> global_kvcache_mgr)
     : options_(options),
       is_master_service_(is_master_service),
-      etcd_client_(etcd_client) {
-  auto handle_instance_metainfo =
-      std::bind(&InstanceMgr::update_instance_metainfo,
-                this,
-                std::placeholders::_1,
-                std::placeholders::_2);
+      metadata_store_(metadata_store),
+      global_kvcache_mgr_(std::move(global_kvcache_mgr)),
+      prefill_ring_(FLAGS_consistent_hash_virtual_nodes),
+      decode_ring_(FLAGS_consistent_hash_virtual_nodes),
+      role_balancer_(role_balancer_options()) {
+  if (!FLAGS_topology_path.empty() && !topology_.load(FLAGS_topology_path)) {
+    LOG(ERROR) << "Pair instances without topology, failed to load "
+               << FLAGS_topology_path;
+  }
+  instance_watch_ = std::make_unique<WatchEventCoalescer>(
+      "instance_metainfo",
+      FLAGS_watch_coalesce_window_us,
+      [this](const WatchEvents& events) { update_instance_metainfo(events); });
+  load_metrics_watch_ = std::make_unique<WatchEventCoalescer>(
+      "load_metrics",
+      FLAGS_watch_coalesce_window_us,
+      [this](const WatchEvents& events) { update_load_metrics(events); });
   for (auto& it : ETCD_KEYS_PREFIX_MAP) {
-    etcd_client_->add_watch(it.second, handle_instance_metainfo);
+    metadata_store_->add_watch(it.second, instance_watch_->callback());
   }
   if (!is_master_service_) {
-    auto handle_load_metrics = std::bind(&InstanceMgr::update_load_metrics,
-                                         this,
-                                         std::placeholders::_1,
-                                         std::placeholders::_2);
-    etcd_client_->add_watch(ETCD_LOADMETRICS_PREFIX, handle_load_metrics);
+    metadata_store_->add_watch(ETCD_LOADMETRICS_PREFIX,
+                               load_metrics_watch_->callback());
   }
 
   init();
@@ -70,7 +118,7 @@ void InstanceMgr::init() {
   {
     std::unique_lock<std::shared_mutex> lock(inst_mutex_);
     for (auto& it : ETCD_KEYS_PREFIX_MAP) {
-      etcd_client_->get_prefix(it.second, &instances_);
+      metadata_store_->get_prefix(it.second, &instances_);
     }
     // create ttft predictor and request metrics for each instance
     {
@@ -79,8 +127,8 @@ void InstanceMgr::init() {
       for (auto& pair : instances_) {
         time_predictors_.insert_or_assign(
             pair.first,
-            TimePredictor(pair.second.ttft_profiling_data,
-                          pair.second.tpot_profiling_data));
+            std::make_shared<TimePredictor>(pair.second.ttft_profiling_data,
+                                            pair.second.tpot_profiling_data));
         request_metrics_.insert_or_assign(pair.first, RequestMetrics());
       }
     }
@@ -98,12 +146,14 @@ void InstanceMgr::init() {
           case InstanceType::PREFILL:
             ist.second.instance_index = prefill_index_.size();
             prefill_index_.emplace_back(ist.first);
+            prefill_ring_.add(ist.first);
             LOG(INFO) << "Register a new prefill instance, instance name : "
                       << ist.first;
             break;
           case InstanceType::DECODE:
             ist.second.instance_index = decode_index_.size();
             decode_index_.emplace_back(ist.first);
+            decode_ring_.add(ist.first);
             LOG(INFO) << "Register a new decode instance, instance name : "
                       << ist.first;
             break;
@@ -115,12 +165,14 @@ void InstanceMgr::init() {
               ist.second.instance_index = prefill_index_.size();
               ist.second.current_type = InstanceType::PREFILL;
               prefill_index_.emplace_back(ist.first);
+              prefill_ring_.add(ist.first);
               LOG(INFO) << "Register a new prefill instance, instance name : "
                         << ist.first;
             } else {
               ist.second.instance_index = decode_index_.size();
               ist.second.current_type = InstanceType::DECODE;
               decode_index_.emplace_back(ist.first);
+              decode_ring_.add(ist.first);
               LOG(INFO) << "Register a new decode instance, instance name : "
                         << ist.first;
             }
@@ -144,8 +196,15 @@ void InstanceMgr::init() {
     }
   }
   {
+    std::shared_lock<std::shared_mutex> inst_lock(inst_mutex_);
     std::unique_lock<std::shared_mutex> lock(load_metric_mutex_);
-    etcd_client_->get_prefix(ETCD_LOADMETRICS_PREFIX, &load_metrics_);
+    metadata_store_->get_prefix(ETCD_LOADMETRICS_PREFIX, &load_metrics_);
+    for (const auto& [name, metainfo] : instances_) {
+      if (metainfo.instance_index != -1) {
+        add_to_load_heap(name, serving_role(metainfo));
+      }
+      latency_stats_.add_instance(name);
+    }
   }
 
   for (int i = 0; i < prefill_index_.size(); i++) {
@@ -153,7 +212,16 @@ void InstanceMgr::init() {
   }
 }
 
-InstanceMgr::~InstanceMgr() { exited_ = true; }
+InstanceMgr::~InstanceMgr() {
+  exited_ = true;
+  for (auto& it : ETCD_KEYS_PREFIX_MAP) {
+    metadata_store_->remove_watch(it.second);
+  }
+  metadata_store_->remove_watch(ETCD_LOADMETRICS_PREFIX);
+  // the upload in flight calls back into the manager
+  std::unique_lock<std::mutex> lock(update_mutex_);
+  upload_cv_.wait(lock, [this]() { return !uploading_; });
+}
 
 InstanceMetaInfo InstanceMgr::get_instance_info(
     const std::string& instance_name) {
@@ -167,6 +235,75 @@ InstanceMetaInfo InstanceMgr::get_instance_info(
   return instances_[instance_name];
 }
 
+int32_t InstanceMgr::get_dp_size(const std::string& instance_name) {
+  std::shared_lock<std::shared_mutex> lock(inst_mutex_);
+  auto it = instances_.find(instance_name);
+  return it == instances_.end() ? 0 : it->second.dp_size;
+}
+
+void InstanceMgr::select_dp_ranks(const OverlapScores& overlap_scores,
+                                  Routing* routing) {
+  const int32_t prefill_dp_size = get_dp_size(routing->prefill_name);
+  const int32_t decode_dp_size = get_dp_size(routing->decode_name);
+
+  std::lock_guard<std::mutex> lock(request_metrics_mutex_);
+  routing->prefill_dp_rank =
+      select_dp_rank(routing->prefill_name, prefill_dp_size, overlap_scores);
+  if (routing->decode_name == routing->prefill_name) {
+    routing->decode_dp_rank = routing->prefill_dp_rank;
+  } else {
+    routing->decode_dp_rank =
+        select_dp_rank(routing->decode_name, decode_dp_size, overlap_scores);
+  }
+}
+
+int32_t InstanceMgr::select_dp_rank(const std::string& instance_name,
+                                    int32_t dp_size,
+                                    const OverlapScores& overlap_scores) {
+  if (dp_size <= 1) {
+    return -1;
+  }
+  auto it = request_metrics_.find(instance_name);
+  if (it == request_metrics_.end()) {
+    return -1;
+  }
+  dp_size = std::min(dp_size, kMaxDpRanks);
+  auto& request_num = it->second.dp_rank_request_num;
+  if (request_num.size() < static_cast<size_t>(dp_size)) {
+    request_num.resize(dp_size, 0);
+  }
+
+  const std::vector<uint32_t>* matched_blocks = nullptr;
+  auto score_it = overlap_scores.hbm_dp_rank_score.find(instance_name);
+  if (score_it != overlap_scores.hbm_dp_rank_score.end() &&
+      overlap_scores.max_block_num > 0) {
+    matched_blocks = &score_it->second;
+  }
+  const int64_t max_request_num =
+      *std::max_element(request_num.begin(), request_num.begin() + dp_size);
+
+  // the same trade-off between prefix hits and load as the cache aware
+  // policy makes between instances
+  int32_t best_rank = 0;
+  float best_score = std::numeric_limits<float>::lowest();
+  for (int32_t rank = 0; rank < dp_size; ++rank) {
+    float score = 0;
+    if (matched_blocks != nullptr &&
+        static_cast<size_t>(rank) < matched_blocks->size()) {
+      score += static_cast<float>((*matched_blocks)[rank]) /
+               overlap_scores.max_block_num;
+    }
+    if (max_request_num > 0) {
+      score -= static_cast<float>(request_num[rank]) / max_request_num;
+    }
+    if (score > best_score) {
+      best_score = score;
+      best_rank = rank;
+    }
+  }
+  return best_rank;
+}
+
 bool InstanceMgr::get_next_instance_pair(Routing* routing) {
   std::unique_lock<std::shared_mutex> lock(inst_mutex_);
   if (prefill_index_.empty()) {
@@ -180,12 +317,141 @@ bool InstanceMgr::get_next_instance_pair(Routing* routing) {
     return true;
   }
   next_decode_index_ = next_decode_index_ % decode_index_.size();
+  if (topology_.enabled()) {
+    // the nearest decode instance to the prefill instance in round robin
+    // order
+    const TopologyLocation prefill_location =
+        topology_.locate(routing->prefill_name);
+    uint64_t nearest_index = next_decode_index_;
+    double min_distance = std::numeric_limits<double>::max();
+    for (size_t i = 0; i < decode_index_.size(); ++i) {
+      const uint64_t index = (next_decode_index_ + i) % decode_index_.size();
+      const double distance = topology_.distance(
+          prefill_location, topology_.locate(decode_index_[index]));
+      if (distance < min_distance) {
+        min_distance = distance;
+        nearest_index = index;
+      }
+    }
+    next_decode_index_ = nearest_index;
+  }
   routing->decode_name = decode_index_[next_decode_index_];
   next_decode_index_++;
   return true;
 }
 
-// TODO: refactor later, currently return all decode instances
+bool InstanceMgr::sample_instances(InstanceType role,
+                                   size_t num_choices,
+                                   const std::string& preferred,
+                                   std::vector<InstanceSample>* samples) {
+  thread_local absl::BitGen bitgen;
+  samples->clear();
+  {
+    std::shared_lock<std::shared_mutex> lock(inst_mutex_);
+    const auto& role_index =
+        role == InstanceType::DECODE ? decode_index_ : prefill_index_;
+    if (role_index.empty()) {
+      return false;
+    }
+
+    std::vector<uint64_t> indexes;
+    if (num_choices >= role_index.size()) {
+      indexes.resize(role_index.size());
+      std::iota(indexes.begin(), indexes.end(), 0);
+    } else {
+      // `num_choices` is small, retrying on duplicates is cheap
+      while (indexes.size() < num_choices) {
+        const uint64_t index =
+            absl::Uniform<uint64_t>(bitgen, 0, role_index.size());
+        if (std::find(indexes.begin(), indexes.end(), index) ==
+            indexes.end()) {
+          indexes.emplace_back(index);
+        }
+      }
+    }
+    auto it = instances_.find(preferred);
+    if (it != instances_.end()) {
+      const uint64_t index = it->second.instance_index;
+      if (index < role_index.size() && role_index[index] == preferred &&
+          std::find(indexes.begin(), indexes.end(), index) == indexes.end()) {
+        indexes.emplace_back(index);
+      }
+    }
+
+    samples->reserve(indexes.size());
+    for (uint64_t index : indexes) {
+      samples->emplace_back();
+      samples->back().name = role_index[index];
+    }
+  }
+
+  const CapacityLimits limits = capacity_limits();
+  std::vector<std::optional<LoadMetrics>> load_metrics(samples->size());
+  {
+    std::shared_lock<std::shared_mutex> metric_lock(load_metric_mutex_);
+    for (size_t i = 0; i < samples->size(); ++i) {
+      auto it = load_metrics_.find((*samples)[i].name);
+      if (it != load_metrics_.end()) {
+        load_metrics[i] = it->second;
+      }
+    }
+  }
+  std::lock_guard<std::mutex> lock(request_metrics_mutex_);
+  for (size_t i = 0; i < samples->size(); ++i) {
+    auto& sample = (*samples)[i];
+    auto it = request_metrics_.find(sample.name);
+    if (it != request_metrics_.end()) {
+      sample.outstanding_tokens =
+          it->second.prefill_token_num + it->second.decode_token_num;
+      sample.has_room = limits.has_room(
+          role,
+          load_metrics[i].has_value() ? &*load_metrics[i] : nullptr,
+          it->second);
+    }
+  }
+  return true;
+}
+
+bool InstanceMgr::select_instance_by_hash(InstanceType role,
+                                          std::string_view key,
+                                          double load_factor,
+                                          std::string* instance_name) {
+  std::shared_lock<std::shared_mutex> lock(inst_mutex_);
+  const auto& role_index =
+      role == InstanceType::DECODE ? decode_index_ : prefill_index_;
+  const auto& ring =
+      role == InstanceType::DECODE ? decode_ring_ : prefill_ring_;
+  if (role_index.empty()) {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> metrics_lock(request_metrics_mutex_);
+  auto get_request_num = [&](const std::string& name) -> int64_t {
+    auto it = request_metrics_.find(name);
+    if (it == request_metrics_.end()) {
+      return 0;
+    }
+    return role == InstanceType::DECODE ? it->second.decode_request_num
+                                        : it->second.prefill_request_num;
+  };
+  int64_t total_request_num = 0;
+  for (const auto& name : role_index) {
+    total_request_num += get_request_num(name);
+  }
+  // the bound includes the new request, the least loaded instance is always
+  // within it
+  const int64_t max_request_num = std::ceil(
+      std::max(load_factor, 1.0) * (total_request_num + 1) / role_index.size());
+
+  *instance_name = ring.walk(key, [&](const std::string& name) {
+    return get_request_num(name) + 1 <= max_request_num;
+  });
+  if (instance_name->empty()) {
+    *instance_name = role_index.front();
+  }
+  return true;
+}
+
 std::vector<std::string> InstanceMgr::get_static_decode_list(
     const std::string& instance_name) {
   std::vector<std::string> decode_list;
@@ -195,11 +461,12 @@ std::vector<std::string> InstanceMgr::get_static_decode_list(
       decode_list.emplace_back(inst.second.name);
     }
   }
+  lock.unlock();
 
+  rank_by_distance(instance_name, &decode_list);
   return decode_list;
 }
 
-// TODO: refactor later, currently return all prefill instances
 std::vector<std::string> InstanceMgr::get_static_prefill_list(
     const std::string& instance_name) {
   std::vector<std::string> prefill_list;
@@ -210,78 +477,172 @@ std::vector<std::string> InstanceMgr::get_static_prefill_list(
       prefill_list.emplace_back(inst.second.name);
     }
   }
+  lock.unlock();
 
+  rank_by_distance(instance_name, &prefill_list);
   return prefill_list;
 }
 
-void InstanceMgr::get_load_metrics(LoadBalanceInfos* infos) {
-  std::shared_lock<std::shared_mutex> inst_lock(inst_mutex_);
-  std::shared_lock<std::shared_mutex> metric_lock(load_metric_mutex_);
+void InstanceMgr::rank_by_distance(const std::string& instance_name,
+                                   std::vector<std::string>* names) const {
+  const TopologyLocation location = topology_.locate(instance_name);
+  std::vector<std::pair<double, std::string>> ranked;
+  ranked.reserve(names->size());
+  for (auto& name : *names) {
+    ranked.emplace_back(topology_.distance(location, topology_.locate(name)),
+                        std::move(name));
+  }
+  std::sort(ranked.begin(), ranked.end());
 
-  for (auto name : infos->overlap_scores.instances) {
-    auto it = load_metrics_.find(name);
-    if (it == load_metrics_.end()) {
-      continue;
+  size_t size = ranked.size();
+  if (FLAGS_static_instance_list_size > 0) {
+    size = std::min<size_t>(size, FLAGS_static_instance_list_size);
+  }
+  names->clear();
+  for (size_t i = 0; i < size; ++i) {
+    names->emplace_back(std::move(ranked[i].second));
+  }
+}
+
+void InstanceMgr::get_candidates(const CandidateQuery& query,
+                                 std::vector<InstanceCandidate>* candidates) {
+  candidates->clear();
+  const uint64_t now = now_ms();
+  std::shared_lock<std::shared_mutex> inst_lock(inst_mutex_);
+  auto add_candidate = [&](const std::string& name, InstanceType role) {
+    auto it = instances_.find(name);
+    if (it == instances_.end()) {
+      return;
     }
-    auto instance_it = instances_.find(name);
-    if (instance_it == instances_.end()) {
-      continue;
+    candidates->emplace_back();
+    auto& candidate = candidates->back();
+    candidate.name = name;
+    candidate.role = role;
+    candidate.heartbeat_age_ms =
+        now > it->second.latest_timestamp ? now - it->second.latest_timestamp
+                                          : 0;
+  };
+  // the heaps and the query may hold instances which serve another role now
+  // or were drained, only instances in `role_index` serve the role.
+  auto serves_role = [&](const std::string& name,
+                         const std::vector<std::string>& role_index) {
+    auto it = instances_.find(name);
+    if (it == instances_.end()) {
+      return false;
+    }
+    const uint64_t index = it->second.instance_index;
+    return index < role_index.size() && role_index[index] == name;
+  };
+  auto collect = [&](const std::vector<std::string>& role_index,
+                     InstanceType role) {
+    if (query.names == nullptr) {
+      for (const auto& name : role_index) {
+        add_candidate(name, role);
+      }
+      return;
+    }
+    for (const auto& name : *query.names) {
+      if (serves_role(name, role_index)) {
+        add_candidate(name, role);
+      }
     }
+  };
+  collect(prefill_index_, InstanceType::PREFILL);
+  const size_t num_prefill_candidates = candidates->size();
+  collect(decode_index_, InstanceType::DECODE);
+  const size_t num_decode_candidates =
+      candidates->size() - num_prefill_candidates;
 
-    if (instance_it->second.type == InstanceType::DECODE) {
-      infos->decode_load_metrics.insert(std::make_pair(name, it->second));
-      infos->decode_max_waiting_requests_num =
-          std::max(infos->decode_max_waiting_requests_num,
-                   it->second.waiting_requests_num);
-    } else {
-      infos->prefill_load_metrics.insert(std::make_pair(name, it->second));
-      infos->prefill_max_waiting_requests_num =
-          std::max(infos->prefill_max_waiting_requests_num,
-                   it->second.waiting_requests_num);
-    }
-  }
-
-  std::string least_loaded_prefill_instance;
-  float least_loaded_prefill_gpu_cache_usage_perc = 1;
-  std::string least_loaded_decode_instance;
-  float least_loaded_decode_gpu_cache_usage_perc = 1;
-
-  if (infos->prefill_load_metrics.size() == 0 ||
-      infos->decode_load_metrics.size() == 0) {
-    for (const auto& metric : load_metrics_) {
-      auto instance_it = instances_.find(metric.first);
-      if (instance_it != instances_.end()) {
-        if (instance_it->second.type != InstanceType::DECODE) {
-          if (metric.second.gpu_cache_usage_perc <
-              least_loaded_prefill_gpu_cache_usage_perc) {
-            least_loaded_prefill_gpu_cache_usage_perc =
-                metric.second.gpu_cache_usage_perc;
-            least_loaded_prefill_instance = metric.first;
-          }
-        } else {
-          if (metric.second.gpu_cache_usage_perc <
-              least_loaded_decode_gpu_cache_usage_perc) {
-            least_loaded_decode_gpu_cache_usage_perc =
-                metric.second.gpu_cache_usage_perc;
-            least_loaded_decode_instance = metric.first;
-          }
+  {
+    std::shared_lock<std::shared_mutex> metric_lock(load_metric_mutex_);
+    // fall back to the least loaded instances, instances without load
+    // metrics have a score of 1 and are never selected.
+    auto add_least_loaded = [&](const IndexedMinHeap<std::string, float>& heap,
+                                const std::vector<std::string>& role_index,
+                                InstanceType role) {
+      if (!heap.empty() && serves_role(heap.top().second, role_index)) {
+        if (heap.top().first < 1) {
+          add_candidate(heap.top().second, role);
         }
+        return;
       }
+      // the heap is out of step with the role index, scan the index
+      const std::string* least_loaded = nullptr;
+      float least_score = 1;
+      for (const auto& name : role_index) {
+        auto it = load_metrics_.find(name);
+        if (it != load_metrics_.end() &&
+            it->second.gpu_cache_usage_perc < least_score) {
+          least_score = it->second.gpu_cache_usage_perc;
+          least_loaded = &name;
+        }
+      }
+      if (least_loaded != nullptr) {
+        add_candidate(*least_loaded, role);
+      }
+    };
+    if (query.names != nullptr && num_prefill_candidates == 0) {
+      add_least_loaded(
+          prefill_load_heap_, prefill_index_, InstanceType::PREFILL);
+    }
+    if (query.names != nullptr && num_decode_candidates == 0) {
+      add_least_loaded(decode_load_heap_, decode_index_, InstanceType::DECODE);
+    }
+
+    for (auto& candidate : *candidates) {
+      auto it = load_metrics_.find(candidate.name);
+      if (it != load_metrics_.end()) {
+        candidate.has_load_metrics = true;
+        candidate.load_metrics = it->second;
+      }
+    }
+  }
+
+  std::lock_guard<std::mutex> request_metrics_lock(request_metrics_mutex_);
+  for (auto& candidate : *candidates) {
+    auto it = request_metrics_.find(candidate.name);
+    if (it != request_metrics_.end()) {
+      candidate.request_metrics = it->second;
+    }
+    if (query.num_prompt_tokens < 0) {
+      continue;
+    }
+    const auto& metrics = candidate.request_metrics;
+    auto time_predictor = get_time_predictor(candidate.name);
+    if (time_predictor == nullptr) {
+      continue;
+    }
+    candidate.predicted_ttft =
+        time_predictor->predict_ttft(query.num_prompt_tokens);
+    candidate.predicted_tpot = time_predictor->predict_tpot(
+        metrics.decode_token_num + query.num_prompt_tokens,
+        metrics.decode_request_num + 1);
+    if (FLAGS_slo_use_measured_latency) {
+      // the prediction does not see the interference of other workloads on
+      // the instance, trust the measured tail latency when it is worse.
+      candidate.predicted_tpot = std::max(
+          candidate.predicted_tpot,
+          latency_stats_.get_latency_percentile(candidate.name, 0.99).tbt);
     }
   }
+}
 
-  if (infos->prefill_load_metrics.size() == 0 &&
-      !least_loaded_prefill_instance.empty()) {
-    infos->prefill_load_metrics.insert(
-        std::make_pair(least_loaded_prefill_instance,
-                       load_metrics_[least_loaded_prefill_instance]));
+void InstanceMgr::add_estimated_prefill_time(const std::string& instance_name,
+                                             int64_t time) {
+  std::lock_guard<std::mutex> lock(request_metrics_mutex_);
+  auto it = request_metrics_.find(instance_name);
+  if (it != request_metrics_.end()) {
+    it->second.estimated_prefill_time += time;
   }
+}
 
-  if (infos->decode_load_metrics.size() == 0 &&
-      !least_loaded_decode_instance.empty()) {
-    infos->decode_load_metrics.insert(
-        std::make_pair(least_loaded_decode_instance,
-                       load_metrics_[least_loaded_decode_instance]));
+void InstanceMgr::update_load_heap(const std::string& instance_name) {
+  auto it = load_metrics_.find(instance_name);
+  float score = it == load_metrics_.end() ? 1 : it->second.gpu_cache_usage_perc;
+  if (prefill_load_heap_.contains(instance_name)) {
+    prefill_load_heap_.update(instance_name, score);
+  } else if (decode_load_heap_.contains(instance_name)) {
+    decode_load_heap_.update(instance_name, score);
   }
 }
 
@@ -294,31 +655,83 @@ void InstanceMgr::record_load_metrics_update(
       instance_name,
       LoadMetrics(load_metrics.waiting_requests_num(),
                   load_metrics.gpu_cache_usage_perc()));
+  removed_instance_.erase(instance_name);
 }
 
 bool InstanceMgr::upload_load_metrics() {
-  std::lock_guard<std::mutex> lock(update_mutex_);
-  bool status = etcd_client_->set(ETCD_LOADMETRICS_PREFIX, updated_metrics_);
-  status =
-      status && etcd_client_->rm(ETCD_LOADMETRICS_PREFIX, removed_instance_);
+  return upload_load_metrics_async().get();
+}
+
+std::future<bool> InstanceMgr::upload_load_metrics_async() {
+  auto promise = std::make_shared<std::promise<bool>>();
+  auto future = promise->get_future();
+  auto metrics =
+      std::make_shared<std::unordered_map<std::string, LoadMetrics>>();
+  auto removed = std::make_shared<std::unordered_set<std::string>>();
   {
-    std::unique_lock<std::shared_mutex> lock(inst_mutex_);
-    for (auto& iter : updated_metrics_) {
-      load_metrics_.insert_or_assign(iter.first, std::move(iter.second));
+    std::unique_lock<std::mutex> lock(update_mutex_);
+    // a later upload of an instance must not overtake an earlier one
+    upload_cv_.wait(lock, [this]() { return !uploading_; });
+    if (updated_metrics_.empty() && removed_instance_.empty()) {
+      promise->set_value(true);
+      return future;
     }
-    for (auto& iter : removed_instance_) {
-      load_metrics_.erase(iter);
+    {
+      std::unique_lock<std::shared_mutex> lock(load_metric_mutex_);
+      for (auto& iter : updated_metrics_) {
+        load_metrics_.insert_or_assign(iter.first, iter.second);
+        update_load_heap(iter.first);
+      }
+      for (auto& iter : removed_instance_) {
+        load_metrics_.erase(iter);
+        update_load_heap(iter);
+      }
     }
+    metrics->swap(updated_metrics_);
+    removed->swap(removed_instance_);
+    uploading_ = true;
   }
-  updated_metrics_.clear();
-  removed_instance_.clear();
 
-  return status;
+  auto update = MetadataStore::make_batch_update(
+      ETCD_LOADMETRICS_PREFIX, *metrics, *removed);
+  metadata_store_->batch_update_async(
+      std::move(update), [this, metrics, removed, promise](bool ok) {
+        {
+          std::lock_guard<std::mutex> lock(update_mutex_);
+          // keep the changes to retry with the next upload if the store
+          // fails, unless the instance has changed again
+          if (!ok) {
+            for (auto& [name, load_metrics] : *metrics) {
+              if (removed_instance_.count(name) == 0) {
+                updated_metrics_.try_emplace(name, load_metrics);
+              }
+            }
+            for (const auto& name : *removed) {
+              if (updated_metrics_.count(name) == 0) {
+                removed_instance_.insert(name);
+              }
+            }
+          }
+          uploading_ = false;
+        }
+        upload_cv_.notify_all();
+        promise->set_value(ok);
+      });
+  return future;
 }
 
 void InstanceMgr::set_as_master() {
   is_master_service_ = true;
-  etcd_client_->remove_watch(ETCD_LOADMETRICS_PREFIX);
+  {
+    // heartbeats were sent to the previous master, give every instance a full
+    // interval to find the new one.
+    std::unique_lock<std::shared_mutex> lock(inst_mutex_);
+    const uint64_t now = now_ms();
+    for (auto& [name, metainfo] : instances_) {
+      metainfo.latest_timestamp = now;
+    }
+  }
+  metadata_store_->remove_watch(ETCD_LOADMETRICS_PREFIX);
 }
 
 std::shared_ptr<brpc::Channel> InstanceMgr::get_channel(
@@ -352,220 +765,224 @@ bool InstanceMgr::create_channel(const std::string& instance_name) {
   return true;
 }
 
-void InstanceMgr::update_instance_metainfo(const etcd::Response& response,
-                                           const uint64_t& prefix_len) {
-  if (response.events().empty() || exited_) {
-    return;
+ErrorCode InstanceMgr::register_instance(const InstanceMetaInfo& metainfo) {
+  std::unique_lock<std::shared_mutex> lock(inst_mutex_);
+  if (instances_.find(metainfo.name) != instances_.end()) {
+    LOG(ERROR) << "Instance is already registered, instance_name: "
+               << metainfo.name;
+    return ErrorCode::INSTANCE_EXISTED;
   }
 
-  threadpool_.schedule([this,
-                        response = std::move(response),
-                        prefix_len = std::move(prefix_len)] {
-    if (exited_) return;
-    std::unordered_map<std::string, InstanceMetaInfo> put_map;
-    std::vector<std::string> delete_list;
+  if (!add_instance(metainfo.name, InstanceMetaInfo(metainfo))) {
+    return ErrorCode::INTERNAL_ERROR;
+  }
+  return ErrorCode::OK;
+}
 
-    for (const auto& event : response.events()) {
-      std::string instance_name = event.kv().key().substr(prefix_len);
+bool InstanceMgr::add_instance(const std::string& instance_name,
+                               InstanceMetaInfo&& metainfo) {
+  if (!create_channel(instance_name)) {
+    LOG(ERROR) << "create channel fail: " << instance_name;
+    return false;
+  }
 
-      if (event.event_type() == etcd::Event::EventType::PUT) {
-        InstanceMetaInfo metainfo;
-        auto json_str = event.kv().as_string();
-        if (!metainfo.parse_from_json(json_str)) {
-          LOG(ERROR) << "pase json:" << json_str << " error!";
-          continue;
-        }
+  {
+    std::lock_guard<std::mutex> time_predictor_lock(time_predictor_mutex_);
+    std::lock_guard<std::mutex> request_metrics_lock(request_metrics_mutex_);
+    // create ttft predictor for instance
+    time_predictors_.try_emplace(
+        instance_name,
+        std::make_shared<TimePredictor>(metainfo.ttft_profiling_data,
+                                        metainfo.tpot_profiling_data));
+
+    // create request metrics for instance
+    request_metrics_.emplace(instance_name, RequestMetrics());
+  }
+  latency_stats_.add_instance(instance_name);
+  metainfo.latest_timestamp = now_ms();
+
+  switch (metainfo.type) {
+    case InstanceType::DEFAULT:
+    case InstanceType::PREFILL:
+      metainfo.instance_index = prefill_index_.size();
+      prefill_index_.emplace_back(instance_name);
+      prefill_ring_.add(instance_name);
+      LOG(INFO) << "Register a new prefill instance, instance name : "
+                << instance_name;
+      break;
+    case InstanceType::DECODE:
+      metainfo.instance_index = decode_index_.size();
+      decode_index_.emplace_back(instance_name);
+      decode_ring_.add(instance_name);
+      LOG(INFO) << "Register a new decode instance, instance name : "
+                << instance_name;
+      break;
+    case InstanceType::MIX:
+      // In the initial state, we set the first MIX type instance as a
+      // decode instance, while all subsequent instances are set as
+      // prefill instances.
+      if (decode_index_.size() > 0) {
+        metainfo.instance_index = prefill_index_.size();
+        metainfo.current_type = InstanceType::PREFILL;
+        prefill_index_.emplace_back(instance_name);
+        prefill_ring_.add(instance_name);
+        LOG(INFO) << "Register a new prefill instance, instance name : "
+                  << instance_name;
+      } else {
+        metainfo.instance_index = decode_index_.size();
+        metainfo.current_type = InstanceType::DECODE;
+        decode_index_.emplace_back(instance_name);
+        decode_ring_.add(instance_name);
+        LOG(INFO) << "Register a new decode instance, instance name : "
+                  << instance_name;
+      }
+      break;
+    default:
+      LOG(WARNING) << "Unknown InstanceType: " << int(metainfo.type);
+      break;
+  }
+  if (metainfo.instance_index != -1) {
+    std::unique_lock<std::shared_mutex> lock(load_metric_mutex_);
+    add_to_load_heap(instance_name, serving_role(metainfo));
+  }
 
-        put_map.insert(std::make_pair(instance_name, std::move(metainfo)));
+  instances_.insert(std::make_pair(instance_name, std::move(metainfo)));
+  return true;
+}
 
-      } else if (event.event_type() == etcd::Event::EventType::DELETE_) {
-        delete_list.push_back(instance_name);
-      }
+void InstanceMgr::update_instance_metainfo(const WatchEvents& events) {
+  if (exited_) {
+    return;
+  }
+  // parse outside of the writer lock, nullopt for deletes
+  std::vector<std::pair<std::string, std::optional<InstanceMetaInfo>>> updates;
+  updates.reserve(events.size());
+  for (const auto& event : events) {
+    if (event.type == WatchEvent::Type::DELETE) {
+      updates.emplace_back(event.key, std::nullopt);
+      continue;
+    }
+    InstanceMetaInfo metainfo;
+    if (!metainfo.parse_from_json(event.value)) {
+      LOG(ERROR) << "pase json:" << event.value << " error!";
+      continue;
     }
+    updates.emplace_back(event.key, std::move(metainfo));
+  }
 
-    {
-      std::unique_lock<std::shared_mutex> lock(inst_mutex_);
-      for (auto& iter : put_map) {
-        if (instances_.find(iter.first) != instances_.end()) {
+  std::vector<std::string> removed_names;
+  {
+    std::unique_lock<std::shared_mutex> lock(inst_mutex_);
+    for (auto& [instance_name, metainfo] : updates) {
+      if (metainfo.has_value()) {
+        if (instances_.find(instance_name) != instances_.end()) {
           LOG(ERROR) << "Instance is already registered, instance_name: "
-                     << iter.first;
+                     << instance_name;
           continue;
         }
-
-        if (!create_channel(iter.first)) {
-          LOG(ERROR) << "create channel fail: " << iter.first;
+        add_instance(instance_name, std::move(*metainfo));
+      } else {
+        LOG(INFO) << "delete instance: " << instance_name;
+        if (instances_.find(instance_name) == instances_.end()) {
+          LOG(ERROR) << "Instance is already deleted, instance_name: "
+                     << instance_name;
           continue;
         }
+        remove_instance(instance_name);
+        removed_names.emplace_back(instance_name);
+      }
+    }
+  }
 
-        {
-          std::lock_guard<std::mutex> time_predictor_lock(
-              time_predictor_mutex_);
-          std::lock_guard<std::mutex> request_metrics_lock(
-              request_metrics_mutex_);
-          // create ttft predictor for instance
-          time_predictors_.emplace(
-              iter.first,
-              TimePredictor(iter.second.ttft_profiling_data,
-                            iter.second.tpot_profiling_data));
-
-          // create request metrics for instance
-          request_metrics_.emplace(iter.first, RequestMetrics());
-        }
-
-        switch (iter.second.type) {
-          case InstanceType::DEFAULT:
-          case InstanceType::PREFILL:
-            iter.second.instance_index = prefill_index_.size();
-            prefill_index_.emplace_back(iter.first);
-            LOG(INFO) << "Register a new prefill instance, instance name : "
-                      << iter.first;
-            break;
-          case InstanceType::DECODE:
-            iter.second.instance_index = decode_index_.size();
-            decode_index_.emplace_back(iter.first);
-            LOG(INFO) << "Register a new decode instance, instance name : "
-                      << iter.first;
-            break;
-          case InstanceType::MIX:
-            // In the initial state, we set the first MIX type instance as a
-            // decode instance, while all subsequent instances are set as
-            // prefill instances.
-            if (decode_index_.size() > 0) {
-              iter.second.instance_index = prefill_index_.size();
-              iter.second.current_type = InstanceType::PREFILL;
-              prefill_index_.emplace_back(iter.first);
-              LOG(INFO) << "Register a new prefill instance, instance name : "
-                        << iter.first;
-            } else {
-              iter.second.instance_index = decode_index_.size();
-              iter.second.current_type = InstanceType::DECODE;
-              decode_index_.emplace_back(iter.first);
-              LOG(INFO) << "Register a new decode instance, instance name : "
-                        << iter.first;
-            }
-            break;
-          default:
-            LOG(WARNING) << "Unknown InstanceType: " << int(iter.second.type);
-            break;
-        }
+  // only the master uploads the caches, the other services see the removal
+  // through their cache watch
+  if (!removed_names.empty() && is_master_service_ &&
+      global_kvcache_mgr_ != nullptr) {
+    global_kvcache_mgr_->remove_instance_caches(removed_names);
+  }
+}
 
-        instances_.insert(std::make_pair(iter.first, std::move(iter.second)));
-      }
+void InstanceMgr::remove_instance(const std::string& instance_name) {
+  erase_from_role_index(instance_name);
 
-      for (auto& iter : delete_list) {
-        LOG(INFO) << "delete instance: " << iter;
-        if (instances_.find(iter) == instances_.end()) {
-          LOG(ERROR) << "Instance is already deleted, instance_name: " << iter;
-          continue;
-        }
-        // TODO: notify cache manager to clear expire cache
-        uint64_t index = instances_[iter].instance_index;
+  instances_.erase(instance_name);
+  cached_channels_.erase(instance_name);
+  {
+    std::lock_guard<std::mutex> time_predictor_lock(time_predictor_mutex_);
+    std::lock_guard<std::mutex> request_metrics_lock(request_metrics_mutex_);
+    time_predictors_.erase(instance_name);
+    request_metrics_.erase(instance_name);
+  }
+  {
+    std::lock_guard<std::mutex> lock(latency_metrics_mutex_);
+    latency_metrics_.erase(instance_name);
+  }
+  latency_stats_.remove_instance(instance_name);
+  {
+    std::lock_guard<std::mutex> lock(update_mutex_);
+    updated_metrics_.erase(instance_name);
+    removed_instance_.insert(instance_name);
+  }
+}
 
-        switch (instances_[iter].type) {
-          case InstanceType::DEFAULT:
-          case InstanceType::PREFILL:
-            if (index == -1 || index >= prefill_index_.size()) {
-              break;
-            }
-            std::swap(prefill_index_[index], prefill_index_.back());
-            instances_[prefill_index_[index]].instance_index = index;
-            prefill_index_.pop_back();
-            break;
-          case InstanceType::DECODE:
-            if (index == -1 || index >= decode_index_.size()) {
-              break;
-            }
-            std::swap(decode_index_[index], decode_index_.back());
-            instances_[decode_index_[index]].instance_index = index;
-            decode_index_.pop_back();
-            break;
-          case InstanceType::MIX:
-            if (index == -1) {
-              break;
-            }
-            if (instances_[iter].current_type == InstanceType::PREFILL) {
-              if (index >= prefill_index_.size()) {
-                break;
-              }
-              std::swap(prefill_index_[index], prefill_index_.back());
-              instances_[prefill_index_[index]].instance_index = index;
-              prefill_index_.pop_back();
-            } else {
-              if (index >= decode_index_.size()) {
-                break;
-              }
-              std::swap(decode_index_[index], decode_index_.back());
-              instances_[decode_index_[index]].instance_index = index;
-              decode_index_.pop_back();
-            }
-            break;
-          default:
-            LOG(WARNING) << "Unknown InstanceType: "
-                         << int(instances_[iter].type);
-            break;
-        }
+bool InstanceMgr::record_heartbeat(const std::string& instance_name) {
+  std::unique_lock<std::shared_mutex> lock(inst_mutex_);
+  auto iter = instances_.find(instance_name);
+  if (iter == instances_.end()) {
+    return false;
+  }
+  iter->second.latest_timestamp = now_ms();
+  return true;
+}
 
-        instances_.erase(iter);
-        cached_channels_.erase(iter);
-        {
-          std::lock_guard<std::mutex> time_predictor_lock(
-              time_predictor_mutex_);
-          std::lock_guard<std::mutex> request_metrics_lock(
-              request_metrics_mutex_);
-          time_predictors_.erase(iter);
-          request_metrics_.erase(iter);
-        }
-        {
-          std::lock_guard<std::mutex> lock(update_mutex_);
-          updated_metrics_.erase(iter);
-          removed_instance_.insert(iter);
-        }
-      }
+std::vector<std::string> InstanceMgr::remove_disconnected_instances(
+    uint64_t timeout_ms) {
+  std::vector<std::string> disconnected_instances;
+  const uint64_t now = now_ms();
+  std::unique_lock<std::shared_mutex> lock(inst_mutex_);
+  for (const auto& [name, metainfo] : instances_) {
+    if (now > metainfo.latest_timestamp + timeout_ms) {
+      disconnected_instances.emplace_back(name);
     }
-  });
+  }
+  for (const auto& name : disconnected_instances) {
+    LOG(WARNING) << "Instance " << name << " has not sent heartbeats for "
+                 << now - instances_[name].latest_timestamp
+                 << " ms, remove it.";
+    remove_instance(name);
+  }
+  return disconnected_instances;
 }
 
-void InstanceMgr::update_load_metrics(const etcd::Response& response,
-                                      const uint64_t& prefix_len) {
-  if (response.events().empty() || exited_) {
+void InstanceMgr::update_load_metrics(const WatchEvents& events) {
+  if (exited_) {
     return;
   }
-  threadpool_.schedule([this,
-                        response = std::move(response),
-                        prefix_len = std::move(prefix_len)] {
-    if (exited_) return;
-    std::unordered_map<std::string, LoadMetrics> put_map;
-    std::vector<std::string> delete_list;
-
-    for (const auto& event : response.events()) {
-      std::string instance_name = event.kv().key().substr(prefix_len);
-
-      if (event.event_type() == etcd::Event::EventType::PUT) {
-        LoadMetrics load_metrics;
-        auto json_str = event.kv().as_string();
-        if (!load_metrics.parse_from_json(json_str)) {
-          LOG(ERROR) << "pase json:" << json_str << " error!";
-          continue;
-        }
-
-        put_map.insert(std::make_pair(instance_name, std::move(load_metrics)));
-
-      } else if (event.event_type() == etcd::Event::EventType::DELETE_) {
-        delete_list.push_back(instance_name);
-      }
+  // parse outside of the writer lock, nullopt for deletes
+  std::vector<std::pair<std::string, std::optional<LoadMetrics>>> updates;
+  updates.reserve(events.size());
+  for (const auto& event : events) {
+    if (event.type == WatchEvent::Type::DELETE) {
+      updates.emplace_back(event.key, std::nullopt);
+      continue;
     }
+    LoadMetrics load_metrics;
+    if (!load_metrics.parse_from_json(event.value)) {
+      LOG(ERROR) << "pase json:" << event.value << " error!";
+      continue;
+    }
+    updates.emplace_back(event.key, std::move(load_metrics));
+  }
 
-    {
-      std::unique_lock<std::shared_mutex> lock(load_metric_mutex_);
-      for (auto& iter : put_map) {
-        load_metrics_.insert_or_assign(iter.first, std::move(iter.second));
-      }
-
-      for (auto& iter : delete_list) {
-        load_metrics_.erase(iter);
-      }
+  std::unique_lock<std::shared_mutex> lock(load_metric_mutex_);
+  for (auto& [instance_name, load_metrics] : updates) {
+    if (load_metrics.has_value()) {
+      load_metrics_.insert_or_assign(instance_name, std::move(*load_metrics));
+    } else {
+      load_metrics_.erase(instance_name);
     }
-  });
+    update_load_heap(instance_name);
+  }
 }
 
 void InstanceMgr::update_latency_metrics(
@@ -597,8 +1014,19 @@ void InstanceMgr::update_request_metrics(std::shared_ptr<Request> request,
     return;
   }
 
+  auto add_dp_rank_request = [](RequestMetrics& metrics,
+                                int32_t rank,
+                                int64_t num) {
+    if (rank >= 0 &&
+        static_cast<size_t>(rank) < metrics.dp_rank_request_num.size()) {
+      metrics.dp_rank_request_num[rank] += num;
+    }
+  };
+
   int64_t num_prompt_tokens = request->token_ids.size();
   int64_t num_generated_tokens = request->num_generated_tokens;
+  const int32_t prefill_dp_rank = request->routing.prefill_dp_rank;
+  const int32_t decode_dp_rank = request->routing.decode_dp_rank;
   switch (action) {
     case RequestAction::SCHEDULE:
       // update the request metrics for prefill and decode instances when
@@ -608,6 +1036,9 @@ void InstanceMgr::update_request_metrics(std::shared_ptr<Request> request,
 
       decode_it->second.decode_request_num += 1;
       decode_it->second.decode_token_num += num_prompt_tokens;
+
+      add_dp_rank_request(prefill_it->second, prefill_dp_rank, 1);
+      add_dp_rank_request(decode_it->second, decode_dp_rank, 1);
       break;
     case RequestAction::FINISH_PREFILL:
       // update the request metrics for prefill and decode instance when request
@@ -615,6 +1046,7 @@ void InstanceMgr::update_request_metrics(std::shared_ptr<Request> request,
       prefill_it->second.prefill_request_num -= 1;
       prefill_it->second.prefill_token_num -= num_prompt_tokens;
       prefill_it->second.estimated_prefill_time -= request->estimated_ttft;
+      add_dp_rank_request(prefill_it->second, prefill_dp_rank, -1);
 
       decode_it->second.decode_token_num += 1;
       break;
@@ -629,191 +1061,259 @@ void InstanceMgr::update_request_metrics(std::shared_ptr<Request> request,
       decode_it->second.decode_request_num -= 1;
       decode_it->second.decode_token_num -=
           (num_prompt_tokens + num_generated_tokens);
+      add_dp_rank_request(decode_it->second, decode_dp_rank, -1);
       break;
     case RequestAction::CANCEL:
       // update the request metrics for prefill and decode instances when
-      // request is cancelled
-      prefill_it->second.prefill_request_num -= 1;
-      prefill_it->second.prefill_token_num -= num_prompt_tokens;
-      prefill_it->second.estimated_prefill_time -= request->estimated_ttft;
+      // request is cancelled, the prefill part has already been released if
+      // the prefill phase finished.
+      if (!request->prefill_finished) {
+        prefill_it->second.prefill_request_num -= 1;
+        prefill_it->second.prefill_token_num -= num_prompt_tokens;
+        prefill_it->second.estimated_prefill_time -= request->estimated_ttft;
+        add_dp_rank_request(prefill_it->second, prefill_dp_rank, -1);
+      }
 
       decode_it->second.decode_request_num -= 1;
       decode_it->second.decode_token_num -=
           (num_prompt_tokens + num_generated_tokens);
+      add_dp_rank_request(decode_it->second, decode_dp_rank, -1);
       break;
     default:
       LOG(ERROR) << "Unknown RequestAction: " << static_cast<int32_t>(action);
       break;
   }
-
-  if (options_.load_balance_policy() == "SLO_AWARE" &&
-      decode_it->second.decode_request_num == 0) {
-    std::unique_lock<std::shared_mutex> instance_lock(inst_mutex_);
-    flip_decode_to_prefill(request->routing.decode_name);
-  }
 }
 
-bool InstanceMgr::select_instance_pair_on_slo(
+int64_t InstanceMgr::estimate_remaining_time(
     std::shared_ptr<Request> request) {
-  std::unique_lock<std::shared_mutex> lock(inst_mutex_);
-  std::lock_guard<std::mutex> request_metrics_lock(request_metrics_mutex_);
-
-  if (prefill_index_.empty()) {
-    LOG(ERROR) << "No prefill or default instance found!";
-    return false;
+  int64_t remaining_time = 0;
+  if (!request->prefill_finished) {
+    remaining_time += request->estimated_ttft;
+  }
+  if (request->max_tokens <= request->num_generated_tokens) {
+    return remaining_time;
   }
 
-  // get min prefill time instance from request metrics
-  auto min_prefill_instance = prefill_index_[0];
-  int64_t min_prefill_time = std::numeric_limits<int64_t>::max();
-  int64_t total_prefill_time = 0;
-  for (auto& prefill_instance : prefill_index_) {
-    int64_t prefill_time =
-        request_metrics_[prefill_instance].estimated_prefill_time;
-    total_prefill_time += prefill_time;
-    if (prefill_time < min_prefill_time) {
-      min_prefill_instance = prefill_instance;
-      min_prefill_time = prefill_time;
+  int64_t token_num = 0;
+  int64_t request_num = 0;
+  {
+    std::lock_guard<std::mutex> lock(request_metrics_mutex_);
+    auto it = request_metrics_.find(request->routing.decode_name);
+    if (it == request_metrics_.end()) {
+      return remaining_time;
     }
+    token_num = it->second.decode_token_num;
+    request_num = it->second.decode_request_num;
   }
-  int64_t avg_prefill_time = total_prefill_time / prefill_index_.size();
 
-  if (decode_index_.empty()) {
-    LOG(ERROR) << "No decode instance found!";
-    return false;
+  auto time_predictor = get_time_predictor(request->routing.decode_name);
+  if (time_predictor == nullptr) {
+    return remaining_time;
   }
+  // A decode step is shared by the whole batch, the request only owns its
+  // share of every step.
+  request_num = std::max<int64_t>(1, request_num);
+  int64_t tpot = time_predictor->predict_tpot(token_num, request_num);
+  remaining_time += (request->max_tokens - request->num_generated_tokens) *
+                    tpot / request_num;
+  return remaining_time;
+}
 
-  // select decode instance
-  auto min_decode_instance = decode_index_[0];
-  int64_t min_estimated_tpot = std::numeric_limits<int64_t>::max();
-  std::string target_decode_instance;
-  for (auto& decode_instance : decode_index_) {
-    int64_t token_num = request_metrics_[decode_instance].decode_token_num;
-    int64_t request_num = request_metrics_[decode_instance].decode_request_num;
-    auto& time_predictor = get_time_predictor(decode_instance);
-    // calculate the estimated tpot
-    int64_t estimated_tpot = time_predictor.predict_tpot(
-        token_num + request->token_ids.size(), request_num + 1);
-    // If the estimated tpot meets the requirements, the request will be
-    // directly dispatched to that instance.
-    if (estimated_tpot <= FLAGS_target_tpot && target_decode_instance.empty()) {
-      target_decode_instance = decode_instance;
-    }
-
-    // Record the instance with the minimum estimated tpot.
-    if (estimated_tpot < min_estimated_tpot) {
-      min_decode_instance = decode_instance;
-      min_estimated_tpot = estimated_tpot;
-    }
+void InstanceMgr::observe_ttft(std::shared_ptr<Request> request,
+                               int64_t ttft) {
+  if (!FLAGS_enable_time_predictor_refit) {
+    return;
   }
-
-  if (!target_decode_instance.empty()) {
-    request->routing.decode_name = target_decode_instance;
-  } else {
-    request->routing.decode_name = min_decode_instance;
-  }
-
-  // select prefill instance
-  float tpot_threshold = (decode_index_.size() - 1.0f) / decode_index_.size();
-  // When the prefill instances are already overloaded and there are other
-  // instances with lower loads in the decode group, we will dispatch the
-  // prefill requests to those instances to alleviate the pressure on the
-  // prefill instances.
-  if (min_prefill_time > FLAGS_target_ttft &&
-      target_decode_instance != min_decode_instance &&
-      min_estimated_tpot < FLAGS_target_tpot * tpot_threshold &&
-      request_metrics_[min_decode_instance].estimated_prefill_time <
-          min_prefill_time) {
-    request->routing.prefill_name = min_decode_instance;
-    // update estimated ttft
-    auto& time_predictor = get_time_predictor(min_decode_instance);
-    request->estimated_ttft =
-        time_predictor.predict_ttft(request->token_ids.size());
-    request_metrics_[min_decode_instance].estimated_prefill_time +=
-        request->estimated_ttft;
-  } else {
-    request->routing.prefill_name = min_prefill_instance;
-    // update estimated ttft
-    auto& time_predictor = get_time_predictor(min_prefill_instance);
-    request->estimated_ttft =
-        time_predictor.predict_ttft(request->token_ids.size());
-    request_metrics_[min_prefill_instance].estimated_prefill_time +=
-        request->estimated_ttft;
-  }
-
-  // If there are no decode instances that meet the requirements, switch a
-  // prefill instance to decode if the number of instances allows. Since the
-  // current disaggregated PD mode does not support prefill and decode using the
-  // same instance, we only switch the instance here, without dispatching the
-  // decode request to this instance.
-  float ttft_threshold = (prefill_index_.size() - 1.0f) / prefill_index_.size();
-  if (target_decode_instance.empty() &&
-      (avg_prefill_time < FLAGS_target_ttft * ttft_threshold ||
-       decode_index_.size() < prefill_index_.size())) {
-    flip_prefill_to_decode(request->routing.prefill_name);
+  auto time_predictor = get_time_predictor(request->routing.prefill_name);
+  if (time_predictor == nullptr) {
+    return;
   }
-
-  return true;
+  const int32_t length = request->token_ids.size();
+  g_static_ttft_error << std::llabs(
+      int64_t(time_predictor->predict_static_ttft(length)) - ttft);
+  g_online_ttft_error << std::llabs(
+      int64_t(time_predictor->predict_ttft(length)) - ttft);
+  time_predictor->update_ttft(length, ttft);
 }
 
-void InstanceMgr::flip_prefill_to_decode(std::string& instance_name) {
-  if (prefill_index_.size() <= 1) {
-    // Ensure there is at least one prefill instance.
+void InstanceMgr::observe_tpot(std::shared_ptr<Request> request,
+                               int64_t tpot) {
+  if (!FLAGS_enable_time_predictor_refit) {
+    return;
+  }
+  int64_t token_num = 0;
+  int64_t request_num = 0;
+  {
+    std::lock_guard<std::mutex> lock(request_metrics_mutex_);
+    auto it = request_metrics_.find(request->routing.decode_name);
+    if (it == request_metrics_.end()) {
+      return;
+    }
+    token_num = it->second.decode_token_num;
+    request_num = it->second.decode_request_num;
+  }
+  if (request_num <= 0) {
     return;
   }
 
-  if (instances_.find(instance_name) == instances_.end()) {
-    LOG(ERROR) << "Can't find instance, instance_name: " << instance_name;
+  auto time_predictor = get_time_predictor(request->routing.decode_name);
+  if (time_predictor == nullptr) {
     return;
   }
+  g_static_tpot_error << std::llabs(
+      int64_t(time_predictor->predict_static_tpot(token_num, request_num)) -
+      tpot);
+  g_online_tpot_error << std::llabs(
+      int64_t(time_predictor->predict_tpot(token_num, request_num)) - tpot);
+  time_predictor->update_tpot(token_num, request_num, tpot);
+}
 
-  // delete instance name from prefill_index_
-  uint64_t index = instances_[instance_name].instance_index;
-  std::swap(prefill_index_[index], prefill_index_.back());
-  instances_[prefill_index_[index]].instance_index = index;
-  prefill_index_.pop_back();
+CapacityLimits InstanceMgr::capacity_limits() {
+  CapacityLimits limits;
+  limits.max_cache_usage = FLAGS_admission_max_cache_usage;
+  limits.max_requests = FLAGS_admission_max_requests_per_instance;
+  limits.max_prefill_time = FLAGS_target_ttft;
+  return limits;
+}
 
-  // insert instance name to decode_index_
-  instances_[instance_name].instance_index = decode_index_.size();
-  instances_[instance_name].current_type = InstanceType::DECODE;
-  decode_index_.emplace_back(instance_name);
+bool InstanceMgr::has_capacity() {
+  std::shared_lock<std::shared_mutex> lock(inst_mutex_);
+  if (prefill_index_.empty()) {
+    return false;
+  }
 
-  LOG(INFO) << "Flip prefill to decode, instance name : " << instance_name;
+  const CapacityLimits limits = capacity_limits();
+  std::shared_lock<std::shared_mutex> metric_lock(load_metric_mutex_);
+  std::lock_guard<std::mutex> request_metrics_lock(request_metrics_mutex_);
+  auto has_free_instance = [&](const std::vector<std::string>& index,
+                               InstanceType role) {
+    for (const auto& name : index) {
+      auto it = request_metrics_.find(name);
+      if (it == request_metrics_.end()) {
+        continue;
+      }
+      auto load_it = load_metrics_.find(name);
+      if (limits.has_room(
+              role,
+              load_it == load_metrics_.end() ? nullptr : &load_it->second,
+              it->second)) {
+        return true;
+      }
+    }
+    return false;
+  };
+  return has_free_instance(prefill_index_, InstanceType::PREFILL) &&
+         (decode_index_.empty() ||
+          has_free_instance(decode_index_, InstanceType::DECODE));
 }
 
-void InstanceMgr::flip_decode_to_prefill(std::string& instance_name) {
-  if (decode_index_.size() <= 1) {
-    // Ensure there is at least one decode instance.
+void InstanceMgr::rebalance_roles() {
+  std::vector<InstanceRoleLoad> loads;
+  {
+    std::shared_lock<std::shared_mutex> lock(inst_mutex_);
+    std::lock_guard<std::mutex> request_metrics_lock(request_metrics_mutex_);
+    std::lock_guard<std::mutex> time_predictor_lock(time_predictor_mutex_);
+    loads.reserve(instances_.size());
+    for (const auto& [name, metainfo] : instances_) {
+      InstanceRoleLoad load;
+      load.name = name;
+      load.flippable = metainfo.type == InstanceType::MIX;
+      const InstanceType role =
+          load.flippable ? metainfo.current_type : metainfo.type;
+      load.role = role == InstanceType::DECODE ? InstanceType::DECODE
+                                               : InstanceType::PREFILL;
+      auto metrics_it = request_metrics_.find(name);
+      if (metrics_it != request_metrics_.end()) {
+        const auto& metrics = metrics_it->second;
+        load.prefill_time = metrics.estimated_prefill_time;
+        load.prefill_request_num = metrics.prefill_request_num;
+        load.decode_request_num = metrics.decode_request_num;
+        auto predictor_it = time_predictors_.find(name);
+        if (metrics.decode_request_num > 0 &&
+            predictor_it != time_predictors_.end()) {
+          load.tpot = predictor_it->second->predict_tpot(
+              metrics.decode_token_num, metrics.decode_request_num);
+        }
+      }
+      loads.emplace_back(std::move(load));
+    }
+  }
+
+  auto changes = role_balancer_.balance(loads, now_ms());
+  if (changes.drain.empty() && changes.flip.empty()) {
     return;
   }
 
-  if (instances_.find(instance_name) == instances_.end()) {
-    LOG(ERROR) << "Can't find instance, instance_name: " << instance_name;
+  std::unique_lock<std::shared_mutex> lock(inst_mutex_);
+  // a drained instance takes no new requests until it has a new role
+  for (const auto& name : changes.drain) {
+    if (instances_.find(name) != instances_.end()) {
+      erase_from_role_index(name);
+    }
+  }
+  for (const auto& [name, role] : changes.flip) {
+    auto it = instances_.find(name);
+    if (it == instances_.end() || it->second.instance_index != -1) {
+      continue;
+    }
+    insert_into_role_index(name, role);
+    LOG(INFO) << "Switch instance " << name << " to the "
+              << (role == InstanceType::DECODE ? "decode" : "prefill")
+              << " role";
+  }
+}
+
+void InstanceMgr::erase_from_role_index(const std::string& instance_name) {
+  auto& metainfo = instances_[instance_name];
+  const InstanceType role = serving_role(metainfo);
+  auto& role_index =
+      role == InstanceType::DECODE ? decode_index_ : prefill_index_;
+  uint64_t index = metainfo.instance_index;
+  if (index == -1 || index >= role_index.size()) {
     return;
   }
 
-  // delete instance name from decode_index_
-  uint64_t index = instances_[instance_name].instance_index;
-  std::swap(decode_index_[index], decode_index_.back());
-  instances_[decode_index_[index]].instance_index = index;
-  decode_index_.pop_back();
+  std::swap(role_index[index], role_index.back());
+  instances_[role_index[index]].instance_index = index;
+  role_index.pop_back();
+  metainfo.instance_index = -1;
+  (role == InstanceType::DECODE ? decode_ring_ : prefill_ring_)
+      .remove(instance_name);
+  std::unique_lock<std::shared_mutex> lock(load_metric_mutex_);
+  (role == InstanceType::DECODE ? decode_load_heap_ : prefill_load_heap_)
+      .erase(instance_name);
+}
 
-  // insert instance name to prefill_index
-  instances_[instance_name].instance_index = prefill_index_.size();
-  instances_[instance_name].current_type = InstanceType::PREFILL;
-  prefill_index_.emplace_back(instance_name);
+void InstanceMgr::insert_into_role_index(const std::string& instance_name,
+                                         InstanceType role) {
+  auto& metainfo = instances_[instance_name];
+  auto& role_index =
+      role == InstanceType::DECODE ? decode_index_ : prefill_index_;
+  metainfo.current_type = role;
+  metainfo.instance_index = role_index.size();
+  role_index.emplace_back(instance_name);
+  (role == InstanceType::DECODE ? decode_ring_ : prefill_ring_)
+      .add(instance_name);
+  std::unique_lock<std::shared_mutex> lock(load_metric_mutex_);
+  add_to_load_heap(instance_name, role);
+}
 
-  LOG(INFO) << "Flip decode to prefill, instance name : " << instance_name;
+void InstanceMgr::add_to_load_heap(const std::string& instance_name,
+                                   InstanceType role) {
+  auto it = load_metrics_.find(instance_name);
+  const float score =
+      it == load_metrics_.end() ? 1 : it->second.gpu_cache_usage_perc;
+  (role == InstanceType::DECODE ? decode_load_heap_ : prefill_load_heap_)
+      .update(instance_name, score);
 }
 
-TimePredictor& InstanceMgr::get_time_predictor(
+std::shared_ptr<TimePredictor> InstanceMgr::get_time_predictor(
     const std::string& instance_name) {
   std::lock_guard<std::mutex> lock(time_predictor_mutex_);
-
   auto it = time_predictors_.find(instance_name);
   if (it == time_predictors_.end()) {
-    LOG(FATAL) << "Find TimePredictor failed, instance name : "
-               << instance_name;
+    return nullptr;
   }
   return it->second;
 }
@@ -17,32 +17,71 @@ limitations under the License.
 
 #include <brpc/channel.h>
 
+#include <condition_variable>
+#include <future>
+#include <mutex>
 #include <shared_mutex>
 #include <thread>
 #include <unordered_map>
 #include <unordered_set>
 
+#include "common/consistent_hash_ring.h"
+#include "common/indexed_heap.h"
 #include "common/macros.h"
 #include "common/options.h"
-#include "common/threadpool.h"
 #include "common/time_predictor.h"
+#include "common/topology.h"
 #include "common/types.h"
+#include "global_kvcache_mgr.h"
+#include "latency_stats.h"
 #include "request/request.h"
-#include "scheduler/etcd_client/etcd_client.h"
+#include "role_balancer.h"
+#include "scheduler/metadata_store/metadata_store.h"
+#include "scheduler/metadata_store/watch_event_coalescer.h"
 #include "xllm_rpc_service.pb.h"
 
 namespace xllm_service {
 
+// an instance sampled for routing with its outstanding work
+struct InstanceSample {
+  std::string name;
+  // prompt tokens waiting for prefill and tokens of the decoding requests
+  int64_t outstanding_tokens = 0;
+  // within `InstanceMgr::capacity_limits`
+  bool has_room = true;
+};
+
+struct CandidateQuery {
+  // only collect these instances if not null. For a role none of them takes
+  // requests of, the least loaded instance of the role is collected instead.
+  const std::unordered_set<std::string>* names = nullptr;
+  // predict the latencies of a request with this many prompt tokens on the
+  // candidates, not predicted if negative
+  int64_t num_prompt_tokens = -1;
+};
+
 class InstanceMgr final {
  public:
-  explicit InstanceMgr(const Options& options,
-                       const std::shared_ptr<EtcdClient>& etcd_client,
-                       const bool is_master_service);
+  // the master removes the caches of the instances deleted from the metadata
+  // store from `global_kvcache_mgr` if it is given
+  explicit InstanceMgr(
+      const Options& options,
+      const std::shared_ptr<MetadataStore>& metadata_store,
+      const bool is_master_service,
+      std::shared_ptr<GlobalKVCacheMgr> global_kvcache_mgr = nullptr);
 
   ~InstanceMgr();
 
   InstanceMetaInfo get_instance_info(const std::string& instance_name);
 
+  // 0 if the instance is not registered
+  int32_t get_dp_size(const std::string& instance_name);
+
+  // choose the data parallel ranks of the instances in `routing` which have
+  // more than one rank, preferring ranks with long prefix hits and few
+  // running requests.
+  void select_dp_ranks(const OverlapScores& overlap_scores, Routing* routing);
+
   bool get_next_instance_pair(Routing* routing);
 
   std::vector<std::string> get_static_decode_list(
@@ -51,14 +90,52 @@ class InstanceMgr final {
   std::vector<std::string> get_static_prefill_list(
       const std::string& instance_name);
 
-  void get_load_metrics(LoadBalanceInfos* infos);
+  // the instances of both roles with a snapshot of their loads
+  void get_candidates(const CandidateQuery& query,
+                      std::vector<InstanceCandidate>* candidates);
+
+  // account the estimated prefill time of a request routed to the instance
+  void add_estimated_prefill_time(const std::string& instance_name,
+                                  int64_t time);
+
+  // sample `num_choices` distinct instances taking requests of `role`
+  // uniformly at random, plus `preferred` if it takes requests of the role.
+  // Return false if no instance takes requests of the role.
+  bool sample_instances(InstanceType role,
+                        size_t num_choices,
+                        const std::string& preferred,
+                        std::vector<InstanceSample>* samples);
+
+  // the first instance taking requests of `role` clockwise from `key` on the
+  // consistent hash ring whose running requests of the role stay within
+  // `load_factor` times the average. Return false if no instance takes
+  // requests of the role.
+  bool select_instance_by_hash(InstanceType role,
+                               std::string_view key,
+                               double load_factor,
+                               std::string* instance_name);
+
+  // register instance directly through rpc instead of etcd
+  ErrorCode register_instance(const InstanceMetaInfo& metainfo);
 
   std::shared_ptr<brpc::Channel> get_channel(const std::string& instance_name);
 
+  // record the heartbeat time of the instance, return false if the instance
+  // is not registered.
+  bool record_heartbeat(const std::string& instance_name);
+
+  // remove the instances which have not sent a heartbeat for `timeout_ms`,
+  // return the names of the removed instances.
+  std::vector<std::string> remove_disconnected_instances(uint64_t timeout_ms);
+
   void record_load_metrics_update(const std::string& instance_name,
                                   const proto::LoadMetrics& load_metrics);
   bool upload_load_metrics();
 
+  // upload the pending load metrics without waiting for the store, like
+  // `GlobalKVCacheMgr::upload_kvcache_async`.
+  std::future<bool> upload_load_metrics_async();
+
   // update the recent token latency metrics for the corresponding instance
   void update_latency_metrics(const std::string& instance_name,
                               const proto::LatencyMetrics& latency_metrics);
@@ -67,8 +144,32 @@ class InstanceMgr final {
   void update_request_metrics(std::shared_ptr<Request> request,
                               RequestAction action);
 
-  // select instances based on the SLO
-  bool select_instance_pair_on_slo(std::shared_ptr<Request> request);
+  // estimate the instance time in milliseconds the request still needs,
+  // used to account for the work saved when a request is cancelled
+  int64_t estimate_remaining_time(std::shared_ptr<Request> request);
+
+  // refit the predictors of the routed instances with the latencies observed
+  // for the request, the unit is milliseconds. `tpot` is the mean of several
+  // inter-token latencies, refitting on every token is too costly.
+  void observe_ttft(std::shared_ptr<Request> request, int64_t ttft);
+  void observe_tpot(std::shared_ptr<Request> request, int64_t tpot);
+
+  // latencies of the instances measured by the service
+  LatencyStats& latency_stats() { return latency_stats_; }
+
+  const Topology& topology() const { return topology_; }
+
+  // whether there is a prefill instance, and a decode instance if there are
+  // any, which are not saturated by the running requests or their load.
+  bool has_capacity();
+
+  // the limits of `has_capacity` from the admission flags, the policies
+  // prefer instances within them when the admission queue is enabled
+  static CapacityLimits capacity_limits();
+
+  // move MIX instances between the prefill and the decode role according to
+  // the smoothed loads, called periodically.
+  void rebalance_roles();
 
   void set_as_master();
 
@@ -78,18 +179,49 @@ class InstanceMgr final {
   void init();
 
   bool create_channel(const std::string& target_uri);
-  // use etcd as ServiceDiscovery
-  void update_instance_metainfo(const etcd::Response& response,
-                                const uint64_t& prefix_len);
 
-  void update_load_metrics(const etcd::Response& response,
-                           const uint64_t& prefix_len);
+  // add a new instance to the indexes, `inst_mutex_` must be held.
+  bool add_instance(const std::string& instance_name,
+                    InstanceMetaInfo&& metainfo);
+
+  // remove the instance from the indexes, `inst_mutex_` must be held.
+  void remove_instance(const std::string& instance_name);
+
+  // remove the instance from or add it to the index and the load heap of its
+  // role, so that it stops or starts taking requests. `inst_mutex_` must be
+  // held.
+  void erase_from_role_index(const std::string& instance_name);
+  void insert_into_role_index(const std::string& instance_name,
+                              InstanceType role);
 
-  TimePredictor& get_time_predictor(const std::string& instance_name);
+  // use the metadata store as ServiceDiscovery, the coalesced changes are
+  // applied in order.
+  void update_instance_metainfo(const WatchEvents& events);
 
-  void flip_prefill_to_decode(std::string& instance_name);
+  void update_load_metrics(const WatchEvents& events);
 
-  void flip_decode_to_prefill(std::string& instance_name);
+  // update the score of the instance in its load heap after its load metrics
+  // change, `load_metric_mutex_` must be held.
+  void update_load_heap(const std::string& instance_name);
+
+  // add the instance to the load heap of the role it serves now,
+  // `load_metric_mutex_` must be held.
+  void add_to_load_heap(const std::string& instance_name, InstanceType role);
+
+  // null if the instance is unknown. The map lock is only held for the
+  // lookup, the predictor has its own lock.
+  std::shared_ptr<TimePredictor> get_time_predictor(
+      const std::string& instance_name);
+
+  // `request_metrics_mutex_` must be held
+  int32_t select_dp_rank(const std::string& instance_name,
+                         int32_t dp_size,
+                         const OverlapScores& overlap_scores);
+
+  // sort `names` by the topology distance to `instance_name`, nearest first,
+  // and keep at most `FLAGS_static_instance_list_size` of them.
+  void rank_by_distance(const std::string& instance_name,
+                        std::vector<std::string>* names) const;
 
  private:
   Options options_;
@@ -98,7 +230,9 @@ class InstanceMgr final {
   bool use_etcd_ = false;
   std::atomic_bool is_master_service_ = false;
 
-  std::shared_ptr<EtcdClient> etcd_client_;
+  std::shared_ptr<MetadataStore> metadata_store_;
+
+  std::shared_ptr<GlobalKVCacheMgr> global_kvcache_mgr_;
 
   std::shared_mutex inst_mutex_;
   std::unordered_map<std::string, InstanceMetaInfo> instances_;
@@ -106,32 +240,54 @@ class InstanceMgr final {
   std::vector<std::string> decode_index_;
   uint64_t next_prefill_index_ = 0;
   uint64_t next_decode_index_ = 0;
+  // the instances of the role indexes placed on consistent hash rings
+  ConsistentHashRing prefill_ring_;
+  ConsistentHashRing decode_ring_;
 
   std::shared_mutex load_metric_mutex_;
   std::unordered_map<std::string, LoadMetrics> load_metrics_;
   std::unordered_map<std::string, std::shared_ptr<brpc::Channel>>
       cached_channels_;
+  // the instances of the role indexes keyed by gpu cache usage, used to find
+  // the least loaded instance without scanning `load_metrics_`. Guarded by
+  // `load_metric_mutex_`.
+  IndexedMinHeap<std::string, float> prefill_load_heap_;
+  IndexedMinHeap<std::string, float> decode_load_heap_;
 
   std::mutex update_mutex_;
   std::unordered_map<std::string, LoadMetrics> updated_metrics_;
   std::unordered_set<std::string> removed_instance_;
+  // an upload is in flight, guarded by update_mutex_
+  bool uploading_ = false;
+  std::condition_variable upload_cv_;
 
   // "instance name" -> "TimePredictor" map
   std::mutex time_predictor_mutex_;
-  std::unordered_map<std::string, TimePredictor> time_predictors_;
+  std::unordered_map<std::string, std::shared_ptr<TimePredictor>>
+      time_predictors_;
 
   // Record the latest token latency metrics for each instance, including TTFT
   // and TBT.
   std::mutex latency_metrics_mutex_;
   std::unordered_map<std::string, LatencyMetrics> latency_metrics_;
 
+  LatencyStats latency_stats_;
+
+  // immutable after construction
+  Topology topology_;
+
+  // only used by `rebalance_roles`
+  RoleBalancer role_balancer_;
+
   // Record the request metrics for each instance, including prefill token
   // count, prefill request count, estimated prefill execution time, decode
   // token count, and decode request count.
   std::mutex request_metrics_mutex_;
   std::unordered_map<std::string, RequestMetrics> request_metrics_;
 
-  ThreadPool threadpool_;
+  // declared last to stop applying changes first
+  std::unique_ptr<WatchEventCoalescer> instance_watch_;
+  std::unique_ptr<WatchEventCoalescer> load_metrics_watch_;
 };
 
 }  // namespace xllm_service
@@ -0,0 +1,478 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "instance_mgr.h"
+
+#include <glog/logging.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "global_kvcache_mgr.h"
+#include "scheduler/metadata_store/memory_store.h"
+
+namespace xllm_service::test {
+
+namespace {
+InstanceMetaInfo make_instance(const std::string& name, InstanceType type) {
+  InstanceMetaInfo metainfo;
+  metainfo.name = name;
+  metainfo.rpc_address = name;
+  metainfo.type = type;
+  metainfo.dp_size = 1;
+  return metainfo;
+}
+
+bool contains(const std::vector<std::string>& names, const std::string& name) {
+  return std::find(names.begin(), names.end(), name) != names.end();
+}
+
+// a store whose updates fail while `failing` is set
+class FailingStore : public MemoryStore {
+ public:
+  bool batch_update(
+      const std::vector<std::pair<std::string, std::string>>& puts,
+      const std::vector<std::string>& deletes) override {
+    if (failing) {
+      return false;
+    }
+    return MemoryStore::batch_update(puts, deletes);
+  }
+
+  std::atomic_bool failing = false;
+};
+}  // namespace
+
+// an instance manager of the master service on a memory store
+class InstanceMgrTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    options_.block_size(4);
+    metadata_store_ = std::make_shared<MemoryStore>();
+    instance_mgr_ = std::make_unique<InstanceMgr>(
+        options_, metadata_store_, /*is_master_service=*/true);
+  }
+
+  Options options_;
+  std::shared_ptr<MetadataStore> metadata_store_;
+  std::unique_ptr<InstanceMgr> instance_mgr_;
+};
+
+// Inject a failure by stopping the heartbeats of one instance and measure how
+// long it takes until the instance is removed.
+TEST_F(InstanceMgrTest, EvictInstanceMissingHeartbeats) {
+  constexpr uint64_t kTimeoutMs = 300;
+  constexpr uint64_t kCheckIntervalMs = kTimeoutMs / 4;
+  constexpr auto kHeartbeatInterval = std::chrono::milliseconds(50);
+  const std::string alive_name = "127.0.0.1:19001";
+  const std::string failed_name = "127.0.0.1:19002";
+
+  ASSERT_EQ(ErrorCode::OK,
+            instance_mgr_->register_instance(
+                make_instance(alive_name, InstanceType::PREFILL)));
+  ASSERT_EQ(ErrorCode::OK,
+            instance_mgr_->register_instance(
+                make_instance(failed_name, InstanceType::DECODE)));
+
+  std::atomic_bool failed = false;
+  std::atomic_bool stopped = false;
+  std::thread heartbeat([&]() {
+    while (!stopped) {
+      instance_mgr_->record_heartbeat(alive_name);
+      if (!failed) {
+        instance_mgr_->record_heartbeat(failed_name);
+      }
+      std::this_thread::sleep_for(kHeartbeatInterval);
+    }
+  });
+
+  // both instances survive while they send heartbeats
+  std::this_thread::sleep_for(std::chrono::milliseconds(2 * kTimeoutMs));
+  auto removed = instance_mgr_->remove_disconnected_instances(kTimeoutMs);
+  EXPECT_FALSE(contains(removed, alive_name));
+  EXPECT_FALSE(contains(removed, failed_name));
+
+  failed = true;
+  auto failed_time = std::chrono::steady_clock::now();
+  bool evicted = false;
+  while (!evicted && std::chrono::steady_clock::now() - failed_time <
+                         std::chrono::milliseconds(10 * kTimeoutMs)) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(kCheckIntervalMs));
+    removed = instance_mgr_->remove_disconnected_instances(kTimeoutMs);
+    EXPECT_FALSE(contains(removed, alive_name));
+    evicted = contains(removed, failed_name);
+  }
+  auto time_to_eviction =
+      std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::steady_clock::now() - failed_time)
+          .count();
+  stopped = true;
+  heartbeat.join();
+
+  ASSERT_TRUE(evicted);
+  LOG(INFO) << "time to eviction: " << time_to_eviction << " ms";
+  // the last heartbeat is sent at most one heartbeat interval before failure
+  EXPECT_GE(time_to_eviction, kTimeoutMs - kHeartbeatInterval.count());
+  EXPECT_LE(time_to_eviction,
+            kTimeoutMs + kCheckIntervalMs + kHeartbeatInterval.count() + 100);
+
+  EXPECT_TRUE(instance_mgr_->get_instance_info(failed_name).empty());
+  EXPECT_EQ(nullptr, instance_mgr_->get_channel(failed_name));
+  EXPECT_FALSE(instance_mgr_->get_instance_info(alive_name).empty());
+  // an evicted instance has to register again
+  EXPECT_FALSE(instance_mgr_->record_heartbeat(failed_name));
+}
+
+TEST_F(InstanceMgrTest, RemoveCachesOfEvictedInstance) {
+  GlobalKVCacheMgr kvcache_mgr(
+      options_, metadata_store_, /*is_master_service=*/true);
+  const std::string name = "127.0.0.1:19003";
+  std::vector<int32_t> token_ids = {1, 2, 3, 4};
+  Murmur3Key key;
+  murmur_hash3(nullptr, Slice<int32_t>(token_ids), key.data);
+
+  proto::KvCacheEvent event;
+  event.add_stored_cache(key.to_string());
+  kvcache_mgr.record_updated_kvcaches(name, event);
+  ASSERT_TRUE(kvcache_mgr.upload_kvcache());
+
+  OverlapScores scores;
+  kvcache_mgr.match(Slice<int32_t>(token_ids), &scores);
+  EXPECT_EQ(1, scores.hbm_instance_score.count(name));
+
+  kvcache_mgr.remove_instance_caches({name});
+  ASSERT_TRUE(kvcache_mgr.upload_kvcache());
+
+  OverlapScores scores_after_removal;
+  kvcache_mgr.match(Slice<int32_t>(token_ids), &scores_after_removal);
+  EXPECT_EQ(0, scores_after_removal.hbm_instance_score.count(name));
+}
+
+TEST_F(InstanceMgrTest, RemoveCachesOfDeletedInstance) {
+  auto kvcache_mgr = std::make_shared<GlobalKVCacheMgr>(
+      options_, metadata_store_, /*is_master_service=*/true);
+  InstanceMgr instance_mgr(
+      options_, metadata_store_, /*is_master_service=*/true, kvcache_mgr);
+  const std::string name = "127.0.0.1:19005";
+  const std::string key = "XLLM:PREFILL:" + name;
+  ASSERT_TRUE(metadata_store_->put(
+      key,
+      make_instance(name, InstanceType::PREFILL).serialize_to_json().dump()));
+
+  std::vector<int32_t> token_ids = {1, 2, 3, 4};
+  Murmur3Key block_key;
+  murmur_hash3(nullptr, Slice<int32_t>(token_ids), block_key.data);
+  proto::KvCacheEvent event;
+  event.add_stored_cache(block_key.to_string());
+  kvcache_mgr->record_updated_kvcaches(name, event);
+  ASSERT_TRUE(kvcache_mgr->upload_kvcache());
+
+  // the instance leaves by deleting its key, as when its lease expires
+  ASSERT_TRUE(metadata_store_->rm(key));
+  bool removed = false;
+  const auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (!removed && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    ASSERT_TRUE(kvcache_mgr->upload_kvcache());
+    OverlapScores scores;
+    kvcache_mgr->match(Slice<int32_t>(token_ids), &scores);
+    removed = scores.hbm_instance_score.count(name) == 0;
+  }
+  EXPECT_TRUE(removed);
+  EXPECT_EQ(0, instance_mgr.get_dp_size(name));
+}
+
+TEST(UploadTest, RetryFailedUploads) {
+  Options options;
+  options.block_size(4);
+  auto store = std::make_shared<FailingStore>();
+  InstanceMgr instance_mgr(options, store, /*is_master_service=*/true);
+  GlobalKVCacheMgr kvcache_mgr(options, store, /*is_master_service=*/true);
+  const std::string name = "127.0.0.1:19005";
+  ASSERT_EQ(ErrorCode::OK,
+            instance_mgr.register_instance(
+                make_instance(name, InstanceType::DEFAULT)));
+
+  std::vector<int32_t> token_ids = {1, 2, 3, 4};
+  Murmur3Key key;
+  murmur_hash3(nullptr, Slice<int32_t>(token_ids), key.data);
+  proto::KvCacheEvent event;
+  event.add_stored_cache(key.to_string());
+  kvcache_mgr.record_updated_kvcaches(name, event);
+  proto::LoadMetrics load_metrics;
+  load_metrics.set_waiting_requests_num(3);
+  instance_mgr.record_load_metrics_update(name, load_metrics);
+
+  store->failing = true;
+  auto kvcache_upload = kvcache_mgr.upload_kvcache_async();
+  auto load_metrics_upload = instance_mgr.upload_load_metrics_async();
+  EXPECT_FALSE(kvcache_upload.get());
+  EXPECT_FALSE(load_metrics_upload.get());
+  // the local view is updated even if the store fails
+  OverlapScores scores;
+  kvcache_mgr.match(Slice<int32_t>(token_ids), &scores);
+  EXPECT_EQ(1, scores.hbm_instance_score.count(name));
+  std::unordered_map<std::string, std::string> values;
+  store->get_prefix("", &values);
+  const size_t num_values = values.size();
+
+  // the failed updates are sent again with the next upload
+  store->failing = false;
+  kvcache_upload = kvcache_mgr.upload_kvcache_async();
+  load_metrics_upload = instance_mgr.upload_load_metrics_async();
+  EXPECT_TRUE(kvcache_upload.get());
+  EXPECT_TRUE(load_metrics_upload.get());
+  values.clear();
+  store->get_prefix("", &values);
+  EXPECT_EQ(num_values + 2, values.size());
+  // the watches call back into the managers
+  store->stop_watch();
+}
+
+TEST_F(InstanceMgrTest, FallBackToInstanceServingTheRole) {
+  // the first MIX instance serves decode, it must not be a prefill candidate
+  const std::string mix_name = "127.0.0.1:19030";
+  const std::string prefill_name = "127.0.0.1:19031";
+  ASSERT_EQ(ErrorCode::OK,
+            instance_mgr_->register_instance(
+                make_instance(mix_name, InstanceType::MIX)));
+  ASSERT_EQ(ErrorCode::OK,
+            instance_mgr_->register_instance(
+                make_instance(prefill_name, InstanceType::PREFILL)));
+  proto::LoadMetrics load_metrics;
+  load_metrics.set_gpu_cache_usage_perc(0.1);
+  instance_mgr_->record_load_metrics_update(mix_name, load_metrics);
+  load_metrics.set_gpu_cache_usage_perc(0.5);
+  instance_mgr_->record_load_metrics_update(prefill_name, load_metrics);
+  ASSERT_TRUE(instance_mgr_->upload_load_metrics());
+
+  // no instance holds the prefix
+  const std::unordered_set<std::string> names = {"127.0.0.1:19039"};
+  CandidateQuery query;
+  query.names = &names;
+  std::vector<InstanceCandidate> candidates;
+  instance_mgr_->get_candidates(query, &candidates);
+  ASSERT_EQ(2u, candidates.size());
+  EXPECT_EQ(prefill_name, candidates[0].name);
+  EXPECT_EQ(InstanceType::PREFILL, candidates[0].role);
+  EXPECT_EQ(mix_name, candidates[1].name);
+  EXPECT_EQ(InstanceType::DECODE, candidates[1].role);
+
+  // a less loaded prefill instance takes over
+  load_metrics.set_gpu_cache_usage_perc(0.01);
+  const std::string other_name = "127.0.0.1:19032";
+  ASSERT_EQ(ErrorCode::OK,
+            instance_mgr_->register_instance(
+                make_instance(other_name, InstanceType::PREFILL)));
+  instance_mgr_->record_load_metrics_update(other_name, load_metrics);
+  ASSERT_TRUE(instance_mgr_->upload_load_metrics());
+  instance_mgr_->get_candidates(query, &candidates);
+  ASSERT_EQ(2u, candidates.size());
+  EXPECT_EQ(other_name, candidates[0].name);
+}
+
+TEST_F(InstanceMgrTest, BoundLoadOfSessionInstance) {
+  constexpr double kLoadFactor = 1.5;
+  for (int32_t i = 0; i < 4; ++i) {
+    const std::string name = "127.0.0.1:1901" + std::to_string(i);
+    ASSERT_EQ(ErrorCode::OK,
+              instance_mgr_->register_instance(
+                  make_instance(name, InstanceType::PREFILL)));
+  }
+  ASSERT_EQ(ErrorCode::OK,
+            instance_mgr_->register_instance(
+                make_instance("127.0.0.1:19020", InstanceType::DECODE)));
+
+  std::string session_instance;
+  ASSERT_TRUE(instance_mgr_->select_instance_by_hash(
+      InstanceType::PREFILL, "session", kLoadFactor, &session_instance));
+  std::vector<std::shared_ptr<Request>> requests;
+  std::unordered_map<std::string, int32_t> request_num;
+  for (int32_t i = 0; i < 16; ++i) {
+    auto request = std::make_shared<Request>();
+    ASSERT_TRUE(instance_mgr_->select_instance_by_hash(
+        InstanceType::PREFILL,
+        "session",
+        kLoadFactor,
+        &request->routing.prefill_name));
+    request->routing.decode_name = "127.0.0.1:19020";
+    instance_mgr_->update_request_metrics(request, RequestAction::SCHEDULE);
+    request_num[request->routing.prefill_name] += 1;
+    requests.emplace_back(std::move(request));
+  }
+  // the session instance takes requests up to the bound, the others spill
+  EXPECT_EQ(6, request_num[session_instance]);
+  for (const auto& [name, num] : request_num) {
+    EXPECT_LE(num, 6) << name;
+  }
+
+  for (auto& request : requests) {
+    instance_mgr_->update_request_metrics(request,
+                                          RequestAction::FINISH_PREFILL);
+  }
+  std::string idle_instance;
+  ASSERT_TRUE(instance_mgr_->select_instance_by_hash(
+      InstanceType::PREFILL, "session", kLoadFactor, &idle_instance));
+  EXPECT_EQ(session_instance, idle_instance);
+}
+
+TEST_F(InstanceMgrTest, RouteToDpRankWithPrefix) {
+  GlobalKVCacheMgr kvcache_mgr(
+      options_, metadata_store_, /*is_master_service=*/true);
+  const std::string name = "127.0.0.1:19004";
+  auto metainfo = make_instance(name, InstanceType::DEFAULT);
+  metainfo.dp_size = 4;
+  ASSERT_EQ(ErrorCode::OK, instance_mgr_->register_instance(metainfo));
+
+  std::vector<int32_t> token_ids = {1, 2, 3, 4, 5, 6, 7, 8};
+  Murmur3Key first_key;
+  Murmur3Key second_key;
+  murmur_hash3(nullptr, Slice<int32_t>(token_ids).slice(0, 4), first_key.data);
+  murmur_hash3(
+      first_key.data, Slice<int32_t>(token_ids).slice(4, 8), second_key.data);
+
+  // rank 2 holds both blocks, rank 1 only the first one
+  proto::KvCacheEvent rank1_event;
+  rank1_event.set_dp_rank(1);
+  rank1_event.add_stored_cache(first_key.to_string());
+  kvcache_mgr.record_updated_kvcaches(name, rank1_event);
+  proto::KvCacheEvent rank2_event;
+  rank2_event.set_dp_rank(2);
+  rank2_event.add_stored_cache(first_key.to_string());
+  rank2_event.add_stored_cache(second_key.to_string());
+  kvcache_mgr.record_updated_kvcaches(name, rank2_event);
+  ASSERT_TRUE(kvcache_mgr.upload_kvcache());
+
+  OverlapScores scores;
+  kvcache_mgr.match(Slice<int32_t>(token_ids), &scores);
+  EXPECT_EQ(2, scores.hbm_instance_score[name]);
+  EXPECT_EQ(std::vector<uint32_t>({0, 1, 2}),
+            scores.hbm_dp_rank_score[name]);
+
+  Routing routing;
+  routing.prefill_name = name;
+  routing.decode_name = name;
+  instance_mgr_->select_dp_ranks(scores, &routing);
+  EXPECT_EQ(2, routing.prefill_dp_rank);
+  EXPECT_EQ(2, routing.decode_dp_rank);
+
+  // removing the blocks from rank 2 leaves the instance cached on rank 1
+  proto::KvCacheEvent removed_event;
+  removed_event.set_dp_rank(2);
+  removed_event.add_removed_cache(first_key.to_string());
+  removed_event.add_removed_cache(second_key.to_string());
+  kvcache_mgr.record_updated_kvcaches(name, removed_event);
+  ASSERT_TRUE(kvcache_mgr.upload_kvcache());
+
+  OverlapScores scores_after_removal;
+  kvcache_mgr.match(Slice<int32_t>(token_ids), &scores_after_removal);
+  EXPECT_EQ(1, scores_after_removal.hbm_instance_score[name]);
+  EXPECT_EQ(std::vector<uint32_t>({0, 1}),
+            scores_after_removal.hbm_dp_rank_score[name]);
+  kvcache_mgr.remove_instance_caches({name});
+  ASSERT_TRUE(kvcache_mgr.upload_kvcache());
+}
+
+TEST_F(InstanceMgrTest, SampleDistinctInstances) {
+  for (int32_t i = 0; i < 4; ++i) {
+    ASSERT_EQ(ErrorCode::OK,
+              instance_mgr_->register_instance(make_instance(
+                  "127.0.0.1:1910" + std::to_string(i),
+                  InstanceType::PREFILL)));
+  }
+  ASSERT_EQ(ErrorCode::OK,
+            instance_mgr_->register_instance(
+                make_instance("127.0.0.1:19110", InstanceType::DECODE)));
+
+  std::unordered_set<std::string> sampled;
+  std::vector<InstanceSample> samples;
+  for (int32_t i = 0; i < 100; ++i) {
+    ASSERT_TRUE(instance_mgr_->sample_instances(
+        InstanceType::PREFILL, 2, "", &samples));
+    ASSERT_EQ(2, samples.size());
+    EXPECT_NE(samples[0].name, samples[1].name);
+    for (const auto& sample : samples) {
+      EXPECT_NE("127.0.0.1:19110", sample.name);
+      sampled.insert(sample.name);
+    }
+  }
+  // every instance of the role is sampled sooner or later
+  EXPECT_EQ(4, sampled.size());
+}
+
+TEST_F(InstanceMgrTest, SamplePreferredInstance) {
+  for (int32_t i = 0; i < 8; ++i) {
+    ASSERT_EQ(ErrorCode::OK,
+              instance_mgr_->register_instance(make_instance(
+                  "127.0.0.1:1912" + std::to_string(i),
+                  InstanceType::PREFILL)));
+  }
+  const std::string decode_name = "127.0.0.1:19130";
+  ASSERT_EQ(ErrorCode::OK,
+            instance_mgr_->register_instance(
+                make_instance(decode_name, InstanceType::DECODE)));
+
+  const std::string preferred = "127.0.0.1:19125";
+  std::vector<InstanceSample> samples;
+  for (int32_t i = 0; i < 20; ++i) {
+    ASSERT_TRUE(instance_mgr_->sample_instances(
+        InstanceType::PREFILL, 1, preferred, &samples));
+    std::vector<std::string> names;
+    for (const auto& sample : samples) {
+      names.emplace_back(sample.name);
+    }
+    EXPECT_TRUE(contains(names, preferred));
+    // the preferred instance is not sampled twice
+    EXPECT_EQ(
+        names.size(),
+        std::unordered_set<std::string>(names.begin(), names.end()).size());
+  }
+
+  // an instance of the other role or an unknown one is not added
+  ASSERT_TRUE(instance_mgr_->sample_instances(
+      InstanceType::PREFILL, 1, decode_name, &samples));
+  ASSERT_EQ(1, samples.size());
+  EXPECT_NE(decode_name, samples[0].name);
+  ASSERT_TRUE(instance_mgr_->sample_instances(
+      InstanceType::PREFILL, 1, "127.0.0.1:1", &samples));
+  EXPECT_EQ(1, samples.size());
+}
+
+TEST_F(InstanceMgrTest, SampleFewerInstancesThanChoices) {
+  std::vector<InstanceSample> samples;
+  EXPECT_FALSE(
+      instance_mgr_->sample_instances(InstanceType::PREFILL, 2, "", &samples));
+  EXPECT_TRUE(samples.empty());
+
+  const std::string name = "127.0.0.1:19140";
+  ASSERT_EQ(ErrorCode::OK,
+            instance_mgr_->register_instance(
+                make_instance(name, InstanceType::PREFILL)));
+  ASSERT_TRUE(instance_mgr_->sample_instances(
+      InstanceType::PREFILL, 2, name, &samples));
+  ASSERT_EQ(1, samples.size());
+  EXPECT_EQ(name, samples[0].name);
+  // no instance takes decode requests
+  EXPECT_FALSE(
+      instance_mgr_->sample_instances(InstanceType::DECODE, 2, "", &samples));
+}
+
+}  // namespace xllm_service::test
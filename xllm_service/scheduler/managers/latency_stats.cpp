@@ -0,0 +1,96 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "latency_stats.h"
+
+#include <mutex>
+
+namespace {
+constexpr char kInstancePrefix[] = "xllm_service_instance_";
+}  // namespace
+
+namespace xllm_service {
+
+LatencyStats::Recorders::Recorders(const std::string& instance_name)
+    : ttft(kInstancePrefix + instance_name + "_ttft"),
+      tbt(kInstancePrefix + instance_name + "_tbt"),
+      e2e(kInstancePrefix + instance_name + "_e2e"),
+      queueing(kInstancePrefix + instance_name + "_queueing") {}
+
+void LatencyStats::add_instance(const std::string& instance_name) {
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  if (recorders_.find(instance_name) != recorders_.end()) {
+    return;
+  }
+  recorders_.emplace(instance_name,
+                     std::make_shared<Recorders>(instance_name));
+}
+
+void LatencyStats::remove_instance(const std::string& instance_name) {
+  // threads still recording keep the recorders alive until they are done
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  recorders_.erase(instance_name);
+}
+
+std::shared_ptr<LatencyStats::Recorders> LatencyStats::find(
+    const std::string& instance_name) {
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  auto it = recorders_.find(instance_name);
+  if (it == recorders_.end()) {
+    return nullptr;
+  }
+  return it->second;
+}
+
+void LatencyStats::record_ttft(const std::string& instance_name,
+                               int64_t ttft) {
+  if (auto recorders = find(instance_name)) {
+    recorders->ttft << ttft;
+  }
+}
+
+void LatencyStats::record_tbt(const std::string& instance_name, int64_t tbt) {
+  if (auto recorders = find(instance_name)) {
+    recorders->tbt << tbt;
+  }
+}
+
+void LatencyStats::record_e2e(const std::string& instance_name, int64_t e2e) {
+  if (auto recorders = find(instance_name)) {
+    recorders->e2e << e2e;
+  }
+}
+
+void LatencyStats::record_queueing(const std::string& instance_name,
+                                   int64_t queueing) {
+  if (auto recorders = find(instance_name)) {
+    recorders->queueing << queueing;
+  }
+}
+
+MeasuredLatency LatencyStats::get_latency_percentile(
+    const std::string& instance_name,
+    double ratio) {
+  MeasuredLatency latency;
+  auto recorders = find(instance_name);
+  if (recorders == nullptr) {
+    return latency;
+  }
+  latency.ttft = recorders->ttft.latency_percentile(ratio) / 1000;
+  latency.tbt = recorders->tbt.latency_percentile(ratio) / 1000;
+  return latency;
+}
+
+}  // namespace xllm_service
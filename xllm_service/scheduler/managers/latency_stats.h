@@ -0,0 +1,78 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#include <bvar/bvar.h>
+
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+
+#include "common/macros.h"
+
+namespace xllm_service {
+
+// Latency percentiles of an instance measured by the service over the recent
+// window, in milliseconds. Zero means no sample in the window.
+struct MeasuredLatency {
+  int64_t ttft = 0;
+  int64_t tbt = 0;
+};
+
+// Per-instance latency histograms of the requests measured by the service:
+// TTFT and queueing before the forward of the prefill instance, TBT and end to
+// end latency of the decode instance. They are exposed as bvars
+// `xllm_service_instance_<name>_{ttft,tbt,e2e,queueing}` in microseconds, so
+// they show up in /metrics. Recording does not lock the recorders, the map is
+// only locked exclusively when instances come and go.
+class LatencyStats final {
+ public:
+  LatencyStats() = default;
+
+  void add_instance(const std::string& instance_name);
+  void remove_instance(const std::string& instance_name);
+
+  // the unit is microseconds
+  void record_ttft(const std::string& instance_name, int64_t ttft);
+  void record_tbt(const std::string& instance_name, int64_t tbt);
+  void record_e2e(const std::string& instance_name, int64_t e2e);
+  void record_queueing(const std::string& instance_name, int64_t queueing);
+
+  // `ratio` is the percentile in (0, 1)
+  MeasuredLatency get_latency_percentile(const std::string& instance_name,
+                                         double ratio);
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(LatencyStats);
+
+  struct Recorders {
+    explicit Recorders(const std::string& instance_name);
+
+    bvar::LatencyRecorder ttft;
+    bvar::LatencyRecorder tbt;
+    bvar::LatencyRecorder e2e;
+    bvar::LatencyRecorder queueing;
+  };
+
+  std::shared_ptr<Recorders> find(const std::string& instance_name);
+
+ private:
+  std::shared_mutex mutex_;
+  std::unordered_map<std::string, std::shared_ptr<Recorders>> recorders_;
+};
+
+}  // namespace xllm_service
@@ -0,0 +1,239 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "role_balancer.h"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+
+namespace xllm_service {
+
+namespace {
+// requests of `role` still running on the instance
+int64_t running_requests(const InstanceRoleLoad& load, InstanceType role) {
+  return role == InstanceType::DECODE ? load.decode_request_num
+                                      : load.prefill_request_num;
+}
+}  // namespace
+
+RoleBalancer::RoleBalancer(const RoleBalancerOptions& options)
+    : options_(options) {
+  options_.target_ttft = std::max<int64_t>(1, options_.target_ttft);
+  options_.target_tpot = std::max<int64_t>(1, options_.target_tpot);
+  options_.smoothing = std::clamp(options_.smoothing, 0.01, 1.0);
+}
+
+double RoleBalancer::smooth(double value, double sample) const {
+  // follow a rising load at once and a falling one slowly, so that a burst is
+  // seen early and a short lull does not give its instances away.
+  if (sample >= value) {
+    return sample;
+  }
+  return options_.smoothing * sample + (1 - options_.smoothing) * value;
+}
+
+RoleChanges RoleBalancer::balance(const std::vector<InstanceRoleLoad>& loads,
+                                  int64_t now_ms) {
+  RoleChanges changes;
+
+  // the loads with the role changes of this round applied
+  std::vector<InstanceRoleLoad> current = loads;
+  std::unordered_map<std::string, InstanceRoleLoad*> load_map;
+  load_map.reserve(current.size());
+  for (auto& load : current) {
+    load_map.emplace(load.name, &load);
+    role_since_ms_.try_emplace(load.name, now_ms);
+    if (load.role == InstanceType::DECODE && load.decode_request_num <= 0) {
+      idle_since_ms_.try_emplace(load.name, now_ms);
+    } else {
+      idle_since_ms_.erase(load.name);
+    }
+  }
+  // forget the removed instances
+  for (auto it = role_since_ms_.begin(); it != role_since_ms_.end();) {
+    if (load_map.count(it->first) == 0) {
+      draining_.erase(it->first);
+      idle_since_ms_.erase(it->first);
+      it = role_since_ms_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+
+  // the instances which have finished the requests of their old role take
+  // their new role
+  for (auto it = draining_.begin(); it != draining_.end();) {
+    auto& load = *load_map[it->first];
+    if (running_requests(load, load.role) > 0 &&
+        now_ms - it->second.start_ms < options_.max_drain_ms) {
+      ++it;
+      continue;
+    }
+    load.role = it->second.role;
+    changes.flip.emplace_back(it->first, it->second.role);
+    role_since_ms_[it->first] = now_ms;
+    it = draining_.erase(it);
+  }
+
+  // the loads of the instances which serve a role
+  double prefill_time = 0;
+  double tpot = 0;
+  int64_t num_prefill = 0;
+  int64_t num_decode = 0;
+  for (const auto& load : current) {
+    if (draining_.count(load.name) != 0) {
+      continue;
+    }
+    if (load.role == InstanceType::DECODE) {
+      tpot += load.tpot;
+      ++num_decode;
+    } else {
+      prefill_time += load.prefill_time;
+      ++num_prefill;
+    }
+  }
+  const double prefill_sample =
+      num_prefill > 0 ? prefill_time / num_prefill / options_.target_ttft : 0;
+  const double decode_sample =
+      num_decode > 0 ? tpot / num_decode / options_.target_tpot : 0;
+  if (!initialized_) {
+    prefill_pressure_ = prefill_sample;
+    decode_pressure_ = decode_sample;
+    initialized_ = true;
+  } else {
+    prefill_pressure_ = smooth(prefill_pressure_, prefill_sample);
+    decode_pressure_ = smooth(decode_pressure_, decode_sample);
+  }
+
+  // instances on their way to a role count as its capacity already, the
+  // roles do not trade instances in both directions at once.
+  int64_t to_prefill = 0;
+  int64_t to_decode = 0;
+  for (const auto& [drain_name, drain] : draining_) {
+    ++(drain.role == InstanceType::DECODE ? to_decode : to_prefill);
+  }
+  // total loads in units of instances loaded up to the SLO target
+  const double prefill_load = prefill_pressure_ * num_prefill;
+  const double decode_load = decode_pressure_ * num_decode;
+
+  std::vector<std::string> names;
+  InstanceType new_role = InstanceType::PREFILL;
+  if (to_decode == 0 && num_prefill > 0 &&
+      prefill_load >= options_.high_watermark * (num_prefill + to_prefill)) {
+    new_role = InstanceType::PREFILL;
+    names = pick_instances(
+        current,
+        InstanceType::DECODE,
+        num_moves(
+            prefill_load, num_prefill + to_prefill, decode_load, num_decode),
+        now_ms);
+  } else if (to_prefill == 0 && num_decode > 0 &&
+             decode_load >=
+                 options_.high_watermark * (num_decode + to_decode)) {
+    new_role = InstanceType::DECODE;
+    names = pick_instances(
+        current,
+        InstanceType::PREFILL,
+        num_moves(
+            decode_load, num_decode + to_decode, prefill_load, num_prefill),
+        now_ms);
+  } else if (draining_.empty() && num_decode > 1 &&
+             decode_load / (num_decode - 1) <= options_.low_watermark) {
+    // spare MIX instances serve prefill, return a decode instance which has
+    // been idle for the dwell time.
+    for (const auto& [idle_name, idle_since_ms] : idle_since_ms_) {
+      if (load_map[idle_name]->flippable &&
+          now_ms - idle_since_ms >= options_.min_dwell_ms &&
+          now_ms - role_since_ms_[idle_name] >= options_.min_dwell_ms) {
+        names.emplace_back(idle_name);
+        new_role = InstanceType::PREFILL;
+        break;
+      }
+    }
+  }
+
+  for (const auto& name : names) {
+    LOG(INFO) << "Drain instance " << name << " to switch to the "
+              << (new_role == InstanceType::DECODE ? "decode" : "prefill")
+              << " role, prefill pressure: " << prefill_pressure_
+              << ", decode pressure: " << decode_pressure_;
+    changes.drain.emplace_back(name);
+    const auto& load = *load_map[name];
+    if (running_requests(load, load.role) == 0) {
+      changes.flip.emplace_back(name, new_role);
+      role_since_ms_[name] = now_ms;
+    } else {
+      draining_.emplace(name, Drain{new_role, now_ms});
+    }
+  }
+  return changes;
+}
+
+int64_t RoleBalancer::num_moves(double receiver_load,
+                                int64_t receiver_num,
+                                double donor_load,
+                                int64_t donor_num) const {
+  // enough instances to bring the receiver below the high watermark. The
+  // donor stays below the low watermark without them, or when both roles are
+  // busy, below the receiver by the width of the hysteresis band.
+  const double band = options_.high_watermark - options_.low_watermark;
+  int64_t moves = 0;
+  while (moves + 1 < donor_num &&
+         receiver_load / (receiver_num + moves) >= options_.high_watermark) {
+    const double donor_after = donor_load / (donor_num - moves - 1);
+    const double receiver_after = receiver_load / (receiver_num + moves + 1);
+    if (donor_after > std::max(options_.low_watermark, receiver_after - band)) {
+      break;
+    }
+    ++moves;
+  }
+  return moves;
+}
+
+std::vector<std::string> RoleBalancer::pick_instances(
+    const std::vector<InstanceRoleLoad>& loads,
+    InstanceType role,
+    int64_t num,
+    int64_t now_ms) const {
+  std::vector<const InstanceRoleLoad*> candidates;
+  for (const auto& load : loads) {
+    if (!load.flippable || load.role != role ||
+        draining_.count(load.name) != 0) {
+      continue;
+    }
+    if (now_ms - role_since_ms_.at(load.name) < options_.min_dwell_ms) {
+      continue;
+    }
+    candidates.emplace_back(&load);
+  }
+  // the instances with the fewest running requests drain first
+  num = std::min<int64_t>(num, candidates.size());
+  std::partial_sort(candidates.begin(),
+                    candidates.begin() + num,
+                    candidates.end(),
+                    [role](const auto* a, const auto* b) {
+                      return running_requests(*a, role) <
+                             running_requests(*b, role);
+                    });
+  std::vector<std::string> names;
+  names.reserve(num);
+  for (int64_t i = 0; i < num; ++i) {
+    names.emplace_back(candidates[i]->name);
+  }
+  return names;
+}
+
+}  // namespace xllm_service
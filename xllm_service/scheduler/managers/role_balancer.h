@@ -0,0 +1,127 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "common/types.h"
+
+namespace xllm_service {
+
+// Load of an instance sampled by the role balancer.
+struct InstanceRoleLoad {
+  std::string name;
+  // the current role, PREFILL or DECODE
+  InstanceType role = InstanceType::PREFILL;
+  // only MIX instances can change their role
+  bool flippable = false;
+  // estimated time of the queued prefill work, in milliseconds
+  int64_t prefill_time = 0;
+  // estimated TPOT of the running decode batch, in milliseconds
+  int64_t tpot = 0;
+  // requests still running on the instance in each phase
+  int64_t prefill_request_num = 0;
+  int64_t decode_request_num = 0;
+};
+
+struct RoleChanges {
+  // instances which stop taking new requests of their current role
+  std::vector<std::string> drain;
+  // drained instances which take requests of the new role from now on
+  std::vector<std::pair<std::string, InstanceType>> flip;
+};
+
+struct RoleBalancerOptions {
+  // SLO targets in milliseconds
+  int64_t target_ttft = 1000;
+  int64_t target_tpot = 50;
+  // weight of the latest sample when a smoothed load falls, a rising load is
+  // followed at once. 1 means no smoothing.
+  double smoothing = 0.2;
+  // an instance keeps its role for at least this long, in milliseconds
+  int64_t min_dwell_ms = 5000;
+  // a drain which does not finish in time is completed anyway, so that an
+  // instance whose requests are lost does not stay out of service forever.
+  int64_t max_drain_ms = 60000;
+  // a role is overloaded when its smoothed load, relative to its SLO target,
+  // is above `high_watermark` and can give away an instance when it is below
+  // `low_watermark`. The gap between them keeps the roles from oscillating.
+  double high_watermark = 1.0;
+  double low_watermark = 0.7;
+};
+
+// Decides when MIX instances switch between the prefill and the decode role.
+// It runs periodically off the request path. The loads of the roles are
+// smoothed, instances are moved only to an overloaded role from one with
+// spare capacity, and only after they kept their role for a minimum time. A
+// moved instance first drains the requests of its old role before it takes
+// requests of the new role. Decode instances which stay idle go back to
+// prefill, the default role of spare MIX instances.
+// Not thread-safe.
+class RoleBalancer final {
+ public:
+  explicit RoleBalancer(const RoleBalancerOptions& options);
+
+  // sample the loads of all instances at `now_ms` and return the role changes
+  // to apply.
+  RoleChanges balance(const std::vector<InstanceRoleLoad>& loads,
+                      int64_t now_ms);
+
+  // smoothed loads relative to the SLO targets
+  double prefill_pressure() const { return prefill_pressure_; }
+  double decode_pressure() const { return decode_pressure_; }
+
+ private:
+  struct Drain {
+    InstanceType role;
+    int64_t start_ms;
+  };
+
+  double smooth(double value, double sample) const;
+
+  // the number of instances to move from the donor role to the receiver
+  int64_t num_moves(double receiver_load,
+                    int64_t receiver_num,
+                    double donor_load,
+                    int64_t donor_num) const;
+
+  // pick up to `num` flippable instances of `role` which are cheapest to
+  // drain and have kept their role for the dwell time.
+  std::vector<std::string> pick_instances(
+      const std::vector<InstanceRoleLoad>& loads,
+      InstanceType role,
+      int64_t num,
+      int64_t now_ms) const;
+
+ private:
+  RoleBalancerOptions options_;
+
+  bool initialized_ = false;
+  double prefill_pressure_ = 0;
+  double decode_pressure_ = 0;
+
+  // "instance name" -> time when the instance got its current role
+  std::unordered_map<std::string, int64_t> role_since_ms_;
+  // "instance name" -> the role an instance is draining for
+  std::unordered_map<std::string, Drain> draining_;
+  // "instance name" -> since when a decode instance has no requests
+  std::unordered_map<std::string, int64_t> idle_since_ms_;
+};
+
+}  // namespace xllm_service
@@ -0,0 +1,400 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// Replays a request trace through a simulated cluster of MIX instances and
+// compares the per-request role flipping the SLO aware policy used to do with
+// the periodic RoleBalancer. Reports the number of role flips and the SLO
+// attainment of both.
+//
+// The trace is a csv file of `arrival_ms,prompt_len,output_len` lines. When
+// no trace is given, a synthetic one alternating between prefill heavy and
+// decode heavy bursts is generated.
+
+#include <gflags/gflags.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "common/global_gflags.h"
+#include "role_balancer.h"
+
+DEFINE_string(trace_path, "", "The csv trace to replay.");
+DEFINE_int32(num_instances, 8, "The number of MIX instances.");
+DEFINE_int32(duration_s, 600, "Duration of the synthetic trace in seconds.");
+DEFINE_double(base_qps, 4, "Request rate out of bursts.");
+DEFINE_double(burst_qps, 16, "Request rate during bursts.");
+DEFINE_int32(burst_period_s, 60, "The interval between two bursts.");
+DEFINE_int32(burst_length_s, 20, "The length of a burst.");
+DEFINE_int32(seed, 1, "Seed of the synthetic trace.");
+
+namespace xllm_service {
+namespace {
+
+constexpr int64_t kStepMs = 10;
+
+// cost model of an instance, in milliseconds
+double prefill_time(int64_t prompt_len) { return 20 + 0.05 * prompt_len; }
+double tpot(int64_t batch_size) { return 10 + 0.5 * batch_size; }
+
+struct TraceRequest {
+  int64_t arrival_ms;
+  int64_t prompt_len;
+  int64_t output_len;
+};
+
+std::vector<TraceRequest> load_trace(const std::string& path) {
+  std::vector<TraceRequest> trace;
+  std::ifstream file(path);
+  std::string line;
+  while (std::getline(file, line)) {
+    TraceRequest request;
+    char sep1, sep2;
+    std::istringstream stream(line);
+    if (stream >> request.arrival_ms >> sep1 >> request.prompt_len >> sep2 >>
+        request.output_len) {
+      trace.emplace_back(request);
+    }
+  }
+  std::sort(trace.begin(), trace.end(), [](const auto& a, const auto& b) {
+    return a.arrival_ms < b.arrival_ms;
+  });
+  return trace;
+}
+
+std::vector<TraceRequest> generate_trace() {
+  std::mt19937_64 rng(FLAGS_seed);
+  std::uniform_real_distribution<double> uniform(0, 1);
+  std::vector<TraceRequest> trace;
+  const int64_t period_ms = FLAGS_burst_period_s * 1000;
+  const int64_t burst_ms = FLAGS_burst_length_s * 1000;
+  double time_ms = 0;
+  while (time_ms < FLAGS_duration_s * 1000.0) {
+    const int64_t now = time_ms;
+    const bool in_burst = now % period_ms < burst_ms;
+    // odd bursts bring long prompts, even bursts long outputs
+    const bool prefill_heavy = (now / period_ms) % 2 == 1;
+    const double qps = in_burst ? FLAGS_burst_qps : FLAGS_base_qps;
+    time_ms += -std::log(1 - uniform(rng)) * 1000 / qps;
+
+    TraceRequest request;
+    request.arrival_ms = time_ms;
+    if (in_burst && prefill_heavy) {
+      request.prompt_len = 4096 + uniform(rng) * 8192;
+      request.output_len = 16 + uniform(rng) * 64;
+    } else if (in_burst) {
+      request.prompt_len = 128 + uniform(rng) * 512;
+      request.output_len = 256 + uniform(rng) * 768;
+    } else {
+      request.prompt_len = 256 + uniform(rng) * 2048;
+      request.output_len = 64 + uniform(rng) * 256;
+    }
+    trace.emplace_back(request);
+  }
+  return trace;
+}
+
+struct SimRequest {
+  const TraceRequest* trace = nullptr;
+  int decode_instance = -1;
+  double ttft_ms = -1;
+  int64_t decode_start_ms = 0;
+  double generated = 0;
+  int64_t finish_ms = 0;
+};
+
+struct SimInstance {
+  std::string name;
+  InstanceType role = InstanceType::PREFILL;
+  // whether new requests of its role are routed to the instance
+  bool active = true;
+  // requests waiting for or in prefill, with the remaining work of the head
+  std::deque<int> prefill_queue;
+  double head_remaining_ms = 0;
+  double queued_prefill_ms = 0;
+  // requests routed to the instance for decode, and those decoding
+  int64_t decode_request_num = 0;
+  std::vector<int> batch;
+};
+
+enum class Controller { LEGACY, BALANCER };
+
+struct Result {
+  int64_t flips = 0;
+  int64_t finished = 0;
+  int64_t ttft_met = 0;
+  int64_t tpot_met = 0;
+  int64_t slo_met = 0;
+  std::vector<double> ttfts;
+};
+
+class Simulator {
+ public:
+  Simulator(const std::vector<TraceRequest>& trace, Controller controller)
+      : trace_(trace), controller_(controller), balancer_(balancer_options()) {
+    instances_.resize(FLAGS_num_instances);
+    for (size_t i = 0; i < instances_.size(); ++i) {
+      instances_[i].name = "instance_" + std::to_string(i);
+      // the same initial roles as the instance manager gives MIX instances
+      instances_[i].role =
+          i == 0 ? InstanceType::DECODE : InstanceType::PREFILL;
+    }
+    requests_.resize(trace_.size());
+  }
+
+  Result run() {
+    size_t next = 0;
+    int64_t unfinished = trace_.size();
+    int64_t next_balance_ms = FLAGS_role_balance_interval_ms;
+    for (now_ms_ = 0; unfinished > 0; now_ms_ += kStepMs) {
+      while (next < trace_.size() && trace_[next].arrival_ms <= now_ms_) {
+        dispatch(next++);
+      }
+      for (size_t i = 0; i < instances_.size(); ++i) {
+        unfinished -= step(i);
+      }
+      if (controller_ == Controller::BALANCER && now_ms_ >= next_balance_ms) {
+        balance();
+        next_balance_ms += std::max(1, FLAGS_role_balance_interval_ms);
+      }
+    }
+
+    for (const auto& request : requests_) {
+      const double request_tpot =
+          (request.finish_ms - request.decode_start_ms) /
+          std::max<double>(1, request.trace->output_len);
+      const bool ttft_met = request.ttft_ms <= FLAGS_target_ttft;
+      const bool tpot_met = request_tpot <= FLAGS_target_tpot;
+      result_.ttft_met += ttft_met;
+      result_.tpot_met += tpot_met;
+      result_.slo_met += ttft_met && tpot_met;
+      result_.ttfts.emplace_back(request.ttft_ms);
+    }
+    return result_;
+  }
+
+ private:
+  static RoleBalancerOptions balancer_options() {
+    RoleBalancerOptions options;
+    options.target_ttft = FLAGS_target_ttft;
+    options.target_tpot = FLAGS_target_tpot;
+    options.smoothing = FLAGS_role_load_smoothing;
+    options.min_dwell_ms = FLAGS_role_min_dwell_ms;
+    return options;
+  }
+
+  std::vector<int> active(InstanceType role) const {
+    std::vector<int> result;
+    for (size_t i = 0; i < instances_.size(); ++i) {
+      if (instances_[i].active && instances_[i].role == role) {
+        result.emplace_back(i);
+      }
+    }
+    return result;
+  }
+
+  // route like `SloAwarePolicy`
+  void dispatch(int id) {
+    auto& request = requests_[id];
+    request.trace = &trace_[id];
+    auto prefills = active(InstanceType::PREFILL);
+    auto decodes = active(InstanceType::DECODE);
+
+    int prefill = prefills[0];
+    for (int i : prefills) {
+      if (instances_[i].queued_prefill_ms <
+          instances_[prefill].queued_prefill_ms) {
+        prefill = i;
+      }
+    }
+    int target_decode = -1;
+    int min_decode = decodes[0];
+    for (int i : decodes) {
+      const double estimated = tpot(instances_[i].decode_request_num + 1);
+      if (estimated <= FLAGS_target_tpot && target_decode < 0) {
+        target_decode = i;
+      }
+      if (instances_[i].decode_request_num <
+          instances_[min_decode].decode_request_num) {
+        min_decode = i;
+      }
+    }
+    request.decode_instance = target_decode >= 0 ? target_decode : min_decode;
+    instances_[request.decode_instance].decode_request_num += 1;
+
+    auto& instance = instances_[prefill];
+    if (instance.prefill_queue.empty()) {
+      instance.head_remaining_ms = prefill_time(request.trace->prompt_len);
+    }
+    instance.prefill_queue.push_back(id);
+    instance.queued_prefill_ms += prefill_time(request.trace->prompt_len);
+
+    if (controller_ == Controller::LEGACY && target_decode < 0 &&
+        prefills.size() > 1) {
+      double total_prefill_ms = 0;
+      for (int i : prefills) {
+        total_prefill_ms += instances_[i].queued_prefill_ms;
+      }
+      const double threshold = (prefills.size() - 1.0) / prefills.size();
+      if (total_prefill_ms / prefills.size() <
+              FLAGS_target_ttft * threshold ||
+          decodes.size() < prefills.size()) {
+        flip(prefill, InstanceType::DECODE);
+      }
+    }
+  }
+
+  // advance the instance by one step, return the number of finished requests
+  int64_t step(int index) {
+    auto& instance = instances_[index];
+    // a prefill preempts the running decode batch
+    if (!instance.prefill_queue.empty()) {
+      instance.head_remaining_ms -= kStepMs;
+      instance.queued_prefill_ms -= kStepMs;
+      if (instance.head_remaining_ms <= 0) {
+        const int id = instance.prefill_queue.front();
+        instance.prefill_queue.pop_front();
+        auto& request = requests_[id];
+        request.ttft_ms = now_ms_ + kStepMs - request.trace->arrival_ms;
+        request.decode_start_ms = now_ms_ + kStepMs;
+        instances_[request.decode_instance].batch.emplace_back(id);
+        if (!instance.prefill_queue.empty()) {
+          instance.head_remaining_ms = prefill_time(
+              trace_[instance.prefill_queue.front()].prompt_len);
+        } else {
+          instance.queued_prefill_ms = 0;
+        }
+      }
+      return 0;
+    }
+
+    int64_t finished = 0;
+    const double tokens = kStepMs / tpot(instance.batch.size());
+    for (size_t i = 0; i < instance.batch.size();) {
+      auto& request = requests_[instance.batch[i]];
+      request.generated += tokens;
+      if (request.generated < request.trace->output_len) {
+        ++i;
+        continue;
+      }
+      request.finish_ms = now_ms_ + kStepMs;
+      instance.batch[i] = instance.batch.back();
+      instance.batch.pop_back();
+      instance.decode_request_num -= 1;
+      ++finished;
+      if (controller_ == Controller::LEGACY &&
+          instance.decode_request_num == 0 &&
+          instance.role == InstanceType::DECODE &&
+          active(InstanceType::DECODE).size() > 1) {
+        flip(index, InstanceType::PREFILL);
+      }
+    }
+    return finished;
+  }
+
+  void balance() {
+    std::vector<InstanceRoleLoad> loads;
+    for (const auto& instance : instances_) {
+      InstanceRoleLoad load;
+      load.name = instance.name;
+      load.role = instance.role;
+      load.flippable = true;
+      load.prefill_time = instance.queued_prefill_ms;
+      load.prefill_request_num = instance.prefill_queue.size();
+      load.decode_request_num = instance.decode_request_num;
+      load.tpot =
+          instance.decode_request_num > 0 ? tpot(instance.decode_request_num)
+                                          : 0;
+      loads.emplace_back(std::move(load));
+    }
+    auto changes = balancer_.balance(loads, now_ms_);
+    for (const auto& name : changes.drain) {
+      instances_[index_of(name)].active = false;
+    }
+    for (const auto& [name, role] : changes.flip) {
+      flip(index_of(name), role);
+    }
+  }
+
+  int index_of(const std::string& name) const {
+    return std::stoi(name.substr(name.find('_') + 1));
+  }
+
+  void flip(int index, InstanceType role) {
+    instances_[index].role = role;
+    instances_[index].active = true;
+    ++result_.flips;
+  }
+
+ private:
+  const std::vector<TraceRequest>& trace_;
+  Controller controller_;
+  RoleBalancer balancer_;
+  std::vector<SimInstance> instances_;
+  std::vector<SimRequest> requests_;
+  int64_t now_ms_ = 0;
+  Result result_;
+};
+
+void report(const char* name, Result result, size_t num_requests) {
+  std::sort(result.ttfts.begin(), result.ttfts.end());
+  auto percentile = [&](double ratio) {
+    return result.ttfts[std::min(result.ttfts.size() - 1,
+                                 size_t(ratio * result.ttfts.size()))];
+  };
+  const double total = std::max<size_t>(1, num_requests);
+  std::printf(
+      "%-9s flips: %6ld  ttft slo: %6.2f%%  tpot slo: %6.2f%%  slo: %6.2f%%  "
+      "ttft p50/p99: %.0f/%.0f ms\n",
+      name,
+      result.flips,
+      100 * result.ttft_met / total,
+      100 * result.tpot_met / total,
+      100 * result.slo_met / total,
+      percentile(0.5),
+      percentile(0.99));
+}
+
+}  // namespace
+}  // namespace xllm_service
+
+int main(int argc, char* argv[]) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  using namespace xllm_service;
+
+  auto trace = FLAGS_trace_path.empty() ? generate_trace()
+                                        : load_trace(FLAGS_trace_path);
+  if (trace.empty() || FLAGS_num_instances < 2) {
+    std::cerr << "need a non empty trace and at least 2 instances\n";
+    return 1;
+  }
+  std::printf("requests: %zu, instances: %d\n",
+              trace.size(),
+              FLAGS_num_instances);
+  report("legacy",
+         Simulator(trace, Controller::LEGACY).run(),
+         trace.size());
+  report("balancer",
+         Simulator(trace, Controller::BALANCER).run(),
+         trace.size());
+  return 0;
+}
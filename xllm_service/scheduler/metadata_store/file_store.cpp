@@ -0,0 +1,157 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "file_store.h"
+
+#include <cstdio>
+
+namespace xllm_service {
+
+namespace {
+// a record is the op, the key and value sizes and the bytes of both
+constexpr char kPutOp = 'P';
+constexpr char kDeleteOp = 'D';
+constexpr uint64_t kMinCompactRecords = 1024;
+
+void write_record(std::ofstream* stream,
+                  char op,
+                  const std::string& key,
+                  const std::string& value) {
+  const uint32_t key_size = key.size();
+  const uint32_t value_size = value.size();
+  stream->put(op);
+  stream->write(reinterpret_cast<const char*>(&key_size), sizeof(key_size));
+  stream->write(reinterpret_cast<const char*>(&value_size),
+                sizeof(value_size));
+  stream->write(key.data(), key.size());
+  stream->write(value.data(), value.size());
+}
+}  // namespace
+
+FileStore::FileStore(const std::string& path) : path_(path) {
+  std::map<std::string, std::string> data;
+  uint64_t num_records = replay(&data);
+  LOG(INFO) << "Load " << data.size() << " keys from " << num_records
+            << " records of " << path_;
+  // start from a snapshot, which also drops a truncated tail
+  if (!compact(data)) {
+    LOG(FATAL) << "Failed to write metadata store " << path_;
+  }
+  restore(std::move(data));
+}
+
+FileStore::~FileStore() {
+  // no more changes can be applied by the watchers
+  stop_watch();
+  log_.close();
+}
+
+void FileStore::on_applied(
+    const WatchEvents& events,
+    const std::map<std::string, std::string>& data,
+    const std::unordered_set<std::string>& leased_keys) {
+  for (const auto& event : events) {
+    append(event);
+  }
+  log_.flush();
+  if (!log_.good()) {
+    LOG(ERROR) << "Failed to append to metadata store " << path_;
+  }
+  if (num_records_ > 2 * data.size() + kMinCompactRecords) {
+    compact(data, leased_keys);
+  }
+}
+
+uint64_t FileStore::replay(std::map<std::string, std::string>* data) {
+  std::ifstream stream(path_, std::ios::binary);
+  if (!stream.is_open()) {
+    return 0;
+  }
+
+  uint64_t num_records = 0;
+  std::string key;
+  std::string value;
+  while (true) {
+    char op = 0;
+    uint32_t key_size = 0;
+    uint32_t value_size = 0;
+    if (!stream.get(op) ||
+        !stream.read(reinterpret_cast<char*>(&key_size), sizeof(key_size)) ||
+        !stream.read(reinterpret_cast<char*>(&value_size),
+                     sizeof(value_size))) {
+      break;
+    }
+    key.resize(key_size);
+    value.resize(value_size);
+    if (!stream.read(key.data(), key_size) ||
+        !stream.read(value.data(), value_size)) {
+      LOG(WARNING) << "Drop truncated record at the end of " << path_;
+      break;
+    }
+    if (op == kPutOp) {
+      data->insert_or_assign(key, value);
+    } else if (op == kDeleteOp) {
+      data->erase(key);
+    } else {
+      LOG(WARNING) << "Stop at unknown record of " << path_;
+      break;
+    }
+    ++num_records;
+  }
+  return num_records;
+}
+
+bool FileStore::compact(const std::map<std::string, std::string>& data,
+                        const std::unordered_set<std::string>& leased_keys) {
+  const std::string tmp_path = path_ + ".tmp";
+  uint64_t num_records = 0;
+  {
+    std::ofstream stream(tmp_path, std::ios::binary | std::ios::trunc);
+    for (const auto& [key, value] : data) {
+      // leased keys go away with the process
+      if (leased_keys.count(key) != 0) {
+        continue;
+      }
+      write_record(&stream, kPutOp, key, value);
+      ++num_records;
+    }
+    stream.flush();
+    if (!stream.good()) {
+      LOG(ERROR) << "Failed to write " << tmp_path;
+      std::remove(tmp_path.c_str());
+      return false;
+    }
+  }
+
+  log_.close();
+  if (std::rename(tmp_path.c_str(), path_.c_str()) != 0) {
+    LOG(ERROR) << "Failed to rename " << tmp_path << " to " << path_;
+  } else {
+    num_records_ = num_records;
+  }
+  log_.open(path_, std::ios::binary | std::ios::app);
+  return log_.is_open();
+}
+
+void FileStore::append(const WatchEvent& event) {
+  if (event.type == WatchEvent::Type::PUT) {
+    write_record(&log_, kPutOp, event.key, event.value);
+  } else {
+    write_record(&log_, kDeleteOp, event.key, "");
+  }
+  ++num_records_;
+}
+
+}  // namespace xllm_service
@@ -0,0 +1,61 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#include <fstream>
+#include <map>
+#include <string>
+#include <unordered_set>
+
+#include "memory_store.h"
+
+namespace xllm_service {
+
+// Metadata store of a single master which survives restarts. The changes are
+// appended to a log at `path`, which is replayed when the store is opened and
+// compacted to a snapshot of the live keys once it has grown large. Keys with
+// a lease are not logged, they go away with the process like on etcd.
+class FileStore : public MemoryStore {
+ public:
+  explicit FileStore(const std::string& path);
+  ~FileStore() override;
+
+ protected:
+  void on_applied(
+      const WatchEvents& events,
+      const std::map<std::string, std::string>& data,
+      const std::unordered_set<std::string>& leased_keys) override;
+
+ private:
+  // read the log into `data`, a truncated last record is dropped.
+  // Return the number of records read.
+  uint64_t replay(std::map<std::string, std::string>* data);
+
+  // rewrite the log with one record per key of `data`, except the
+  // `leased_keys`
+  bool compact(const std::map<std::string, std::string>& data,
+               const std::unordered_set<std::string>& leased_keys = {});
+
+  void append(const WatchEvent& event);
+
+ private:
+  std::string path_;
+  std::ofstream log_;
+  // records in the log, compacted when far more than the live keys
+  uint64_t num_records_ = 0;
+};
+
+}  // namespace xllm_service
@@ -0,0 +1,244 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "memory_store.h"
+
+namespace xllm_service {
+
+namespace {
+bool matches(const std::string& key,
+             const std::string& key_prefix,
+             bool recursive) {
+  if (!recursive) {
+    return key == key_prefix;
+  }
+  return key.compare(0, key_prefix.size(), key_prefix) == 0;
+}
+}  // namespace
+
+MemoryStore::MemoryStore() {
+  std::lock_guard<std::mutex> lock(watch_mutex_);
+  dispatch_thread_ =
+      std::make_unique<std::thread>(&MemoryStore::dispatch, this);
+  dispatch_thread_id_ = dispatch_thread_->get_id();
+}
+
+MemoryStore::~MemoryStore() {
+  stop_watch();
+  {
+    std::lock_guard<std::mutex> lock(watch_mutex_);
+    exited_ = true;
+  }
+  watch_cv_.notify_all();
+  dispatch_thread_->join();
+}
+
+bool MemoryStore::put(const std::string& key, const std::string& value) {
+  std::lock_guard<std::mutex> lock(data_mutex_);
+  apply_locked({{WatchEvent::Type::PUT, key, value}}, /*leased=*/false);
+  return true;
+}
+
+bool MemoryStore::get(const std::string& key, std::string* value) {
+  std::lock_guard<std::mutex> lock(data_mutex_);
+  auto it = data_.find(key);
+  if (it == data_.end()) {
+    return false;
+  }
+  if (value) {
+    *value = it->second;
+  }
+  return true;
+}
+
+bool MemoryStore::get_prefix(
+    const std::string& key_prefix,
+    std::unordered_map<std::string, std::string>* values) {
+  std::lock_guard<std::mutex> lock(data_mutex_);
+  for (auto it = data_.lower_bound(key_prefix);
+       it != data_.end() && matches(it->first, key_prefix, true);
+       ++it) {
+    values->insert_or_assign(it->first.substr(key_prefix.size()), it->second);
+  }
+  return true;
+}
+
+bool MemoryStore::rm(const std::string& key) {
+  std::lock_guard<std::mutex> lock(data_mutex_);
+  apply_locked({{WatchEvent::Type::DELETE, key, ""}}, /*leased=*/false);
+  return true;
+}
+
+bool MemoryStore::batch_update(
+    const std::vector<std::pair<std::string, std::string>>& puts,
+    const std::vector<std::string>& deletes) {
+  WatchEvents events;
+  events.reserve(puts.size() + deletes.size());
+  for (const auto& [key, value] : puts) {
+    events.push_back({WatchEvent::Type::PUT, key, value});
+  }
+  for (const auto& key : deletes) {
+    events.push_back({WatchEvent::Type::DELETE, key, ""});
+  }
+  std::lock_guard<std::mutex> lock(data_mutex_);
+  apply_locked(std::move(events), /*leased=*/false);
+  return true;
+}
+
+bool MemoryStore::create_with_lease(const std::string& key,
+                                    const std::string& value,
+                                    int ttl) {
+  std::lock_guard<std::mutex> lock(data_mutex_);
+  if (data_.count(key) != 0) {
+    return false;
+  }
+  apply_locked({{WatchEvent::Type::PUT, key, value}}, /*leased=*/true);
+  return true;
+}
+
+void MemoryStore::add_watch(const std::string& key_prefix,
+                            Callback callback,
+                            bool recursive) {
+  auto watcher = std::make_shared<Watcher>();
+  watcher->key_prefix = key_prefix;
+  watcher->recursive = recursive;
+  watcher->callback = std::move(callback);
+
+  std::lock_guard<std::mutex> lock(watch_mutex_);
+  auto it = watchers_.find(key_prefix);
+  if (it != watchers_.end()) {
+    it->second->cancelled = true;
+  }
+  watchers_[key_prefix] = std::move(watcher);
+}
+
+void MemoryStore::remove_watch(const std::string& key_prefix) {
+  std::unique_lock<std::mutex> lock(watch_mutex_);
+  auto it = watchers_.find(key_prefix);
+  if (it == watchers_.end()) {
+    return;
+  }
+  it->second->cancelled = true;
+  watchers_.erase(it);
+  wait_for_dispatch(&lock);
+}
+
+void MemoryStore::stop_watch() {
+  std::unique_lock<std::mutex> lock(watch_mutex_);
+  for (auto& [key_prefix, watcher] : watchers_) {
+    watcher->cancelled = true;
+  }
+  watchers_.clear();
+  pending_events_.clear();
+  wait_for_dispatch(&lock);
+}
+
+void MemoryStore::restore(std::map<std::string, std::string>&& data) {
+  std::lock_guard<std::mutex> lock(data_mutex_);
+  data_ = std::move(data);
+  leased_keys_.clear();
+}
+
+void MemoryStore::apply_locked(WatchEvents&& events, bool leased) {
+  WatchEvents applied;
+  WatchEvents persisted;
+  applied.reserve(events.size());
+  for (auto& event : events) {
+    bool was_leased = leased_keys_.count(event.key) != 0;
+    if (event.type == WatchEvent::Type::PUT) {
+      data_.insert_or_assign(event.key, event.value);
+      if (leased) {
+        leased_keys_.insert(event.key);
+      } else if (was_leased) {
+        leased_keys_.erase(event.key);
+      }
+    } else {
+      if (data_.erase(event.key) == 0) {
+        continue;
+      }
+      leased_keys_.erase(event.key);
+    }
+    if (!leased && !(event.type == WatchEvent::Type::DELETE && was_leased)) {
+      persisted.push_back(event);
+    }
+    applied.emplace_back(std::move(event));
+  }
+  if (!persisted.empty()) {
+    on_applied(persisted, data_, leased_keys_);
+  }
+  if (applied.empty()) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(watch_mutex_);
+    if (watchers_.empty()) {
+      return;
+    }
+    pending_events_.emplace_back(std::move(applied));
+  }
+  watch_cv_.notify_all();
+}
+
+void MemoryStore::dispatch() {
+  std::unique_lock<std::mutex> lock(watch_mutex_);
+  while (true) {
+    watch_cv_.wait(lock,
+                   [this] { return exited_ || !pending_events_.empty(); });
+    if (exited_) {
+      break;
+    }
+    WatchEvents events = std::move(pending_events_.front());
+    pending_events_.pop_front();
+
+    std::vector<std::pair<std::shared_ptr<Watcher>, WatchEvents>> deliveries;
+    for (const auto& [key_prefix, watcher] : watchers_) {
+      WatchEvents matched;
+      for (const auto& event : events) {
+        if (matches(event.key, key_prefix, watcher->recursive)) {
+          matched.push_back(event);
+        }
+      }
+      if (!matched.empty()) {
+        deliveries.emplace_back(watcher, std::move(matched));
+      }
+    }
+    if (deliveries.empty()) {
+      continue;
+    }
+
+    dispatching_ = true;
+    for (auto& [watcher, matched] : deliveries) {
+      // a callback may remove the watchers of the following ones
+      if (watcher->cancelled) {
+        continue;
+      }
+      lock.unlock();
+      watcher->callback(matched, watcher->key_prefix.size());
+      lock.lock();
+    }
+    dispatching_ = false;
+    watch_cv_.notify_all();
+  }
+}
+
+void MemoryStore::wait_for_dispatch(std::unique_lock<std::mutex>* lock) {
+  if (std::this_thread::get_id() == dispatch_thread_id_) {
+    return;
+  }
+  watch_cv_.wait(*lock, [this] { return !dispatching_; });
+}
+
+}  // namespace xllm_service
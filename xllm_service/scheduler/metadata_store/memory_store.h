@@ -0,0 +1,113 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+
+#include "metadata_store.h"
+
+namespace xllm_service {
+
+// In-process metadata store for a single master, the tests and the
+// benchmarks. Changes are applied at once and delivered to the watchers in
+// order by a dispatch thread, like the etcd watchers do. Leases never expire
+// since they live as long as the process which owns them.
+class MemoryStore : public MetadataStore {
+ public:
+  MemoryStore();
+  ~MemoryStore() override;
+
+  using MetadataStore::get;
+  using MetadataStore::get_prefix;
+  using MetadataStore::rm;
+
+  bool put(const std::string& key, const std::string& value) override;
+
+  bool get(const std::string& key, std::string* value) override;
+
+  bool get_prefix(
+      const std::string& key_prefix,
+      std::unordered_map<std::string, std::string>* values) override;
+
+  bool rm(const std::string& key) override;
+
+  bool batch_update(
+      const std::vector<std::pair<std::string, std::string>>& puts,
+      const std::vector<std::string>& deletes) override;
+
+  bool create_with_lease(const std::string& key,
+                         const std::string& value,
+                         int ttl) override;
+
+  void add_watch(const std::string& key_prefix,
+                 Callback callback,
+                 bool recursive = true) override;
+
+  void remove_watch(const std::string& key_prefix) override;
+
+  void stop_watch() override;
+
+ protected:
+  // replace the content of the store, without watch events
+  void restore(std::map<std::string, std::string>&& data);
+
+  // called with the applied changes of keys without lease, in apply order.
+  // `data` is the whole content, including the `leased_keys`.
+  virtual void on_applied(
+      const WatchEvents& events,
+      const std::map<std::string, std::string>& data,
+      const std::unordered_set<std::string>& leased_keys) {}
+
+ private:
+  struct Watcher {
+    std::string key_prefix;
+    bool recursive = true;
+    Callback callback;
+    bool cancelled = false;
+  };
+
+  // apply `events` and queue them for the watchers, deletes of missing keys
+  // are dropped. `data_mutex_` has to be held.
+  void apply_locked(WatchEvents&& events, bool leased);
+
+  void dispatch();
+
+  // wait until no callback runs, unless called by a callback
+  void wait_for_dispatch(std::unique_lock<std::mutex>* lock);
+
+ private:
+  std::mutex data_mutex_;
+  // ordered for prefix scans
+  std::map<std::string, std::string> data_;
+  std::unordered_set<std::string> leased_keys_;
+
+  std::mutex watch_mutex_;
+  std::condition_variable watch_cv_;
+  std::map<std::string, std::shared_ptr<Watcher>> watchers_;
+  std::deque<WatchEvents> pending_events_;
+  bool dispatching_ = false;
+  bool exited_ = false;
+  std::thread::id dispatch_thread_id_;
+  std::unique_ptr<std::thread> dispatch_thread_;
+};
+
+}  // namespace xllm_service
@@ -0,0 +1,71 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "metadata_store.h"
+
+namespace xllm_service {
+
+BatchUpdate MetadataStore::make_batch_update(const std::string& key_prefix,
+                                             const Murmur3KeyCacheMap& values) {
+  BatchUpdate update;
+  update.puts.reserve(values.size());
+  for (const auto& iter : values) {
+    if (iter.second.empty()) {
+      update.deletes.emplace_back(key_prefix + iter.first.to_string());
+    } else {
+      update.puts.emplace_back(key_prefix + iter.first.to_string(),
+                               iter.second.serialize_to_json().dump());
+    }
+  }
+  return update;
+}
+
+bool MetadataStore::set(const std::string& key_prefix,
+                        const Murmur3KeyCacheMap& values) {
+  auto update = make_batch_update(key_prefix, values);
+  return batch_update(update.puts, update.deletes);
+}
+
+bool MetadataStore::rm(const std::string& key_prefix,
+                       const std::unordered_set<std::string>& keys) {
+  std::vector<std::string> deletes;
+  deletes.reserve(keys.size());
+  for (const auto& iter : keys) {
+    deletes.emplace_back(key_prefix + iter);
+  }
+  return batch_update({}, deletes);
+}
+
+bool MetadataStore::get_prefix(const std::string& key_prefix,
+                               Murmur3KeyCacheMap* values) {
+  std::unordered_map<std::string, std::string> json_values;
+  if (!get_prefix(key_prefix, &json_values)) {
+    return false;
+  }
+
+  for (auto& [key_str, json_str] : json_values) {
+    Murmur3Key key(key_str.c_str());
+    CacheLocations value;
+    if (!value.parse_from_json(json_str)) {
+      LOG(ERROR) << "Parse json fail: " << json_str;
+      continue;
+    }
+
+    values->insert_or_assign(std::move(key), std::move(value));
+  }
+  return true;
+}
+
+}  // namespace xllm_service
@@ -0,0 +1,209 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#include <glog/logging.h>
+
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "common/hash_util.h"
+#include "common/types.h"
+
+namespace xllm_service {
+
+struct WatchEvent {
+  enum class Type : int8_t {
+    PUT = 0,
+    DELETE = 1,
+  };
+
+  Type type = Type::PUT;
+  std::string key;
+  // empty for DELETE
+  std::string value;
+};
+
+// the events of one change of the store, in the order they were applied
+using WatchEvents = std::vector<WatchEvent>;
+
+// `prefix_len` is the length of the watched prefix, the key of an event
+// without it is the name of the watched item.
+using Callback =
+    std::function<void(const WatchEvents& events, const uint64_t& prefix_len)>;
+
+// the puts and deletes of one update, a key is in at most one of them so the
+// operations can be applied in any order.
+struct BatchUpdate {
+  std::vector<std::pair<std::string, std::string>> puts;
+  std::vector<std::string> deletes;
+
+  bool empty() const { return puts.empty() && deletes.empty(); }
+};
+
+// called once all operations of an update are applied, `ok` is false if any
+// of them failed.
+using UpdateCallback = std::function<void(bool ok)>;
+
+// Key-value store of the metadata shared by the masters, the instances, their
+// load metrics and kv cache locations. Implementations provide the plain
+// operations, the typed helpers on top of them store json serialized values.
+class MetadataStore {
+ public:
+  virtual ~MetadataStore() = default;
+
+  virtual bool put(const std::string& key, const std::string& value) = 0;
+
+  // return false if the key does not exist
+  virtual bool get(const std::string& key, std::string* value) = 0;
+
+  // the keys of `values` are without `key_prefix`
+  virtual bool get_prefix(
+      const std::string& key_prefix,
+      std::unordered_map<std::string, std::string>* values) = 0;
+
+  virtual bool rm(const std::string& key) = 0;
+
+  // apply the puts and deletes as transactions, return false and log the
+  // error if any of them fails.
+  virtual bool batch_update(
+      const std::vector<std::pair<std::string, std::string>>& puts,
+      const std::vector<std::string>& deletes) = 0;
+
+  // issue the update and return without waiting for it, `done` may run on a
+  // thread of the store. Updates in flight are applied in any order, so an
+  // update touching the keys of another one has to wait for it.
+  virtual void batch_update_async(BatchUpdate update, UpdateCallback done) {
+    done(batch_update(update.puts, update.deletes));
+  }
+
+  std::future<bool> batch_update_async(BatchUpdate update) {
+    auto promise = std::make_shared<std::promise<bool>>();
+    auto future = promise->get_future();
+    batch_update_async(std::move(update),
+                       [promise](bool ok) { promise->set_value(ok); });
+    return future;
+  }
+
+  // create the key if it does not exist, bound to a lease of `ttl` seconds
+  // which is kept alive while the store is. Return false if the key exists.
+  virtual bool create_with_lease(const std::string& key,
+                                 const std::string& value,
+                                 int ttl) = 0;
+
+  // call `callback` with the changes of the keys under `key_prefix`, or of
+  // the key itself if not `recursive`. Callbacks run on a thread of the
+  // store, one at a time.
+  virtual void add_watch(const std::string& key_prefix,
+                         Callback callback,
+                         bool recursive = true) = 0;
+
+  virtual void remove_watch(const std::string& key_prefix) = 0;
+
+  // no callback runs once this returns
+  virtual void stop_watch() = 0;
+
+  template <typename T>
+  bool set(const std::string& key, const T& value) {
+    return put(key, value.serialize_to_json().dump());
+  }
+
+  bool set(const std::string& key, const std::string& value) {
+    return put(key, value);
+  }
+
+  // the update which puts `values` under `key_prefix` and deletes
+  // `removed_keys`, empty values are deleted too.
+  template <typename T>
+  static BatchUpdate make_batch_update(
+      const std::string& key_prefix,
+      const std::unordered_map<std::string, T>& values,
+      const std::unordered_set<std::string>& removed_keys = {}) {
+    BatchUpdate update;
+    update.puts.reserve(values.size());
+    update.deletes.reserve(removed_keys.size());
+    for (const auto& iter : values) {
+      if (iter.second.empty()) {
+        update.deletes.emplace_back(key_prefix + iter.first);
+      } else {
+        update.puts.emplace_back(key_prefix + iter.first,
+                                 iter.second.serialize_to_json().dump());
+      }
+    }
+    for (const auto& key : removed_keys) {
+      update.deletes.emplace_back(key_prefix + key);
+    }
+    return update;
+  }
+
+  static BatchUpdate make_batch_update(const std::string& key_prefix,
+                                       const Murmur3KeyCacheMap& values);
+
+  // put `values` under `key_prefix` and delete `removed_keys` in batched
+  // transactions, empty values are deleted too. Return false if any of the
+  // transactions fails.
+  template <typename T>
+  bool set(const std::string& key_prefix,
+           const std::unordered_map<std::string, T>& values,
+           const std::unordered_set<std::string>& removed_keys = {}) {
+    auto update = make_batch_update(key_prefix, values, removed_keys);
+    return batch_update(update.puts, update.deletes);
+  }
+
+  bool set(const std::string& key_prefix, const Murmur3KeyCacheMap& values);
+
+  bool rm(const std::string& key_prefix,
+          const std::unordered_set<std::string>& keys);
+
+  template <typename T>
+  bool get(const std::string& key, T* value) {
+    std::string json_str;
+    if (!get(key, &json_str)) {
+      return false;
+    }
+    return value == nullptr || value->parse_from_json(json_str);
+  }
+
+  template <typename T>
+  bool get_prefix(const std::string& key_prefix,
+                  std::unordered_map<std::string, T>* values) {
+    std::unordered_map<std::string, std::string> json_values;
+    if (!get_prefix(key_prefix, &json_values)) {
+      return false;
+    }
+
+    for (auto& [key, json_str] : json_values) {
+      T value;
+      if (!value.parse_from_json(json_str)) {
+        LOG(ERROR) << "Parse json fail: " << json_str;
+        continue;
+      }
+      values->insert_or_assign(key, std::move(value));
+    }
+    return true;
+  }
+
+  bool get_prefix(const std::string& key_prefix, Murmur3KeyCacheMap* values);
+};
+
+}  // namespace xllm_service
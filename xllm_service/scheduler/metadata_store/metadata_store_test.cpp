@@ -0,0 +1,239 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+
+#include "file_store.h"
+#include "memory_store.h"
+
+namespace xllm_service::test {
+
+namespace {
+// collect the events delivered to a watcher
+class EventCollector {
+ public:
+  Callback callback() {
+    return [this](const WatchEvents& events, const uint64_t& prefix_len) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (const auto& event : events) {
+        names_.emplace_back(
+            (event.type == WatchEvent::Type::PUT ? "+" : "-") +
+            event.key.substr(prefix_len));
+      }
+      cv_.notify_all();
+    };
+  }
+
+  std::vector<std::string> wait_for(size_t num_events) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait_for(lock, std::chrono::seconds(5), [&]() {
+      return names_.size() >= num_events;
+    });
+    return names_;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::vector<std::string> names_;
+};
+
+std::string temp_path(const std::string& name) {
+  return testing::TempDir() + "/" + name + "." + std::to_string(getpid());
+}
+}  // namespace
+
+TEST(MemoryStoreTest, PutGetAndRemove) {
+  MemoryStore store;
+  std::string value;
+  EXPECT_FALSE(store.get("a", &value));
+  ASSERT_TRUE(store.put("a", "1"));
+  ASSERT_TRUE(store.get("a", &value));
+  EXPECT_EQ("1", value);
+  ASSERT_TRUE(store.rm("a"));
+  EXPECT_FALSE(store.get("a", &value));
+  // removing a missing key is not an error
+  EXPECT_TRUE(store.rm("a"));
+}
+
+TEST(MemoryStoreTest, GetPrefixAndTypedValues) {
+  MemoryStore store;
+  std::unordered_map<std::string, LoadMetrics> metrics = {
+      {"i1", LoadMetrics(3, 0.5)}, {"i2", LoadMetrics(1, 0.25)}};
+  ASSERT_TRUE(store.set("LOAD:", metrics));
+  ASSERT_TRUE(store.put("LOADED", "other"));
+
+  std::unordered_map<std::string, LoadMetrics> loaded;
+  ASSERT_TRUE(store.get_prefix("LOAD:", &loaded));
+  ASSERT_EQ(2u, loaded.size());
+  EXPECT_EQ(3u, loaded["i1"].waiting_requests_num);
+  EXPECT_EQ(0.25, loaded["i2"].gpu_cache_usage_perc);
+
+  LoadMetrics value;
+  ASSERT_TRUE(store.get("LOAD:i1", &value));
+  EXPECT_EQ(3u, value.waiting_requests_num);
+
+  // the removed keys are deleted in the same update
+  metrics = {{"i3", LoadMetrics()}};
+  ASSERT_TRUE(store.set("LOAD:", metrics, {"i1", "i2"}));
+  loaded.clear();
+  ASSERT_TRUE(store.get_prefix("LOAD:", &loaded));
+  ASSERT_EQ(1u, loaded.size());
+  EXPECT_EQ(1u, loaded.count("i3"));
+}
+
+TEST(MemoryStoreTest, BatchUpdateAsync) {
+  MemoryStore store;
+  std::unordered_map<std::string, LoadMetrics> metrics = {
+      {"i1", LoadMetrics(3, 0.5)}};
+  auto update = MetadataStore::make_batch_update("LOAD:", metrics, {"i2"});
+  EXPECT_EQ(1u, update.puts.size());
+  EXPECT_EQ(std::vector<std::string>({"LOAD:i2"}), update.deletes);
+  ASSERT_TRUE(store.batch_update_async(std::move(update)).get());
+  LoadMetrics value;
+  EXPECT_TRUE(store.get("LOAD:i1", &value));
+}
+
+TEST(MemoryStoreTest, WatchPrefixInOrder) {
+  MemoryStore store;
+  EventCollector collector;
+  store.add_watch("CACHE:", collector.callback());
+  store.put("OTHER", "x");
+  store.batch_update({{"CACHE:a", "1"}, {"CACHE:b", "2"}}, {});
+  store.rm("CACHE:a");
+  // no event for a key which does not exist
+  store.rm("CACHE:c");
+  store.put("CACHE:c", "3");
+
+  EXPECT_EQ(std::vector<std::string>({"+a", "+b", "-a", "+c"}),
+            collector.wait_for(4));
+
+  store.remove_watch("CACHE:");
+  store.put("CACHE:d", "4");
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  EXPECT_EQ(4u, collector.wait_for(4).size());
+}
+
+TEST(MemoryStoreTest, RemoveWatchFromCallback) {
+  MemoryStore store;
+  std::mutex mutex;
+  std::condition_variable cv;
+  int32_t num_calls = 0;
+  store.add_watch(
+      "MASTER",
+      [&](const WatchEvents& events, const uint64_t& prefix_len) {
+        store.remove_watch("MASTER");
+        std::lock_guard<std::mutex> lock(mutex);
+        ++num_calls;
+        cv.notify_all();
+      },
+      /*recursive=*/false);
+  store.put("MASTER", "a");
+  store.put("MASTER", "b");
+
+  std::unique_lock<std::mutex> lock(mutex);
+  cv.wait_for(lock, std::chrono::seconds(5), [&]() { return num_calls > 0; });
+  lock.unlock();
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  lock.lock();
+  EXPECT_EQ(1, num_calls);
+}
+
+TEST(MemoryStoreTest, CreateWithLeaseOnlyOnce) {
+  MemoryStore store;
+  EXPECT_TRUE(store.create_with_lease("MASTER", "a", /*ttl=*/3));
+  EXPECT_FALSE(store.create_with_lease("MASTER", "b", /*ttl=*/3));
+  std::string value;
+  ASSERT_TRUE(store.get("MASTER", &value));
+  EXPECT_EQ("a", value);
+}
+
+TEST(FileStoreTest, RestoreAfterReopen) {
+  const std::string path = temp_path("file_store_test");
+  std::remove(path.c_str());
+  {
+    FileStore store(path);
+    store.batch_update({{"a", "1"}, {"b", "2"}, {"c", "3"}}, {"b"});
+    store.put("a", "4");
+    store.create_with_lease("MASTER", "m", /*ttl=*/3);
+  }
+  {
+    FileStore store(path);
+    std::unordered_map<std::string, std::string> values;
+    ASSERT_TRUE(store.get_prefix("", &values));
+    // keys with a lease go away with the store
+    EXPECT_EQ((std::unordered_map<std::string, std::string>{{"a", "4"},
+                                                             {"c", "3"}}),
+              values);
+    // compaction keeps the content
+    for (int32_t i = 0; i < 4096; ++i) {
+      store.put("k", std::to_string(i));
+    }
+  }
+  FileStore store(path);
+  std::string value;
+  ASSERT_TRUE(store.get("k", &value));
+  EXPECT_EQ("4095", value);
+  EXPECT_TRUE(store.get("a", &value));
+  std::remove(path.c_str());
+}
+
+TEST(FileStoreTest, DropLeaseOnCompaction) {
+  const std::string path = temp_path("file_store_lease_test");
+  std::remove(path.c_str());
+  {
+    FileStore store(path);
+    ASSERT_TRUE(store.create_with_lease("MASTER", "m", /*ttl=*/3));
+    // compact while the lease is alive
+    for (int32_t i = 0; i < 4096; ++i) {
+      store.put("k", std::to_string(i));
+    }
+  }
+  FileStore store(path);
+  std::string value;
+  EXPECT_FALSE(store.get("MASTER", &value));
+  EXPECT_TRUE(store.create_with_lease("MASTER", "n", /*ttl=*/3));
+  ASSERT_TRUE(store.get("k", &value));
+  EXPECT_EQ("4095", value);
+  std::remove(path.c_str());
+}
+
+TEST(FileStoreTest, DropTruncatedRecord) {
+  const std::string path = temp_path("file_store_truncated_test");
+  std::remove(path.c_str());
+  {
+    FileStore store(path);
+    store.put("a", "1");
+    store.put("b", "2");
+  }
+  // cut the last record in the middle of its value
+  ASSERT_EQ(0, truncate(path.c_str(), 2 * (1 + 8 + 2) - 1));
+  FileStore store(path);
+  std::string value;
+  EXPECT_TRUE(store.get("a", &value));
+  EXPECT_FALSE(store.get("b", &value));
+  store.put("c", "3");
+  EXPECT_TRUE(store.get("c", &value));
+  std::remove(path.c_str());
+}
+
+}  // namespace xllm_service::test
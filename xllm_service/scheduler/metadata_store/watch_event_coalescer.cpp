@@ -0,0 +1,128 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "watch_event_coalescer.h"
+
+#include <butil/time.h>
+
+#include <chrono>
+
+namespace xllm_service {
+
+WatchEventCoalescer::WatchEventCoalescer(const std::string& name,
+                                         int64_t window_us,
+                                         ApplyFn apply)
+    : window_us_(window_us),
+      apply_(std::move(apply)),
+      apply_lag_("xllm_service_watch_" + name + "_apply_lag"),
+      received_events_("xllm_service_watch_" + name + "_events"),
+      applied_events_("xllm_service_watch_" + name + "_applied_events") {
+  thread_ = std::make_unique<std::thread>(&WatchEventCoalescer::run, this);
+}
+
+WatchEventCoalescer::~WatchEventCoalescer() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    exited_ = true;
+  }
+  cv_.notify_all();
+  thread_->join();
+}
+
+Callback WatchEventCoalescer::callback() {
+  return [this](const WatchEvents& events, const uint64_t& prefix_len) {
+    add(events, prefix_len);
+  };
+}
+
+void WatchEventCoalescer::add(const WatchEvents& events, uint64_t prefix_len) {
+  if (events.empty()) {
+    return;
+  }
+  bool was_empty = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    was_empty = pending_.empty();
+    if (was_empty) {
+      first_pending_us_ = butil::monotonic_time_us();
+    }
+    for (const auto& event : events) {
+      auto [it, inserted] = index_.try_emplace(event.key, pending_.size());
+      if (!inserted) {
+        WatchEvent& latest = pending_[it->second];
+        if (latest.type != WatchEvent::Type::DELETE ||
+            event.type == WatchEvent::Type::DELETE) {
+          latest.type = event.type;
+          latest.value = event.value;
+          continue;
+        }
+        // keep the delete before the put
+        it->second = pending_.size();
+      }
+      pending_.push_back(
+          {event.type, event.key.substr(prefix_len), event.value});
+    }
+  }
+  received_events_ << events.size();
+  if (was_empty) {
+    cv_.notify_all();
+  }
+}
+
+void WatchEventCoalescer::flush() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  flush_requested_ = true;
+  cv_.notify_all();
+  cv_.wait(lock,
+           [this]() { return exited_ || (pending_.empty() && !applying_); });
+  flush_requested_ = false;
+}
+
+void WatchEventCoalescer::run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    cv_.wait(lock, [this]() { return exited_ || !pending_.empty(); });
+    // wait for later changes of the same keys
+    const int64_t deadline_us = first_pending_us_ + window_us_;
+    while (!exited_ && !flush_requested_) {
+      const int64_t now_us = butil::monotonic_time_us();
+      if (now_us >= deadline_us) {
+        break;
+      }
+      cv_.wait_for(lock, std::chrono::microseconds(deadline_us - now_us));
+    }
+    if (exited_) {
+      break;
+    }
+
+    WatchEvents events;
+    events.swap(pending_);
+    index_.clear();
+    const int64_t first_pending_us = first_pending_us_;
+    applying_ = true;
+    lock.unlock();
+
+    apply_(events);
+    apply_lag_ << butil::monotonic_time_us() - first_pending_us;
+    applied_events_ << events.size();
+
+    lock.lock();
+    applying_ = false;
+    cv_.notify_all();
+  }
+  cv_.notify_all();
+}
+
+}  // namespace xllm_service
@@ -0,0 +1,92 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#include <bvar/bvar.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include "common/macros.h"
+#include "metadata_store.h"
+
+namespace xllm_service {
+
+// Collects the watch events of a metadata store and hands them to `apply` in
+// batches from one thread, so a burst of changes costs one parse and one
+// writer critical section instead of one per event. Only the latest event of
+// a key is kept, except that a delete followed by a put is kept as both, so a
+// re-created item is removed and added again rather than updated in place.
+//
+// The events of a key are applied in order. The time from receiving the
+// oldest event of a batch until it is applied is exposed as the bvar
+// `xllm_service_watch_<name>_apply_lag` in microseconds, next to the numbers
+// of received and applied events.
+class WatchEventCoalescer final {
+ public:
+  // the keys of `events` are without the watched prefix, in the order the
+  // keys first changed.
+  using ApplyFn = std::function<void(const WatchEvents& events)>;
+
+  // an event waits at most `window_us` for later ones before it is applied
+  WatchEventCoalescer(const std::string& name,
+                      int64_t window_us,
+                      ApplyFn apply);
+  // drop the pending events
+  ~WatchEventCoalescer();
+
+  // the callback to pass to `MetadataStore::add_watch`
+  Callback callback();
+
+  void add(const WatchEvents& events, uint64_t prefix_len);
+
+  // apply the pending events without waiting for the window, and return once
+  // they are applied.
+  void flush();
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(WatchEventCoalescer);
+
+  void run();
+
+ private:
+  const int64_t window_us_;
+  ApplyFn apply_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  WatchEvents pending_;
+  // key with prefix -> position of its latest event in `pending_`
+  std::unordered_map<std::string, size_t> index_;
+  int64_t first_pending_us_ = 0;
+  bool applying_ = false;
+  bool flush_requested_ = false;
+  bool exited_ = false;
+
+  bvar::LatencyRecorder apply_lag_;
+  bvar::Adder<int64_t> received_events_;
+  bvar::Adder<int64_t> applied_events_;
+
+  std::unique_ptr<std::thread> thread_;
+};
+
+}  // namespace xllm_service
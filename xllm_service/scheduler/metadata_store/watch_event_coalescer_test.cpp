@@ -0,0 +1,106 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "watch_event_coalescer.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace xllm_service::test {
+
+namespace {
+constexpr int64_t kLongWindowUs = 10 * 1000 * 1000;
+
+// record the applied batches as "+key=value" and "-key"
+class BatchRecorder {
+ public:
+  WatchEventCoalescer::ApplyFn apply() {
+    return [this](const WatchEvents& events) {
+      std::vector<std::string> batch;
+      for (const auto& event : events) {
+        batch.emplace_back(event.type == WatchEvent::Type::PUT
+                               ? "+" + event.key + "=" + event.value
+                               : "-" + event.key);
+      }
+      std::lock_guard<std::mutex> lock(mutex_);
+      batches_.emplace_back(std::move(batch));
+    };
+  }
+
+  std::vector<std::vector<std::string>> batches() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return batches_;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::vector<std::vector<std::string>> batches_;
+};
+
+WatchEvent put(const std::string& key, const std::string& value) {
+  return {WatchEvent::Type::PUT, key, value};
+}
+
+WatchEvent del(const std::string& key) {
+  return {WatchEvent::Type::DELETE, key, ""};
+}
+}  // namespace
+
+TEST(WatchEventCoalescerTest, KeepLatestEventOfKey) {
+  BatchRecorder recorder;
+  WatchEventCoalescer coalescer("test_latest", kLongWindowUs, recorder.apply());
+  auto callback = coalescer.callback();
+  callback({put("P:a", "1"), put("P:b", "1")}, 2);
+  callback({put("P:a", "2"), del("P:b")}, 2);
+  callback({put("P:c", "1")}, 2);
+  coalescer.flush();
+
+  // the keys stay in the order they first changed
+  EXPECT_EQ(std::vector<std::vector<std::string>>({{"+a=2", "-b", "+c=1"}}),
+            recorder.batches());
+}
+
+TEST(WatchEventCoalescerTest, KeepDeleteBeforePut) {
+  BatchRecorder recorder;
+  WatchEventCoalescer coalescer(
+      "test_recreate", kLongWindowUs, recorder.apply());
+  coalescer.add({del("P:a"), put("P:a", "1"), put("P:a", "2")}, 2);
+  coalescer.flush();
+  EXPECT_EQ(std::vector<std::vector<std::string>>({{"-a", "+a=2"}}),
+            recorder.batches());
+}
+
+TEST(WatchEventCoalescerTest, ApplyAfterWindow) {
+  BatchRecorder recorder;
+  WatchEventCoalescer coalescer(
+      "test_window", /*window_us=*/1000, recorder.apply());
+  coalescer.add({put("P:a", "1")}, 2);
+  for (int32_t i = 0; i < 1000 && recorder.batches().empty(); ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  ASSERT_EQ(1u, recorder.batches().size());
+
+  // a new window starts with the next event
+  coalescer.add({put("P:a", "2")}, 2);
+  coalescer.flush();
+  EXPECT_EQ(std::vector<std::vector<std::string>>({{"+a=1"}, {"+a=2"}}),
+            recorder.batches());
+}
+
+}  // namespace xllm_service::test
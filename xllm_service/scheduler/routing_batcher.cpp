@@ -0,0 +1,81 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "routing_batcher.h"
+
+#include <butil/time.h>
+#include <bvar/bvar.h>
+
+#include <algorithm>
+
+namespace xllm_service {
+
+namespace {
+bvar::IntRecorder g_routing_batch_size("xllm_service_routing_batch_size");
+}  // namespace
+
+RoutingBatcher::RoutingBatcher(int64_t window_us,
+                               int32_t max_batch_size,
+                               RouteFunc route)
+    : window_us_(window_us),
+      max_batch_size_(std::max(max_batch_size, 1)),
+      route_(std::move(route)) {}
+
+void RoutingBatcher::route(BatchedRequest* item) {
+  std::unique_lock<bthread::Mutex> lock(mutex_);
+  const bool leader = current_batch_ == nullptr;
+  if (leader) {
+    current_batch_ = std::make_shared<Batch>();
+    current_batch_->items.reserve(max_batch_size_);
+  }
+  std::shared_ptr<Batch> batch = current_batch_;
+  batch->items.push_back(item);
+
+  if (!leader) {
+    if (batch->items.size() >= max_batch_size_) {
+      // later requests start the next batch, wake up the leader to route the
+      // full one
+      current_batch_.reset();
+      cv_.notify_all();
+    }
+    while (!batch->routed) {
+      cv_.wait(lock);
+    }
+    return;
+  }
+
+  const int64_t deadline_us = butil::monotonic_time_us() + window_us_;
+  while (batch->items.size() < max_batch_size_) {
+    const int64_t now_us = butil::monotonic_time_us();
+    if (now_us >= deadline_us) {
+      break;
+    }
+    cv_.wait_for(lock, deadline_us - now_us);
+  }
+  // later requests start the next batch
+  if (current_batch_ == batch) {
+    current_batch_.reset();
+  }
+  lock.unlock();
+
+  g_routing_batch_size << batch->items.size();
+  route_(batch->items);
+
+  lock.lock();
+  batch->routed = true;
+  cv_.notify_all();
+}
+
+}  // namespace xllm_service
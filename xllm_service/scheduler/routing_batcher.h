@@ -0,0 +1,65 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#include <bthread/condition_variable.h>
+#include <bthread/mutex.h>
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "common/macros.h"
+#include "loadbalance_policy/loadbalance_policy.h"
+
+namespace xllm_service {
+
+// Collects the requests arriving within a short window and routes them as
+// one batch, so that a burst is spread by a joint decision instead of piling
+// onto the instance which looks best to every single request. The first
+// request of a batch waits for the window and routes the whole batch, the
+// others wait for it. The callers tokenize and match their prompts before
+// joining, so that work runs in parallel.
+class RoutingBatcher final {
+ public:
+  using RouteFunc = std::function<void(const std::vector<BatchedRequest*>&)>;
+
+  RoutingBatcher(int64_t window_us, int32_t max_batch_size, RouteFunc route);
+
+  // join the current batch and wait until it is routed
+  void route(BatchedRequest* item);
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(RoutingBatcher);
+
+  struct Batch {
+    std::vector<BatchedRequest*> items;
+    bool routed = false;
+  };
+
+ private:
+  const int64_t window_us_;
+  const size_t max_batch_size_;
+  const RouteFunc route_;
+
+  bthread::Mutex mutex_;
+  bthread::ConditionVariable cv_;
+  // the batch collecting requests, null until the next request arrives
+  std::shared_ptr<Batch> current_batch_;
+};
+
+}  // namespace xllm_service
@@ -0,0 +1,101 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "routing_batcher.h"
+
+#include <butil/time.h>
+#include <gtest/gtest.h>
+
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace xllm_service::test {
+
+namespace {
+// records the size of every routed batch and selects all its requests
+struct BatchRecorder {
+  void operator()(const std::vector<BatchedRequest*>& batch) {
+    std::lock_guard<std::mutex> lock(mutex);
+    batch_sizes.push_back(batch.size());
+    for (auto* item : batch) {
+      item->selected = true;
+    }
+  }
+
+  std::mutex mutex;
+  std::vector<size_t> batch_sizes;
+};
+
+void route_concurrently(RoutingBatcher* batcher,
+                        std::vector<BatchedRequest>* items) {
+  std::vector<std::thread> threads;
+  for (auto& item : *items) {
+    threads.emplace_back([batcher, &item]() { batcher->route(&item); });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+}  // namespace
+
+TEST(RoutingBatcherTest, RouteAloneAfterWindow) {
+  constexpr int64_t kWindowUs = 20000;
+  BatchRecorder recorder;
+  RoutingBatcher batcher(
+      kWindowUs, 4, [&](const auto& batch) { recorder(batch); });
+
+  BatchedRequest item;
+  const int64_t start_us = butil::monotonic_time_us();
+  batcher.route(&item);
+  EXPECT_GE(butil::monotonic_time_us() - start_us, kWindowUs);
+  EXPECT_TRUE(item.selected);
+  EXPECT_EQ(std::vector<size_t>({1}), recorder.batch_sizes);
+}
+
+TEST(RoutingBatcherTest, RouteFullBatchBeforeWindow) {
+  // long enough to never expire during the test
+  constexpr int64_t kWindowUs = 60 * 1000 * 1000;
+  BatchRecorder recorder;
+  RoutingBatcher batcher(
+      kWindowUs, 4, [&](const auto& batch) { recorder(batch); });
+
+  std::vector<BatchedRequest> items(4);
+  route_concurrently(&batcher, &items);
+  EXPECT_EQ(std::vector<size_t>({4}), recorder.batch_sizes);
+  for (const auto& item : items) {
+    EXPECT_TRUE(item.selected);
+  }
+}
+
+TEST(RoutingBatcherTest, SplitBurstIntoBatches) {
+  BatchRecorder recorder;
+  RoutingBatcher batcher(
+      /*window_us=*/5000, 4, [&](const auto& batch) { recorder(batch); });
+
+  std::vector<BatchedRequest> items(10);
+  route_concurrently(&batcher, &items);
+  size_t num_routed = 0;
+  for (size_t batch_size : recorder.batch_sizes) {
+    EXPECT_LE(batch_size, 4);
+    num_routed += batch_size;
+  }
+  EXPECT_EQ(items.size(), num_routed);
+  for (const auto& item : items) {
+    EXPECT_TRUE(item.selected);
+  }
+}
+
+}  // namespace xllm_service::test
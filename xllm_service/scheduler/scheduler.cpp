@@ -15,16 +15,88 @@ limitations under the License.
 
 #include "scheduler/scheduler.h"
 
+#include <brpc/controller.h>
+#include <butil/time.h>
+#include <bvar/bvar.h>
+
+#include <algorithm>
+#include <nlohmann/json.hpp>
+#include <unordered_set>
+
+#include "common/global_gflags.h"
 #include "common/xllm/status.h"
-#include "loadbalance_policy/cache_aware_routing.h"
-#include "loadbalance_policy/round_robin.h"
-#include "loadbalance_policy/slo_aware_policy.h"
+#include "etcd_client/etcd_client.h"
+#include "loadbalance_policy/policy_registry.h"
+#include "metadata_store/file_store.h"
+#include "metadata_store/memory_store.h"
 #include "tokenizer/tokenizer_factory.h"
 
 namespace {
 constexpr int32_t kHeartbeatInterval = 3;  // in seconds
 
+// The tpot predictors are refitted with the mean of this many inter-token
+// latencies of a request instead of with every token.
+constexpr int32_t kTbtSamplesPerRefit = 16;
+
 std::string ETCD_MASTER_SERVICE_KEY = "XLLM:SERVICE:MASTER";
+
+bvar::Adder<int64_t> g_cancelled_requests("xllm_service_cancelled_requests");
+// Estimated instance time saved by cancelling requests whose client has gone
+// away, in milliseconds.
+bvar::Adder<int64_t> g_cancel_saved_time_ms(
+    "xllm_service_cancel_saved_time_ms");
+
+// Size of the instance heartbeats in bytes and the time to apply their kv
+// cache events to the global index in microseconds.
+bvar::IntRecorder g_heartbeat_bytes("xllm_service_heartbeat_bytes");
+bvar::LatencyRecorder g_kvcache_event_apply_latency(
+    "xllm_service_kvcache_event_apply");
+
+bvar::Adder<int64_t> g_disconnected_instances(
+    "xllm_service_disconnected_instances");
+
+// Time of the etcd uploads done by the master on every heartbeat, in
+// microseconds.
+bvar::LatencyRecorder g_kvcache_upload_latency("xllm_service_kvcache_upload");
+bvar::LatencyRecorder g_load_metrics_upload_latency(
+    "xllm_service_load_metrics_upload");
+bvar::Adder<int64_t> g_etcd_upload_failures(
+    "xllm_service_etcd_upload_failures");
+
+// Time from receiving a token from an instance to handing it to the client
+// connection, including the wait for the output thread of the request, in
+// microseconds.
+bvar::LatencyRecorder g_token_delivery_latency("xllm_service_token_delivery");
+
+void handle_cancel_response(brpc::Controller* cntl,
+                            std::string instance_name,
+                            std::string service_request_id) {
+  std::unique_ptr<brpc::Controller> cntl_guard(cntl);
+  if (cntl->Failed()) {
+    LOG_EVERY_N(WARNING, 100)
+        << "Fail to cancel request " << service_request_id << " on "
+        << instance_name << ", " << cntl->ErrorText();
+  }
+}
+
+std::shared_ptr<xllm_service::MetadataStore> create_metadata_store(
+    const xllm_service::Options& options) {
+  if (options.metadata_store() == "memory") {
+    LOG(INFO) << "Keep the metadata in memory, only one master can run.";
+    return std::make_shared<xllm_service::MemoryStore>();
+  }
+  if (options.metadata_store() == "file") {
+    LOG(INFO) << "Keep the metadata in " << options.metadata_store_path()
+              << ", only one master can run.";
+    return std::make_shared<xllm_service::FileStore>(
+        options.metadata_store_path());
+  }
+  LOG_IF(ERROR, options.metadata_store() != "etcd")
+      << "Unknown metadata store " << options.metadata_store()
+      << ", use etcd instead.";
+  return std::make_shared<xllm_service::EtcdClient>(
+      options.etcd_addr(), FLAGS_etcd_max_inflight_txns);
+}
 }  // namespace
 
 namespace xllm_service {
@@ -34,75 +106,186 @@ Scheduler::Scheduler(const Options& options) : options_(options) {
                                                   &tokenizer_args_);
   chat_template_ = std::make_unique<JinjaChatTemplate>(tokenizer_args_);
 
-  etcd_client_ = std::make_shared<EtcdClient>(options_.etcd_addr());
-  if (!etcd_client_->get(ETCD_MASTER_SERVICE_KEY, nullptr)) {
-    is_master_service_ = etcd_client_->set(
+  metadata_store_ = create_metadata_store(options_);
+  if (!metadata_store_->get(ETCD_MASTER_SERVICE_KEY, nullptr)) {
+    is_master_service_ = metadata_store_->create_with_lease(
         ETCD_MASTER_SERVICE_KEY, options_.service_name(), kHeartbeatInterval);
     LOG(INFO) << "Set current service as master!";
   }
 
-  instance_mgr_ =
-      std::make_unique<InstanceMgr>(options, etcd_client_, is_master_service_);
-
   global_kvcache_mgr_ = std::make_shared<GlobalKVCacheMgr>(
-      options, etcd_client_, is_master_service_);
+      options, metadata_store_, is_master_service_);
+
+  instance_mgr_ = std::make_unique<InstanceMgr>(
+      options, metadata_store_, is_master_service_, global_kvcache_mgr_);
+
+  const PolicyContext policy_context{
+      options, instance_mgr_, global_kvcache_mgr_};
+  lb_policy_ = PolicyRegistry::instance().create(options.load_balance_policy(),
+                                                 policy_context);
+  if (lb_policy_ == nullptr) {
+    LOG(ERROR) << "Unknown load balance policy "
+               << options.load_balance_policy() << ", use RR instead.";
+    lb_policy_ = PolicyRegistry::instance().create("RR", policy_context);
+  }
+  if (lb_policy_->balances_roles() && FLAGS_role_balance_interval_ms > 0) {
+    role_balance_thread_ = std::make_unique<std::thread>(
+        &Scheduler::rebalance_instance_roles, this);
+  }
 
-  if (options.load_balance_policy() == "CAR") {
-    lb_policy_ =
-        std::make_unique<CacheAwareRouting>(instance_mgr_, global_kvcache_mgr_);
-  } else if (options.load_balance_policy() == "SLO_AWARE") {
-    lb_policy_ = std::make_unique<SloAwarePolicy>(options, instance_mgr_);
-  } else {
-    lb_policy_ = std::make_unique<RoundRobin>(instance_mgr_);
+  if (FLAGS_instance_cancel_uri.empty()) {
+    LOG(INFO) << "--instance_cancel_uri is not set, requests whose client has "
+                 "gone away are not cancelled on the instances.";
+  }
+
+  AdmissionQueueOptions admission_options;
+  admission_options.max_depth = FLAGS_admission_queue_size;
+  admission_queue_ = std::make_unique<AdmissionQueue>(
+      admission_options, [this]() { return instance_mgr_->has_capacity(); });
+
+  if (FLAGS_routing_batch_window_us > 0) {
+    routing_batcher_ = std::make_unique<RoutingBatcher>(
+        FLAGS_routing_batch_window_us,
+        FLAGS_routing_max_batch_size,
+        [this](const std::vector<BatchedRequest*>& batch) {
+          lb_policy_->select_instances_pairs(batch);
+        });
   }
 
   if (is_master_service_) {
     heartbeat_thread_ = std::make_unique<std::thread>(
         &Scheduler::update_master_service_heartbeat, this);
+    detect_thread_ = std::make_unique<std::thread>(
+        &Scheduler::detect_disconnected_instances, this);
   } else {
     auto handle_master = std::bind(&Scheduler::handle_master_service_watch,
                                    this,
                                    std::placeholders::_1,
                                    std::placeholders::_2);
-    etcd_client_->add_watch(ETCD_MASTER_SERVICE_KEY, handle_master);
+    metadata_store_->add_watch(ETCD_MASTER_SERVICE_KEY, handle_master);
   }
 }
 
-Scheduler::~Scheduler() { etcd_client_->stop_watch(); }
+Scheduler::~Scheduler() {
+  exited_ = true;
+  metadata_store_->stop_watch();
+  if (heartbeat_thread_ && heartbeat_thread_->joinable()) {
+    heartbeat_thread_->join();
+  }
+  if (detect_thread_ && detect_thread_->joinable()) {
+    detect_thread_->join();
+  }
+  if (role_balance_thread_ && role_balance_thread_->joinable()) {
+    role_balance_thread_->join();
+  }
+}
 
-bool Scheduler::schedule(std::shared_ptr<Request> request) {
+llm::Status Scheduler::schedule(std::shared_ptr<Request> request) {
   // apply chat template
   if (request->messages.size() > 0) {
     if (chat_template_ == nullptr) {
       LOG(ERROR) << "Chat template has not configured.";
-      return false;
+      return llm::Status(llm::StatusCode::UNKNOWN,
+                         "Chat template has not configured.");
     }
 
     auto prompt = chat_template_->apply(request->messages);
     if (!prompt.has_value()) {
       LOG(ERROR) << "Failed to construct prompt from messages";
-      return false;
+      return llm::Status(llm::StatusCode::INVALID_ARGUMENT,
+                         "Failed to construct prompt from messages.");
     }
     request->prompt = prompt.value();
+    request->stages.end(RequestStage::CHAT_TEMPLATE);
   }
 
   // encode prompt
   if (request->prompt.size() != 0) {
     if (!get_tls_tokenizer()->encode(request->prompt, &request->token_ids)) {
       LOG(ERROR) << "Encode prompt failed: " << request->prompt;
-      return false;
+      return llm::Status(llm::StatusCode::INVALID_ARGUMENT,
+                         "Encode prompt failed.");
+    }
+    request->stages.end(RequestStage::TOKENIZE);
+  }
+
+  // wait for capacity instead of routing to saturated instances
+  bool queued = false;
+  if (request->prompt.size() != 0 && admission_queue_->enabled()) {
+    auto status = admission_queue_->admit(
+        request->priority,
+        request->arrival_time_us + FLAGS_admission_timeout_ms * 1000L,
+        &queued);
+    if (!status.ok()) {
+      return status;
     }
+    request->stages.end(RequestStage::ADMISSION);
   }
 
-  auto ret = lb_policy_->select_instances_pair(request);
+  request->schedule_time_us = butil::monotonic_time_us();
+  bool ret = false;
+  // requests released from the admission queue come one at a time, they are
+  // not held back for a batch
+  if (routing_batcher_ != nullptr && request->prompt.size() != 0 &&
+      !queued) {
+    BatchedRequest item;
+    item.request = request;
+    // match the prefix before joining the batch, in parallel with the other
+    // requests of the batch
+    if (lb_policy_->use_overlap_scores() && !request->token_ids.empty()) {
+      Slice<int32_t> token_ids(request->token_ids.data(),
+                               request->token_ids.size());
+      global_kvcache_mgr_->match(token_ids, &item.overlap_scores);
+      request->stages.end(RequestStage::PREFIX_MATCH);
+    }
+    routing_batcher_->route(&item);
+    ret = item.selected;
+    if (lb_policy_->use_overlap_scores() && !request->token_ids.empty()) {
+      request->overlap_scores = std::move(item.overlap_scores);
+      request->prefix_matched = true;
+    }
+  } else {
+    ret = lb_policy_->select_instances_pair(request);
+  }
+  if (ret) {
+    select_dp_ranks(request);
+    request->stages.end(RequestStage::ROUTING);
+  }
+  // the prefix match is not needed once the request is routed
+  request->overlap_scores = OverlapScores();
+  request->prefix_matched = false;
   DLOG(INFO) << request->routing.debug_string();
 
   // update request metrics
   if (request->prompt.size() != 0) {
     instance_mgr_->update_request_metrics(request, RequestAction::SCHEDULE);
   }
+  if (queued) {
+    // the next request is released with the load of this one
+    admission_queue_->dispatched();
+  }
 
-  return ret;
+  if (!ret) {
+    return llm::Status(llm::StatusCode::UNAVAILABLE,
+                       "Schedule request failed!");
+  }
+  return llm::Status();
+}
+
+void Scheduler::select_dp_ranks(std::shared_ptr<Request> request) {
+  if (instance_mgr_->get_dp_size(request->routing.prefill_name) <= 1 &&
+      instance_mgr_->get_dp_size(request->routing.decode_name) <= 1) {
+    return;
+  }
+
+  // reuse the prefix match of the policy
+  if (!request->prefix_matched && !request->token_ids.empty()) {
+    Slice<int32_t> token_ids(request->token_ids.data(),
+                             request->token_ids.size());
+    global_kvcache_mgr_->match(token_ids, &request->overlap_scores);
+    request->prefix_matched = true;
+  }
+  instance_mgr_->select_dp_ranks(request->overlap_scores, &request->routing);
 }
 
 std::shared_ptr<brpc::Channel> Scheduler::get_channel(
@@ -114,37 +297,172 @@ void Scheduler::update_master_service_heartbeat() {
   while (!exited_) {
     std::this_thread::sleep_for(std::chrono::seconds(kHeartbeatInterval));
 
-    global_kvcache_mgr_->upload_kvcache();
+    // the uploads overlap, each one is timed until it is done
+    butil::Timer timer(butil::Timer::STARTED);
+    auto kvcache_upload = global_kvcache_mgr_->upload_kvcache_async();
+    auto load_metrics_upload = instance_mgr_->upload_load_metrics_async();
+    if (!kvcache_upload.get()) {
+      g_etcd_upload_failures << 1;
+    }
+    timer.stop();
+    g_kvcache_upload_latency << timer.u_elapsed();
+
+    if (!load_metrics_upload.get()) {
+      g_etcd_upload_failures << 1;
+    }
+    timer.stop();
+    g_load_metrics_upload_latency << timer.u_elapsed();
+  }
+}
 
-    instance_mgr_->upload_load_metrics();
+ErrorCode Scheduler::register_instance(const InstanceMetaInfo& metainfo) {
+  if (exited_) {
+    return ErrorCode::INTERNAL_ERROR;
   }
+  return instance_mgr_->register_instance(metainfo);
 }
 
-void Scheduler::handle_instance_heartbeat(const proto::HeartbeatRequest* req) {
+bool Scheduler::handle_instance_heartbeat(const proto::HeartbeatRequest* req) {
   if (exited_) {
+    return true;
+  }
+  if (!instance_mgr_->record_heartbeat(req->name())) {
+    // the events of an unknown instance would bring back the cache locations
+    // of an evicted instance.
+    LOG_EVERY_N(WARNING, 100)
+        << "Receive heartbeat from unregistered instance " << req->name();
+    return false;
+  }
+  g_heartbeat_bytes << req->ByteSizeLong();
+  if (req->has_cache_event() || req->dp_cache_events_size() > 0) {
+    butil::Timer timer(butil::Timer::STARTED);
+    if (req->has_cache_event()) {
+      global_kvcache_mgr_->record_updated_kvcaches(req->name(),
+                                                   req->cache_event());
+    }
+    for (const auto& cache_event : req->dp_cache_events()) {
+      global_kvcache_mgr_->record_updated_kvcaches(req->name(), cache_event);
+    }
+    timer.stop();
+    g_kvcache_event_apply_latency << timer.u_elapsed();
+  }
+  // metrics are only reported when they change
+  if (req->has_load_metrics()) {
+    instance_mgr_->record_load_metrics_update(req->name(), req->load_metrics());
+  }
+  if (req->has_latency_metrics()) {
+    instance_mgr_->update_latency_metrics(req->name(), req->latency_metrics());
+  }
+  return true;
+}
+
+void Scheduler::detect_disconnected_instances() {
+  if (options_.detect_disconnected_instance_interval() <= 0) {
     return;
   }
-  global_kvcache_mgr_->record_updated_kvcaches(req->name(), req->cache_event());
-  instance_mgr_->record_load_metrics_update(req->name(), req->load_metrics());
-  instance_mgr_->update_latency_metrics(req->name(), req->latency_metrics());
+  const uint64_t timeout_ms =
+      options_.detect_disconnected_instance_interval() * 1000;
+  // check a few times per interval, an instance is removed at most
+  // `timeout_ms + check_interval_ms` after its last heartbeat.
+  const uint64_t check_interval_ms = std::max<uint64_t>(timeout_ms / 4, 1);
+  while (!exited_) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(check_interval_ms));
+    if (exited_) {
+      break;
+    }
+
+    auto instance_names = instance_mgr_->remove_disconnected_instances(
+        timeout_ms);
+    if (instance_names.empty()) {
+      continue;
+    }
+    g_disconnected_instances << instance_names.size();
+    global_kvcache_mgr_->remove_instance_caches(instance_names);
+    fail_requests_on_instances(instance_names);
+  }
+}
+
+void Scheduler::rebalance_instance_roles() {
+  while (!exited_) {
+    std::this_thread::sleep_for(
+        std::chrono::milliseconds(FLAGS_role_balance_interval_ms));
+    if (exited_) {
+      break;
+    }
+    instance_mgr_->rebalance_roles();
+  }
+}
+
+void Scheduler::fail_requests_on_instances(
+    const std::vector<std::string>& instance_names) {
+  std::unordered_set<std::string> names(instance_names.begin(),
+                                        instance_names.end());
+  std::vector<std::pair<std::string, OutputCallback>> failed_requests;
+  {
+    std::lock_guard<std::mutex> guard(request_mutex_);
+    for (const auto& [service_request_id, request] : requests_) {
+      // responses may be forwarded by the prefill instance, so the request
+      // is lost if either of them is gone.
+      if (names.count(request->routing.prefill_name) != 0 ||
+          names.count(request->routing.decode_name) != 0) {
+        failed_requests.emplace_back(service_request_id,
+                                     request->output_callback);
+      }
+    }
+  }
+
+  for (auto& [service_request_id, cb] : failed_requests) {
+    size_t req_thread_idx = -1;
+    {
+      std::lock_guard<std::mutex> guard(thread_map_mutex_);
+      auto it = remote_requests_output_thread_map_.find(service_request_id);
+      if (it == remote_requests_output_thread_map_.end()) {
+        continue;
+      }
+      req_thread_idx = it->second;
+    }
+
+    // run on the output thread of the request, after the outputs received
+    // before the instance was removed.
+    output_threadpools_[req_thread_idx].schedule(
+        [this, service_request_id = service_request_id, cb = std::move(cb)]() {
+          llm::RequestOutput output(llm::Status(
+              llm::StatusCode::UNAVAILABLE, "Instance is disconnected."));
+          output.service_request_id = service_request_id;
+          output.finished = true;
+          cb(output);
+          finish_request(service_request_id, /*error=*/true);
+        });
+  }
+  LOG_IF(WARNING, !failed_requests.empty())
+      << "Fail " << failed_requests.size()
+      << " requests on disconnected instances.";
 }
 
-void Scheduler::handle_master_service_watch(const etcd::Response& response,
+void Scheduler::handle_master_service_watch(const WatchEvents& events,
                                             const uint64_t& prefix_len) {
-  if (exited_ || response.events().empty()) {
+  if (exited_ || events.empty() || is_master_service_) {
     return;
   }
 
-  if (etcd_client_->set(ETCD_MASTER_SERVICE_KEY,
-                        options_.service_name(),
-                        kHeartbeatInterval)) {
+  if (metadata_store_->create_with_lease(ETCD_MASTER_SERVICE_KEY,
+                                        options_.service_name(),
+                                        kHeartbeatInterval)) {
     is_master_service_ = true;
 
-    heartbeat_thread_ = std::make_unique<std::thread>(
-        &Scheduler::update_master_service_heartbeat, this);
+    // replacing a running thread would terminate the process, keep it
+    if (!heartbeat_thread_ || !heartbeat_thread_->joinable()) {
+      heartbeat_thread_ = std::make_unique<std::thread>(
+          &Scheduler::update_master_service_heartbeat, this);
+    }
 
     global_kvcache_mgr_->set_as_master();
     instance_mgr_->set_as_master();
+
+    if (!detect_thread_ || !detect_thread_->joinable()) {
+      detect_thread_ = std::make_unique<std::thread>(
+          &Scheduler::detect_disconnected_instances, this);
+    }
   }
 }
 
@@ -267,32 +585,111 @@ bool Scheduler::record_new_request(
 
 void Scheduler::finish_request(const std::string& service_request_id,
                                bool error) {
+  // The request is released out of the lock, releasing its call data may run
+  // the client cancel callback which takes `request_mutex_` again.
+  std::shared_ptr<Request> request;
+  int64_t mean_tbt_us = -1;
   {
     std::lock_guard<std::mutex> guard(request_mutex_);
     auto it = requests_.find(service_request_id);
     if (it != requests_.end()) {
+      request = std::move(it->second);
+      requests_.erase(it);
       // update instance request metrics for finished request
       if (error) {
-        instance_mgr_->update_request_metrics(it->second,
-                                              RequestAction::CANCEL);
+        instance_mgr_->update_request_metrics(request, RequestAction::CANCEL);
       } else {
-        instance_mgr_->update_request_metrics(it->second,
+        instance_mgr_->update_request_metrics(request,
                                               RequestAction::FINISH_DECODE);
+        if (request->num_pending_tbt > 0) {
+          mean_tbt_us = request->pending_tbt_us / request->num_pending_tbt;
+        }
       }
+    }
+  }
+  if (request != nullptr) {
+    admission_queue_->notify();
+  }
+  // refit with the rest of the inter-token latencies
+  if (mean_tbt_us >= 0) {
+    instance_mgr_->observe_tpot(request, mean_tbt_us / 1000);
+  }
+  if (request != nullptr && !error && request->arrival_time_us > 0) {
+    instance_mgr_->latency_stats().record_e2e(
+        request->routing.decode_name,
+        butil::monotonic_time_us() - request->arrival_time_us);
+  }
 
-      requests_.erase(it);
+  {
+    std::lock_guard<std::mutex> guard(thread_map_mutex_);
+    remote_requests_output_thread_map_.erase(service_request_id);
+  }
+}
+
+void Scheduler::cancel_request(const std::string& service_request_id) {
+  std::shared_ptr<Request> request;
+  {
+    std::lock_guard<std::mutex> guard(request_mutex_);
+    auto it = requests_.find(service_request_id);
+    if (it == requests_.end()) {
+      // the request has already finished
+      return;
     }
+    request = std::move(it->second);
+    requests_.erase(it);
+    request->cancelled = true;
+    instance_mgr_->update_request_metrics(request, RequestAction::CANCEL);
   }
+  admission_queue_->notify();
 
   {
     std::lock_guard<std::mutex> guard(thread_map_mutex_);
     remote_requests_output_thread_map_.erase(service_request_id);
   }
+
+  g_cancelled_requests << 1;
+  g_cancel_saved_time_ms << instance_mgr_->estimate_remaining_time(request);
+  LOG(INFO) << "Client has gone away, cancel request: " << service_request_id;
+
+  if (FLAGS_instance_cancel_uri.empty()) {
+    return;
+  }
+  send_cancel_to_instance(request->routing.prefill_name, service_request_id);
+  if (request->routing.decode_name != request->routing.prefill_name) {
+    send_cancel_to_instance(request->routing.decode_name, service_request_id);
+  }
+}
+
+void Scheduler::send_cancel_to_instance(const std::string& instance_name,
+                                        const std::string& service_request_id) {
+  if (instance_name.empty()) {
+    return;
+  }
+  auto channel = instance_mgr_->get_channel(instance_name);
+  if (channel == nullptr) {
+    return;
+  }
+
+  nlohmann::json body;
+  body["service_request_id"] = service_request_id;
+
+  brpc::Controller* cntl = new brpc::Controller();
+  cntl->http_request().uri() = instance_name + FLAGS_instance_cancel_uri;
+  cntl->http_request().set_method(brpc::HTTP_METHOD_POST);
+  cntl->request_attachment().append(body.dump());
+
+  google::protobuf::Closure* done = brpc::NewCallback(
+      &handle_cancel_response, cntl, instance_name, service_request_id);
+  channel->CallMethod(NULL, cntl, NULL, NULL, done);
 }
 
 bool Scheduler::handle_generation(const llm::RequestOutput& request_output) {
+  const int64_t receive_ns = butil::cpuwide_time_ns();
   const std::string& service_request_id = request_output.service_request_id;
   OutputCallback cb;
+  std::shared_ptr<Request> request;
+  int64_t tbt_us = -1;
+  int64_t mean_tbt_us = -1;
   {
     std::lock_guard<std::mutex> guard(request_mutex_);
     auto it = requests_.find(service_request_id);
@@ -307,6 +704,26 @@ bool Scheduler::handle_generation(const llm::RequestOutput& request_output) {
     // update instance request metrics
     it->second->num_generated_tokens += 1;
     instance_mgr_->update_request_metrics(it->second, RequestAction::GENERATE);
+
+    request = it->second;
+    int64_t now_us = butil::monotonic_time_us();
+    if (request->last_token_time_us > 0) {
+      tbt_us = now_us - request->last_token_time_us;
+      request->pending_tbt_us += tbt_us;
+      if (++request->num_pending_tbt >= kTbtSamplesPerRefit) {
+        mean_tbt_us = request->pending_tbt_us / request->num_pending_tbt;
+        request->pending_tbt_us = 0;
+        request->num_pending_tbt = 0;
+      }
+    }
+    request->last_token_time_us = now_us;
+  }
+  if (tbt_us >= 0) {
+    instance_mgr_->latency_stats().record_tbt(request->routing.decode_name,
+                                              tbt_us);
+  }
+  if (mean_tbt_us >= 0) {
+    instance_mgr_->observe_tpot(request, mean_tbt_us / 1000);
   }
 
   size_t req_thread_idx = -1;
@@ -326,8 +743,12 @@ bool Scheduler::handle_generation(const llm::RequestOutput& request_output) {
       [this,
        service_request_id,
        cb,
-       request_output = std::move(request_output)]() mutable {
-        if (!cb(request_output) || request_output.finished) {
+       request_output = std::move(request_output),
+       receive_ns]() mutable {
+        const bool ok = cb(request_output);
+        g_token_delivery_latency
+            << (butil::cpuwide_time_ns() - receive_ns) / 1000;
+        if (!ok || request_output.finished) {
           finish_request(service_request_id);
         }
       });
@@ -337,14 +758,38 @@ bool Scheduler::handle_generation(const llm::RequestOutput& request_output) {
 
 void Scheduler::update_request_metrics_for_prefill(
     const std::string& service_request_id) {
-  std::lock_guard<std::mutex> guard(request_mutex_);
-  auto it = requests_.find(service_request_id);
-  if (it != requests_.end()) {
-    it->second->num_generated_tokens += 1;
+  std::shared_ptr<Request> request;
+  {
+    std::lock_guard<std::mutex> guard(request_mutex_);
+    auto it = requests_.find(service_request_id);
+    if (it == requests_.end()) {
+      return;
+    }
+    request = it->second;
+    request->num_generated_tokens += 1;
+    request->prefill_finished = true;
+    request->last_token_time_us = butil::monotonic_time_us();
     // update instance request metrics for prefill finished request
-    instance_mgr_->update_request_metrics(it->second,
+    instance_mgr_->update_request_metrics(request,
                                           RequestAction::FINISH_PREFILL);
   }
+  admission_queue_->notify();
+  if (request->schedule_time_us > 0) {
+    instance_mgr_->observe_ttft(
+        request,
+        (request->last_token_time_us - request->schedule_time_us) / 1000);
+  }
+  if (request->arrival_time_us > 0) {
+    auto& latency_stats = instance_mgr_->latency_stats();
+    latency_stats.record_ttft(
+        request->routing.prefill_name,
+        request->last_token_time_us - request->arrival_time_us);
+    if (request->forward_time_us > 0) {
+      latency_stats.record_queueing(
+          request->routing.prefill_name,
+          request->forward_time_us - request->arrival_time_us);
+    }
+  }
 }
 
 }  // namespace xllm_service
\ No newline at end of file
@@ -15,17 +15,20 @@ limitations under the License.
 
 #pragma once
 
+#include "admission_queue.h"
 #include "chat_template/jinja_chat_template.h"
 #include "common/call_data.h"
 #include "common/options.h"
 #include "common/threadpool.h"
 #include "common/xllm/output.h"
-#include "etcd_client/etcd_client.h"
+#include "common/xllm/status.h"
 #include "loadbalance_policy/loadbalance_policy.h"
 #include "managers/global_kvcache_mgr.h"
 #include "managers/instance_mgr.h"
+#include "metadata_store/metadata_store.h"
 #include "request/request.h"
 #include "response_handler.h"
+#include "routing_batcher.h"
 #include "tokenizer/tokenizer.h"
 #include "tokenizer/tokenizer_args.h"
 
@@ -37,7 +40,9 @@ class Scheduler final {
   Scheduler(const Options& options);
   ~Scheduler();
 
-  bool schedule(std::shared_ptr<Request> request);
+  // select the instances for the request, waiting in the admission queue
+  // while all instances are saturated.
+  llm::Status schedule(std::shared_ptr<Request> request);
 
   std::shared_ptr<brpc::Channel> get_channel(const std::string& target_name);
 
@@ -49,7 +54,11 @@ class Scheduler final {
   std::vector<std::string> get_static_prefill_list(
       const std::string& instance_name);
 
-  void handle_instance_heartbeat(const proto::HeartbeatRequest* req);
+  // register instance from rpc, instances can join without etcd
+  ErrorCode register_instance(const InstanceMetaInfo& metainfo);
+
+  // return false if the instance is not registered, it has to register again
+  bool handle_instance_heartbeat(const proto::HeartbeatRequest* req);
 
   void exited() { exited_ = true; }
 
@@ -63,6 +72,10 @@ class Scheduler final {
   void finish_request(const std::string& service_request_id,
                       bool error = false);
 
+  // called when the client of the request has gone away, release the request
+  // and ask the routed instances to stop generating for it.
+  void cancel_request(const std::string& service_request_id);
+
   // handle generations from prefill/decode instance
   bool handle_generation(const llm::RequestOutput& request_output);
 
@@ -75,11 +88,28 @@ class Scheduler final {
 
   void update_master_service_heartbeat();
 
-  void handle_master_service_watch(const etcd::Response& response,
+  // choose the data parallel ranks of the selected instances by prefix hits
+  // and per-rank load
+  void select_dp_ranks(std::shared_ptr<Request> request);
+
+  // remove the instances which stop sending heartbeats together with their
+  // cache locations, and fail the requests routed to them.
+  void detect_disconnected_instances();
+
+  void fail_requests_on_instances(
+      const std::vector<std::string>& instance_names);
+
+  // periodically move MIX instances between the prefill and decode roles
+  void rebalance_instance_roles();
+
+  void handle_master_service_watch(const WatchEvents& events,
                                    const uint64_t& prefix_len);
 
   Tokenizer* get_tls_tokenizer();
 
+  void send_cancel_to_instance(const std::string& instance_name,
+                               const std::string& service_request_id);
+
  private:
   Options options_;
 
@@ -92,7 +122,7 @@ class Scheduler final {
   // chat template instance
   std::unique_ptr<JinjaChatTemplate> chat_template_;
 
-  std::shared_ptr<EtcdClient> etcd_client_;
+  std::shared_ptr<MetadataStore> metadata_store_;
 
   std::unique_ptr<Tokenizer> tokenizer_;
 
@@ -102,8 +132,17 @@ class Scheduler final {
 
   std::unique_ptr<LoadBalancePolicy> lb_policy_;
 
+  std::unique_ptr<AdmissionQueue> admission_queue_;
+
+  // null if requests are routed one by one
+  std::unique_ptr<RoutingBatcher> routing_batcher_;
+
   std::unique_ptr<std::thread> heartbeat_thread_;
 
+  std::unique_ptr<std::thread> detect_thread_;
+
+  std::unique_ptr<std::thread> role_balance_thread_;
+
   // `service request id` -> `request` map
   std::unordered_map<std::string, std::shared_ptr<Request>> requests_;
   std::mutex request_mutex_;
@@ -0,0 +1,407 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "cluster_simulator.h"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <chrono>
+#include <queue>
+#include <tuple>
+#include <unordered_map>
+
+#include "loadbalance_policy/policy_registry.h"
+#include "scheduler/metadata_store/memory_store.h"
+#include "simulated_instance.h"
+
+namespace xllm_service {
+
+namespace {
+// the simulated instances get local addresses, so that the instance manager
+// can create channels to them
+constexpr int32_t kBasePort = 40000;
+
+enum class EventType : int8_t {
+  HEARTBEAT = 0,
+  ARRIVAL = 1,
+  PREFILL_DONE = 2,
+  DECODE_STEP_DONE = 3,
+};
+
+struct Event {
+  int64_t time_us;
+  // events of the same time are handled in the order they are pushed
+  uint64_t seq;
+  EventType type;
+  // the trace request of an arrival, the instance otherwise
+  size_t index;
+};
+
+struct LaterEvent {
+  bool operator()(const Event& a, const Event& b) const {
+    return std::tie(a.time_us, a.seq) > std::tie(b.time_us, b.seq);
+  }
+};
+
+LatencySummary summarize(std::vector<double>* latencies) {
+  LatencySummary summary;
+  if (latencies->empty()) {
+    return summary;
+  }
+  std::sort(latencies->begin(), latencies->end());
+  auto percentile = [&](double ratio) {
+    return (*latencies)[std::min(latencies->size() - 1,
+                                 size_t(ratio * latencies->size()))];
+  };
+  double sum = 0;
+  for (double latency : *latencies) {
+    sum += latency;
+  }
+  summary.mean = sum / latencies->size();
+  summary.p50 = percentile(0.5);
+  summary.p90 = percentile(0.9);
+  summary.p99 = percentile(0.99);
+  return summary;
+}
+
+// The state of one replay.
+class Simulation final {
+ public:
+  Simulation(const ClusterSimulatorOptions& options,
+             const std::vector<TraceRequest>& trace,
+             InstanceMgr* instance_mgr,
+             GlobalKVCacheMgr* kvcache_mgr)
+      : options_(options),
+        trace_(trace),
+        instance_mgr_(instance_mgr),
+        kvcache_mgr_(kvcache_mgr),
+        requests_(trace.size()) {
+    const int32_t num_instances =
+        options.num_prefill_instances + options.num_decode_instances;
+    const int32_t num_slow_instances =
+        static_cast<int32_t>(options.slow_fraction * num_instances);
+    for (int32_t i = 0; i < num_instances; ++i) {
+      SimulatedInstanceOptions instance_options;
+      instance_options.name = "127.0.0.1:" + std::to_string(kBasePort + i);
+      instance_options.type = i < options.num_prefill_instances
+                                  ? InstanceType::PREFILL
+                                  : InstanceType::DECODE;
+      instance_options.block_size = options.options.block_size();
+      instance_options.num_cache_blocks = options.num_cache_blocks;
+      instance_options.max_prefill_tokens = options.max_prefill_tokens;
+      instance_options.max_decode_batch_size = options.max_decode_batch_size;
+      // spread the slow instances evenly over both roles
+      if ((i + 1) * num_slow_instances / num_instances >
+          i * num_slow_instances / num_instances) {
+        instance_options.slowdown = options.slowdown;
+      }
+      instance_index_.emplace(instance_options.name, instances_.size());
+      instances_.emplace_back(
+          std::make_unique<SimulatedInstance>(instance_options,
+                                              options.ttft_profiling_data,
+                                              options.tpot_profiling_data));
+    }
+  }
+
+  bool register_instances() {
+    for (const auto& instance : instances_) {
+      InstanceMetaInfo metainfo(
+          instance->name(), instance->name(), instance->type());
+      metainfo.ttft_profiling_data = options_.ttft_profiling_data;
+      metainfo.tpot_profiling_data = options_.tpot_profiling_data;
+      if (instance_mgr_->register_instance(metainfo) != ErrorCode::OK) {
+        LOG(ERROR) << "Failed to register simulated instance "
+                   << instance->name();
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void run(LoadBalancePolicy* policy, SimulationReport* report) {
+    policy_ = policy;
+    // report the idle instances before the first request arrives
+    push(0, EventType::HEARTBEAT, 0);
+    for (size_t i = 0; i < trace_.size(); ++i) {
+      push(trace_[i].arrival_time_us, EventType::ARRIVAL, i);
+    }
+    num_unfinished_ = trace_.size();
+
+    int64_t now_us = 0;
+    while (!events_.empty()) {
+      const Event event = events_.top();
+      events_.pop();
+      now_us = event.time_us;
+      switch (event.type) {
+        case EventType::HEARTBEAT:
+          handle_heartbeat(now_us);
+          break;
+        case EventType::ARRIVAL:
+          handle_arrival(now_us, event.index);
+          break;
+        case EventType::PREFILL_DONE:
+          handle_prefill_done(now_us, event.index);
+          break;
+        case EventType::DECODE_STEP_DONE:
+          handle_decode_step_done(now_us, event.index);
+          break;
+      }
+    }
+
+    report->num_requests = trace_.size();
+    report->num_failed = num_failed_;
+    report->ttft = summarize(&ttfts_);
+    report->tpot = summarize(&tpots_);
+    report->cache_hit_rate =
+        num_prompt_tokens_ > 0 ? double(num_cached_tokens_) / num_prompt_tokens_
+                               : 0;
+    const int64_t start_us =
+        trace_.empty() ? 0 : trace_.front().arrival_time_us;
+    report->duration_s = std::max<int64_t>(0, last_finish_us_ - start_us) / 1e6;
+    if (report->duration_s > 0) {
+      report->request_throughput = num_finished_ / report->duration_s;
+      report->token_throughput = num_output_tokens_ / report->duration_s;
+    }
+    if (!trace_.empty()) {
+      report->routing_time_ns =
+          static_cast<double>(routing_time_.count()) / trace_.size();
+    }
+  }
+
+ private:
+  void push(int64_t time_us, EventType type, size_t index) {
+    events_.push(Event{time_us, next_seq_++, type, index});
+  }
+
+  // the instances send their heartbeats together, the master uploads the
+  // changes right after them
+  void handle_heartbeat(int64_t now_us) {
+    for (const auto& instance : instances_) {
+      proto::KvCacheEvent cache_event;
+      if (instance->take_cache_event(&cache_event)) {
+        kvcache_mgr_->record_updated_kvcaches(instance->name(), cache_event);
+      }
+      instance_mgr_->record_load_metrics_update(instance->name(),
+                                                instance->load_metrics());
+    }
+    if (!kvcache_mgr_->upload_kvcache() ||
+        !instance_mgr_->upload_load_metrics()) {
+      LOG_EVERY_N(WARNING, 100) << "Failed to upload the instance updates";
+    }
+    if (num_unfinished_ > 0) {
+      push(now_us + options_.heartbeat_interval_ms * 1000,
+           EventType::HEARTBEAT,
+           0);
+    }
+  }
+
+  void handle_arrival(int64_t now_us, size_t index) {
+    SimRequest& sim_request = requests_[index];
+    auto request = std::make_shared<Request>();
+    request->service_request_id = "sim-" + std::to_string(index);
+    request->token_ids = trace_[index].token_ids;
+    request->max_tokens = trace_[index].num_output_tokens;
+    request->arrival_time_us = now_us;
+    request->schedule_time_us = now_us;
+    sim_request.request = request;
+    sim_request.num_output_tokens =
+        std::max<int64_t>(1, trace_[index].num_output_tokens);
+
+    const auto routing_start = std::chrono::steady_clock::now();
+    const bool routed = policy_->select_instances_pair(request);
+    routing_time_ += std::chrono::steady_clock::now() - routing_start;
+    if (!routed) {
+      fail_request();
+      return;
+    }
+    auto prefill_it = instance_index_.find(request->routing.prefill_name);
+    auto decode_it = instance_index_.find(request->routing.decode_name);
+    if (prefill_it == instance_index_.end() ||
+        decode_it == instance_index_.end()) {
+      // an instance registered by someone else
+      LOG_EVERY_N(WARNING, 100)
+          << "Request routed out of the simulated instances: "
+          << request->routing.debug_string();
+      fail_request();
+      return;
+    }
+    instance_mgr_->update_request_metrics(request, RequestAction::SCHEDULE);
+    num_prompt_tokens_ += request->token_ids.size();
+
+    instances_[prefill_it->second]->enqueue_prefill(&sim_request);
+    start_prefill(now_us, prefill_it->second);
+  }
+
+  void handle_prefill_done(int64_t now_us, size_t index) {
+    for (auto* sim_request : instances_[index]->finish_prefill()) {
+      auto& request = sim_request->request;
+      num_cached_tokens_ += sim_request->num_cached_tokens;
+      request->num_generated_tokens += 1;
+      request->prefill_finished = true;
+      request->last_token_time_us = now_us;
+      sim_request->first_token_time_us = now_us;
+      instance_mgr_->update_request_metrics(request,
+                                            RequestAction::FINISH_PREFILL);
+      instance_mgr_->observe_ttft(
+          request, (now_us - request->schedule_time_us) / 1000);
+      instance_mgr_->latency_stats().record_ttft(
+          request->routing.prefill_name, now_us - request->arrival_time_us);
+
+      if (request->num_generated_tokens >= sim_request->num_output_tokens) {
+        finish_request(now_us, sim_request);
+        continue;
+      }
+      const size_t decode_index =
+          instance_index_.at(request->routing.decode_name);
+      instances_[decode_index]->enqueue_decode(sim_request);
+      start_decode_step(now_us, decode_index);
+    }
+    start_prefill(now_us, index);
+  }
+
+  void handle_decode_step_done(int64_t now_us, size_t index) {
+    for (auto* sim_request : instances_[index]->finish_decode_step()) {
+      auto& request = sim_request->request;
+      instance_mgr_->update_request_metrics(request, RequestAction::GENERATE);
+      const int64_t tbt_us = now_us - request->last_token_time_us;
+      request->last_token_time_us = now_us;
+      instance_mgr_->latency_stats().record_tbt(request->routing.decode_name,
+                                                tbt_us);
+      instance_mgr_->observe_tpot(request, tbt_us / 1000);
+
+      if (request->num_generated_tokens >= sim_request->num_output_tokens) {
+        finish_request(now_us, sim_request);
+      }
+    }
+    start_decode_step(now_us, index);
+  }
+
+  void start_prefill(int64_t now_us, size_t index) {
+    const int64_t finish_us = instances_[index]->start_prefill(now_us);
+    if (finish_us >= 0) {
+      push(finish_us, EventType::PREFILL_DONE, index);
+    }
+  }
+
+  void start_decode_step(int64_t now_us, size_t index) {
+    const int64_t finish_us = instances_[index]->start_decode_step(now_us);
+    if (finish_us >= 0) {
+      push(finish_us, EventType::DECODE_STEP_DONE, index);
+    }
+  }
+
+  void finish_request(int64_t now_us, SimRequest* sim_request) {
+    auto& request = sim_request->request;
+    instance_mgr_->update_request_metrics(request,
+                                          RequestAction::FINISH_DECODE);
+    instance_mgr_->latency_stats().record_e2e(
+        request->routing.decode_name, now_us - request->arrival_time_us);
+
+    sim_request->finish_time_us = now_us;
+    ttfts_.push_back(
+        (sim_request->first_token_time_us - request->arrival_time_us) / 1e3);
+    if (sim_request->num_output_tokens > 1) {
+      tpots_.push_back(
+          (now_us - sim_request->first_token_time_us) / 1e3 /
+          (sim_request->num_output_tokens - 1));
+    }
+    num_output_tokens_ += request->num_generated_tokens;
+    num_finished_ += 1;
+    num_unfinished_ -= 1;
+    last_finish_us_ = std::max(last_finish_us_, now_us);
+  }
+
+  void fail_request() {
+    num_failed_ += 1;
+    num_unfinished_ -= 1;
+  }
+
+ private:
+  const ClusterSimulatorOptions& options_;
+  const std::vector<TraceRequest>& trace_;
+  InstanceMgr* instance_mgr_;
+  GlobalKVCacheMgr* kvcache_mgr_;
+  LoadBalancePolicy* policy_ = nullptr;
+
+  std::vector<std::unique_ptr<SimulatedInstance>> instances_;
+  // instance name -> index in `instances_`
+  std::unordered_map<std::string, size_t> instance_index_;
+
+  // indexed like the trace
+  std::vector<SimRequest> requests_;
+
+  std::priority_queue<Event, std::vector<Event>, LaterEvent> events_;
+  uint64_t next_seq_ = 0;
+
+  int64_t num_unfinished_ = 0;
+  int64_t num_finished_ = 0;
+  int64_t num_failed_ = 0;
+  int64_t num_prompt_tokens_ = 0;
+  int64_t num_cached_tokens_ = 0;
+  int64_t num_output_tokens_ = 0;
+  int64_t last_finish_us_ = 0;
+  std::chrono::nanoseconds routing_time_{0};
+  std::vector<double> ttfts_;
+  std::vector<double> tpots_;
+};
+}  // namespace
+
+void set_default_profile(ClusterSimulatorOptions* options) {
+  options->ttft_profiling_data = {
+      {128, 30}, {512, 55}, {1024, 90}, {2048, 170}, {4096, 360}, {8192, 800}};
+  options->tpot_profiling_data = {{1024, 1, 18.2},
+                                  {1024, 16, 20.8},
+                                  {2048, 32, 27.5},
+                                  {4096, 32, 35.3},
+                                  {2048, 64, 36.9},
+                                  {1024, 128, 40.1},
+                                  {4096, 128, 87.3}};
+}
+
+ClusterSimulator::ClusterSimulator(const ClusterSimulatorOptions& options)
+    : options_(options) {}
+
+bool ClusterSimulator::run(const std::string& policy,
+                           const std::vector<TraceRequest>& trace,
+                           SimulationReport* report) {
+  // every replay starts from an empty store
+  auto metadata_store = std::make_shared<MemoryStore>();
+  auto instance_mgr = std::make_shared<InstanceMgr>(
+      options_.options, metadata_store, /*is_master_service=*/true);
+  auto kvcache_mgr = std::make_shared<GlobalKVCacheMgr>(
+      options_.options, metadata_store, /*is_master_service=*/true);
+
+  Simulation simulation(
+      options_, trace, instance_mgr.get(), kvcache_mgr.get());
+  bool ok = simulation.register_instances();
+  if (ok) {
+    auto lb_policy = PolicyRegistry::instance().create(
+        policy, PolicyContext{options_.options, instance_mgr, kvcache_mgr});
+    if (lb_policy == nullptr) {
+      LOG(ERROR) << "Unknown load balance policy " << policy;
+      ok = false;
+    } else {
+      report->policy = policy;
+      simulation.run(lb_policy.get(), report);
+    }
+  }
+
+  // the watches call back into the managers
+  metadata_store->stop_watch();
+  return ok;
+}
+
+}  // namespace xllm_service
@@ -0,0 +1,117 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "common/macros.h"
+#include "common/options.h"
+#include "trace.h"
+
+namespace xllm_service {
+
+struct ClusterSimulatorOptions {
+  // `block_size` is used. The simulator keeps the cache and load updates of
+  // the simulated instances in an in-process metadata store, which the
+  // managers upload to and watch like the master does with etcd.
+  Options options;
+
+  int32_t num_prefill_instances = 4;
+  int32_t num_decode_instances = 4;
+
+  // the fraction of the instances running `slowdown` times slower than the
+  // profiles
+  double slow_fraction = 0;
+  double slowdown = 2.0;
+
+  // see `SimulatedInstanceOptions`
+  int64_t num_cache_blocks = 4096;
+  int64_t max_prefill_tokens = 8192;
+  int32_t max_decode_batch_size = 128;
+
+  // the interval of the instance heartbeats, the master uploads the reported
+  // cache and load changes right after them. In simulated milliseconds.
+  int64_t heartbeat_interval_ms = 3000;
+
+  // latency profiles of the instances, in the format of `InstanceMetaInfo`
+  std::vector<std::pair<int32_t, double>> ttft_profiling_data;
+  std::vector<std::tuple<int32_t, int32_t, double>> tpot_profiling_data;
+};
+
+// Latency percentiles in milliseconds.
+struct LatencySummary {
+  double mean = 0;
+  double p50 = 0;
+  double p90 = 0;
+  double p99 = 0;
+};
+
+struct SimulationReport {
+  std::string policy;
+
+  int64_t num_requests = 0;
+  // requests the policy found no instance for
+  int64_t num_failed = 0;
+
+  LatencySummary ttft;
+  LatencySummary tpot;
+
+  // prompt tokens found in the prefix caches of the prefill instances
+  double cache_hit_rate = 0;
+
+  // from the first arrival to the last finished request, in simulated
+  // seconds
+  double duration_s = 0;
+  double request_throughput = 0;
+  double token_throughput = 0;
+
+  // wall clock time the policy takes per routing decision, in nanoseconds
+  double routing_time_ns = 0;
+};
+
+// the latency profile of an instance serving a mid-sized model on one
+// accelerator, used when no profile is given
+void set_default_profile(ClusterSimulatorOptions* options);
+
+// Replays a trace in simulated time against a fleet of `SimulatedInstance`s,
+// routed by a policy of the `PolicyRegistry` on top of the real
+// `InstanceMgr` and `GlobalKVCacheMgr`. The simulator feeds the managers
+// like the `Scheduler` does: the request metrics on schedule, first token,
+// every generated token and finish, the observed latencies, and the cache
+// events and load metrics of the instances with the heartbeats. Routing
+// decisions therefore see the same stale state they see in production.
+class ClusterSimulator final {
+ public:
+  explicit ClusterSimulator(const ClusterSimulatorOptions& options);
+
+  // replay the trace with a fresh fleet and fresh managers, return false if
+  // the policy is unknown
+  bool run(const std::string& policy,
+           const std::vector<TraceRequest>& trace,
+           SimulationReport* report);
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(ClusterSimulator);
+
+ private:
+  const ClusterSimulatorOptions options_;
+};
+
+}  // namespace xllm_service
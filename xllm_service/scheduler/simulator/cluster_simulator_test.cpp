@@ -0,0 +1,189 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <fstream>
+
+#include "cluster_simulator.h"
+#include "simulated_instance.h"
+#include "trace.h"
+
+namespace xllm_service::test {
+
+namespace {
+constexpr int32_t kBlockSize = 4;
+
+const std::vector<std::pair<int32_t, double>> kTtftProfile = {
+    {100, 20}, {1000, 110}, {4000, 410}};
+const std::vector<std::tuple<int32_t, int32_t, double>> kTpotProfile = {
+    {100, 1, 10}, {100, 8, 12}, {1000, 8, 20}, {1000, 32, 50}};
+
+SimulatedInstanceOptions instance_options(InstanceType type) {
+  SimulatedInstanceOptions options;
+  options.name = "127.0.0.1:19100";
+  options.type = type;
+  options.block_size = kBlockSize;
+  options.num_cache_blocks = 4;
+  return options;
+}
+
+SimRequest make_request(std::vector<int32_t> token_ids,
+                        int64_t num_output_tokens = 1) {
+  SimRequest request;
+  request.request = std::make_shared<Request>();
+  request.request->token_ids = std::move(token_ids);
+  request.num_output_tokens = num_output_tokens;
+  return request;
+}
+}  // namespace
+
+TEST(SimulatedInstanceTest, ReusePrefixAcrossRequests) {
+  SimulatedInstance instance(
+      instance_options(InstanceType::PREFILL), kTtftProfile, kTpotProfile);
+  auto first = make_request({1, 2, 3, 4, 5, 6, 7, 8, 9});
+  auto second = make_request({1, 2, 3, 4, 5, 6, 7, 8, 10, 11});
+
+  instance.enqueue_prefill(&first);
+  const int64_t first_finish = instance.start_prefill(0);
+  EXPECT_GT(first_finish, 0);
+  instance.enqueue_prefill(&second);
+  // the instance is busy with the first request
+  EXPECT_EQ(-1, instance.start_prefill(0));
+  EXPECT_EQ(1, instance.finish_prefill().size());
+  EXPECT_EQ(0, first.num_cached_tokens);
+
+  const int64_t second_finish = instance.start_prefill(first_finish);
+  EXPECT_EQ(2 * kBlockSize, second.num_cached_tokens);
+  // the cached prefix is not computed again
+  EXPECT_LT(second_finish - first_finish, first_finish);
+  instance.finish_prefill();
+
+  proto::KvCacheEvent event;
+  ASSERT_TRUE(instance.take_cache_event(&event));
+  EXPECT_EQ(2, event.stored_cache_size());
+  EXPECT_FALSE(instance.take_cache_event(&event));
+}
+
+TEST(SimulatedInstanceTest, EvictTailBeforeHead) {
+  SimulatedInstance instance(
+      instance_options(InstanceType::PREFILL), kTtftProfile, kTpotProfile);
+  auto shared = make_request({1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 0});
+  auto other = make_request({21, 22, 23, 24, 25, 26, 27, 28, 0});
+  for (auto* request : {&shared, &other}) {
+    instance.enqueue_prefill(request);
+    instance.start_prefill(0);
+    instance.finish_prefill();
+  }
+  proto::KvCacheEvent event;
+  ASSERT_TRUE(instance.take_cache_event(&event));
+  // the 5 blocks do not fit, the last block of the shared prefix goes first
+  EXPECT_EQ(4, event.stored_cache_size());
+  EXPECT_EQ(1, event.removed_cache_size());
+
+  auto again = make_request({1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 0});
+  instance.enqueue_prefill(&again);
+  instance.start_prefill(0);
+  EXPECT_EQ(2 * kBlockSize, again.num_cached_tokens);
+}
+
+TEST(SimulatedInstanceTest, GenerateOneTokenPerStep) {
+  SimulatedInstance instance(
+      instance_options(InstanceType::DECODE), kTtftProfile, kTpotProfile);
+  auto short_request = make_request({1, 2, 3}, /*num_output_tokens=*/2);
+  auto long_request = make_request({1, 2, 3}, /*num_output_tokens=*/3);
+  for (auto* request : {&short_request, &long_request}) {
+    request->request->num_generated_tokens = 1;
+    instance.enqueue_decode(request);
+  }
+
+  EXPECT_GT(instance.start_decode_step(0), 0);
+  EXPECT_EQ(2, instance.finish_decode_step().size());
+  EXPECT_EQ(2, short_request.request->num_generated_tokens);
+  // the finished request leaves the batch
+  instance.start_decode_step(0);
+  EXPECT_EQ(1, instance.finish_decode_step().size());
+  EXPECT_EQ(3, long_request.request->num_generated_tokens);
+  EXPECT_EQ(-1, instance.start_decode_step(0));
+  EXPECT_EQ(0, instance.load_metrics().gpu_cache_usage_perc());
+}
+
+TEST(TraceTest, LoadRequestTrace) {
+  char path[] = "/tmp/request_trace_XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_GE(fd, 0);
+  close(fd);
+  {
+    std::ofstream stream(path);
+    // a streamed request with usage, a non streamed one and a request
+    // without its forwarded request
+    stream << R"({"time_ms":5000,"service_request_id":"a",)"
+           << R"("data":"{\"token_ids\":[1,2,3],\"max_tokens\":8}"})"
+           << "\n";
+    stream << R"({"time_ms":5100,"service_request_id":"a",)"
+           << R"("data":"data: {\"choices\":[]}\n\n"})" << "\n";
+    stream << R"({"time_ms":5200,"service_request_id":"a",)"
+           << R"("data":"data: {\"usage\":{\"completion_tokens\":6}}\n\n)"
+           << R"(data: [DONE]\n\n"})" << "\n";
+    stream << R"({"time_ms":4000,"service_request_id":"b",)"
+           << R"("data":"{\"token_ids\":[4,5],\"max_tokens\":8}"})" << "\n";
+    stream << R"({"time_ms":4500,"service_request_id":"c",)"
+           << R"("data":"data: {\"choices\":[]}\n\n"})" << "\n";
+  }
+
+  std::vector<TraceRequest> requests;
+  ASSERT_TRUE(load_request_trace(path, 16, &requests));
+  std::remove(path);
+  ASSERT_EQ(2, requests.size());
+  EXPECT_EQ(0, requests[0].arrival_time_us);
+  EXPECT_EQ(std::vector<int32_t>({4, 5}), requests[0].token_ids);
+  EXPECT_EQ(8, requests[0].num_output_tokens);
+  EXPECT_EQ(1000000, requests[1].arrival_time_us);
+  EXPECT_EQ(6, requests[1].num_output_tokens);
+}
+
+TEST(ClusterSimulatorTest, ReplaySyntheticTrace) {
+  SyntheticTraceOptions trace_options;
+  trace_options.num_requests = 200;
+  trace_options.num_prefixes = 4;
+  trace_options.prefix_len = 64;
+  trace_options.max_suffix_len = 64;
+  trace_options.max_output_len = 32;
+  const auto trace = generate_trace(trace_options);
+
+  ClusterSimulatorOptions options;
+  options.options.block_size(16);
+  options.num_prefill_instances = 2;
+  options.num_decode_instances = 2;
+  options.ttft_profiling_data = kTtftProfile;
+  options.tpot_profiling_data = kTpotProfile;
+  ClusterSimulator simulator(options);
+
+  SimulationReport report;
+  EXPECT_FALSE(simulator.run("NO_SUCH_POLICY", trace, &report));
+  ASSERT_TRUE(simulator.run("CAR", trace, &report));
+  EXPECT_EQ(200, report.num_requests);
+  EXPECT_EQ(0, report.num_failed);
+  EXPECT_GT(report.ttft.p50, 0);
+  EXPECT_GE(report.ttft.p99, report.ttft.p50);
+  EXPECT_GT(report.tpot.p50, 0);
+  // the requests share 4 prefixes of 4 blocks
+  EXPECT_GT(report.cache_hit_rate, 0.2);
+  EXPECT_GT(report.token_throughput, 0);
+}
+
+}  // namespace xllm_service::test
@@ -0,0 +1,215 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "simulated_instance.h"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace xllm_service {
+
+namespace {
+int64_t to_duration_us(double latency_ms, double slowdown) {
+  return std::max<int64_t>(1, std::llround(latency_ms * slowdown * 1000));
+}
+}  // namespace
+
+SimulatedInstance::SimulatedInstance(
+    const SimulatedInstanceOptions& options,
+    const std::vector<std::pair<int32_t, double>>& ttft_profiling_data,
+    const std::vector<std::tuple<int32_t, int32_t, double>>&
+        tpot_profiling_data)
+    : options_(options),
+      time_predictor_(ttft_profiling_data, tpot_profiling_data) {
+  CHECK_GT(options_.block_size, 0);
+  CHECK_GT(options_.num_cache_blocks, 0);
+}
+
+void SimulatedInstance::enqueue_prefill(SimRequest* request) {
+  if (request->block_keys.empty()) {
+    const auto& token_ids = request->request->token_ids;
+    const size_t block_size = options_.block_size;
+    Murmur3Key key;
+    for (size_t i = 0; i + block_size <= token_ids.size(); i += block_size) {
+      murmur_hash3(i == 0 ? nullptr : key.data,
+                   Slice<int32_t>(token_ids).slice(i, i + block_size),
+                   key.data);
+      request->block_keys.emplace_back(key);
+    }
+  }
+  waiting_.push_back(request);
+}
+
+int64_t SimulatedInstance::start_prefill(int64_t now_us) {
+  if (busy_ || waiting_.empty()) {
+    return -1;
+  }
+
+  int64_t num_batch_tokens = 0;
+  int64_t num_computed_tokens = 0;
+  while (!waiting_.empty()) {
+    SimRequest* request = waiting_.front();
+    const int64_t num_tokens = request->request->token_ids.size();
+    if (!running_.empty() &&
+        num_batch_tokens + num_tokens > options_.max_prefill_tokens) {
+      break;
+    }
+    waiting_.pop_front();
+    // the last prompt token is computed even if the whole prompt is cached,
+    // it produces the first token
+    request->num_cached_tokens = std::min(
+        match_prefix(*request) * options_.block_size, num_tokens - 1);
+    num_batch_tokens += num_tokens;
+    num_computed_tokens += num_tokens - request->num_cached_tokens;
+    running_.push_back(request);
+  }
+
+  busy_ = true;
+  const double latency_ms =
+      time_predictor_.predict_static_ttft(num_computed_tokens);
+  return now_us + to_duration_us(latency_ms, options_.slowdown);
+}
+
+std::vector<SimRequest*> SimulatedInstance::finish_prefill() {
+  for (const auto* request : running_) {
+    store_prefix(*request);
+  }
+  busy_ = false;
+  return std::move(running_);
+}
+
+void SimulatedInstance::enqueue_decode(SimRequest* request) {
+  waiting_.push_back(request);
+}
+
+int64_t SimulatedInstance::start_decode_step(int64_t now_us) {
+  if (busy_) {
+    return -1;
+  }
+
+  const int64_t max_tokens =
+      options_.num_cache_blocks * int64_t(options_.block_size);
+  while (!waiting_.empty() &&
+         running_.size() < size_t(options_.max_decode_batch_size)) {
+    SimRequest* request = waiting_.front();
+    const int64_t num_tokens = decode_tokens(*request);
+    if (!running_.empty() && num_decode_tokens_ + num_tokens > max_tokens) {
+      break;
+    }
+    waiting_.pop_front();
+    num_decode_tokens_ += num_tokens;
+    running_.push_back(request);
+  }
+  if (running_.empty()) {
+    return -1;
+  }
+
+  busy_ = true;
+  return now_us + to_duration_us(time_predictor_.predict_static_tpot(
+                                     num_decode_tokens_, running_.size()),
+                                 options_.slowdown);
+}
+
+std::vector<SimRequest*> SimulatedInstance::finish_decode_step() {
+  std::vector<SimRequest*> step = running_;
+  running_.clear();
+  for (auto* request : step) {
+    request->request->num_generated_tokens += 1;
+    num_decode_tokens_ += 1;
+    if (request->request->num_generated_tokens < request->num_output_tokens) {
+      running_.push_back(request);
+    } else {
+      num_decode_tokens_ -= decode_tokens(*request);
+    }
+  }
+  busy_ = false;
+  return step;
+}
+
+bool SimulatedInstance::take_cache_event(proto::KvCacheEvent* event) {
+  if (cache_changes_.empty()) {
+    return false;
+  }
+  for (const auto& [key, stored] : cache_changes_) {
+    if (stored) {
+      event->add_stored_cache(key.to_string());
+    } else {
+      event->add_removed_cache(key.to_string());
+    }
+  }
+  cache_changes_.clear();
+  return true;
+}
+
+proto::LoadMetrics SimulatedInstance::load_metrics() const {
+  proto::LoadMetrics load_metrics;
+  load_metrics.set_waiting_requests_num(waiting_.size());
+  if (options_.type == InstanceType::DECODE) {
+    load_metrics.set_gpu_cache_usage_perc(
+        double(num_decode_tokens_) /
+        (options_.num_cache_blocks * options_.block_size));
+  } else {
+    load_metrics.set_gpu_cache_usage_perc(double(lru_.size()) /
+                                          options_.num_cache_blocks);
+  }
+  return load_metrics;
+}
+
+int64_t SimulatedInstance::match_prefix(const SimRequest& request) {
+  int64_t num_blocks = 0;
+  for (const auto& key : request.block_keys) {
+    if (lru_index_.count(key) == 0) {
+      break;
+    }
+    num_blocks += 1;
+  }
+  // touch the blocks from the last one, so that the tail of a prefix is
+  // evicted before its head like in the engines
+  for (int64_t i = num_blocks - 1; i >= 0; --i) {
+    auto it = lru_index_[request.block_keys[i]];
+    lru_.splice(lru_.begin(), lru_, it);
+  }
+  return num_blocks;
+}
+
+void SimulatedInstance::store_prefix(const SimRequest& request) {
+  for (auto key = request.block_keys.rbegin(); key != request.block_keys.rend();
+       ++key) {
+    auto it = lru_index_.find(*key);
+    if (it != lru_index_.end()) {
+      lru_.splice(lru_.begin(), lru_, it->second);
+      continue;
+    }
+    lru_.push_front(*key);
+    lru_index_.emplace(*key, lru_.begin());
+    cache_changes_.insert_or_assign(*key, true);
+  }
+
+  while (lru_.size() > size_t(options_.num_cache_blocks)) {
+    const Murmur3Key& key = lru_.back();
+    lru_index_.erase(key);
+    cache_changes_.insert_or_assign(key, false);
+    lru_.pop_back();
+  }
+}
+
+int64_t SimulatedInstance::decode_tokens(const SimRequest& request) const {
+  return request.request->token_ids.size() +
+         request.request->num_generated_tokens;
+}
+
+}  // namespace xllm_service
@@ -0,0 +1,161 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "common/hash_util.h"
+#include "common/macros.h"
+#include "common/time_predictor.h"
+#include "common/types.h"
+#include "request/request.h"
+#include "xllm_rpc_service.pb.h"
+
+namespace xllm_service {
+
+// A request replayed by the cluster simulator. The times are simulated.
+struct SimRequest {
+  std::shared_ptr<Request> request;
+
+  // the number of tokens to generate, including the first one
+  int64_t num_output_tokens = 0;
+
+  // hash keys of the full blocks of the prompt
+  std::vector<Murmur3Key> block_keys;
+
+  // prompt tokens found in the prefix cache of the prefill instance
+  int64_t num_cached_tokens = 0;
+
+  // in microseconds
+  int64_t first_token_time_us = 0;
+  int64_t finish_time_us = 0;
+};
+
+struct SimulatedInstanceOptions {
+  std::string name;
+
+  // PREFILL instances run the prefill of the requests and keep their
+  // prompts in a prefix cache, DECODE instances generate the other tokens
+  InstanceType type = InstanceType::PREFILL;
+
+  int32_t block_size = 128;
+
+  // the size of the prefix cache of a PREFILL instance and of the kv cache
+  // of the running requests of a DECODE instance
+  int64_t num_cache_blocks = 4096;
+
+  // the max number of prompt tokens prefilled in one batch, a longer prompt
+  // is prefilled alone
+  int64_t max_prefill_tokens = 8192;
+
+  int32_t max_decode_batch_size = 128;
+
+  // the latencies of the instance are the profiled ones times `slowdown`
+  double slowdown = 1.0;
+};
+
+// An instance simulated from the latency profiles of a real one. A PREFILL
+// instance prefills the waiting requests in FCFS batches, the cached prefix
+// of a prompt is not computed again. The prefix cache keeps the blocks in
+// LRU order. A DECODE instance runs continuous batching, every step
+// generates one token for each running request.
+//
+// The instance does not keep the time, the simulator starts the work at the
+// simulated time and finishes it at the returned time.
+class SimulatedInstance final {
+ public:
+  SimulatedInstance(
+      const SimulatedInstanceOptions& options,
+      const std::vector<std::pair<int32_t, double>>& ttft_profiling_data,
+      const std::vector<std::tuple<int32_t, int32_t, double>>&
+          tpot_profiling_data);
+
+  const std::string& name() const { return options_.name; }
+
+  InstanceType type() const { return options_.type; }
+
+  void enqueue_prefill(SimRequest* request);
+
+  // start prefilling the next batch of waiting requests if the instance is
+  // idle. Return the time the batch finishes, or -1 if no batch is started.
+  int64_t start_prefill(int64_t now_us);
+
+  // finish the running batch and store the prompts in the prefix cache,
+  // return the requests of the batch
+  std::vector<SimRequest*> finish_prefill();
+
+  void enqueue_decode(SimRequest* request);
+
+  // start the next decode step if the instance is idle and there are
+  // requests to decode. Return the time the step finishes, or -1 if no step
+  // is started.
+  int64_t start_decode_step(int64_t now_us);
+
+  // every request of the step generates one token, return the requests of
+  // the step. The finished requests are released.
+  std::vector<SimRequest*> finish_decode_step();
+
+  // the net change of the prefix cache since the last call, return false if
+  // nothing changed
+  bool take_cache_event(proto::KvCacheEvent* event);
+
+  proto::LoadMetrics load_metrics() const;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(SimulatedInstance);
+
+  // the number of leading blocks of the request in the prefix cache, they
+  // are moved to the front of the LRU order
+  int64_t match_prefix(const SimRequest& request);
+
+  void store_prefix(const SimRequest& request);
+
+  // kv cache tokens a decoding request holds
+  int64_t decode_tokens(const SimRequest& request) const;
+
+ private:
+  const SimulatedInstanceOptions options_;
+
+  // the ground truth of the instance latencies, only the profiled fit is
+  // used
+  TimePredictor time_predictor_;
+
+  std::deque<SimRequest*> waiting_;
+  std::vector<SimRequest*> running_;
+  bool busy_ = false;
+
+  // prefix cache, most recently used first
+  std::list<Murmur3Key> lru_;
+  std::unordered_map<Murmur3Key,
+                     std::list<Murmur3Key>::iterator,
+                     FixedStringKeyHash,
+                     FixedStringKeyEqual>
+      lru_index_;
+  // block -> whether it is stored or removed since the last cache event
+  std::unordered_map<Murmur3Key, bool, FixedStringKeyHash, FixedStringKeyEqual>
+      cache_changes_;
+
+  // kv cache tokens held by the running requests of a DECODE instance
+  int64_t num_decode_tokens_ = 0;
+};
+
+}  // namespace xllm_service
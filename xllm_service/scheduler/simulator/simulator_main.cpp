@@ -0,0 +1,172 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// Replays a request trace through a simulated cluster of prefill and decode
+// instances once per load balance policy and reports the TTFT and TPOT
+// percentiles, the prefix cache hit rate and the throughput of every policy.
+// The routing runs the real policies and managers, see `ClusterSimulator`.
+//
+// The trace is written by the service with --enable_request_trace. When no
+// trace is given, a synthetic one of requests sharing prefixes is generated.
+// The instance latencies come from a profile in the format of the instance
+// meta info:
+//   {"ttft_profiling_data": [[prompt_len, ms], ...],
+//    "tpot_profiling_data": [[avg_len, batch_size, ms], ...]}
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <cstdio>
+#include <fstream>
+#include <nlohmann/json.hpp>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "cluster_simulator.h"
+#include "common/global_gflags.h"
+
+DEFINE_string(trace_path, "", "The request trace to replay.");
+DEFINE_string(policies,
+              "RR,CAR,SLO_AWARE",
+              "Comma separated load balance policies to compare.");
+DEFINE_string(profile_path, "", "The latency profile of the instances.");
+DEFINE_int32(num_prefill_instances, 4, "The number of prefill instances.");
+DEFINE_int32(num_decode_instances, 4, "The number of decode instances.");
+DEFINE_double(slow_fraction, 0, "Fraction of instances running slower.");
+DEFINE_double(slowdown, 2.0, "Latency factor of the slow instances.");
+DEFINE_int64(cache_blocks, 4096, "KV cache blocks of an instance.");
+DEFINE_int64(max_prefill_tokens, 8192, "Prompt tokens of a prefill batch.");
+DEFINE_int32(max_decode_batch_size, 128, "Requests of a decode batch.");
+DEFINE_int64(heartbeat_interval_ms,
+             3000,
+             "Simulated interval of the instance heartbeats.");
+DEFINE_int64(default_output_len,
+             256,
+             "Output length of traced requests without a known length.");
+DEFINE_int32(num_requests, 2000, "Requests of the synthetic trace.");
+DEFINE_double(qps, 8, "Request rate of the synthetic trace.");
+DEFINE_int32(num_prefixes, 32, "Prefix groups of the synthetic trace.");
+DEFINE_double(prefix_skew, 1.0, "Zipf exponent of the prefix popularity.");
+DEFINE_int32(prefix_len, 1024, "Length of the shared prefixes.");
+DEFINE_int32(max_suffix_len, 1024, "Max length of the unique suffixes.");
+DEFINE_int32(max_output_len, 512, "Max output length.");
+DEFINE_int32(seed, 1, "Seed of the synthetic trace.");
+
+namespace xllm_service {
+namespace {
+
+bool load_profile(const std::string& path, ClusterSimulatorOptions* options) {
+  std::ifstream stream(path);
+  auto profile = nlohmann::json::parse(stream, nullptr, false);
+  if (profile.is_discarded() || !profile.contains("ttft_profiling_data") ||
+      !profile.contains("tpot_profiling_data")) {
+    LOG(ERROR) << "Invalid latency profile " << path;
+    return false;
+  }
+  for (const auto& item : profile["ttft_profiling_data"]) {
+    options->ttft_profiling_data.emplace_back(item[0], item[1]);
+  }
+  for (const auto& item : profile["tpot_profiling_data"]) {
+    options->tpot_profiling_data.emplace_back(item[0], item[1], item[2]);
+  }
+  return true;
+}
+
+void print_report(const SimulationReport& report) {
+  std::printf(
+      "%-16s failed: %5ld  ttft mean/p50/p90/p99: %6.0f/%6.0f/%6.0f/%6.0f ms"
+      "  tpot mean/p50/p90/p99: %5.1f/%5.1f/%5.1f/%5.1f ms"
+      "  cache hit: %5.1f%%  throughput: %6.2f req/s %8.1f tok/s"
+      "  routing: %7.0f ns\n",
+      report.policy.c_str(),
+      report.num_failed,
+      report.ttft.mean,
+      report.ttft.p50,
+      report.ttft.p90,
+      report.ttft.p99,
+      report.tpot.mean,
+      report.tpot.p50,
+      report.tpot.p90,
+      report.tpot.p99,
+      100 * report.cache_hit_rate,
+      report.request_throughput,
+      report.token_throughput,
+      report.routing_time_ns);
+}
+
+}  // namespace
+}  // namespace xllm_service
+
+int main(int argc, char* argv[]) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  google::InitGoogleLogging(argv[0]);
+  using namespace xllm_service;
+
+  std::vector<TraceRequest> trace;
+  if (FLAGS_trace_path.empty()) {
+    SyntheticTraceOptions trace_options;
+    trace_options.num_requests = FLAGS_num_requests;
+    trace_options.qps = FLAGS_qps;
+    trace_options.num_prefixes = FLAGS_num_prefixes;
+    trace_options.prefix_skew = FLAGS_prefix_skew;
+    trace_options.prefix_len = FLAGS_prefix_len;
+    trace_options.max_suffix_len = FLAGS_max_suffix_len;
+    trace_options.max_output_len = FLAGS_max_output_len;
+    trace_options.seed = FLAGS_seed;
+    trace = generate_trace(trace_options);
+  } else if (!load_request_trace(
+                 FLAGS_trace_path, FLAGS_default_output_len, &trace)) {
+    return 1;
+  }
+  if (trace.empty()) {
+    LOG(ERROR) << "The trace has no request to replay";
+    return 1;
+  }
+
+  ClusterSimulatorOptions options;
+  options.options.block_size(FLAGS_block_size)
+      .murmur_hash3_seed(FLAGS_murmur_hash3_seed);
+  options.num_prefill_instances = FLAGS_num_prefill_instances;
+  options.num_decode_instances = FLAGS_num_decode_instances;
+  options.slow_fraction = FLAGS_slow_fraction;
+  options.slowdown = FLAGS_slowdown;
+  options.num_cache_blocks = FLAGS_cache_blocks;
+  options.max_prefill_tokens = FLAGS_max_prefill_tokens;
+  options.max_decode_batch_size = FLAGS_max_decode_batch_size;
+  options.heartbeat_interval_ms = FLAGS_heartbeat_interval_ms;
+  if (FLAGS_profile_path.empty()) {
+    set_default_profile(&options);
+  } else if (!load_profile(FLAGS_profile_path, &options)) {
+    return 1;
+  }
+
+  std::printf("requests: %zu, prefill instances: %d, decode instances: %d\n",
+              trace.size(),
+              options.num_prefill_instances,
+              options.num_decode_instances);
+  ClusterSimulator simulator(options);
+  std::stringstream policies(FLAGS_policies);
+  std::string policy;
+  while (std::getline(policies, policy, ',')) {
+    SimulationReport report;
+    if (!simulator.run(policy, trace, &report)) {
+      std::fprintf(stderr, "skip policy %s\n", policy.c_str());
+      continue;
+    }
+    print_report(report);
+  }
+  return 0;
+}
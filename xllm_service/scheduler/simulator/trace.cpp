@@ -0,0 +1,233 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "trace.h"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <cmath>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <nlohmann/json.hpp>
+#include <random>
+#include <sstream>
+#include <unordered_map>
+
+namespace xllm_service {
+
+namespace {
+// token ids of the synthetic prompts are drawn from this vocabulary
+constexpr int32_t kVocabSize = 32000;
+
+constexpr char kStreamEventPrefix[] = "data: ";
+
+// the traced entries of one request
+struct TracedRequest {
+  bool has_input = false;
+  int64_t arrival_time_us = 0;
+  std::vector<int32_t> token_ids;
+  int64_t max_tokens = 0;
+  int64_t usage_tokens = 0;
+  int64_t num_chunks = 0;
+};
+
+// the entries written before `time_ms` was traced only have a timestamp in
+// seconds of the local time
+int64_t parse_timestamp_us(const std::string& timestamp) {
+  std::tm tm = {};
+  std::istringstream stream(timestamp);
+  stream >> std::get_time(&tm, "%Y-%m-%d %H:%M:%S");
+  if (stream.fail()) {
+    return -1;
+  }
+  tm.tm_isdst = -1;
+  return static_cast<int64_t>(std::mktime(&tm)) * 1000000;
+}
+
+int64_t completion_tokens(const nlohmann::json& response) {
+  if (!response.contains("usage") || !response["usage"].is_object()) {
+    return 0;
+  }
+  return response["usage"].value("completion_tokens", int64_t(0));
+}
+
+// a streamed chunk holds one or more events, every event but the last one
+// carries generated tokens, the last one may carry the usage instead.
+void parse_stream_chunk(const std::string& data, TracedRequest* traced) {
+  const size_t prefix_len = sizeof(kStreamEventPrefix) - 1;
+  size_t pos = data.find(kStreamEventPrefix);
+  while (pos != std::string::npos) {
+    const size_t begin = pos + prefix_len;
+    const size_t end = data.find(kStreamEventPrefix, begin);
+    const std::string event = data.substr(
+        begin, end == std::string::npos ? std::string::npos : end - begin);
+    pos = end;
+    if (event.rfind("[DONE]", 0) == 0) {
+      continue;
+    }
+    auto response = nlohmann::json::parse(event, nullptr, false);
+    if (response.is_discarded()) {
+      continue;
+    }
+    const int64_t usage_tokens = completion_tokens(response);
+    if (usage_tokens > 0) {
+      traced->usage_tokens = usage_tokens;
+    } else {
+      traced->num_chunks += 1;
+    }
+  }
+}
+
+void parse_entry(const std::string& data,
+                 int64_t time_us,
+                 TracedRequest* traced) {
+  if (data.rfind(kStreamEventPrefix, 0) == 0) {
+    parse_stream_chunk(data, traced);
+    return;
+  }
+
+  auto message = nlohmann::json::parse(data, nullptr, false);
+  if (message.is_discarded() || !message.is_object()) {
+    return;
+  }
+  if (message.contains("token_ids") && message["token_ids"].is_array()) {
+    // the request forwarded to the prefill instance
+    traced->has_input = true;
+    traced->arrival_time_us = time_us;
+    traced->token_ids = message["token_ids"].get<std::vector<int32_t>>();
+    traced->max_tokens = message.value("max_tokens", int64_t(0));
+    return;
+  }
+  const int64_t usage_tokens = completion_tokens(message);
+  if (usage_tokens > 0) {
+    traced->usage_tokens = usage_tokens;
+  }
+}
+}  // namespace
+
+bool load_request_trace(const std::string& path,
+                        int64_t default_num_output_tokens,
+                        std::vector<TraceRequest>* requests) {
+  std::ifstream stream(path);
+  if (!stream.is_open()) {
+    LOG(ERROR) << "Failed to open trace " << path;
+    return false;
+  }
+
+  std::unordered_map<std::string, TracedRequest> traced_requests;
+  std::string line;
+  int64_t num_invalid_lines = 0;
+  while (std::getline(stream, line)) {
+    if (line.empty()) {
+      continue;
+    }
+    auto entry = nlohmann::json::parse(line, nullptr, false);
+    if (entry.is_discarded() || !entry.contains("service_request_id") ||
+        !entry.contains("data")) {
+      num_invalid_lines += 1;
+      continue;
+    }
+    int64_t time_us = -1;
+    if (entry.contains("time_ms")) {
+      time_us = entry["time_ms"].get<int64_t>() * 1000;
+    } else {
+      time_us = parse_timestamp_us(entry.value("timestamp", ""));
+    }
+    const auto id = entry["service_request_id"].get<std::string>();
+    parse_entry(
+        entry["data"].get<std::string>(), time_us, &traced_requests[id]);
+  }
+  if (num_invalid_lines > 0) {
+    LOG(WARNING) << "Skip " << num_invalid_lines << " invalid lines of trace "
+                 << path;
+  }
+
+  requests->clear();
+  requests->reserve(traced_requests.size());
+  for (auto& [id, traced] : traced_requests) {
+    if (!traced.has_input || traced.token_ids.empty() ||
+        traced.arrival_time_us < 0) {
+      continue;
+    }
+    TraceRequest request;
+    request.arrival_time_us = traced.arrival_time_us;
+    request.token_ids = std::move(traced.token_ids);
+    if (traced.usage_tokens > 0) {
+      request.num_output_tokens = traced.usage_tokens;
+    } else if (traced.num_chunks > 0) {
+      request.num_output_tokens = traced.num_chunks;
+    } else if (traced.max_tokens > 0) {
+      request.num_output_tokens = traced.max_tokens;
+    } else {
+      request.num_output_tokens = default_num_output_tokens;
+    }
+    requests->emplace_back(std::move(request));
+  }
+
+  std::sort(requests->begin(),
+            requests->end(),
+            [](const TraceRequest& a, const TraceRequest& b) {
+              return a.arrival_time_us < b.arrival_time_us;
+            });
+  if (!requests->empty()) {
+    const int64_t start_time_us = requests->front().arrival_time_us;
+    for (auto& request : *requests) {
+      request.arrival_time_us -= start_time_us;
+    }
+  }
+  return true;
+}
+
+std::vector<TraceRequest> generate_trace(const SyntheticTraceOptions& options) {
+  std::mt19937_64 rng(options.seed);
+  std::uniform_int_distribution<int32_t> token(0, kVocabSize - 1);
+  std::uniform_real_distribution<double> uniform(0, 1);
+  std::uniform_int_distribution<int32_t> suffix_len(options.min_suffix_len,
+                                                    options.max_suffix_len);
+  std::uniform_int_distribution<int32_t> output_len(options.min_output_len,
+                                                    options.max_output_len);
+
+  std::vector<std::vector<int32_t>> prefixes(options.num_prefixes);
+  std::vector<double> weights(options.num_prefixes);
+  for (int32_t i = 0; i < options.num_prefixes; ++i) {
+    prefixes[i].resize(options.prefix_len);
+    for (auto& token_id : prefixes[i]) {
+      token_id = token(rng);
+    }
+    weights[i] = 1 / std::pow(i + 1, options.prefix_skew);
+  }
+  std::discrete_distribution<int32_t> prefix(weights.begin(), weights.end());
+
+  std::vector<TraceRequest> requests(options.num_requests);
+  double time_us = 0;
+  for (auto& request : requests) {
+    time_us += -std::log(1 - uniform(rng)) / options.qps * 1000000;
+    request.arrival_time_us = static_cast<int64_t>(time_us);
+    if (!prefixes.empty()) {
+      const auto& prefix_tokens = prefixes[prefix(rng)];
+      request.token_ids = prefix_tokens;
+    }
+    const int32_t num_suffix_tokens = suffix_len(rng);
+    for (int32_t i = 0; i < num_suffix_tokens; ++i) {
+      request.token_ids.push_back(token(rng));
+    }
+    request.num_output_tokens = output_len(rng);
+  }
+  return requests;
+}
+
+}  // namespace xllm_service
@@ -0,0 +1,65 @@
+/* Copyright 2025 The xLLM Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://github.com/jd-opensource/xllm-service/blob/main/LICENSE
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace xllm_service {
+
+// A request replayed by the cluster simulator.
+struct TraceRequest {
+  // arrival time relative to the first request of the trace, in microseconds
+  int64_t arrival_time_us = 0;
+
+  std::vector<int32_t> token_ids;
+
+  // the number of generated tokens, including the first one
+  int64_t num_output_tokens = 0;
+};
+
+// Load a trace written by `RequestTracer`. The arrival time, the token ids
+// and `max_tokens` of a request come from its forwarded request, the number
+// of generated tokens from the usage of its response, or from the number of
+// streamed chunks if there is no usage. Requests without a traced forwarded
+// request are skipped. The requests are sorted by arrival time. Return false
+// if the trace can't be read.
+bool load_request_trace(const std::string& path,
+                        int64_t default_num_output_tokens,
+                        std::vector<TraceRequest>* requests);
+
+struct SyntheticTraceOptions {
+  int32_t num_requests = 1000;
+  // Poisson arrivals at this rate
+  double qps = 8;
+  // every prompt starts with the shared prefix of one of `num_prefixes`
+  // groups, picked by a Zipf distribution with exponent `prefix_skew`
+  int32_t num_prefixes = 32;
+  double prefix_skew = 1.0;
+  int32_t prefix_len = 1024;
+  // the lengths of the unique prompt suffix and of the output are uniform
+  int32_t min_suffix_len = 64;
+  int32_t max_suffix_len = 1024;
+  int32_t min_output_len = 16;
+  int32_t max_output_len = 512;
+  uint64_t seed = 1;
+};
+
+// generate a trace of requests sharing prefixes
+std::vector<TraceRequest> generate_trace(const SyntheticTraceOptions& options);
+
+}  // namespace xllm_service